@@ -18,4 +18,9 @@
 extern uint8_t const ascii_to_hid[128][2];
 extern uint8_t const hid_to_ascii[128][2];
 
+static inline int32_t clamp(int32_t value, int32_t min, int32_t max)
+{
+    return value < min ? min : value > max ? max : value;
+}
+
 #endif
\ No newline at end of file
@@ -8,6 +8,8 @@
 #define DEBUG_TAG "test"
 #include "babelfish.h"
 
+DBG_MODULE();
+
 uint8_t leds[] = { LED_PWR_GPIO, LED_P_OK_GPIO, LED_AUX_GPIO };
 
 ChannelConfig channels[NUM_CHANNELS] = {
@@ -4,14 +4,16 @@
 
 #include "hid_codes.h"
 
+DBG_MODULE();
+
 #define UP 0
 #define DOWN 1
 
-void
-translate_boot_kbd_report(hid_keyboard_report_t const *report)
+uint
+translate_boot_kbd_report(HidBootState* state, hid_keyboard_report_t const *report)
 {
-	static uint8_t down_keys[6] = { 0 };
-	static uint8_t mod_down_state = 0;
+	uint8_t* down_keys = state->keys;
+	uint8_t mod_down_state = state->modifiers;
 
 	DBG_V("Keyboard: mod: %02x keycodes: %02x %02x %02x %02x %02x %02x\n", report->modifier, report->keycode[0],
 		report->keycode[1], report->keycode[2], report->keycode[3], report->keycode[4], report->keycode[5]);
@@ -60,13 +62,14 @@ translate_boot_kbd_report(hid_keyboard_report_t const *report)
 	new_mod_up = mod_changed & ~report->modifier;
 	new_mod_down = mod_changed & report->modifier;
 
-	mod_down_state = report->modifier;
+	state->modifiers = report->modifier;
 
     uint32_t written_events = 0;
 #define WRITE_EVENT(page, code, downval) \
 	do { \
 		KeyboardEvent evt = {page, code, .down = downval}; \
-		enqueue_kbd_event(&evt); \
+		if (enqueue_kbd_event(&evt)) \
+			written_events++; \
 	} while (0)
 
 	// write all the released keys
@@ -115,12 +118,13 @@ translate_boot_kbd_report(hid_keyboard_report_t const *report)
 			continue;
 		WRITE_EVENT(0, hidcode, DOWN);
 	}
+	return written_events;
 }
 
-void
-translate_boot_mouse_report(hid_mouse_report_t const *report)
+uint
+translate_boot_mouse_report(HidBootState* state, hid_mouse_report_t const *report)
 {
-    static uint16_t buttons_down = 0;
+    uint16_t buttons_down = state->buttons;
 
     uint16_t current_buttons_state = report->buttons;
     uint16_t changed_buttons = current_buttons_state ^ buttons_down;
@@ -133,7 +137,63 @@ translate_boot_mouse_report(hid_mouse_report_t const *report)
     event.buttons_up = changed_buttons & ~current_buttons_state;
 	event.buttons = report->buttons;
 
-    buttons_down = current_buttons_state;
+    state->buttons = current_buttons_state;
+
+	return enqueue_mouse_event(&event) ? 1 : 0;
+}
+
+bool
+translate_boot_release_all(HidBootState* state, uint* released)
+{
+	// the modifiers translate_boot_kbd_report sends, in its order
+	static const struct {
+		uint8_t bit;
+		uint8_t keycode;
+	} mods[] = {
+		{ KEYBOARD_MODIFIER_LEFTSHIFT, HID_KEY_LEFT_SHIFT },
+		{ KEYBOARD_MODIFIER_RIGHTSHIFT, HID_KEY_RIGHT_SHIFT },
+		{ KEYBOARD_MODIFIER_LEFTCTRL, HID_KEY_LEFT_CONTROL },
+		{ KEYBOARD_MODIFIER_RIGHTCTRL, HID_KEY_RIGHT_CONTROL },
+		{ KEYBOARD_MODIFIER_LEFTALT, HID_KEY_LEFT_ALT },
+		{ KEYBOARD_MODIFIER_RIGHTALT, HID_KEY_RIGHT_ALT },
+	};
+
+	*released = 0;
+
+	// a key or modifier only leaves state once its release is queued; stop
+	// at the first the queue won't take, so keys still go up first
+	bool full = false;
+	for (int i = 0; i < 6 && !full; i++) {
+		if (state->keys[i] == 0)
+			continue;
+		KeyboardEvent evt = {0, state->keys[i], .down = UP};
+		if (!(full = !enqueue_kbd_event(&evt))) {
+			state->keys[i] = 0;
+			(*released)++;
+		}
+	}
+	for (uint i = 0; i < count_of(mods) && !full; i++) {
+		if (!(state->modifiers & mods[i].bit))
+			continue;
+		KeyboardEvent evt = {0, mods[i].keycode, .down = UP};
+		if (!(full = !enqueue_kbd_event(&evt))) {
+			state->modifiers &= ~mods[i].bit;
+			(*released)++;
+		}
+	}
+	// the GUI bits never made it out as key downs
+	if (!full)
+		state->modifiers = 0;
+
+	if (state->buttons) {
+		MouseEvent event = {
+			.buttons_up = state->buttons,
+		};
+		if (enqueue_mouse_event(&event)) {
+			state->buttons = 0;
+			(*released)++;
+		}
+	}
 
-	enqueue_mouse_event(&event);
+	return !full && state->buttons == 0;
 }
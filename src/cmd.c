@@ -1,19 +1,36 @@
 #include <pico/stdlib.h>
-#include <pico/multicore.h>
 #include <tusb.h>
-#include <pio_usb.h>
 
 #define DEBUG_VERBOSE 0
 #define DEBUG_TAG "cmd"
 
 #include "babelfish.h"
+#include "hid_codes.h"
 
 #define CMD_MS_HOLD 500
 #define CMD_KEY HID_KEY_EQUAL
 
+/*
+ * Holding CMD_KEY for CMD_MS_HOLD enters command mode. Its key down is held
+ * back until that's decided: a release before the deadline forwards it as a
+ * tap right away, and so does any other key arriving first (a chord, e.g.
+ * shift-=). Other keys are never delayed. The deadline itself is checked by
+ * cmd_task() from the mainloop, so command mode starts on time even when no
+ * other event arrives.
+ *
+ * Everything below works off a now_ms passed in, so the logic can be driven
+ * with a virtual clock (tools/sim/cmd_test.c); only cmd_process_event and
+ * cmd_task read the real one.
+ */
+typedef enum {
+    CmdIdle,
+    CmdPending, // CMD_KEY is down, deadline not reached
+    CmdActive,  // in command mode until CMD_KEY is released
+} CmdState;
+
 static KeyboardEvent s_cmd_saved_ev;
-static uint32_t s_cmd_down_stamp = 0;
-static bool s_in_cmd = false;
+static uint32_t s_cmd_deadline_ms = 0;
+static CmdState s_cmd_state = CmdIdle;
 
 char hid_to_cmd_ascii(uint16_t hid)
 {
@@ -57,10 +74,10 @@ void send_kbd_string(const char* str)
             continue;
 
         KeyboardEvent ev = { .page = 0, .keycode = hid, .down = true };
-        host->kbd_event(ev);
+        HOST_KBD_EVENT(ev);
         sleep_ms(100);
         ev.down = false;
-        host->kbd_event(ev);
+        HOST_KBD_EVENT(ev);
         sleep_ms(100);
     }
 }
@@ -68,7 +85,7 @@ void send_kbd_string(const char* str)
 void cmd_process_char(char c)
 {
     static char cmd[12];
-    static char cmd_len = 0;
+    static uint8_t cmd_len = 0;
 
     if (c == 0) {
         cmd_len = 0;
@@ -82,7 +99,7 @@ void cmd_process_char(char c)
             case 'h':
                 send_kbd_string("Hosts\n");
                 int i = 0;
-                while (hosts[i].name) {
+                while (hosts[i].name[0]) {
                     char buf[32];
                     snprintf(buf, 32, "%d", i);
                     send_kbd_string(g_current_host_index == i ? "* " : "  ");
@@ -100,7 +117,7 @@ void cmd_process_char(char c)
         }
     } else if (cmd_len == 5) {
         if (cmd[0] == 'd') {
-            bool ch_num = cmd[1] - 'a';
+            int ch_num = cmd[1] - 'a';
             bool is_high = cmd[2] == '1';
             bool is_normal = cmd[3] == 'n';
             int mode = cmd[4] - '1';
@@ -116,42 +133,60 @@ void cmd_process_char(char c)
     }
 }
 
-bool cmd_process_event(KeyboardEvent ev)
+void cmd_task_at(uint32_t now_ms)
 {
-    if (s_cmd_down_stamp != 0) {
-        uint32_t now_ms = to_ms_since_boot(get_absolute_time());
-        if (now_ms - s_cmd_down_stamp < CMD_MS_HOLD) {
-            // nope, key wasn't held down long enough.
-            // process the original key down and then continue
-            host->kbd_event(s_cmd_saved_ev);
-            s_cmd_down_stamp = 0;
-            return false;
-        }
-
-        s_in_cmd = true;
+    if (s_cmd_state == CmdPending && (int32_t) (now_ms - s_cmd_deadline_ms) >= 0) {
+        s_cmd_state = CmdActive;
         cmd_process_char(0); // reset the command processor
     }
+}
+
+bool cmd_process_event_at(KeyboardEvent ev, uint32_t now_ms)
+{
+    // the deadline may have passed since the last cmd_task
+    cmd_task_at(now_ms);
+
+    switch (s_cmd_state) {
+        case CmdPending:
+            // released early (a tap), or another key came first (a chord):
+            // the held back key down goes out now, followed by this event
+            s_cmd_state = CmdIdle;
+            HOST_KBD_EVENT(s_cmd_saved_ev);
+            return false;
 
-    if (s_in_cmd) {
-        // check for ending (on release)
-        if (ev.keycode == CMD_KEY && !ev.down) {
-            s_cmd_down_stamp = 0;
-            s_in_cmd = false;
+        case CmdActive:
+            // check for ending (on release)
+            if (ev.keycode == CMD_KEY && !ev.down) {
+                s_cmd_state = CmdIdle;
+                return true;
+            }
+
+            // ignore key releases
+            if (ev.down) {
+                cmd_process_char(hid_to_cmd_ascii(ev.keycode));
+            }
             return true;
-        }
 
-        // ignore key releases
-        if (ev.down) {
-            cmd_process_char(hid_to_cmd_ascii(ev.keycode));
-        }
-        return true;
+        case CmdIdle:
+        default:
+            if (ev.keycode == CMD_KEY && ev.down) {
+                s_cmd_state = CmdPending;
+                s_cmd_deadline_ms = now_ms + CMD_MS_HOLD;
+                s_cmd_saved_ev = ev;
+                return true;
+            }
+            return false;
     }
+}
 
-    if (ev.keycode == CMD_KEY && ev.down) {
-        uint32_t now_ms = to_ms_since_boot(get_absolute_time());
-        s_cmd_down_stamp = now_ms;
-        s_cmd_saved_ev = ev;
-        return true;
-    }
+// Returns true if the event was taken by the command processor
+bool cmd_process_event(KeyboardEvent ev)
+{
+    return cmd_process_event_at(ev, to_ms_since_boot(get_absolute_time()));
 }
 
+// Called every mainloop iteration
+void cmd_task()
+{
+    cmd_task_at(to_ms_since_boot(get_absolute_time()));
+}
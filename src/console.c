@@ -0,0 +1,156 @@
+#include <pico/stdlib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DEBUG_TAG "console"
+#include "babelfish.h"
+#include "console.h"
+#include "la_capture.h"
+
+#if DEBUG
+
+static void cmd_help(int argc, char** argv);
+#if LA_CAPTURE
+extern void la_console_cmd(int argc, char** argv);
+#endif
+extern void isr_bench_console_cmd(int argc, char** argv);
+extern void stats_console_cmd(int argc, char** argv);
+extern void dispatchbench_console_cmd(int argc, char** argv);
+extern void tu_log_console_cmd(int argc, char** argv);
+extern void log_console_cmd(int argc, char** argv);
+extern void rec_console_cmd(int argc, char** argv);
+extern void remap_console_cmd(int argc, char** argv);
+extern void keymap_console_cmd(int argc, char** argv);
+extern void kbd_leds_console_cmd(int argc, char** argv);
+extern void usb_host_console_cmd(int argc, char** argv);
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_PS2
+extern void ps2_console_cmd(int argc, char** argv);
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_SGI
+extern void sgi_console_cmd(int argc, char** argv);
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_NEXT
+extern void next_console_cmd(int argc, char** argv);
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_QUAD
+extern void quad_console_cmd(int argc, char** argv);
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_PCMOUSE
+extern void pcmouse_console_cmd(int argc, char** argv);
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_REVERSE
+extern void reverse_console_cmd(int argc, char** argv);
+#endif
+
+static const ConsoleCommand s_commands[] = {
+    { "help", cmd_help, "list console commands" },
+    { "stats", stats_console_cmd, "stats [reset] -- runtime statistics" },
+#if LA_CAPTURE
+    { "la", la_console_cmd, "la start [rate_hz] | la stop | la status -- logic analyzer capture" },
+#endif
+    { "isrbench", isr_bench_console_cmd, "isrbench [ms] -- ISR cycles with and without XIP cache flushing" },
+    { "dispatchbench", dispatchbench_console_cmd, "dispatchbench [n] -- cycles per host update call" },
+    { "log", log_console_cmd, "log [tag|all level] | log bench [n] -- runtime log levels" },
+    { "tulog", tu_log_console_cmd, "tulog [on|off] -- TinyUSB stack logging" },
+    { "rec", rec_console_cmd, "rec [on|off|clear|dump|flush|load] -- raw HID report recorder" },
+    { "keymap", keymap_console_cmd, "keymap [builtin|erase|bench [n]] -- the host keymap, uploads over the USB link" },
+    { "remap", remap_console_cmd, "remap [clear|bench [n]|<rule>] -- key layers, tap/hold, chords and macros" },
+    { "leds", kbd_leds_console_cmd, "leds [hex] -- lock LEDs sent back to the USB keyboards" },
+    { "usbh", usb_host_console_cmd, "usbh [reset] -- PIO-USB frame timing and transfer errors" },
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_PS2
+    { "ps2", ps2_console_cmd, "ps2 -- PS/2 port counters and state" },
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_SGI
+    { "sgi", sgi_console_cmd, "sgi -- SGI link counters and keyboard state" },
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_NEXT
+    { "next", next_console_cmd, "next -- NeXT poll and reply counters" },
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_QUAD
+    { "quad", quad_console_cmd, "quad [rate n] [scale f] -- quadrature edge rate, scaling and counters" },
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_PCMOUSE
+    { "pcmouse", pcmouse_console_cmd, "pcmouse [microsoft|logitech|mousesystems] -- serial mouse format and counters" },
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_REVERSE
+    { "reverse", reverse_console_cmd, "reverse [kbd sun|apollo|none] [mouse sun|mousesystems|microsoft|none] -- devices and USB HID latency" },
+#endif
+    { 0 }
+};
+
+void
+console_printf(const char* fmt, ...)
+{
+    char buf[128];
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+
+    dbg(NULL, "%s", buf);
+}
+
+static void
+cmd_help(int argc, char** argv)
+{
+    for (const ConsoleCommand* c = s_commands; c->name; c++) {
+        console_printf("  %-8s %s\n", c->name, c->help);
+    }
+}
+
+static void
+console_run(char* line)
+{
+    char* argv[CONSOLE_MAX_ARGS];
+    int argc = 0;
+
+    char* tok = strtok(line, " \t");
+    while (tok && argc < CONSOLE_MAX_ARGS) {
+        argv[argc++] = tok;
+        tok = strtok(NULL, " \t");
+    }
+
+    if (argc == 0)
+        return;
+
+    for (const ConsoleCommand* c = s_commands; c->name; c++) {
+        if (strcmp(c->name, argv[0]) == 0) {
+            c->fn(argc, argv);
+            return;
+        }
+    }
+
+    console_printf("unknown command '%s', try 'help'\n", argv[0]);
+}
+
+bool
+console_in_char(char ch)
+{
+    static char line[CONSOLE_MAX_LINE];
+    static int line_len = -1; // -1 when not reading a command line
+
+    if (ch == CONSOLE_CMD_CHAR) {
+        line_len = 0;
+        return true;
+    }
+
+    if (line_len < 0)
+        return false;
+
+    if (ch == '\r' || ch == '\n') {
+        line[line_len] = '\0';
+        line_len = -1;
+        console_run(line);
+    } else if (ch == 0x7f || ch == '\b') {
+        if (line_len > 0)
+            line_len--;
+    } else if (line_len < CONSOLE_MAX_LINE - 1) {
+        line[line_len++] = ch;
+    }
+
+    return true;
+}
+
+#endif
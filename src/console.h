@@ -0,0 +1,24 @@
+#ifndef CONSOLE_H_
+#define CONSOLE_H_
+
+#include <stdbool.h>
+
+// Anything typed on the debug CDC is normally turned into fake keypresses for the
+// current host. A line that starts with CONSOLE_CMD_CHAR (ctrl-\) and ends in CR/LF
+// is run as a console command instead, e.g. "^\la start 4000000\r".
+#define CONSOLE_CMD_CHAR 0x1c
+#define CONSOLE_MAX_LINE 64
+#define CONSOLE_MAX_ARGS 8
+
+typedef struct {
+    const char* name;
+    void (*fn)(int argc, char** argv);
+    const char* help;
+} ConsoleCommand;
+
+// Returns true if the character was consumed by the console
+bool console_in_char(char ch);
+
+void console_printf(const char* fmt, ...);
+
+#endif
@@ -1,12 +1,27 @@
+#define DEBUG_TAG "debug"
+// 'log bench' times a filtered out DBG_VV, so it has to be compiled in
+#ifndef DBG_LEVEL_MAX
+#define DBG_LEVEL_MAX DBG_LEVEL_VVV
+#endif
+
 #include <pico/stdlib.h>
 #include <pico/bootrom.h>
 #include <hardware/uart.h>
 #include <hardware/irq.h>
+#include <hardware/sync.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <tusb.h>
 #include "babelfish.h"
 #include "hid_codes.h"
+#include "console.h"
+#include "la_capture.h"
+#include "usb_link.h"
+#include "isr_stats.h"
+
+DBG_MODULE();
 
 #if DEBUG
 
@@ -21,54 +36,283 @@ static bool debug_connected();
 
 #define USB_DEBUG_TIMEOUT_US 50
 
-#define DBG_MSG_COUNT 8
-static char main_thread_debug_msgs[64][DBG_MSG_COUNT];
-static int main_thread_debug_msg_idx = 0;
-static int main_thread_debug_msg_seen = 0;
+/*
+ * Log output that can't go straight to the CDC.
+ *
+ * Only core0 may touch the USB device stack, so anything logged on core1
+ * (DBG from the host callbacks, and all of TinyUSB's host stack logging) is
+ * appended to a core1 ring and written out by debug_task on core0. TinyUSB's
+ * own logging on core0 goes through a ring too, since it is called from
+ * inside tud_task and debug_out would re-enter it.
+ *
+ * Appending never blocks: if the ring is full, the message is dropped and
+ * counted.
+ */
+#define LOG_RING_SIZE 2048 // power of two
+
+typedef struct {
+    char buf[LOG_RING_SIZE];
+    // head is only written by the owning core, tail only by core0
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint32_t dropped;
+    uint32_t dropped_reported;
+} LogRing;
+
+static LogRing s_log_ring[2];
+
+static bool s_tu_log_enabled = true;
 
-int main_thread_debug_update()
+static void
+log_ring_append(const char* str, int length)
 {
-    while (main_thread_debug_msg_seen < main_thread_debug_msg_idx) {
-        char *msg = main_thread_debug_msgs[main_thread_debug_msg_seen % DBG_MSG_COUNT];
-        puts(msg);
-        main_thread_debug_msg_seen++;
+    LogRing* r = &s_log_ring[get_core_num()];
+
+    // the ring is per core, so only our own IRQs can race us
+    uint32_t irq = save_and_disable_interrupts();
+    if (length > (int) (LOG_RING_SIZE - (r->head - r->tail))) {
+        r->dropped++;
+    } else {
+        uint32_t head = r->head;
+        for (int i = 0; i < length; i++)
+            r->buf[(head + i) & (LOG_RING_SIZE - 1)] = str[i];
+        __dmb();
+        r->head = head + length;
     }
+    restore_interrupts(irq);
 }
 
-int ext_tu_printf(const char* fmt, ...)
+// core0 only
+static void
+log_ring_drain(LogRing* r)
 {
+    while (r->tail != r->head) {
+        __dmb();
+        uint32_t tail = r->tail;
+        uint32_t off = tail & (LOG_RING_SIZE - 1);
+        uint32_t n = r->head - tail;
+        if (n > LOG_RING_SIZE - off)
+            n = LOG_RING_SIZE - off;
+
+        debug_out(&r->buf[off], n);
+
+        __dmb();
+        r->tail = tail + n;
+    }
+
+    if (r->dropped != r->dropped_reported) {
+        uint32_t dropped = r->dropped;
+        char buf[48];
+        int len = snprintf(buf, sizeof(buf), "\r\n[log: %lu messages dropped]\r\n", dropped - r->dropped_reported);
+        debug_out(buf, len);
+        r->dropped_reported = dropped;
+    }
+}
+
+/*
+ * DBG_ISR lines: the format and its arguments, formatted by debug_task.
+ * Per core like the log rings; written by dbg_isr with that core's IRQs
+ * off, read by core0.
+ */
+#define ISR_LOG_SIZE 32 // power of two
+
+typedef struct {
+    const char* tag;
+    const char* fmt;
+    uintptr_t args[4];
+} IsrLogLine;
+
+typedef struct {
+    IsrLogLine lines[ISR_LOG_SIZE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint32_t dropped;
+    uint32_t dropped_reported;
+} IsrLog;
+
+static IsrLog s_isr_log[2];
+
+void
+__not_in_flash_func(dbg_isr)(const char* tag, const char* fmt, const uintptr_t args[4])
+{
+    IsrLog* l = &s_isr_log[get_core_num()];
+
+    uint32_t irq = save_and_disable_interrupts();
+    if (l->head - l->tail == ISR_LOG_SIZE) {
+        l->dropped++;
+    } else {
+        IsrLogLine* line = &l->lines[l->head & (ISR_LOG_SIZE - 1)];
+        line->tag = tag;
+        line->fmt = fmt;
+        for (int i = 0; i < 4; i++)
+            line->args[i] = args[i];
+        __dmb();
+        l->head = l->head + 1;
+    }
+    restore_interrupts(irq);
+}
+
+// core0 only
+static void
+isr_log_drain(IsrLog* l, int core)
+{
+    while (l->tail != l->head) {
+        __dmb();
+        const IsrLogLine* line = &l->lines[l->tail & (ISR_LOG_SIZE - 1)];
+        char prefix[24];
+        int len = snprintf(prefix, sizeof(prefix), "(%s:%d) ", line->tag, core);
+        debug_out(prefix, len);
+        dbg(NULL, line->fmt, line->args[0], line->args[1], line->args[2], line->args[3]);
+        __dmb();
+        l->tail = l->tail + 1;
+    }
+
+    if (l->dropped != l->dropped_reported) {
+        uint32_t dropped = l->dropped;
+        char buf[48];
+        int len = snprintf(buf, sizeof(buf), "\r\n[log: %lu ISR lines dropped]\r\n", dropped - l->dropped_reported);
+        debug_out(buf, len);
+        l->dropped_reported = dropped;
+    }
+}
+
+bool
+debug_tu_log_enabled()
+{
+    return s_tu_log_enabled;
+}
+
+void
+debug_tu_log_set_enabled(bool enabled)
+{
+    s_tu_log_enabled = enabled;
+}
+
+int
+ext_tu_printf(const char* fmt, ...)
+{
+    if (!s_tu_log_enabled)
+        return 0;
+
     char buf[128];
 
     va_list args;
     va_start(args, fmt);
-    int len = vsnprintf(buf, 127, fmt, args);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
     va_end(args);
 
-    //buf[len] = '\n';
-    //buf[len+1] = '\0';
-    //len++;
+    if (len > (int) sizeof(buf) - 1)
+        len = sizeof(buf) - 1;
 
-    debug_out(buf, len+1);
+    log_ring_append(buf, len);
     return len;
 }
 
-int ext_tu_printfz(const char* fmt, ...)
+// tulog [on|off]
+void
+tu_log_console_cmd(int argc, char** argv)
 {
-    int len = 0;
+    if (argc >= 2)
+        debug_tu_log_set_enabled(strcmp(argv[1], "on") == 0);
 
-    int idx = main_thread_debug_msg_idx;
-    char *nx = main_thread_debug_msgs[idx % DBG_MSG_COUNT];
+    console_printf("tinyusb logging %s, dropped core0 %lu core1 %lu\n",
+        s_tu_log_enabled ? "on" : "off", s_log_ring[0].dropped, s_log_ring[1].dropped);
+}
 
-    va_list args;
-    va_start(args, fmt);
-    len = vsnprintf(nx, 62, fmt, args);
-    va_end(args);
+static DbgTag* s_dbg_tags = NULL;
 
-    nx[len] = '\n';
-    nx[len+1] = '\0';
+// Runs from each file's constructor, before main
+void
+dbg_tag_register(DbgTag* tag)
+{
+    tag->next = s_dbg_tags;
+    s_dbg_tags = tag;
+}
 
-    main_thread_debug_msg_idx++;
-    return len+1;
+bool
+dbg_tag_get_level(const char* name, int* level)
+{
+    for (DbgTag* t = s_dbg_tags; t; t = t->next) {
+        if (strcmp(t->name, name) == 0) {
+            *level = t->level;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+dbg_tag_set_level(const char* name, int level)
+{
+    bool all = strcmp(name, "all") == 0;
+    bool found = false;
+    for (DbgTag* t = s_dbg_tags; t; t = t->next) {
+        if (all || strcmp(t->name, name) == 0) {
+            t->level = level;
+            found = true;
+        }
+    }
+    return found;
+}
+
+static void
+log_bench(int n)
+{
+    // make sure the call site below is filtered out
+    uint8_t saved_level = dbg_tag_self.level;
+    dbg_tag_self.level = DBG_LEVEL_OFF;
+
+    volatile int sink = 0;
+    uint32_t start = isr_cycles_now();
+    for (int i = 0; i < n; i++)
+        sink = i;
+    uint32_t empty = (start - isr_cycles_now()) & 0xffffff;
+
+    start = isr_cycles_now();
+    for (int i = 0; i < n; i++) {
+        sink = i;
+        DBG_VV("log bench %d %d\n", i, sink);
+    }
+    uint32_t filtered = (start - isr_cycles_now()) & 0xffffff;
+
+    dbg_tag_self.level = saved_level;
+
+    console_printf("%d filtered call sites: %lu cycles over an empty loop, %lu.%02lu cycles each\n",
+        n, filtered - empty, (filtered - empty) / n, ((filtered - empty) * 100 / n) % 100);
+}
+
+/*
+ * log                  -- list tags and their levels
+ * log <tag|all> <0-4>  -- set a level (0 off, 1 DBG ... 4 DBG_VVV)
+ * log bench [n]        -- cost of a filtered out call site
+ */
+void
+log_console_cmd(int argc, char** argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+        int n = argc >= 3 ? atoi(argv[2]) : 10000;
+        log_bench(n > 0 ? n : 10000);
+        return;
+    }
+
+    if (argc >= 3) {
+        if (!dbg_tag_set_level(argv[1], atoi(argv[2])))
+            console_printf("unknown tag '%s'\n", argv[1]);
+        return;
+    }
+
+    // several files can share a tag, only list each one once
+    for (DbgTag* t = s_dbg_tags; t; t = t->next) {
+        bool seen = false;
+        for (DbgTag* u = s_dbg_tags; u != t; u = u->next) {
+            if (strcmp(u->name, t->name) == 0) {
+                seen = true;
+                break;
+            }
+        }
+        if (!seen)
+            console_printf("  %-10s %d\n", t->name, t->level);
+    }
 }
 
 void
@@ -93,14 +337,20 @@ debug_init()
 void
 debug_task()
 {
-    main_thread_debug_update();
+    log_ring_drain(&s_log_ring[0]);
+    log_ring_drain(&s_log_ring[1]);
+    isr_log_drain(&s_isr_log[0], 0);
+    isr_log_drain(&s_isr_log[1], 1);
     tud_task();
 
     static char buf[128];
     int len = debug_in(buf, sizeof(buf));
-    if (len > 0) {
-        debug_in_char(buf[0]);
+    for (int i = 0; i < len; i++) {
+        debug_in_char(buf[i]);
     }
+
+    la_capture_task();
+    usb_link_task();
 }
 
 bool debug_connected() {
@@ -152,6 +402,17 @@ void
 debug_out(const char* buf, int length)
 {
     static uint64_t last_avail_time;
+
+    // the CDC belongs to the capture stream while the logic analyzer runs
+    if (la_capture_active())
+        return;
+
+    // the device stack is core0's, hand the output over
+    if (get_core_num() != 0) {
+        log_ring_append(buf, length);
+        return;
+    }
+
     if (!mutex_try_enter_block_until(&debug_mutex, make_timeout_time_ms(PICO_STDIO_DEADLOCK_TIMEOUT_MS))) {
         return;
     }
@@ -257,6 +518,9 @@ debug_in_char(char ch)
     static bool in_esc = false;
     static bool in_motion = false;
 
+    if (console_in_char(ch))
+        return;
+
     if (ch == 0x1B) { // ESC
         in_esc = true;
         return;
@@ -3,6 +3,9 @@
 
 #if DEBUG
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #if !defined(DEBUG_VERBOSE)
 #define DEBUG_VERBOSE 0
 #endif
@@ -14,26 +17,92 @@ void debug_task();
 
 void dbg(const char* tag, const char *fmt, ...);
 
+// Whether TinyUSB's own logging (ext_tu_printf) is currently enabled
+bool debug_tu_log_enabled();
+void debug_tu_log_set_enabled(bool enabled);
+
 #ifndef DEBUG_TAG
 #define DEBUG_TAG "??"
 #endif
 
-#define DBG(...) dbg(DEBUG_TAG, __VA_ARGS__)
-#if DEBUG_VERBOSE > 0
-#define DBG_V(...) dbg(DEBUG_TAG, __VA_ARGS__)
-#endif
-#if DEBUG_VERBOSE > 1
-#define DBG_VV(...) dbg(DEBUG_TAG, __VA_ARGS__)
-#endif
-#if DEBUG_VERBOSE > 2
-#define DBG_VVV(...) dbg(DEBUG_TAG, __VA_ARGS__)
+/*
+ * Log levels are per tag and can be changed at runtime with the 'log'
+ * console command. A file that logs declares its tag once, at file scope
+ * after its includes, with DBG_MODULE(); the tag is named DEBUG_TAG and
+ * starts at DBG_LEVEL_INFO + DEBUG_VERBOSE.
+ *
+ * Call sites above DBG_LEVEL_MAX are compiled out entirely. It defaults to
+ * the file's starting level, so DBG_V and up cost nothing unless the file
+ * or the build (BABELFISH_DBG_LEVEL_MAX) asks for them; only those can be
+ * turned on from the console. A call site that is compiled in but filtered
+ * out is a byte load and a branch ('log bench' times it), and its
+ * arguments are never evaluated.
+ */
+#define DBG_LEVEL_OFF  0
+#define DBG_LEVEL_INFO 1 // DBG
+#define DBG_LEVEL_V    2 // DBG_V
+#define DBG_LEVEL_VV   3 // DBG_VV
+#define DBG_LEVEL_VVV  4 // DBG_VVV
+
+#ifndef DBG_LEVEL_MAX
+#define DBG_LEVEL_MAX (DBG_LEVEL_INFO + DEBUG_VERBOSE)
 #endif
+
+typedef struct DbgTag {
+    const char* name;
+    uint8_t level;
+    struct DbgTag* next;
+} DbgTag;
+
+void dbg_tag_register(DbgTag* tag);
+
+// By tag name ("all" sets every tag); false if no file uses the tag
+bool dbg_tag_get_level(const char* name, int* level);
+bool dbg_tag_set_level(const char* name, int level);
+
+#define DBG_MODULE() \
+    static DbgTag dbg_tag_self; \
+    static void __attribute__((constructor, used)) dbg_tag_self_register() \
+    { \
+        dbg_tag_register(&dbg_tag_self); \
+    } \
+    static DbgTag dbg_tag_self = { DEBUG_TAG, DBG_LEVEL_INFO + DEBUG_VERBOSE, 0 }
+
+#define DBG_AT(lvl, ...) do { \
+    if ((lvl) <= DBG_LEVEL_MAX && dbg_tag_self.level >= (lvl)) \
+        dbg(DEBUG_TAG, __VA_ARGS__); \
+} while (0)
+
+#define DBG(...) DBG_AT(DBG_LEVEL_INFO, __VA_ARGS__)
+#define DBG_V(...) DBG_AT(DBG_LEVEL_V, __VA_ARGS__)
+#define DBG_VV(...) DBG_AT(DBG_LEVEL_VV, __VA_ARGS__)
+#define DBG_VVV(...) DBG_AT(DBG_LEVEL_VVV, __VA_ARGS__)
 #define DBG_CONT(...) dbg(nullptr, __VA_ARGS__)
 
+/*
+ * For handlers that run from RAM: dbg formats through newlib, in flash.
+ * DBG_ISR only stores the format and up to four word sized arguments in a
+ * per-core ring, and debug_task formats them on core0. So no %llu, pointer
+ * arguments need a (uintptr_t) cast, and a %s must still be there when the
+ * ring is drained (a literal or a const table).
+ */
+void dbg_isr(const char* tag, const char* fmt, const uintptr_t args[4]);
+
+#define DBG_ISR_AT(lvl, fmt, ...) do { \
+    if ((lvl) <= DBG_LEVEL_MAX && dbg_tag_self.level >= (lvl)) \
+        dbg_isr(DEBUG_TAG, fmt, (const uintptr_t[4]) { __VA_ARGS__ }); \
+} while (0)
+
+#define DBG_ISR(...) DBG_ISR_AT(DBG_LEVEL_INFO, __VA_ARGS__)
+#define DBG_ISR_V(...) DBG_ISR_AT(DBG_LEVEL_V, __VA_ARGS__)
+#define DBG_ISR_VV(...) DBG_ISR_AT(DBG_LEVEL_VV, __VA_ARGS__)
+#define DBG_ISR_VVV(...) DBG_ISR_AT(DBG_LEVEL_VVV, __VA_ARGS__)
+
 #else
 
 #define DEBUG_INIT() do { } while (0)
 #define DEBUG_TASK() do { } while (0)
+#define DBG_MODULE() struct dbg_module_unused
 #define DBG(...) do { } while (0)
 #define DBG_CONT(...) do { } while (0)
 
@@ -48,5 +117,11 @@ void dbg(const char* tag, const char *fmt, ...);
 #ifndef DBG_VVV
 #define DBG_VVV(...) do { } while (0)
 #endif
+#ifndef DBG_ISR
+#define DBG_ISR(...) do { } while (0)
+#define DBG_ISR_V(...) do { } while (0)
+#define DBG_ISR_VV(...) do { } while (0)
+#define DBG_ISR_VVV(...) do { } while (0)
+#endif
 
 #endif
\ No newline at end of file
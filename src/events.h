@@ -37,14 +37,48 @@ typedef struct {
 
 #define MAX_QUEUED_EVENTS 32
 
-void enqueue_kbd_event(const KeyboardEvent* event);
-void enqueue_mouse_event(const MouseEvent* event);
+// false if the queue was full and the event was dropped
+bool enqueue_kbd_event(const KeyboardEvent* event);
+bool enqueue_mouse_event(const MouseEvent* event);
 void get_queued_kbd_events(KeyboardEvent* events, uint* count);
 void get_queued_mouse_events(MouseEvent* events, uint* count);
 
 void babelfish_uart_config(int uidx, char ab);
 
-void translate_boot_kbd_report(hid_keyboard_report_t const *report);
-void translate_boot_mouse_report(hid_mouse_report_t const *report);
+// What a keyboard or mouse interface is holding down, from its last report;
+// each interface keeps its own (hid_pool.h)
+typedef struct {
+    uint8_t keys[6];
+    uint8_t modifiers;
+    uint8_t buttons;
+} HidBootState;
+
+// each returns how many events the queue took
+uint translate_boot_kbd_report(HidBootState* state, hid_keyboard_report_t const *report);
+uint translate_boot_mouse_report(HidBootState* state, hid_mouse_report_t const *report);
+// Releases for everything state holds, keys before modifiers, as if the
+// device had sent empty reports. A release the queue doesn't take stays in
+// state, and so does everything after it; returns true once state is empty,
+// with *released counting the releases queued by this call.
+bool translate_boot_release_all(HidBootState* state, uint* released);
+
+// Drain the HID report ring filled by core1 (hid_app.c)
+void hid_app_task();
+// core1 loop hook, tracks the root port for enumeration timing and makes
+// the mount time requests
+void hid_app_host_task();
+// core1: one control transfer of ours on the bus at a time, held by an
+// interface for one kind of request. Claim fails while another is pending;
+// release only frees it for the holder that claimed it, and says whether
+// it did. An unmount frees it if the interface held it.
+typedef enum {
+    HidCtrlSetIdle = 1,
+    HidCtrlSetProtocol,
+    HidCtrlLeds,
+} HidCtrlKind;
+bool hid_app_ctrl_claim(uint8_t dev_addr, uint8_t instance, HidCtrlKind kind);
+bool hid_app_ctrl_release(uint8_t dev_addr, uint8_t instance, HidCtrlKind kind);
+void hid_app_stats_reset();
+void hid_app_stats_print();
 
 #endif
\ No newline at end of file
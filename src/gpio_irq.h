@@ -0,0 +1,15 @@
+#ifndef GPIO_IRQ_H_
+#define GPIO_IRQ_H_
+
+#include <stdint.h>
+#include <hardware/gpio.h>
+#include <hardware/structs/iobank0.h>
+
+// gpio_acknowledge_irq for the GPIO handlers that run from RAM: the SDK's
+// own is an out of line call into flash.
+static inline void gpio_irq_acknowledge(uint gpio, uint32_t events)
+{
+    io_bank0_hw->intr[gpio / 8] = events << (4 * (gpio % 8));
+}
+
+#endif
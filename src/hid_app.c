@@ -8,33 +8,277 @@
 
 #include <hardware/uart.h>
 #include <tusb.h>
+#include <host/hcd.h>
+#include <string.h>
 
 #define DEBUG_TAG "usb"
 #include "babelfish.h"
+#include "hid_pool.h"
+#include "hid_quirks.h"
+#include "usb_host_health.h"
+#include "hid_ring.h"
+#include "hid_rec.h"
+#include "usb_link.h"
+#include "isr_stats.h"
+#include "kbd_leds.h"
+#include "console.h"
 
-#define MAX_REPORT  4
+DBG_MODULE();
 
-static struct
-{
-  uint8_t report_count;
-  tuh_hid_report_info_t report_info[MAX_REPORT];
-} hid_info[CFG_TUH_HID];
+// Translate reports inside the core1 report callback, the way it was done
+// before the report ring. Only useful for comparing the two with 'stats'
+// (docs/measurements.md).
+#define HID_TRANSLATE_ON_CORE1 0
+_Static_assert(!(HID_TRANSLATE_ON_CORE1 && USB_HOST_REALTIME), "real time core1 only runs the USB host");
+
+static uint process_report(HidSlot* iface, uint8_t itf_protocol, uint8_t const* report, uint16_t len);
+static uint process_generic_report(HidSlot* iface, uint8_t const* report, uint16_t len);
+
+// Enumeration time, from the PIO-USB root port seeing a connect to
+// tuh_mount_cb, bucketed by whether TinyUSB logging was on at the time
+#define USB_HOST_RHPORT 1
+
+static struct {
+  uint32_t count;
+  uint32_t last_us;
+  uint32_t max_us;
+} s_enum_stats[2];
 
-static void process_generic_report(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len);
+static uint32_t s_attach_us = 0; // 0: no enumeration being timed
+static bool s_port_connected = false;
+
+// core0: unplugs, and re-plugs up to the first event reaching the host
+static struct {
+  uint32_t unmounts;
+  uint32_t released; // events synthesised for what departing interfaces held
+  uint32_t retried;  // passes where the event queue couldn't take them all
+  uint32_t count;
+  uint32_t last_ready_us; // attach to the endpoint armed
+  uint32_t last_us;       // attach to the first event
+  uint32_t max_us;
+} s_plug_stats;
 
 // TinyUSB Callbacks
+void tuh_mount_cb(uint8_t dev_addr);
 void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* desc_report, uint16_t desc_len);
 void tuh_hid_umount_cb(uint8_t dev_addr, uint8_t instance);
 void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len);
 
+// The interface and request whose control transfer (of ours) is pending;
+// dev_addr 0 if none
+static struct {
+  uint8_t dev_addr;
+  uint8_t instance;
+  uint8_t kind; // HidCtrlKind
+} s_ctrl_owner;
+
+bool hid_app_ctrl_claim(uint8_t dev_addr, uint8_t instance, HidCtrlKind kind)
+{
+  if (s_ctrl_owner.dev_addr)
+    return false;
+  s_ctrl_owner.dev_addr = dev_addr;
+  s_ctrl_owner.instance = instance;
+  s_ctrl_owner.kind = kind;
+  return true;
+}
+
+bool hid_app_ctrl_release(uint8_t dev_addr, uint8_t instance, HidCtrlKind kind)
+{
+  if (s_ctrl_owner.dev_addr != dev_addr || s_ctrl_owner.instance != instance || s_ctrl_owner.kind != kind)
+    return false;
+  s_ctrl_owner.dev_addr = 0;
+  return true;
+}
+
+static void arm_reports(HidSlot* slot)
+{
+  if (!tuh_hid_receive_report(slot->dev_addr, slot->instance)) {
+    DBG("HID: Failed to request to receive report!\r\n");
+  }
+  slot->ready_us = time_us_32() - slot->attach_us;
+  DBG_VV("HID: report requested for %d:%d\n", slot->dev_addr, slot->instance);
+}
+
+// Once the interface's mount requests are done: which protocol it ended
+// up in, and where its LED reports go
+static void slot_ready(HidSlot* slot)
+{
+  uint8_t itf_protocol = tuh_hid_interface_protocol(slot->dev_addr, slot->instance);
+  if (slot->itf_protocol != HID_ITF_PROTOCOL_NONE) {
+    const char* protocol_str[] = { "None", "Keyboard", "Mouse" };
+    DBG("HID using boot protocol, sub-protocol = %s (%d)\r\n", protocol_str[itf_protocol], itf_protocol);
+  } else {
+    DBG("HID using report protocol\r\n");
+  }
+
+  if (slot->quirks & HidQuirkNoLeds)
+    return;
+  if (slot->itf_protocol == HID_ITF_PROTOCOL_KEYBOARD) {
+    kbd_leds_mount(slot->dev_addr, slot->instance, 0);
+  } else if (slot->itf_protocol == HID_ITF_PROTOCOL_NONE) {
+    // the LED output report usually shares the keyboard input report's id
+    for (int i = 0; i < slot->report_count; ++i) {
+      const tuh_hid_report_info_t* info = &slot->report_info[i];
+      if (info->usage_page == HID_USAGE_PAGE_DESKTOP && info->usage == HID_USAGE_DESKTOP_KEYBOARD) {
+        kbd_leds_mount(slot->dev_addr, slot->instance, info->report_id);
+        break;
+      }
+    }
+  }
+}
+
+// A stall is a valid answer to SET_IDLE, so only count real failures
+static void set_idle_complete(tuh_xfer_t* xfer)
+{
+  uint8_t instance = (uint8_t) xfer->user_data;
+  if (!hid_app_ctrl_release(xfer->daddr, instance, HidCtrlSetIdle))
+    return;
+  if (xfer->result != XFER_RESULT_SUCCESS && xfer->result != XFER_RESULT_STALLED)
+    usb_host_health.ctrl_errors++;
+
+  HidSlot* slot = hid_pool_find(xfer->daddr, instance);
+  if (slot)
+    slot->negotiate &= ~HidNegotiateIdle;
+}
+
+static bool set_idle(HidSlot* slot)
+{
+  tuh_itf_info_t info;
+  if (!tuh_hid_itf_get_info(slot->dev_addr, slot->instance, &info))
+    return false;
+
+  // has to outlive the transfer; there is only ever one of ours
+  static tusb_control_request_t request;
+  request = (tusb_control_request_t) {
+    .bmRequestType = 0x21, // class, interface, out
+    .bRequest = HID_REQ_CONTROL_SET_IDLE,
+    .wValue = (uint16_t) slot->idle << 8, // every report id
+    .wIndex = info.desc.bInterfaceNumber,
+    .wLength = 0,
+  };
+  tuh_xfer_t xfer = {
+    .daddr = slot->dev_addr,
+    .ep_addr = 0,
+    .setup = &request,
+    .buffer = NULL,
+    .complete_cb = set_idle_complete,
+    .user_data = slot->instance,
+  };
+  return tuh_control_xfer(&xfer);
+}
+
+// Also called for TinyUSB's own SET_PROTOCOL at enumeration, which isn't
+// holding the gate
 void tuh_hid_set_protocol_complete_cb(uint8_t dev_addr, uint8_t instance, uint8_t protocol)
 {
   DBG("HID Set Protocol Complete %d:%d %d\r\n", dev_addr, instance, protocol);
-  if (!tuh_hid_receive_report(dev_addr, instance)) {
-    DBG("HID: Failed to request to receive report!\r\n");
+  if (!hid_app_ctrl_release(dev_addr, instance, HidCtrlSetProtocol))
+    return;
+
+  HidSlot* slot = hid_pool_find(dev_addr, instance);
+  if (!slot)
+    return;
+  slot->negotiate &= ~HidNegotiateProtocol;
+  // TinyUSB passes the protocol in use, which stays boot if it failed
+  if (protocol == HID_PROTOCOL_REPORT)
+    slot->itf_protocol = HID_ITF_PROTOCOL_NONE; // the generic path, by report id
+  else
+    usb_host_health.ctrl_errors++;
+}
+
+// Starts the interface's next mount request, if nothing of ours is on the
+// bus. TinyUSB's own control transfers, e.g. another device enumerating,
+// can keep it from starting; it is then tried again on the next pass.
+static void negotiate_start(HidSlot* slot)
+{
+  HidCtrlKind kind = (slot->negotiate & HidNegotiateIdle) ? HidCtrlSetIdle : HidCtrlSetProtocol;
+  if (!hid_app_ctrl_claim(slot->dev_addr, slot->instance, kind))
+    return;
+
+  bool started;
+  if (kind == HidCtrlSetIdle)
+    started = set_idle(slot);
+  else
+    started = tuh_hid_set_protocol(slot->dev_addr, slot->instance, HID_PROTOCOL_REPORT);
+  if (!started) {
+    DBG_V("HID: %d:%d mount request deferred\r\n", slot->dev_addr, slot->instance);
+    hid_app_ctrl_release(slot->dev_addr, slot->instance, kind);
+  }
+}
+
+// The mount time requests, one control transfer at a time across all
+// interfaces; an interface's endpoint is armed once all of its are done
+static void negotiate_task()
+{
+  bool tried = false;
+  for (uint i = 0; i < HID_POOL_SLOTS; i++) {
+    HidSlot* slot = hid_pool_slot(i);
+    if (slot->state != HidSlotMounted || !slot->negotiate)
+      continue;
+
+    if (slot->negotiate == HidNegotiateArm) {
+      slot->negotiate = 0;
+      arm_reports(slot);
+      slot_ready(slot);
+    } else if (!tried) {
+      tried = true;
+      negotiate_start(slot);
+    }
   }
 }
 
+// Called from the core1 loop, next to tuh_task
+void hid_app_host_task()
+{
+  bool connected = hcd_port_connect_status(USB_HOST_RHPORT);
+  if (connected && !s_port_connected)
+    s_attach_us = time_us_32() | 1;
+  s_port_connected = connected;
+
+  negotiate_task();
+  kbd_leds_host_task();
+}
+
+// Invoked when a device is configured. Behind a hub this runs once per
+// device, only the first one after the port connect is timed.
+void tuh_mount_cb(uint8_t dev_addr)
+{
+  if (s_attach_us == 0)
+    return;
+
+  uint32_t us = time_us_32() - s_attach_us;
+  s_attach_us = 0;
+
+  int on = debug_tu_log_enabled() ? 1 : 0;
+  s_enum_stats[on].count++;
+  s_enum_stats[on].last_us = us;
+  if (us > s_enum_stats[on].max_us)
+    s_enum_stats[on].max_us = us;
+
+  DBG("Device %d enumerated in %lu us\r\n", dev_addr, us);
+}
+
+void hid_app_stats_reset()
+{
+  memset(s_enum_stats, 0, sizeof(s_enum_stats));
+  memset(&s_plug_stats, 0, sizeof(s_plug_stats));
+  hid_pool_stats_reset();
+}
+
+void hid_app_stats_print()
+{
+  for (int on = 0; on < 2; on++) {
+    console_printf("  enumeration, tinyusb log %-3s: n %lu last %lu us max %lu us\n",
+        on ? "on" : "off", s_enum_stats[on].count, s_enum_stats[on].last_us, s_enum_stats[on].max_us);
+  }
+  // the first event waits for input, unless a key is held across the re-plug
+  console_printf("  plug to first event: n %lu last %lu us (armed at %lu us) max %lu us\n",
+      s_plug_stats.count, s_plug_stats.last_us, s_plug_stats.last_ready_us, s_plug_stats.max_us);
+  console_printf("  unplugged %lu interfaces, %lu releases sent for them, %lu passes retried\n",
+      s_plug_stats.unmounts, s_plug_stats.released, s_plug_stats.retried);
+  hid_pool_stats_print();
+}
+
 // Invoked when device with hid interface is mounted
 // Report descriptor is also available for use. tuh_hid_parse_report_descriptor() can be used to parse common/simple enough descriptor.
 // Note: if report descriptor length > CFG_TUH_ENUMERATION_BUFSIZE, it will be skipped therefore report_desc = NULL, desc_len = 0
@@ -45,52 +289,116 @@ void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* desc_re
   // TinyUSB will always switch to boot protocol if possible. We may choose to switch
   // back if we can understand the descriptors.
 
-  hid_info[instance].report_count = tuh_hid_parse_report_descriptor(hid_info[instance].report_info, MAX_REPORT, desc_report, desc_len);
-  DBG("HID has %u reports \r\n", hid_info[instance].report_count);
-  for (int i = 0; i < hid_info[instance].report_count; ++i) {
-    const tuh_hid_report_info_t* info = &hid_info[instance].report_info[i];
-    DBG("  Report %d: id=%d, usage_page=0x%x, usage=0x%x\r\n", i, info->report_id, info->usage_page, info->usage);
+  HidSlot* slot = hid_pool_alloc(dev_addr, instance);
+  if (!slot) {
+    // no report requested, so nothing from it reaches the host
+    return;
   }
 
+  uint8_t const itf_protocol = tuh_hid_interface_protocol(dev_addr, instance);
   uint8_t proto = tuh_hid_get_protocol(dev_addr, instance);
-  if (proto == HID_PROTOCOL_BOOT) {
-    const char* protocol_str[] = { "None", "Keyboard", "Mouse" };
-    uint8_t const itf_protocol = tuh_hid_interface_protocol(dev_addr, instance);
-    DBG("HID using boot protocol, sub-protocol = %s (%d)\r\n", protocol_str[itf_protocol], itf_protocol);
-  } else if (proto == HID_PROTOCOL_REPORT) {
-    DBG("HID using report protocol\r\n");
+  tuh_vid_pid_get(dev_addr, &slot->vid, &slot->pid);
+  const HidQuirk* quirk = hid_quirks_find(slot->vid, slot->pid, itf_protocol);
+  slot->quirks = quirk->flags;
+  slot->idle = quirk->idle;
+  slot->itf_protocol = proto == HID_PROTOCOL_BOOT ? itf_protocol : HID_ITF_PROTOCOL_NONE;
+  slot->attach_us = s_attach_us ? s_attach_us : time_us_32();
+
+  slot->negotiate = 0;
+  if (quirk->flags & HidQuirkSetIdle)
+    slot->negotiate |= HidNegotiateIdle;
+  if ((quirk->flags & HidQuirkReportProtocol) && proto == HID_PROTOCOL_BOOT)
+    slot->negotiate |= HidNegotiateProtocol;
+
+  // With nothing to ask for, request the first report before the parsing
+  // and logging below; its callback can't run before we return, as both
+  // happen in tuh_task. Otherwise negotiate_task arms it after.
+  if (!slot->negotiate)
+    arm_reports(slot);
+
+  slot->report_count = tuh_hid_parse_report_descriptor(slot->report_info, HID_POOL_REPORTS, desc_report, desc_len);
+  DBG("HID %04x:%04x has %u reports, quirks %x\r\n", slot->vid, slot->pid, slot->report_count, slot->quirks);
+  for (int i = 0; i < slot->report_count; ++i) {
+    const tuh_hid_report_info_t* info = &slot->report_info[i];
+    DBG("  Report %d: id=%d, usage_page=0x%x, usage=0x%x\r\n", i, info->report_id, info->usage_page, info->usage);
   }
 
-  // Create first report request
-  if (!tuh_hid_receive_report(dev_addr, instance)) {
-    DBG("HID: Failed to request to receive report!\r\n");
+  if (slot->negotiate) {
+    slot->negotiate |= HidNegotiateArm;
+    negotiate_start(slot);
+    return;
   }
-  DBG_VV("HID: report requested for %d:%d\n", dev_addr, instance);
+  slot_ready(slot);
 }
 
 // Invoked when device with hid interface is un-mounted
 void tuh_hid_umount_cb(uint8_t dev_addr, uint8_t instance)
 {
   DBG("HID device address = %d, instance = %d is unmounted\r\n", dev_addr, instance);
+  kbd_leds_umount(dev_addr, instance);
+  // a pending transfer's callback may never come
+  if (s_ctrl_owner.dev_addr == dev_addr && s_ctrl_owner.instance == instance)
+    s_ctrl_owner.dev_addr = 0;
+  // core0 releases what it held, see hid_app_task
+  hid_pool_unmount(dev_addr, instance);
 }
 
-// Invoked when received report from device via interrupt endpoint
-void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len)
+// Counts the report, and with HidQuirkRepeatFilter says whether it's the
+// same as the previous one. memcmp would be a call into flash.
+static bool __not_in_flash_func(repeated)(HidSlot* iface, uint8_t const* report, uint16_t len)
 {
-  uint8_t const itf_protocol = tuh_hid_interface_protocol(dev_addr, instance);
-  uint8_t const protocol = tuh_hid_get_protocol(dev_addr, instance);
+  iface->reports++;
+  if (!(iface->quirks & HidQuirkRepeatFilter) || len > sizeof(iface->last))
+    return false;
 
-  DBG_VV("HID report (dev %d:%d, protocol %d itf_protocol %d) length %d\n", dev_addr, instance, protocol, itf_protocol, len);
+  bool same = len == iface->last_len;
+  for (uint i = 0; same && i < len; i++)
+    same = report[i] == iface->last[i];
+  if (same) {
+    iface->repeats++;
+    return true;
+  }
 
-  if (itf_protocol == HID_ITF_PROTOCOL_KEYBOARD) {
-      translate_boot_kbd_report((hid_keyboard_report_t const*) report);
-  } else if (itf_protocol == HID_ITF_PROTOCOL_MOUSE) {
-      translate_boot_mouse_report((hid_mouse_report_t const*) report);
-  } else {
-      // Generic report requires matching ReportID and contents with previous parsed report info
-      DBG("===== Generic report!\n");
-      process_generic_report(dev_addr, instance, report, len);
+  for (uint i = 0; i < len; i++)
+    iface->last[i] = report[i];
+  iface->last_len = len;
+  return false;
+}
+
+// Invoked when received report from device via interrupt endpoint.
+// This runs on core1 next to PIO-USB, so it only copies the report into the
+// ring and re-arms the endpoint; hid_app_task() does the rest on core0.
+void __not_in_flash_func(tuh_hid_report_received_cb)(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len)
+{
+  uint32_t start = isr_cycles_now();
+  HidSlot* iface = hid_pool_find(dev_addr, instance);
+  // TinyUSB completes a failed IN transfer with no data
+  bool failed = len == 0;
+  if (failed) {
+    usb_host_health.in_errors++;
+    iface = NULL;
+  }
+  if (iface && repeated(iface, report, len))
+    iface = NULL; // nothing new, just re-arm
+
+#if HID_TRANSLATE_ON_CORE1
+  if (iface)
+    process_report(iface, iface->itf_protocol, report, len);
+#else
+  HidReportSlot* slot = iface ? hid_ring_acquire() : NULL;
+  if (slot) {
+    if (len > sizeof(slot->data))
+      len = sizeof(slot->data);
+    slot->dev_addr = dev_addr;
+    slot->instance = instance;
+    slot->itf_protocol = iface->itf_protocol;
+    slot->len = len;
+    slot->pool_slot = iface->index;
+    slot->stamp_us = time_us_32();
+    memcpy(slot->data, report, len);
+    hid_ring_commit();
   }
+#endif
 
 /*
   if (ax == instance) {
@@ -107,18 +415,94 @@ void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t cons
   // Continue to request to receive a report
   if (!tuh_hid_receive_report(dev_addr, instance)) {
     DBG("HID: Failed to request to receive report!\r\n");
+  } else if (failed) {
+    usb_host_health.in_rearms++;
+  }
+
+  uint32_t cycles = (start - isr_cycles_now()) & 0xffffff;
+  hid_ring_stats.core1.rearm_count++;
+  hid_ring_stats.core1.rearm_total_cycles += cycles;
+  if (cycles > hid_ring_stats.core1.rearm_max_cycles)
+    hid_ring_stats.core1.rearm_max_cycles = cycles;
+}
+
+static void first_event(HidSlot* iface)
+{
+  iface->forwarded = true;
+  uint32_t us = time_us_32() - iface->attach_us;
+  s_plug_stats.count++;
+  s_plug_stats.last_ready_us = iface->ready_us;
+  s_plug_stats.last_us = us;
+  if (us > s_plug_stats.max_us)
+    s_plug_stats.max_us = us;
+}
+
+// Called from the core0 mainloop: translate everything core1 has queued
+void hid_app_task()
+{
+  // Interfaces unplugged since the last pass. Looked at before draining the
+  // ring: core1 queued their last reports before marking them gone, so
+  // those are translated first and the releases follow them, and go out
+  // to the host in this same mainloop pass.
+  uint32_t gone = hid_pool_gone_mask();
+  hid_pool_rate_task();
+
+  HidReportSlot* slot;
+  while ((slot = hid_ring_peek()) != NULL) {
+    uint32_t start = isr_cycles_now();
+    HidSlot* iface = hid_pool_slot(slot->pool_slot);
+
+    hid_rec_record(slot);
+    usb_link_trace_report(slot->stamp_us, slot->dev_addr, slot->instance, slot->data, slot->len);
+    if (process_report(iface, slot->itf_protocol, slot->data, slot->len) && !iface->forwarded)
+      first_event(iface);
+    hid_ring_release();
+
+    uint32_t cycles = (start - isr_cycles_now()) & 0xffffff;
+    if (cycles > hid_ring_stats.core0.translate_max_cycles)
+      hid_ring_stats.core0.translate_max_cycles = cycles;
+  }
+
+  for (uint i = 0; gone; i++, gone >>= 1) {
+    if (!(gone & 1))
+      continue;
+    HidSlot* iface = hid_pool_slot(i);
+    uint released;
+    bool done = translate_boot_release_all(&iface->boot, &released);
+    s_plug_stats.released += released;
+    // the event queue was full: stay Gone and send the rest next pass
+    if (!done) {
+      s_plug_stats.retried++;
+      continue;
+    }
+    s_plug_stats.unmounts++;
+    hid_pool_reclaim(iface);
+  }
+}
+
+// How many events the report turned into
+static uint process_report(HidSlot* iface, uint8_t itf_protocol, uint8_t const* report, uint16_t len)
+{
+  DBG_VV("HID report (dev %d:%d, itf_protocol %d) length %d\n", iface->dev_addr, iface->instance, itf_protocol, len);
+
+  if (itf_protocol == HID_ITF_PROTOCOL_KEYBOARD) {
+      return translate_boot_kbd_report(&iface->boot, (hid_keyboard_report_t const*) report);
+  } else if (itf_protocol == HID_ITF_PROTOCOL_MOUSE) {
+      return translate_boot_mouse_report(&iface->boot, (hid_mouse_report_t const*) report);
+  } else {
+      // Generic report requires matching ReportID and contents with previous parsed report info
+      DBG("===== Generic report!\n");
+      return process_generic_report(iface, report, len);
   }
 }
 
 //--------------------------------------------------------------------+
 // Generic Report
 //--------------------------------------------------------------------+
-static void process_generic_report(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len)
+static uint process_generic_report(HidSlot* iface, uint8_t const* report, uint16_t len)
 {
-  (void) dev_addr;
-
-  uint8_t const rpt_count = hid_info[instance].report_count;
-  tuh_hid_report_info_t* rpt_info_arr = hid_info[instance].report_info;
+  uint8_t const rpt_count = iface->report_count;
+  tuh_hid_report_info_t* rpt_info_arr = iface->report_info;
   tuh_hid_report_info_t* rpt_info = NULL;
 
   if (rpt_count == 1 && rpt_info_arr[0].report_id == 0) {
@@ -142,7 +526,7 @@ static void process_generic_report(uint8_t dev_addr, uint8_t instance, uint8_t c
 
   if (!rpt_info) {
     // printf("Couldn't find the report info for this report !\r\n");
-    return;
+    return 0;
   }
 
   // For complete list of Usage Page & Usage checkout src/class/hid/hid.h. For examples:
@@ -157,17 +541,16 @@ static void process_generic_report(uint8_t dev_addr, uint8_t instance, uint8_t c
       case HID_USAGE_DESKTOP_KEYBOARD:
         // TU_LOG1("HID receive keyboard report\r\n");
         // Assume keyboard follow boot report layout
-        translate_boot_kbd_report((hid_keyboard_report_t*) report);
-        break;
+        return translate_boot_kbd_report(&iface->boot, (hid_keyboard_report_t*) report);
 
       case HID_USAGE_DESKTOP_MOUSE:
         // TU_LOG1("HID receive mouse report\r\n");
         // Assume mouse follow boot report layout
-        translate_boot_mouse_report((hid_mouse_report_t*) report);
-        break;
+        return translate_boot_mouse_report(&iface->boot, (hid_mouse_report_t*) report);
 
       default:
         break;
     }
   }
+  return 0;
 }
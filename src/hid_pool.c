@@ -0,0 +1,159 @@
+#include <pico/stdlib.h>
+#include <hardware/sync.h>
+#include <string.h>
+
+#define DEBUG_TAG "hidpool"
+#include "babelfish.h"
+#include "console.h"
+#include "hid_pool.h"
+
+DBG_MODULE();
+
+// TinyUSB keeps an endpoint IN and OUT buffer per interface, next to ours
+#define HID_POOL_TINYUSB_BYTES (CFG_TUH_HID_EPIN_BUFSIZE + CFG_TUH_HID_EPOUT_BUFSIZE)
+
+static HidSlot s_slots[HID_POOL_SLOTS];
+
+_Static_assert(sizeof(s_slots) + HID_POOL_SLOTS * HID_POOL_TINYUSB_BYTES <= HID_POOL_SRAM_BUDGET,
+    "HID interface pool is over its SRAM budget");
+
+static struct {
+    uint32_t peak;
+    uint32_t mounts;
+    uint32_t refused; // pool full
+} s_stats;
+
+// Slots not Free. Counted rather than kept, as each core frees or takes
+// them.
+static uint hid_pool_used()
+{
+    uint used = 0;
+    for (uint i = 0; i < HID_POOL_SLOTS; i++) {
+        if (s_slots[i].state != HidSlotFree)
+            used++;
+    }
+    return used;
+}
+
+// Nothing has to be published separately: reports for a slot only come
+// through the ring after tuh_hid_mount_cb has filled it and armed the
+// endpoint, and the ring commit orders them.
+HidSlot* hid_pool_alloc(uint8_t dev_addr, uint8_t instance)
+{
+    for (uint i = 0; i < HID_POOL_SLOTS; i++) {
+        HidSlot* slot = &s_slots[i];
+        if (slot->state != HidSlotFree)
+            continue;
+
+        memset(slot, 0, sizeof(*slot));
+        slot->index = i;
+        slot->dev_addr = dev_addr;
+        slot->instance = instance;
+        slot->state = HidSlotMounted;
+
+        s_stats.mounts++;
+        uint used = hid_pool_used();
+        if (used > s_stats.peak)
+            s_stats.peak = used;
+        return slot;
+    }
+
+    s_stats.refused++;
+    DBG("no slot for %d:%d, %d interfaces mounted\n", dev_addr, instance, HID_POOL_SLOTS);
+    return NULL;
+}
+
+// The device's last reports are already in the ring; Gone has to be
+// visible after them, core0 relies on it (hid_app_task)
+void hid_pool_unmount(uint8_t dev_addr, uint8_t instance)
+{
+    HidSlot* slot = hid_pool_find(dev_addr, instance);
+    if (!slot)
+        return;
+    __dmb();
+    slot->state = HidSlotGone;
+}
+
+// From the report callback, so in RAM
+HidSlot* __not_in_flash_func(hid_pool_find)(uint8_t dev_addr, uint8_t instance)
+{
+    for (uint i = 0; i < HID_POOL_SLOTS; i++) {
+        HidSlot* slot = &s_slots[i];
+        if (slot->state == HidSlotMounted && slot->dev_addr == dev_addr && slot->instance == instance)
+            return slot;
+    }
+    return NULL;
+}
+
+HidSlot* hid_pool_slot(uint index)
+{
+    return &s_slots[index];
+}
+
+uint32_t hid_pool_gone_mask()
+{
+    uint32_t mask = 0;
+    for (uint i = 0; i < HID_POOL_SLOTS; i++) {
+        if (s_slots[i].state == HidSlotGone)
+            mask |= 1u << i;
+    }
+    // and nothing read from the ring before this
+    __dmb();
+    return mask;
+}
+
+// Core1 may reuse the slot as soon as it sees it Free
+void hid_pool_reclaim(HidSlot* slot)
+{
+    __dmb();
+    slot->state = HidSlotFree;
+}
+
+// Reports per second for each interface, over the last second or so
+void hid_pool_rate_task()
+{
+    static uint32_t s_rate_at_us;
+    uint32_t now = time_us_32();
+    uint32_t elapsed = now - s_rate_at_us;
+    if (elapsed < 1000000)
+        return;
+    s_rate_at_us = now;
+
+    for (uint i = 0; i < HID_POOL_SLOTS; i++) {
+        HidSlot* slot = &s_slots[i];
+        if (slot->state != HidSlotMounted)
+            continue;
+        uint32_t reports = slot->reports;
+        slot->rate = (uint64_t) (reports - slot->rate_mark) * 1000000 / elapsed;
+        slot->rate_mark = reports;
+    }
+}
+
+void hid_pool_stats_reset()
+{
+    s_stats.peak = hid_pool_used();
+    s_stats.mounts = 0;
+    s_stats.refused = 0;
+}
+
+#if DEBUG
+
+void hid_pool_stats_print()
+{
+    console_printf("  hid slots %u/%d (peak %lu), %lu mounts, %lu refused, %u bytes of %d budget\n",
+        hid_pool_used(), HID_POOL_SLOTS, s_stats.peak, s_stats.mounts, s_stats.refused,
+        sizeof(s_slots) + HID_POOL_SLOTS * HID_POOL_TINYUSB_BYTES, HID_POOL_SRAM_BUDGET);
+
+    for (uint i = 0; i < HID_POOL_SLOTS; i++) {
+        const HidSlot* slot = &s_slots[i];
+        if (slot->state == HidSlotFree)
+            continue;
+        console_printf("    [%u] %d:%d %04x:%04x protocol %d, %d reports, quirks %x idle %d%s\n", i, slot->dev_addr,
+            slot->instance, slot->vid, slot->pid, slot->itf_protocol, slot->report_count, slot->quirks, slot->idle,
+            slot->state == HidSlotGone ? ", gone" : (slot->negotiate ? ", negotiating" : ""));
+        console_printf("        %u reports/s, %lu reports, %lu repeats dropped\n", slot->rate, slot->reports,
+            slot->repeats);
+    }
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef HID_POOL_H_
+#define HID_POOL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <tusb.h>
+#include "events.h"
+
+/*
+ * Per-interface state for mounted HID interfaces, one slot each.
+ *
+ * TinyUSB's instance numbers count the interfaces of one device, so two
+ * devices both have an instance 0; slots are keyed by device address and
+ * instance together. The pool matches TinyUSB's own (CFG_TUH_HID), so
+ * whatever TinyUSB mounts gets a slot.
+ *
+ * A slot goes Free -> Mounted in tuh_hid_mount_cb and Mounted -> Gone in
+ * tuh_hid_umount_cb, both on core1. Core0 owns the translation state, so
+ * it is core0 that releases whatever a Gone slot still held and makes it
+ * Free again, once the event queue has taken every release (it may take
+ * a few mainloop passes); until then core1 can't hand the slot to a new
+ * interface.
+ */
+
+#define HID_POOL_SLOTS CFG_TUH_HID
+// report descriptors with more top level collections than this (a combo
+// receiver has keyboard, mouse, consumer, system, vendor) only get the first
+#define HID_POOL_REPORTS 8
+
+// SRAM for up to HID_POOL_SLOTS interfaces: the slots plus TinyUSB's per
+// interface endpoint buffers. Checked at compile time in hid_pool.c.
+#define HID_POOL_SRAM_BUDGET (3 * 1024)
+
+typedef enum {
+    HidSlotFree = 0,
+    HidSlotMounted,
+    HidSlotGone,
+} HidSlotState;
+
+// Mount time requests still to make (hid_quirks.h), one control transfer
+// at a time, from the core1 host task. A request's bit is only cleared
+// when it completes.
+typedef enum {
+    HidNegotiateIdle = 1 << 0,
+    HidNegotiateProtocol = 1 << 1,
+    HidNegotiateArm = 1 << 2, // no transfer: start receiving reports
+} HidNegotiate;
+
+typedef struct {
+    volatile uint8_t state;
+    uint8_t index; // in the pool, for the report ring
+    uint8_t dev_addr;
+    uint8_t instance;
+    // the boot protocol translated (KEYBOARD, MOUSE), or NONE for the
+    // generic path; NONE too once switched to report protocol
+    uint8_t itf_protocol;
+    uint8_t report_count;
+    tuh_hid_report_info_t report_info[HID_POOL_REPORTS];
+
+    // core1, at mount
+    uint16_t vid, pid;
+    uint8_t quirks; // HidQuirkFlag
+    uint8_t idle;
+    uint8_t negotiate; // HidNegotiate still to do
+    uint8_t last_len;
+    uint8_t last[8]; // HidQuirkRepeatFilter: the previous report
+    uint32_t reports;
+    uint32_t repeats; // dropped by the filter
+    // the root port connect (or the mount, behind a hub)
+    uint32_t attach_us;
+    uint32_t ready_us; // attach to the endpoint being armed
+
+    // core0, once a second
+    uint32_t rate_mark;
+    uint16_t rate; // reports per second
+
+    // core0: what the interface holds down, and whether anything from it
+    // has reached the host yet
+    HidBootState boot;
+    bool forwarded;
+} HidSlot;
+
+_Static_assert(HID_POOL_SLOTS <= 32, "hid_pool_gone_mask has a bit per slot");
+
+// core1
+HidSlot* hid_pool_alloc(uint8_t dev_addr, uint8_t instance); // NULL if the pool is full
+void hid_pool_unmount(uint8_t dev_addr, uint8_t instance);
+HidSlot* hid_pool_find(uint8_t dev_addr, uint8_t instance); // mounted ones only
+
+// either core
+HidSlot* hid_pool_slot(uint index);
+
+// core0
+uint32_t hid_pool_gone_mask(); // bit per Gone slot
+void hid_pool_reclaim(HidSlot* slot);
+void hid_pool_rate_task();
+
+void hid_pool_stats_reset();
+void hid_pool_stats_print();
+
+#endif
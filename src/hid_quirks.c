@@ -0,0 +1,30 @@
+#include <pico/stdlib.h>
+#include <tusb.h>
+
+#include "hid_quirks.h"
+
+// Specific devices first, as
+//   { vid, pid, HID_ITF_PROTOCOL_*, flags, idle },
+// then the defaults by interface, and a last entry that matches anything.
+static const HidQuirk s_quirks[] = {
+    // Logitech M105: the boot report stops after X and Y, the report
+    // protocol one is the same layout with the wheel after them
+    { 0x046d, 0xc077, HID_ITF_PROTOCOL_MOUSE, HidQuirkReportProtocol, 0 },
+
+    // defaults
+    { HID_QUIRK_ANY, HID_QUIRK_ANY, HID_ITF_PROTOCOL_KEYBOARD, HidQuirkRepeatFilter, 0 },
+    { HID_QUIRK_ANY, HID_QUIRK_ANY, HID_ITF_PROTOCOL_NONE, 0, 0 },
+};
+
+const HidQuirk* hid_quirks_find(uint16_t vid, uint16_t pid, uint8_t itf_protocol)
+{
+    for (uint i = 0; i < count_of(s_quirks); i++) {
+        const HidQuirk* q = &s_quirks[i];
+        if (q->vid != HID_QUIRK_ANY && (q->vid != vid || q->pid != pid))
+            continue;
+        if (q->itf_protocol != HID_ITF_PROTOCOL_NONE && q->itf_protocol != itf_protocol)
+            continue;
+        return q;
+    }
+    return &s_quirks[count_of(s_quirks) - 1];
+}
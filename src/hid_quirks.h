@@ -0,0 +1,43 @@
+#ifndef HID_QUIRKS_H_
+#define HID_QUIRKS_H_
+
+#include <stdint.h>
+
+/*
+ * What to do with a HID interface at mount, by VID/PID, then by interface
+ * protocol. TinyUSB has already sent SET_IDLE(0) and, for boot interfaces,
+ * SET_PROTOCOL(boot) during enumeration. An entry only adds requests where
+ * a device needs something else, so a device without one is mounted with
+ * no extra control transfers. hid_app.c makes the requests one at a time
+ * and arms the interrupt endpoint once they have all completed.
+ */
+
+typedef enum {
+    // switch to report protocol. Only for devices whose keyboard or mouse
+    // report, after the report id, starts with the boot fields.
+    HidQuirkReportProtocol = 1 << 0,
+    // send SET_IDLE(idle) again, for devices that ignored the one sent at
+    // enumeration or want a different rate
+    HidQuirkSetIdle = 1 << 1,
+    // drop reports identical to the previous one on core1, for keyboards
+    // that resend their state every few ms regardless of the idle rate.
+    // Never for mice, a repeated mouse report is more motion.
+    HidQuirkRepeatFilter = 1 << 2,
+    // no LED output reports (kbd_leds.c), for keyboards that stall them
+    HidQuirkNoLeds = 1 << 3,
+} HidQuirkFlag;
+
+#define HID_QUIRK_ANY 0
+
+typedef struct {
+    uint16_t vid; // HID_QUIRK_ANY matches every device
+    uint16_t pid;
+    uint8_t itf_protocol; // HID_ITF_PROTOCOL_*, NONE matches every interface
+    uint8_t flags;
+    uint8_t idle; // HidQuirkSetIdle: 4 ms units, 0 reports on change only
+} HidQuirk;
+
+// The first entry that matches; there is always one
+const HidQuirk* hid_quirks_find(uint16_t vid, uint16_t pid, uint8_t itf_protocol);
+
+#endif
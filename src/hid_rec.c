@@ -0,0 +1,204 @@
+#include <pico/stdlib.h>
+#include <pico/multicore.h>
+#include <hardware/flash.h>
+#include <hardware/sync.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEBUG_TAG "rec"
+#include "babelfish.h"
+#include "console.h"
+#include "hid_rec.h"
+
+#define REC_RING_SIZE (16 * 1024) // power of two
+
+// flash copy: one sector of header, then the ring contents, oldest first
+#define REC_FLASH_SIZE (REC_RING_SIZE + FLASH_SECTOR_SIZE)
+_Static_assert(REC_FLASH_SIZE == HID_REC_FLASH_SIZE, "hid_rec.h has the size for the flash layout");
+#define REC_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - REC_FLASH_SIZE)
+#define REC_FLASH_MAGIC 0x43524642 // 'BFRC'
+#define REC_FLASH_VERSION 1
+
+typedef struct __attribute__((packed)) {
+    uint32_t stamp_us;
+    uint8_t dev_addr;
+    uint8_t instance;
+    uint8_t len;
+} RecHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t length;
+    uint32_t records;
+} RecFlashHeader;
+
+static uint8_t s_ring[REC_RING_SIZE];
+static uint32_t s_head = 0;
+static uint32_t s_tail = 0;
+static uint32_t s_records = 0;
+static uint32_t s_overwritten = 0;
+static bool s_enabled = true;
+
+static void ring_read(uint32_t pos, void* dst, uint32_t len)
+{
+    uint8_t* d = dst;
+    for (uint32_t i = 0; i < len; i++)
+        d[i] = s_ring[(pos + i) & (REC_RING_SIZE - 1)];
+}
+
+static void ring_write(uint32_t pos, const void* src, uint32_t len)
+{
+    const uint8_t* s = src;
+    uint32_t off = pos & (REC_RING_SIZE - 1);
+    uint32_t n = len;
+    if (n > REC_RING_SIZE - off)
+        n = REC_RING_SIZE - off;
+    memcpy(&s_ring[off], s, n);
+    memcpy(s_ring, s + n, len - n);
+}
+
+void hid_rec_record(const HidReportSlot* slot)
+{
+    if (!s_enabled)
+        return;
+
+    RecHeader hdr = {
+        .stamp_us = slot->stamp_us,
+        .dev_addr = slot->dev_addr,
+        .instance = slot->instance,
+        .len = slot->len,
+    };
+    uint32_t size = sizeof(hdr) + hdr.len;
+
+    // make room by dropping the oldest records
+    while (REC_RING_SIZE - (s_head - s_tail) < size) {
+        RecHeader old;
+        ring_read(s_tail, &old, sizeof(old));
+        s_tail += sizeof(old) + old.len;
+        s_records--;
+        s_overwritten++;
+    }
+
+    ring_write(s_head, &hdr, sizeof(hdr));
+    ring_write(s_head + sizeof(hdr), slot->data, hdr.len);
+    s_head += size;
+    s_records++;
+}
+
+#if DEBUG
+
+static void rec_dump()
+{
+    console_printf("%s\n", HID_REC_TRACE_HEADER);
+    console_printf("# t_us dev_addr instance len data...\n");
+
+    for (uint32_t pos = s_tail; pos != s_head; ) {
+        RecHeader hdr;
+        uint8_t data[CFG_TUH_HID_EPIN_BUFSIZE];
+        ring_read(pos, &hdr, sizeof(hdr));
+        ring_read(pos + sizeof(hdr), data, hdr.len);
+        pos += sizeof(hdr) + hdr.len;
+
+        console_printf("%lu %u %u %u", hdr.stamp_us, hdr.dev_addr, hdr.instance, hdr.len);
+        // a few bytes at a time, console_printf's buffer won't hold a 64 byte report
+        for (int i = 0; i < hdr.len; i += 16) {
+            char hex[3 * 16 + 1];
+            int n = 0;
+            for (int j = i; j < hdr.len && j < i + 16; j++)
+                n += snprintf(hex + n, sizeof(hex) - n, " %02x", data[j]);
+            console_printf("%s", hex);
+        }
+        console_printf("\n");
+    }
+
+    console_printf("# end\n");
+}
+
+// Write the ring to flash. Core1 is parked in RAM while the flash is busy,
+// so PIO-USB misses a few frames.
+static void rec_flush()
+{
+    static uint8_t page[FLASH_PAGE_SIZE];
+
+    RecFlashHeader fh = {
+        .magic = REC_FLASH_MAGIC,
+        .version = REC_FLASH_VERSION,
+        .length = s_head - s_tail,
+        .records = s_records,
+    };
+
+    multicore_lockout_start_blocking();
+    uint32_t irq = save_and_disable_interrupts();
+
+    flash_range_erase(REC_FLASH_OFFSET, REC_FLASH_SIZE);
+
+    memset(page, 0xff, sizeof(page));
+    memcpy(page, &fh, sizeof(fh));
+    flash_range_program(REC_FLASH_OFFSET, page, FLASH_PAGE_SIZE);
+
+    for (uint32_t off = 0; off < fh.length; off += FLASH_PAGE_SIZE) {
+        uint32_t n = fh.length - off;
+        if (n > FLASH_PAGE_SIZE)
+            n = FLASH_PAGE_SIZE;
+        memset(page, 0xff, sizeof(page));
+        ring_read(s_tail + off, page, n);
+        flash_range_program(REC_FLASH_OFFSET + FLASH_SECTOR_SIZE + off, page, FLASH_PAGE_SIZE);
+    }
+
+    restore_interrupts(irq);
+    multicore_lockout_end_blocking();
+
+    console_printf("rec: %lu records, %lu bytes saved to flash\n", fh.records, fh.length);
+}
+
+// Replace the RAM ring with what was last flushed to flash
+static void rec_load()
+{
+    const uint8_t* base = (const uint8_t*) (XIP_BASE + REC_FLASH_OFFSET);
+    const RecFlashHeader* fh = (const RecFlashHeader*) base;
+
+    if (fh->magic != REC_FLASH_MAGIC || fh->version != REC_FLASH_VERSION || fh->length > REC_RING_SIZE) {
+        console_printf("rec: nothing saved in flash\n");
+        return;
+    }
+
+    memcpy(s_ring, base + FLASH_SECTOR_SIZE, fh->length);
+    s_tail = 0;
+    s_head = fh->length;
+    s_records = fh->records;
+    s_overwritten = 0;
+
+    console_printf("rec: %lu records loaded from flash\n", s_records);
+}
+
+/*
+ * rec [on|off|clear|dump|flush|load]
+ */
+void rec_console_cmd(int argc, char** argv)
+{
+    const char* sub = argc >= 2 ? argv[1] : "";
+
+    if (strcmp(sub, "on") == 0) {
+        s_enabled = true;
+    } else if (strcmp(sub, "off") == 0) {
+        s_enabled = false;
+    } else if (strcmp(sub, "clear") == 0) {
+        s_head = s_tail = 0;
+        s_records = s_overwritten = 0;
+    } else if (strcmp(sub, "dump") == 0) {
+        rec_dump();
+        return;
+    } else if (strcmp(sub, "flush") == 0) {
+        rec_flush();
+        return;
+    } else if (strcmp(sub, "load") == 0) {
+        rec_load();
+        return;
+    }
+
+    console_printf("rec %s: %lu records, %lu/%d bytes, %lu overwritten\n",
+        s_enabled ? "on" : "off", s_records, s_head - s_tail, REC_RING_SIZE, s_overwritten);
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef HID_REC_H_
+#define HID_REC_H_
+
+#include <stdint.h>
+#include "hid_ring.h"
+
+/*
+ * Raw HID report recorder, for capturing what a misbehaving keyboard or
+ * mouse actually sends.
+ *
+ * Reports are recorded on core0 as they come out of the HID report ring, with
+ * the timestamp core1 took when the report arrived, so recording costs core1
+ * nothing. The recorder keeps the most recent reports in a RAM ring; 'rec
+ * flush' saves the ring to the end of flash so it survives a reset, and 'rec
+ * dump' prints it over the debug CDC as a trace file:
+ *
+ *   # babelfish hid trace v1
+ *   # t_us dev_addr instance len data...
+ *   12345678 1 0 8 02 00 04 00 00 00 00 00
+ *   ...
+ *   # end
+ *
+ * Lines starting with '#' are comments. tools/hid_trace.py saves a dump to a
+ * file.
+ */
+
+#define HID_REC_TRACE_HEADER "# babelfish hid trace v1"
+
+// what 'rec flush' takes at the end of flash; keymap.c's slots sit below it
+#define HID_REC_FLASH_SIZE (16 * 1024 + 4096)
+
+void hid_rec_record(const HidReportSlot* slot);
+
+#endif
@@ -0,0 +1,93 @@
+#include <pico/stdlib.h>
+#include <hardware/sync.h>
+#include <hardware/clocks.h>
+#include <string.h>
+
+#define DEBUG_TAG "hidring"
+#include "babelfish.h"
+#include "console.h"
+#include "hid_ring.h"
+
+#define SLOT_MASK (HID_RING_SLOTS - 1)
+
+static HidReportSlot s_slots[HID_RING_SLOTS];
+// head is only written by core1, tail only by core0
+static volatile uint32_t s_head = 0;
+static volatile uint32_t s_tail = 0;
+
+HidRingStats hid_ring_stats;
+// reset requests from core0, and the last one core1 carried out
+static volatile uint32_t s_core1_reset_requested;
+static uint32_t s_core1_reset_done;
+
+HidReportSlot* __not_in_flash_func(hid_ring_acquire)()
+{
+    uint32_t depth = s_head - s_tail;
+    if (depth == HID_RING_SLOTS) {
+        hid_ring_stats.core1.dropped++;
+        return NULL;
+    }
+
+    if (depth + 1 > hid_ring_stats.core1.max_depth)
+        hid_ring_stats.core1.max_depth = depth + 1;
+
+    return &s_slots[s_head & SLOT_MASK];
+}
+
+void __not_in_flash_func(hid_ring_commit)()
+{
+    hid_ring_stats.core1.reports++;
+    // slot contents must be visible before core0 sees the new head
+    __dmb();
+    s_head = s_head + 1;
+}
+
+HidReportSlot* hid_ring_peek()
+{
+    if (s_tail == s_head)
+        return NULL;
+
+    // don't read the slot before we've seen the head that published it
+    __dmb();
+    return &s_slots[s_tail & SLOT_MASK];
+}
+
+void hid_ring_release()
+{
+    // done with the slot before core1 can reuse it
+    __dmb();
+    s_tail = s_tail + 1;
+}
+
+void hid_ring_stats_reset()
+{
+    memset(&hid_ring_stats.core0, 0, sizeof(hid_ring_stats.core0));
+    s_core1_reset_requested = s_core1_reset_requested + 1;
+}
+
+void hid_ring_stats_core1_task()
+{
+    uint32_t requested = s_core1_reset_requested;
+    if (requested == s_core1_reset_done)
+        return;
+    memset(&hid_ring_stats.core1, 0, sizeof(hid_ring_stats.core1));
+    s_core1_reset_done = requested;
+}
+
+#if DEBUG
+
+void hid_ring_stats_print()
+{
+    HidRingStats* s = &hid_ring_stats;
+    uint32_t mhz = clock_get_hz(clk_sys) / 1000000;
+
+    console_printf("  reports %lu dropped %lu max depth %lu/%d\n",
+        s->core1.reports, s->core1.dropped, s->core1.max_depth, HID_RING_SLOTS);
+    // per-report costs in cycles, they are only a few microseconds
+    console_printf("  core1 rearm avg %lu max %lu cycles, tuh_task max %lu us\n",
+        s->core1.rearm_count ? (uint32_t) (s->core1.rearm_total_cycles / s->core1.rearm_count) : 0,
+        s->core1.rearm_max_cycles, s->core1.task_max_cycles / mhz);
+    console_printf("  core0 translate max %lu cycles\n", s->core0.translate_max_cycles);
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef HID_RING_H_
+#define HID_RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <tusb.h>
+
+/*
+ * Raw HID reports, handed from core1 (PIO-USB host) to core0.
+ *
+ * Core1 copies each report into a fixed slot straight out of the report
+ * callback and re-arms the endpoint; all diffing and translation happens on
+ * core0, in place in the slot. A slot belongs to core1 until it's committed
+ * and to core0 until it's released, so neither side ever takes a lock.
+ */
+
+#define HID_RING_SLOTS 16 // power of two
+
+typedef struct {
+    uint8_t dev_addr;
+    uint8_t instance;
+    uint8_t itf_protocol;
+    uint8_t len;
+    uint8_t pool_slot; // hid_pool.h
+    uint32_t stamp_us;
+    uint8_t data[CFG_TUH_HID_EPIN_BUFSIZE];
+} HidReportSlot;
+
+// Each half is only ever written by its own core, resets included
+typedef struct {
+    struct {
+        uint32_t reports;
+        uint32_t dropped; // ring full
+        uint32_t max_depth;
+
+        // report callback entry to tuh_hid_receive_report() returning
+        uint32_t rearm_count;
+        uint64_t rearm_total_cycles;
+        uint32_t rearm_max_cycles;
+        // longest single tuh_task() call
+        uint32_t task_max_cycles;
+    } core1;
+
+    struct {
+        // translating one report
+        uint32_t translate_max_cycles;
+    } core0;
+} HidRingStats;
+
+extern HidRingStats hid_ring_stats;
+
+// core1 side
+HidReportSlot* hid_ring_acquire();
+void hid_ring_commit();
+
+// core0 side
+HidReportSlot* hid_ring_peek();
+void hid_ring_release();
+
+// Clears the core0 half now and the core1 half at core1's next
+// hid_ring_stats_core1_task()
+void hid_ring_stats_reset();
+void hid_ring_stats_core1_task();
+void hid_ring_stats_print();
+
+#endif
@@ -7,6 +7,9 @@ typedef enum {
     // Don't call kbd/mouse event functions,
     // the host will do its own pumping
     HostFlagDontPumpEvents = 1 << 0,
+    // Reverse mode: the host reads a retro keyboard/mouse on the channels
+    // and the native USB port enumerates as a HID keyboard and mouse
+    HostFlagUsbHidDevice = 1 << 1,
 } HostFlags;
 
 typedef struct {
@@ -17,6 +20,7 @@ typedef struct {
     void (*mouse_event)(const MouseEvent events);
 
     const char* notes;
+    uint32_t flags; // HostFlags
 } HostDevice;
 
 extern HostDevice hosts[];
@@ -30,13 +34,47 @@ extern void NAME##_update(); \
 extern void NAME##_kbd_event(const KeyboardEvent event); \
 extern void NAME##_mouse_event(const MouseEvent event);
 
-#define HOST_ENTRY(NAME, notes)  { \
+#define HOST_ENTRY_FLAGS(NAME, notes, flags)  { \
     #NAME, \
     NAME##_init, \
     NAME##_update, \
     NAME##_kbd_event, \
     NAME##_mouse_event, \
-    notes \
+    notes, \
+    flags \
 }
 
+#define HOST_ENTRY(NAME, notes) HOST_ENTRY_FLAGS(NAME, notes, 0)
+
+/*
+ * Single-host builds (-DBABELFISH_SINGLE_HOST=apollo, see CMakeLists.txt) only
+ * link one host, and the mainloop calls it directly instead of through the
+ * HostDevice function pointers, so the compiler can inline the hot path
+ * ('dispatchbench', docs/measurements.md).
+ * The hosts[] table still exists (with just the one entry) for cmd.c and the
+ * console.
+ */
+#ifndef BABELFISH_SINGLE_HOST
+#define BABELFISH_HOST_ALL 1
+#else
+#define BABELFISH_HOST_ALL 0
+#endif
+
+#if BABELFISH_HOST_ALL
+#define HOST_INIT()           host->init()
+#define HOST_UPDATE()         host->update()
+#define HOST_KBD_EVENT(ev)    host->kbd_event(ev)
+#define HOST_MOUSE_EVENT(ev)  host->mouse_event(ev)
+#else
+#define HOST_FN_(NAME, fn)    NAME##_##fn
+#define HOST_FN(NAME, fn)     HOST_FN_(NAME, fn)
+#define HOST_PROTOTYPES_X(NAME) HOST_PROTOTYPES(NAME)
+HOST_PROTOTYPES_X(BABELFISH_SINGLE_HOST)
+
+#define HOST_INIT()           HOST_FN(BABELFISH_SINGLE_HOST, init)()
+#define HOST_UPDATE()         HOST_FN(BABELFISH_SINGLE_HOST, update)()
+#define HOST_KBD_EVENT(ev)    HOST_FN(BABELFISH_SINGLE_HOST, kbd_event)(ev)
+#define HOST_MOUSE_EVENT(ev)  HOST_FN(BABELFISH_SINGLE_HOST, mouse_event)(ev)
+#endif
+
 #endif
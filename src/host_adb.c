@@ -5,8 +5,13 @@
 
 #define DEBUG_TAG "adb"
 #include "babelfish.h"
+#include "gpio_irq.h"
+#include "isr_stats.h"
+#include "kbd_leds.h"
 
-#define CHK(cond, ...) if (!(cond)) { DBG(__VA_ARGS__); }
+DBG_MODULE();
+
+#define CHK(cond, ...) if (!(cond)) { DBG_ISR(__VA_ARGS__); }
 #else
 #include <stdint.h>
 #include <stdbool.h>
@@ -14,12 +19,18 @@
 #include <stdlib.h>
 #include <string.h>
 
-uint64_t time_us_64();
+uint32_t time_us_32();
 int gpio_get(int);
 #define DBG printf
+#define DBG_ISR printf
+#define DBG_ISR_V printf
+#define DBG_ISR_VVV(...) do { } while (0)
 #define GPIO_IRQ_EDGE_RISE (1<<1)
 #define GPIO_IRQ_EDGE_FALL (1<<2)
 #define CHK(cond, ...) if (!(cond)) { printf(__VA_ARGS__); }
+#define __not_in_flash_func(f) f
+#define __no_inline_not_in_flash_func(f) f
+#define kbd_leds_set(leds) do { } while (0)
 #endif
 
 #define TIME_MIN(x) ((uint32_t)((x) * 0.7))
@@ -54,6 +65,8 @@ int gpio_get(int);
 #define CMD_LISTEN 2
 #define CMD_TALK 3
 
+#define ADB_ADDR_KEYBOARD 2
+
 const char* CMD_NAMES[] = {
     "Reset",
     "Flush",
@@ -119,8 +132,9 @@ static uint16_t s_adb_kbd_regs[4] = { 0 };
 #define INTERRUPTS_ON()  do { gpio_set_irq_enabled(ADB_GPIO, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true); } while (0)
 #define INTERRUPTS_OFF() do { gpio_set_irq_enabled(ADB_GPIO, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, false); } while (0)
 
-static uint64_t last_transition_us = 0;
-static uint64_t since_last_us = 0;
+// time_us_32 rather than _64: the SDK's time_us_64 is in flash
+static uint32_t last_transition_us = 0;
+static uint32_t since_last_us = 0;
 static bool last_was_rise = false;
 
 static AdbState in_state = Unknown;
@@ -135,6 +149,7 @@ static uint16_t data_value = 0;
 
 #if !defined(TESTBENCH)
 static void adb_isr(unsigned int, long unsigned int);
+static void adb_gpio_irq();
 #endif
 
 static int ADB_GPIO = 0;
@@ -154,12 +169,17 @@ void adb_init() {
     // bus high (or untouched) and configure as an output (with out = 0) when we want to drive it
     // low.
     //gpio_set_dir(ADB_GPIO, GPIO_INOUT);
-    gpio_set_irq_enabled_with_callback(ADB_GPIO, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true, &adb_isr);
+
+    // A raw handler rather than gpio_set_irq_enabled_with_callback: there is only
+    // one callback per core, and the USB power status IRQ already owns it.
+    gpio_add_raw_irq_handler_with_order_priority(ADB_GPIO, adb_gpio_irq, PICO_SHARED_IRQ_HANDLER_HIGHEST_ORDER_PRIORITY);
+    gpio_set_irq_enabled(ADB_GPIO, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
+    irq_set_enabled(IO_IRQ_BANK0, true);
 #endif
 }
 
 void adb_update() {
-    uint64_t cur_time = time_us_64();
+    uint32_t cur_time = time_us_32();
     if (cur_time - last_transition_us > 1000) {
         // we haven't seen a transition in a while; reset state
         in_state = Idle;
@@ -178,12 +198,12 @@ uint8_t cmd_addr = 0;
 uint8_t cmd_cmd = 0;
 uint8_t cmd_reg = 0;
 
-void handle_command(uint8_t command_byte) {
+void __not_in_flash_func(handle_command)(uint8_t command_byte) {
     cmd_addr = (command_byte >> 4) & 0xf;
     cmd_cmd = (command_byte >> 2) & 3;
     cmd_reg = command_byte & 3;
 
-    DBG("==> %s($%x, r%d)\n", CMD_NAMES[cmd_cmd], cmd_addr, cmd_reg);
+    DBG_ISR_V("==> %s($%x, r%d)\n", (uintptr_t) CMD_NAMES[cmd_cmd], cmd_addr, cmd_reg);
     if (cmd_cmd == CMD_RESET) {
     } else if (cmd_cmd == CMD_FLUSH) {
     } else if (cmd_cmd == CMD_LISTEN) {
@@ -195,9 +215,10 @@ void handle_command(uint8_t command_byte) {
     }
 }
 
-void handle_data(uint16_t data) {
+void __not_in_flash_func(handle_data)(uint16_t data) {
     bool is_command = cmd_cmd == CMD_LISTEN;
-    DBG("====> %s data: 0x%04x (probably %s $%x)\n", is_command ? "command" : "reply", data, is_command ? "to" : "from", cmd_addr);
+    DBG_ISR_V("====> %s data: 0x%04x (probably %s $%x)\n", (uintptr_t) (is_command ? "command" : "reply"), data,
+        (uintptr_t) (is_command ? "to" : "from"), cmd_addr);
     if (cmd_cmd == CMD_LISTEN && cmd_reg == 3) {
         uint8_t addr = (data >> 8) & 0xf;
         uint8_t handler = data & 0xff;
@@ -205,48 +226,55 @@ void handle_data(uint16_t data) {
         uint8_t exc = (data >> 14) & 1;
         //DBG("device config register: foo: %x handler %d, addr %x, srq %d, exc %d\n", (data >> 8) & 0xf, handler, addr, srq_en, exc);
         if (addr != cmd_addr) {
-            DBG("device address change: $%x => $%x\n", cmd_addr, addr);
+            DBG_ISR("device address change: $%x => $%x\n", cmd_addr, addr);
         }
+    } else if (cmd_cmd == CMD_LISTEN && cmd_reg == 2 && cmd_addr == ADB_ADDR_KEYBOARD) {
+        // keyboard register 2: the LEDs are the low 3 bits, active low,
+        // num, caps, scroll from bit 0
+        kbd_leds_set(((data & 1) ? 0 : KEYBOARD_LED_NUMLOCK) | ((data & 2) ? 0 : KEYBOARD_LED_CAPSLOCK) |
+                     ((data & 4) ? 0 : KEYBOARD_LED_SCROLLLOCK));
     }
 }
 
 // we're going to be generous and give ourselves 30% tolerance; we'll also
 // expect the compiler to turn these into integer constants
 
-#define CHK_GPIO_LOW() CHK(!gpio_get(ADB_GPIO), "Expected gpio LOW, state: %s\n", STATE_NAMES[in_state])
-#define CHK_GPIO_HIGH() CHK(gpio_get(ADB_GPIO), "Expected gpio HIGH, state: %s\n", STATE_NAMES[in_state])
-#define CHK_RISE() CHK(is_rise, "Expected rise, state: %s\n", STATE_NAMES[in_state])
-#define CHK_FALL() CHK(!is_rise, "Expected FALL, state: %s\n", STATE_NAMES[in_state])
+#define CHK_GPIO_LOW() CHK(!gpio_get(ADB_GPIO), "Expected gpio LOW, state: %s\n", (uintptr_t) STATE_NAMES[in_state])
+#define CHK_GPIO_HIGH() CHK(gpio_get(ADB_GPIO), "Expected gpio HIGH, state: %s\n", (uintptr_t) STATE_NAMES[in_state])
+#define CHK_RISE() CHK(is_rise, "Expected rise, state: %s\n", (uintptr_t) STATE_NAMES[in_state])
+#define CHK_FALL() CHK(!is_rise, "Expected FALL, state: %s\n", (uintptr_t) STATE_NAMES[in_state])
 
-void expect_is_fall_after(bool is_rise, uint32_t time) {
+void __not_in_flash_func(expect_is_fall_after)(bool is_rise, uint32_t time) {
     CHK_GPIO_LOW();
     CHK_FALL();
     if (since_last_us < TIME_MIN(time) || since_last_us > TIME_MAX(time))
-        DBG("[%llu] expected fall after ~%d us, got %llu us, state: %d\n", time_us_64(), time, since_last_us, in_state);
+        DBG_ISR("[%lu] expected fall after ~%lu us, got %lu us, state: %d\n", time_us_32(), time, since_last_us, in_state);
 }
 
-void expect_is_rise_after(bool is_rise, uint32_t time) {
+void __not_in_flash_func(expect_is_rise_after)(bool is_rise, uint32_t time) {
     CHK_GPIO_HIGH();
     CHK_RISE();
     if (since_last_us < TIME_MIN(time) || since_last_us > TIME_MAX(time))
-        DBG("[%llu] expected rise after ~%d us, got %llu us, state: %d\n", time_us_64(), time, since_last_us, in_state);
+        DBG_ISR("[%lu] expected rise after ~%lu us, got %lu us, state: %d\n", time_us_32(), time, since_last_us, in_state);
 }
 
-void expect_is_fall_after_min(bool is_rise, uint32_t time) {
+void __not_in_flash_func(expect_is_fall_after_min)(bool is_rise, uint32_t time) {
     CHK_GPIO_LOW();
     CHK_FALL();
     if (since_last_us < TIME_MIN(time))
-        DBG("[%llu] expected fall after >%d us, got %llu us, state: %d\n", time_us_64(), time, since_last_us, in_state);
+        DBG_ISR("[%lu] expected fall after >%lu us, got %lu us, state: %d\n", time_us_32(), time, since_last_us, in_state);
 }
 
-void expect_is_rise_after_min(bool is_rise, uint32_t time) {
+void __not_in_flash_func(expect_is_rise_after_min)(bool is_rise, uint32_t time) {
     CHK_GPIO_HIGH();
     CHK_RISE();
     if (since_last_us < TIME_MIN(time))
-        DBG("[%llu] expected rise after >%d us, got %llu us, state: %d\n", time_us_64(), time, since_last_us, in_state);
+        DBG_ISR("[%lu] expected rise after >%lu us, got %lu us, state: %d\n", time_us_32(), time, since_last_us, in_state);
 }
 
-void adb_state_machine(uint64_t cur_time, bool is_rise) {
+// The ISR path runs from RAM: ADB host timing is +/- 3%, and an XIP cache
+// miss on the way in can cost microseconds.
+void __no_inline_not_in_flash_func(adb_state_machine)(uint32_t cur_time, bool is_rise) {
     AdbState last_state = in_state;
     switch (in_state) {
     case Unknown:
@@ -301,7 +329,7 @@ void adb_state_machine(uint64_t cur_time, bool is_rise) {
 
     case ListenDataLo:
         if (!gpio_get(ADB_GPIO) || !is_rise) {
-            DBG("expected high (%d) + rise irq (%d), state: %d\n", gpio_get(ADB_GPIO), is_rise, in_state);
+            DBG_ISR("expected high (%d) + rise irq (%d), state: %d\n", gpio_get(ADB_GPIO), is_rise, in_state);
             in_state = Idle;
             return;
         }
@@ -335,7 +363,7 @@ void adb_state_machine(uint64_t cur_time, bool is_rise) {
         // if we saw Srq or not. We don't do anything to process Srq -- it's
         // something for the host to handle.
         if (since_last_us > SRQ_TIME_US) {
-            DBG("saw SRQ");
+            DBG_ISR("saw SRQ\n");
         }
 
         // After the stop bit, we have a rise transition. The high period is
@@ -349,7 +377,7 @@ void adb_state_machine(uint64_t cur_time, bool is_rise) {
             handle_data(data_value);
             in_state = Idle;
         } else {
-            DBG("unexpected data_next_state: %s\n", STATE_NAMES[data_next_state]);
+            DBG_ISR("unexpected data_next_state: %s\n", (uintptr_t) STATE_NAMES[data_next_state]);
         }
 
         data_next_state = Unknown;
@@ -358,20 +386,22 @@ void adb_state_machine(uint64_t cur_time, bool is_rise) {
 
     if (last_state != in_state)
     {
-        //DBG("[%12llu][%s] state: %s -> %s\n", time_us_64(), is_rise ? "rise" : "FALL", STATE_NAMES[last_state], STATE_NAMES[in_state]);
+        DBG_ISR_VVV("[%10lu][%s] state: %s -> %s\n", cur_time, (uintptr_t) (is_rise ? "rise" : "FALL"),
+            (uintptr_t) STATE_NAMES[last_state], (uintptr_t) STATE_NAMES[in_state]);
     }
 }
 
-void adb_isr(unsigned int gpio, long unsigned int events) {
-    uint64_t cur_time = time_us_64();
+void __no_inline_not_in_flash_func(adb_isr)(unsigned int gpio, long unsigned int events) {
+#if !defined(TESTBENCH)
+    ISR_STAT_BEGIN();
+#endif
+    uint32_t cur_time = time_us_32();
     bool is_rise = events & GPIO_IRQ_EDGE_RISE;
     bool is_fall = events & GPIO_IRQ_EDGE_FALL;
 
     if (is_rise && is_fall)
     {
-        DBG("######################\n");
-        DBG("Missed events, got both rise and fall!\n");
-        DBG("######################\n");
+        DBG_ISR("Missed events, got both rise and fall!\n");
     }
 
     since_last_us = cur_time - last_transition_us;
@@ -382,5 +412,18 @@ void adb_isr(unsigned int gpio, long unsigned int events) {
     last_transition_us = cur_time;
     last_was_rise = is_rise;
 
-    // note: gpio_acknowledge_irq is called automatically
+    // note: the IRQ was already acknowledged by adb_gpio_irq
+#if !defined(TESTBENCH)
+    ISR_STAT_END(IsrStatAdb);
+#endif
+}
+
+#if !defined(TESTBENCH)
+void __not_in_flash_func(adb_gpio_irq)() {
+    uint32_t events = gpio_get_irq_event_mask(ADB_GPIO);
+    if (events & (GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL)) {
+        gpio_irq_acknowledge(ADB_GPIO, events);
+        adb_isr(ADB_GPIO, events);
+    }
 }
+#endif
@@ -9,6 +9,10 @@
 #define DEBUG_TAG "apollo"
 
 #include "babelfish.h"
+#include "isr_stats.h"
+#include "keymap.h"
+
+DBG_MODULE();
 
 /**********************
 
@@ -35,6 +39,7 @@ typedef enum {
 static void kbd_xmit_3(char a, char b, char c);
 static void on_keyboard_rx();
 static void set_mode(KeyboardMode mode);
+static void apollo_keymap_init();
 
 void apollo_init() {
 	// Apollo expects 5V serial, not RS-232 voltages.
@@ -49,6 +54,8 @@ void apollo_init() {
 
 	uart_set_irq_enables(UART_KEYBOARD, true, false);
 
+	apollo_keymap_init();
+
 	//sleep_ms(10);
 
 	// say hello or something?
@@ -85,54 +92,64 @@ static KeyboardMode kbd_mode = Mode0_Compatibility;
 // [2] = 0 or gui
 // [256] = hid code
 // [State] = KeyState
-static uint16_t s_code_table[2][256][StateMax];
+static uint16_t __not_in_flash("keymap") s_code_table[2][256][StateMax];
+
+// s_code_table, or a replacement uploaded over the USB link (keymap.c)
+static const void* volatile s_codes = s_code_table;
+_Static_assert(sizeof(s_code_table) == KEYMAP_MAX_LENGTH, "keymap.h sizes its flash slots for this table");
+
+// layer is gui
+static inline uint16_t apollo_keymap_lookup(const void* table, uint8_t layer, uint16_t keycode, uint8_t state) {
+	const uint16_t (*codes)[256][StateMax] = table;
+	return codes[layer][keycode][state];
+}
+
+static void apollo_keymap_init() {
+	keymap_register(KeymapKindApollo, s_code_table, sizeof(s_code_table), &s_codes,
+		apollo_keymap_lookup, 2, StateMax);
+}
 
-static void kbd_xmit_uart(char c) {
+// kbd_xmit* and the mode switches are called from the RX ISR or for every key, so
+// they live in RAM too
+static void __not_in_flash_func(kbd_xmit_uart)(char c) {
 	uart_putc_raw(UART_KEYBOARD, c);
 }
 
-static void kbd_xmit_key(char c) {
-	DBG_VV("xmit for key %02x\n", c);
+static void __no_inline_not_in_flash_func(kbd_xmit_key)(char c) {
+	DBG_ISR_VV("xmit for key %02x\n", c);
 	kbd_xmit_uart(c);
 }
 
-static void kbd_xmit(char c) {
-	DBG_VV("xmit %02x\n", c);
+static void __not_in_flash_func(kbd_xmit)(char c) {
+	DBG_ISR_VV("xmit %02x\n", c);
 	kbd_xmit_uart(c);
 }
 
-static void kbd_tx_str(const char *str) {
-	DBG_VV("xmit str '%s'\n", str);
+static void __not_in_flash_func(kbd_tx_str)(const char *str) {
+	DBG_ISR_VV("xmit str '%s'\n", (uintptr_t) str);
 	while (*str) {
 		kbd_xmit_uart(*str++);
-		// slow this down, unclear if the OS can actually handle a true 1200 baud stream
-		busy_wait_ms(1);
+		// slow this down, unclear if the OS can actually handle a true 1200 baud stream;
+		// time_us_32 is inline, busy_wait_ms would be a call into flash
+		uint32_t start = time_us_32();
+		while (time_us_32() - start < 1000)
+			tight_loop_contents();
 	}
 }
 
-// these are just convenience for logging to avoid spamming
-static void kbd_xmit_2(char a, char b) {
-	DBG_VV("xmit %02x %02x\n", a, b);
-	kbd_xmit_uart(a); kbd_xmit_uart(b);
-}
-
+// just convenience for logging to avoid spamming
 /*static*/ void kbd_xmit_3(char a, char b, char c) {
 	DBG_VV("xmit %02x %02x %02x\n", a, b, c);
 	kbd_xmit_uart(a); kbd_xmit_uart(b); kbd_xmit_uart(c);
 }
 
-static void kbd_xmit_4(char a, char b, char c, char d) {
-	DBG_VV("xmit %02x %02x %02x %02x\n", a, b, c, d);
-	kbd_xmit_uart(a); kbd_xmit_uart(b); kbd_xmit_uart(c); kbd_xmit_uart(d);
-}
-
 void force_set_mode(KeyboardMode mode) {
 	DBG("Setting keyboard mode to %d (no xmit)\n", mode);
 	kbd_mode = mode;
 }
 
-static void force_mode_xmit(KeyboardMode mode) {
-	DBG("Setting keyboard mode to %d\n", mode);
+static void __not_in_flash_func(force_mode_xmit)(KeyboardMode mode) {
+	DBG_ISR("Setting keyboard mode to %d\n", mode);
 	kbd_xmit(0xff);
 	kbd_xmit((char) mode);
 	kbd_mode = mode;
@@ -157,7 +174,6 @@ void apollo_kbd_event(const KeyboardEvent event) {
 	// current state of things, for kbd mode 0
 	static bool ctrl = false;
 	static bool shift = false;
-	static bool alt = false;
 
 	// the windows key or right-alt, which we'll use to trigger
 	// a number of the extra Apollo keys
@@ -204,6 +220,9 @@ void apollo_kbd_event(const KeyboardEvent event) {
 		return; // don't send to the host
 	}
 
+	// one load of the live keymap per event, it may be swapped in between
+	const void* codes = s_codes;
+
 	if (kbd_mode == Mode0_Compatibility) {
 		switch (event.keycode) {
 			case HID_KEY_LEFT_CONTROL:
@@ -214,10 +233,6 @@ void apollo_kbd_event(const KeyboardEvent event) {
 			case HID_KEY_RIGHT_SHIFT:
 				shift = event.down;
 				break;
-			case HID_KEY_LEFT_ALT:
-			case HID_KEY_RIGHT_ALT:
-				alt = event.down;
-				break;
 			default:
 				break;
 		}
@@ -229,11 +244,11 @@ void apollo_kbd_event(const KeyboardEvent event) {
 		uint16_t code;
 
 		if (ctrl)
-			code = s_code_table[gui][event.keycode][State_Control];
+			code = apollo_keymap_lookup(codes, gui, event.keycode, State_Control);
 		else if (shift)
-			code = s_code_table[gui][event.keycode][State_Shifted];
+			code = apollo_keymap_lookup(codes, gui, event.keycode, State_Shifted);
 		else
-			code = s_code_table[gui][event.keycode][State_Unshifted];
+			code = apollo_keymap_lookup(codes, gui, event.keycode, State_Unshifted);
 		
 		//DBG("Mode0: Translating %02x to %04x (%s %s)\n", hidcode, code, ctrl ? "ctrl" : "", shift ? "shift" : "");
 		if (code != 0) {
@@ -243,7 +258,7 @@ void apollo_kbd_event(const KeyboardEvent event) {
 		return;
 	}
 
-	uint16_t code = s_code_table[gui][event.keycode][event.down ? State_Down : State_Up];
+	uint16_t code = apollo_keymap_lookup(codes, gui, event.keycode, event.down ? State_Down : State_Up);
 	kbd_xmit_key(code);
 }
 
@@ -317,16 +332,17 @@ void apollo_mouse_event(const MouseEvent event) {
 // rx: 0x11  -> sees data as 0xff11, puts 0x11
 // rx: 0x17  -> does nothing, clears message
 
-void on_keyboard_rx() {
+void __not_in_flash_func(on_keyboard_rx)() {
     static uint32_t kbd_cmd = 0;
     static bool kbd_reading_cmd = false;
     static int kbd_cmd_bytes = 0;
-	static bool first_irq = true;
+
+	ISR_STAT_BEGIN();
 
     while (uart_is_readable(UART_KEYBOARD)) {
         uint8_t ch = uart_getc(UART_KEYBOARD);
 
-		DBG_VV("recv %02x\n", ch);
+		DBG_ISR_VV("recv %02x\n", ch);
 
         if (!kbd_reading_cmd) {
 			if (ch == 0xff) {
@@ -337,14 +353,14 @@ void on_keyboard_rx() {
 			} else if (ch == 0x00) {
 				// 0x00 outside of 0xff sequence -- just ignore
             } else {
-                DBG("Unknown command start byte: %02x\n", ch);
+                DBG_ISR("Unknown command start byte: %02x\n", ch);
             }
 
 			continue;
         }
 
 		if (kbd_cmd_bytes == 4) {
-			DBG("Too-long keyboard command: currently %08lx, got %02x\n", kbd_cmd, ch);
+			DBG_ISR("Too-long keyboard command: currently %08lx, got %02x\n", kbd_cmd, ch);
 			kbd_reading_cmd = false;
 			continue;
 		}
@@ -352,7 +368,7 @@ void on_keyboard_rx() {
 		kbd_cmd = (kbd_cmd << 8) | ch;
 		kbd_cmd_bytes++;
 
-        DBG_V(" command %08lx (%d bytes)\n", kbd_cmd, kbd_cmd_bytes);
+        DBG_ISR_V(" command %08lx (%d bytes)\n", kbd_cmd, kbd_cmd_bytes);
 
         bool cmd_handled = true;
 
@@ -372,7 +388,7 @@ void on_keyboard_rx() {
 		} else if (kbd_cmd_bytes == 2) {
 			switch (kbd_cmd) {
 				case 0x1221: // keyboard identification
-					DBG_V("keyboard ident request\n");
+					DBG_ISR_V("keyboard ident request\n");
 
 					//kbd_tx_str("\xff\x12\x21"); // already sent as part of loopback
 					kbd_tx_str("3-@\r2-0\rSD-03863-MS\r"); // english ident
@@ -432,19 +448,21 @@ void on_keyboard_rx() {
 		// after mouse, sometimes the (pc?) sends 0xff10045e 00000000
 
 		if (cmd_handled) {
-			DBG_V(" command handled\n");
+			DBG_ISR_V(" command handled\n");
 			kbd_reading_cmd = false;
 			kbd_cmd = 0;
 			kbd_cmd_bytes = 0;
 		}
     }
+
+	ISR_STAT_END(IsrStatKbdRx);
 }
 
 #define Yes 1
 #define No 0
 #define NONE 0
 
-static uint16_t s_code_table[2][256][StateMax] = {
+static uint16_t __not_in_flash("keymap") s_code_table[2][256][StateMax] = {
 /******************* Un-modified; no Apollo keys *********************/
 {
 		                                /*  Down |Up   |Unsh |Shft |Ctrl */
@@ -574,7 +592,7 @@ static uint16_t s_code_table[2][256][StateMax] = {
 #if false
 		[HID_KEY_DELETE] = /*    POP         */ { 0x6C, 0xEC, 0x80,     0x90,   0x80,   0x80,     0xA0,    No  },
 
-/*		[HID_KEY_KEYPAD_NUM_LOCK_AND_CLEAR] = /*         Numpad CLR  */ { NONE,  NONE,  NONE,      NONE,    NONE,    NONE,      NONE,     NONE },
+//		[HID_KEY_KEYPAD_NUM_LOCK_AND_CLEAR] = /*         Numpad CLR  */ { NONE,  NONE,  NONE,      NONE,    NONE,    NONE,      NONE,     NONE },
 		[HID_KEY_] = /*    POP         */ { 0x6C, 0xEC, 0x80,     0x90,   0x80,   0x80,     0xA0,    No  },
 		[HID_KEY_] = /*   [<-]        */ { 0x40, 0xC0, 0x87,     0x97,   0x87,   0x87,     0xA7,    No  },
 		[HID_KEY_] = /*   [->]        */ { 0x42, 0xC2, 0x89,     0x99,   0x89,   0x89,     0xA9,    No  },
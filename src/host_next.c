@@ -0,0 +1,307 @@
+#include <pico/stdlib.h>
+#include <hardware/pio.h>
+#include <hardware/clocks.h>
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+#include <tusb.h>
+
+#define DEBUG_VERBOSE 0
+#define DEBUG_TAG "next"
+
+#include "babelfish.h"
+#include "console.h"
+#include "isr_stats.h"
+#include "pio_util.h"
+
+#include "host_next_keycodes.h"
+#include "next_kms.pio.h"
+
+DBG_MODULE();
+
+/**********************
+
+NeXT keyboard and mouse, the non-ADB ones that hang off the monitor. The
+mouse plugs into the keyboard, so both share the one pair of lines on
+channel A: RX from the host, TX to it.
+
+The monitor polls. Each command frame is a start bit and a byte at 50 us a
+bit; a query gets a 22 bit reply in the window right after it. The PIO
+program (next_kms.pio) receives the command and clocks the reply out on a
+fixed schedule. All the interrupt handler does in between is pick a reply
+word that the mainloop has already encoded, so the answer always starts the
+same time after the poll, however busy the mainloop is.
+
+- Keyboard: each key event is encoded when it arrives, with the modifier
+  bits as they were at that moment, into a queue the handler pops one word
+  per poll. With nothing queued the reply is the idle word, which still
+  carries the current modifiers.
+- Mouse: the mainloop keeps one reply word encoded from all the motion not
+  yet reported. The handler hands it out at most once; until the mainloop
+  has taken that motion off its totals, polls get buttons only.
+
+Reply layout, LSB first on the wire (a word of all ones is no reply):
+
+  bit  0      start, 0
+  bits 1-8    keyboard: key code, bit 8 set on release
+              mouse: left button up, dx (7 bits)
+  bit  9      1
+  bit  10     1 in the idle keyboard reply
+  bits 11-18  keyboard: modifiers in bits 12-18, see host_next_keycodes.h
+              mouse: right button up, dy (7 bits)
+  bits 19-20  0
+  bit  21     stop, 1
+
+The layout and the command values come from what USB converters for these
+keyboards decode; the mouse query in particular is worth checking against a
+capture ('la') before trusting it.
+
+***********************/
+
+#define NEXT_BIT_US 50.0f
+
+#define NEXT_CMD_QUERY_KBD 0x10
+#define NEXT_CMD_QUERY_MOUSE 0x11
+#define NEXT_CMD_RESET 0xef
+
+#define NEXT_NO_REPLY 0xffffffffu
+
+#define NEXT_REPLY_FRAME ((1u << 9) | (1u << 21))
+#define NEXT_REPLY_IDLE (1u << 10)
+#define NEXT_REPLY_KEY_UP (1u << 8)
+#define NEXT_REPLY_MODS_SHIFT 12
+
+#define NEXT_MOUSE_ACCUM_LIMIT 1024
+
+#define KBD_QUEUE_SIZE 32 // power of two
+#define KBD_QUEUE_MASK (KBD_QUEUE_SIZE - 1)
+
+static PIO s_pio = NULL;
+static uint s_sm;
+
+// Keyboard replies: head written by the mainloop, tail by the PIO IRQ
+static uint32_t s_kbd_queue[KBD_QUEUE_SIZE];
+static volatile uint32_t s_kbd_head;
+static volatile uint32_t s_kbd_tail;
+static volatile uint32_t s_kbd_idle_word;
+static uint8_t s_mods;
+
+// Keys whose press is queued and whose release is not yet: the queue always
+// keeps that many slots free, so a release is never the word that overflows
+static uint8_t s_kbd_down[128 / 8];
+static uint32_t s_kbd_owed;
+
+// Mouse reply: encoded by the mainloop, taken at most once by the PIO IRQ
+static volatile uint32_t s_mouse_word;
+static volatile uint32_t s_mouse_idle_word;
+static volatile bool s_mouse_taken;
+static int8_t s_mouse_word_dx, s_mouse_word_dy; // the motion in s_mouse_word
+static int32_t s_mouse_dx, s_mouse_dy;
+static uint8_t s_mouse_buttons;
+
+static struct {
+    volatile uint32_t kbd_polls;
+    volatile uint32_t mouse_polls;
+    volatile uint32_t other_cmds;
+    volatile uint8_t last_other_cmd;
+    volatile uint32_t resets;
+    uint32_t logged_other;
+    uint32_t logged_resets;
+    uint32_t key_replies;
+    uint32_t mouse_replies;
+    uint32_t kbd_overflows;
+} s_stats;
+
+static uint32_t kbd_word(uint8_t code, bool down)
+{
+    return NEXT_REPLY_FRAME | ((uint32_t) (code & 0x7f) << 1) | (down ? 0 : NEXT_REPLY_KEY_UP) |
+        ((uint32_t) s_mods << NEXT_REPLY_MODS_SHIFT);
+}
+
+static uint32_t kbd_idle_word()
+{
+    return NEXT_REPLY_FRAME | NEXT_REPLY_IDLE | ((uint32_t) s_mods << NEXT_REPLY_MODS_SHIFT);
+}
+
+static uint32_t mouse_word(int8_t dx, int8_t dy)
+{
+    uint32_t left_up = (s_mouse_buttons & MOUSE_BUTTON_LEFT) ? 0 : 1;
+    uint32_t right_up = (s_mouse_buttons & MOUSE_BUTTON_RIGHT) ? 0 : 1;
+    return NEXT_REPLY_FRAME |
+        (left_up << 1) | ((uint32_t) (dx & 0x7f) << 2) |
+        (right_up << 11) | ((uint32_t) (dy & 0x7f) << 12);
+}
+
+// Command received: hand the state machine its reply. RAM-resident, and
+// nothing in here is computed on the spot.
+static void __not_in_flash_func(next_pio_irq)()
+{
+    ISR_STAT_BEGIN();
+    while (!pio_sm_is_rx_fifo_empty(s_pio, s_sm)) {
+        uint8_t cmd = pio_sm_get(s_pio, s_sm) >> 24;
+        uint32_t reply;
+
+        switch (cmd) {
+            case NEXT_CMD_QUERY_KBD:
+                s_stats.kbd_polls++;
+                if (s_kbd_tail != s_kbd_head)
+                    reply = s_kbd_queue[s_kbd_tail++ & KBD_QUEUE_MASK];
+                else
+                    reply = s_kbd_idle_word;
+                break;
+            case NEXT_CMD_QUERY_MOUSE:
+                s_stats.mouse_polls++;
+                if (s_mouse_taken) {
+                    reply = s_mouse_idle_word;
+                } else {
+                    reply = s_mouse_word;
+                    s_mouse_taken = true;
+                }
+                break;
+            case NEXT_CMD_RESET:
+                s_stats.resets++;
+                reply = NEXT_NO_REPLY;
+                break;
+            default:
+                s_stats.other_cmds++;
+                s_stats.last_other_cmd = cmd;
+                reply = NEXT_NO_REPLY;
+                break;
+        }
+
+        pio_sm_put(s_pio, s_sm, reply);
+    }
+    ISR_STAT_END(IsrStatNext);
+}
+
+// Settle what the last poll took, then encode what is left
+static void mouse_prepare()
+{
+    uint32_t irq = save_and_disable_interrupts();
+
+    if (s_mouse_taken) {
+        s_mouse_dx -= s_mouse_word_dx;
+        s_mouse_dy -= s_mouse_word_dy;
+        if (s_mouse_word_dx || s_mouse_word_dy)
+            s_stats.mouse_replies++;
+    }
+
+    s_mouse_word_dx = clamp(s_mouse_dx, -64, 63);
+    s_mouse_word_dy = clamp(s_mouse_dy, -64, 63);
+    s_mouse_word = mouse_word(s_mouse_word_dx, s_mouse_word_dy);
+    s_mouse_idle_word = mouse_word(0, 0);
+    s_mouse_taken = false;
+
+    restore_interrupts(irq);
+}
+
+void next_init()
+{
+    channel_config(0, ChannelModeLevelShifter | ChannelModeGPIO | ChannelModeNoInvert);
+
+    s_pio = pio_claim_with_room(&next_kms_program, 1, &s_sm);
+    if (!s_pio) {
+        DBG("no PIO block with room for the NeXT program\n");
+        return;
+    }
+
+    s_kbd_idle_word = kbd_idle_word();
+    mouse_prepare();
+
+    uint offset = pio_add_program(s_pio, &next_kms_program);
+    next_kms_program_init(s_pio, s_sm, offset, channels[0].rx_gpio, channels[0].tx_gpio, NEXT_BIT_US);
+
+    uint irq = s_pio == pio0 ? PIO0_IRQ_0 : PIO1_IRQ_0;
+    pio_set_irq0_source_enabled(s_pio, pis_sm0_rx_fifo_not_empty + s_sm, true);
+    irq_set_exclusive_handler(irq, next_pio_irq);
+    irq_set_enabled(irq, true);
+
+    DBG("pio%d sm %d at offset %u\n", pio_get_index(s_pio), s_sm, offset);
+}
+
+void next_update()
+{
+    if (s_stats.resets != s_stats.logged_resets) {
+        s_stats.logged_resets = s_stats.resets;
+        DBG("reset\n");
+    }
+    if (s_stats.other_cmds != s_stats.logged_other) {
+        s_stats.logged_other = s_stats.other_cmds;
+        DBG("unknown command %02x\n", s_stats.last_other_cmd);
+    }
+
+    if (s_mouse_taken)
+        mouse_prepare();
+}
+
+void next_kbd_event(const KeyboardEvent event)
+{
+    if (event.page != 0)
+        return;
+
+    if (event.keycode >= HID_KEY_LEFT_CONTROL && event.keycode <= HID_KEY_RIGHT_GUI) {
+        uint8_t bit = usb2next_mod[event.keycode - HID_KEY_LEFT_CONTROL];
+        if (event.down)
+            s_mods |= bit;
+        else
+            s_mods &= ~bit;
+        s_kbd_idle_word = kbd_idle_word();
+        return;
+    }
+
+    uint8_t code = usb2next[event.keycode];
+    if (!code)
+        return;
+
+    uint8_t idx = code & 0x7f;
+    uint8_t mask = 1 << (idx & 7);
+    bool was_down = s_kbd_down[idx >> 3] & mask;
+    uint32_t room = KBD_QUEUE_SIZE - (s_kbd_head - s_kbd_tail);
+
+    if (event.down) {
+        // a press needs its own slot, and a new one also the slot for its release
+        if (room < s_kbd_owed + (was_down ? 1 : 2)) {
+            s_stats.kbd_overflows++;
+            return;
+        }
+        if (!was_down) {
+            s_kbd_down[idx >> 3] |= mask;
+            s_kbd_owed++;
+        }
+    } else {
+        // the press was dropped, so the host never saw the key go down
+        if (!was_down)
+            return;
+        s_kbd_down[idx >> 3] &= ~mask;
+        s_kbd_owed--;
+    }
+
+    s_kbd_queue[s_kbd_head & KBD_QUEUE_MASK] = kbd_word(code, event.down);
+    // the word must be in place before the IRQ can see the new head
+    __dmb();
+    s_kbd_head = s_kbd_head + 1;
+    s_stats.key_replies++;
+}
+
+void next_mouse_event(const MouseEvent event)
+{
+    s_mouse_dx = clamp(s_mouse_dx + event.dx, -NEXT_MOUSE_ACCUM_LIMIT, NEXT_MOUSE_ACCUM_LIMIT);
+    s_mouse_dy = clamp(s_mouse_dy + event.dy, -NEXT_MOUSE_ACCUM_LIMIT, NEXT_MOUSE_ACCUM_LIMIT);
+    s_mouse_buttons = event.buttons;
+    mouse_prepare();
+}
+
+#if DEBUG
+
+/*
+ * next -- poll and reply counters
+ */
+void next_console_cmd(int argc, char** argv)
+{
+    console_printf("polls: kbd %lu mouse %lu, resets %lu, other commands %lu (last %02x)\n",
+        s_stats.kbd_polls, s_stats.mouse_polls, s_stats.resets, s_stats.other_cmds, s_stats.last_other_cmd);
+    console_printf("replies: keys %lu (queued %lu, held %lu, overflows %lu), mouse motion %lu; mods %02x\n",
+        s_stats.key_replies, s_kbd_head - s_kbd_tail, s_kbd_owed, s_stats.kbd_overflows, s_stats.mouse_replies,
+        s_mods);
+}
+
+#endif
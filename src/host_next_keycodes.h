@@ -0,0 +1,130 @@
+/*
+ * Sources:
+ *
+ * Previous (NeXT emulator), src/keymap.c
+ * Adafruit USB NeXT keyboard converter, for the modifier bits
+ */
+
+#ifndef _NEXT_KEYCODES_H_
+#define _NEXT_KEYCODES_H_
+
+#include <stdint.h>
+#include "hid_codes.h"
+
+#define NEXT_KEY_BRIGHTNESS_DOWN 0x01
+#define NEXT_KEY_VOLUME_DOWN 0x02
+#define NEXT_KEY_BRIGHTNESS_UP 0x19
+#define NEXT_KEY_VOLUME_UP 0x1a
+#define NEXT_KEY_POWER 0x58
+
+// Modifiers aren't keys on this bus; they ride along in every keyboard reply
+#define NEXT_MOD_CONTROL 0x01
+#define NEXT_MOD_SHIFT_LEFT 0x02
+#define NEXT_MOD_SHIFT_RIGHT 0x04
+#define NEXT_MOD_COMMAND_LEFT 0x08
+#define NEXT_MOD_COMMAND_RIGHT 0x10
+#define NEXT_MOD_ALT_LEFT 0x20
+#define NEXT_MOD_ALT_RIGHT 0x40
+
+// Looked up on every key event; kept in RAM with the other keymaps
+static const uint8_t __not_in_flash("keymap") usb2next[256] = {
+  [HID_KEY_ESCAPE] = 0x49,
+  [HID_KEY_1_EXCLAMATION_MARK] = 0x4a,
+  [HID_KEY_2_AT] = 0x4b,
+  [HID_KEY_3_NUMBER_SIGN] = 0x4c,
+  [HID_KEY_4_DOLLAR] = 0x4d,
+  [HID_KEY_5_PERCENT] = 0x50,
+  [HID_KEY_6_CARET] = 0x4f,
+  [HID_KEY_7_AMPERSAND] = 0x4e,
+  [HID_KEY_8_ASTERISK] = 0x1e,
+  [HID_KEY_9_OPARENTHESIS] = 0x1f,
+  [HID_KEY_0_CPARENTHESIS] = 0x20,
+  [HID_KEY_MINUS_UNDERSCORE] = 0x1d,
+  [HID_KEY_EQUAL_PLUS] = 0x1c,
+  [HID_KEY_GRAVE_ACCENT_AND_TILDE] = 0x26,
+  [HID_KEY_BACKSPACE] = 0x1b,
+
+  [HID_KEY_TAB] = 0x41,
+  [HID_KEY_Q] = 0x42,
+  [HID_KEY_W] = 0x43,
+  [HID_KEY_E] = 0x44,
+  [HID_KEY_R] = 0x45,
+  [HID_KEY_T] = 0x48,
+  [HID_KEY_Y] = 0x47,
+  [HID_KEY_U] = 0x46,
+  [HID_KEY_I] = 0x06,
+  [HID_KEY_O] = 0x07,
+  [HID_KEY_P] = 0x08,
+  [HID_KEY_OBRACKET_AND_OBRACE] = 0x05,
+  [HID_KEY_CBRACKET_AND_CBRACE] = 0x04,
+  [HID_KEY_BACKSLASH_VERTICAL_BAR] = 0x03,
+
+  [HID_KEY_A] = 0x39,
+  [HID_KEY_S] = 0x3a,
+  [HID_KEY_D] = 0x3b,
+  [HID_KEY_F] = 0x3c,
+  [HID_KEY_G] = 0x3d,
+  [HID_KEY_H] = 0x40,
+  [HID_KEY_J] = 0x3f,
+  [HID_KEY_K] = 0x3e,
+  [HID_KEY_L] = 0x2d,
+  [HID_KEY_SEMICOLON_COLON] = 0x2c,
+  [HID_KEY_SINGLE_AND_DOUBLE_QUOTE] = 0x2b,
+  [HID_KEY_ENTER] = 0x2a,
+
+  [HID_KEY_Z] = 0x31,
+  [HID_KEY_X] = 0x32,
+  [HID_KEY_C] = 0x33,
+  [HID_KEY_V] = 0x34,
+  [HID_KEY_B] = 0x35,
+  [HID_KEY_N] = 0x37,
+  [HID_KEY_M] = 0x36,
+  [HID_KEY_COMMA_AND_LESS] = 0x2e,
+  [HID_KEY_DOT_GREATER] = 0x2f,
+  [HID_KEY_SLASH_QUESTION] = 0x30,
+  [HID_KEY_SPACEBAR] = 0x38,
+
+  [HID_KEY_UPARROW] = 0x16,
+  [HID_KEY_DOWNARROW] = 0x0f,
+  [HID_KEY_LEFTARROW] = 0x09,
+  [HID_KEY_RIGHTARROW] = 0x10,
+
+  [HID_KEY_KEYPAD_EQUAL] = 0x27,
+  [HID_KEY_KEYPAD_SLASH] = 0x28,
+  [HID_KEY_KEYPAD_ASTERISK] = 0x25,
+  [HID_KEY_KEYPAD_MINUS] = 0x24,
+  [HID_KEY_KEYPAD_PLUS] = 0x15,
+  [HID_KEY_KEYPAD_ENTER] = 0x0d,
+  [HID_KEY_KEYPAD_1_END] = 0x11,
+  [HID_KEY_KEYPAD_2_DOWN_ARROW] = 0x17,
+  [HID_KEY_KEYPAD_3_PAGEDN] = 0x14,
+  [HID_KEY_KEYPAD_4_LEFT_ARROW] = 0x12,
+  [HID_KEY_KEYPAD_5] = 0x18,
+  [HID_KEY_KEYPAD_6_RIGHT_ARROW] = 0x13,
+  [HID_KEY_KEYPAD_7_HOME] = 0x21,
+  [HID_KEY_KEYPAD_8_UP_ARROW] = 0x22,
+  [HID_KEY_KEYPAD_9_PAGEUP] = 0x23,
+  [HID_KEY_KEYPAD_0_INSERT] = 0x0b,
+  [HID_KEY_KEYPAD_DECIMAL] = 0x0c,
+
+  // the keys above the arrows
+  [HID_KEY_PAGEUP] = NEXT_KEY_BRIGHTNESS_UP,
+  [HID_KEY_PAGEDOWN] = NEXT_KEY_BRIGHTNESS_DOWN,
+  [HID_KEY_VOLUME_UP] = NEXT_KEY_VOLUME_UP,
+  [HID_KEY_VOLUME_DOWN] = NEXT_KEY_VOLUME_DOWN,
+  [HID_KEY_POWER] = NEXT_KEY_POWER,
+};
+
+// HID modifier usages (0xE0-0xE7) to NeXT modifier bits
+static const uint8_t usb2next_mod[8] = {
+  NEXT_MOD_CONTROL,       // left control
+  NEXT_MOD_SHIFT_LEFT,
+  NEXT_MOD_ALT_LEFT,
+  NEXT_MOD_COMMAND_LEFT,  // left GUI
+  NEXT_MOD_CONTROL,       // right control
+  NEXT_MOD_SHIFT_RIGHT,
+  NEXT_MOD_ALT_RIGHT,
+  NEXT_MOD_COMMAND_RIGHT, // right GUI
+};
+
+#endif
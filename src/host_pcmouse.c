@@ -0,0 +1,132 @@
+#include <pico/stdlib.h>
+#include <hardware/gpio.h>
+#include <hardware/uart.h>
+#include <string.h>
+#include <tusb.h>
+
+#define DEBUG_VERBOSE 0
+#define DEBUG_TAG "pcmouse"
+
+#include "babelfish.h"
+#include "console.h"
+#include "serial_mouse.h"
+
+/**********************
+
+PC serial mouse on channel B, through the MAX3232: Microsoft (two buttons),
+Logitech (Microsoft plus the middle button) or Mouse Systems. The packets
+come from serial_mouse.c, the same encoder the Sun mouse uses.
+
+  Ch B TX    mouse data (DE9 pin 2)
+  Ch B RX    the PC's RTS (DE9 pin 7)
+
+A serial mouse runs off RTS/DTR, so the PC resets it by dropping RTS and
+raising it again, then waits for the mouse to identify itself; that is how
+the Microsoft and Logitech drivers (and Windows) find it. RX is watched as a
+plain input for that: RTS low for at least PCMOUSE_RTS_OFF_MIN_US and then
+high again gets the ident after PCMOUSE_IDENT_DELAY_US, as from a mouse that
+has just powered up. The ident also goes out once at init, for PCs that
+don't reset the mouse or cables without RTS.
+
+***********************/
+
+#define UART_MOUSE uart1
+#define PCMOUSE_CHANNEL 1
+
+#define PCMOUSE_DEFAULT_FORMAT SerialMouseMicrosoft
+
+#define PCMOUSE_RTS_OFF_MIN_US 5000
+#define PCMOUSE_IDENT_DELAY_US 20000
+
+static SerialMouse s_mouse;
+
+static struct {
+    bool on;
+    uint32_t off_since_us;
+    uint32_t ident_at_us;
+    bool ident_due;
+    uint32_t resets;
+} s_rts;
+
+static void set_format(SerialMouseFormat format)
+{
+    serial_mouse_init(&s_mouse, UART_MOUSE, format);
+    serial_mouse_ident(&s_mouse);
+}
+
+void pcmouse_init()
+{
+    channel_config(PCMOUSE_CHANNEL, ChannelConfigRS232);
+    set_format(PCMOUSE_DEFAULT_FORMAT);
+
+    // the UART owns the pin but the level reads back through the input
+    // override, so space (RTS on) is 0 as it is to the UART
+    s_rts.on = !gpio_get(channels[PCMOUSE_CHANNEL].rx_gpio);
+}
+
+static void rts_poll()
+{
+    uint32_t now = time_us_32();
+    bool on = !gpio_get(channels[PCMOUSE_CHANNEL].rx_gpio);
+
+    if (on != s_rts.on) {
+        s_rts.on = on;
+        if (!on) {
+            s_rts.off_since_us = now;
+            s_rts.ident_due = false;
+        } else if (now - s_rts.off_since_us >= PCMOUSE_RTS_OFF_MIN_US) {
+            s_rts.resets++;
+            s_rts.ident_due = true;
+            s_rts.ident_at_us = now + PCMOUSE_IDENT_DELAY_US;
+        }
+    }
+
+    if (s_rts.ident_due && (int32_t) (now - s_rts.ident_at_us) >= 0) {
+        s_rts.ident_due = false;
+        serial_mouse_ident(&s_mouse);
+    }
+}
+
+void pcmouse_update()
+{
+    rts_poll();
+    serial_mouse_task(&s_mouse);
+}
+
+void pcmouse_kbd_event(const KeyboardEvent event)
+{
+}
+
+void pcmouse_mouse_event(const MouseEvent event)
+{
+    serial_mouse_event(&s_mouse, &event);
+}
+
+#if DEBUG
+
+/*
+ * pcmouse [microsoft|logitech|mousesystems] -- format, link counters
+ */
+void pcmouse_console_cmd(int argc, char** argv)
+{
+    if (argc >= 2) {
+        SerialMouseFormat format;
+        for (format = 0; format < SerialMouseFormatCount; format++) {
+            if (strcmp(argv[1], serial_mouse_format_name(format)) == 0)
+                break;
+        }
+        if (format == SerialMouseFormatCount) {
+            console_printf("formats: microsoft logitech mousesystems\n");
+            return;
+        }
+        set_format(format);
+    }
+
+    console_printf("%s, %lu packets, %lu idents; rts %s, %lu resets\n",
+        serial_mouse_format_name(s_mouse.format), s_mouse.packets, s_mouse.idents,
+        s_rts.on ? "on" : "off", s_rts.resets);
+    console_printf("tx %lu bytes, %lu dropped, queue max %lu\n",
+        s_mouse.tx.bytes, s_mouse.tx.dropped, s_mouse.tx.max_depth);
+}
+
+#endif
@@ -0,0 +1,712 @@
+#include <pico/stdlib.h>
+#include <hardware/pio.h>
+#include <hardware/clocks.h>
+#include <hardware/sync.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tusb.h>
+
+#define DEBUG_VERBOSE 0
+#define DEBUG_TAG "ps2"
+
+#include "babelfish.h"
+#include "console.h"
+#include "gpio_irq.h"
+#include "isr_stats.h"
+#include "pio_util.h"
+#include "kbd_leds.h"
+
+#include "host_ps2_scancodes.h"
+#include "ps2_device.pio.h"
+
+DBG_MODULE();
+
+/**********************
+
+PS/2 keyboard on channel A and mouse on channel B. On each channel CLK is the
+TX pin and DATA the RX pin, through the level shifter, which passes both
+directions as it does for ADB.
+
+The PIO program (ps2_device.pio) clocks whole frames; everything at the byte
+level happens here.
+
+- Device to host: the mainloop hands the state machine one byte at a time,
+  once CLK and DATA have both been high for 50 us. If the host inhibits the
+  bus partway through, the frame comes back abandoned and the byte goes again.
+- Host to device: the host holds CLK low, pulls DATA low and releases CLK.
+  The CLK rising edge interrupt sees DATA low and, if the state machine is
+  parked, gives it a receive frame; the PIO clocks the byte in and ACKs it,
+  and the mainloop checks the parity and answers.
+
+Keyboard: scan code set 2 only. Requests for sets 1 and 3 are acknowledged
+and ignored, as many real keyboards do. Typematic repeat is generated here at
+the rate and delay the host sets with 0xF3.
+
+Mouse: the standard 3 byte packets, or IntelliMouse 4 byte ones (wheel) after
+the host's sample rate knock of 200, 100, 80. Packets go out as soon as there
+is something to report, the previous packet has cleared the wire and the
+host's sample period has passed.
+
+***********************/
+
+#define PS2_QUEUE_SIZE 64 // power of two
+#define PS2_QUEUE_MASK (PS2_QUEUE_SIZE - 1)
+
+// how long the bus has to be idle before the device may start a frame
+#define PS2_IDLE_US 50
+
+// a frame comes back as all ones when the host inhibited the bus during it
+#define PS2_FRAME_ABANDONED 0xffffffffu
+
+// receive: ten clocks with DATA released (data, parity, stop), then the ACK
+#define PS2_RX_FRAME (10 | (1u << (4 + 10)))
+
+typedef struct Ps2Port Ps2Port;
+
+struct Ps2Port {
+    const char* name;
+    void (*on_byte)(Ps2Port* port, uint8_t byte);
+
+    PIO pio;
+    uint sm;
+    uint clk_gpio;
+    uint data_gpio;
+
+    // bytes waiting for the wire; mainloop only
+    uint8_t queue[PS2_QUEUE_SIZE];
+    uint32_t head;
+    uint32_t tail;
+
+    int16_t in_flight;      // byte handed to the state machine, -1 if none
+    uint8_t last_sent;      // for 0xFE, resend
+
+    // frames given to the state machine whose result hasn't been read yet;
+    // the CLK interrupt adds receive frames
+    volatile uint8_t frames_queued;
+    volatile uint32_t clk_rise_us;
+
+    uint32_t sent;
+    uint32_t received;
+    uint32_t retried;       // sends abandoned because the host inhibited the bus
+    uint32_t rx_errors;     // parity or stop bit errors, answered with 0xFE
+    uint32_t overflows;     // byte sequences dropped with the queue full
+    uint32_t max_depth;
+};
+
+static void kbd_on_byte(Ps2Port* p, uint8_t b);
+static void mouse_on_byte(Ps2Port* p, uint8_t b);
+
+static Ps2Port s_ports[2] = {
+    { .name = "kbd", .on_byte = kbd_on_byte, .in_flight = -1 },
+    { .name = "mouse", .on_byte = mouse_on_byte, .in_flight = -1 },
+};
+
+#define KBD (&s_ports[0])
+#define MOUSE (&s_ports[1])
+
+static PIO s_pio = NULL;
+static uint s_offset;
+
+//
+// Byte level
+//
+
+static bool port_queue(Ps2Port* p, const uint8_t* bytes, uint n)
+{
+    if (PS2_QUEUE_SIZE - (p->head - p->tail) < n) {
+        p->overflows++;
+        return false;
+    }
+
+    for (uint i = 0; i < n; i++)
+        p->queue[p->head++ & PS2_QUEUE_MASK] = bytes[i];
+
+    if (p->head - p->tail > p->max_depth)
+        p->max_depth = p->head - p->tail;
+    return true;
+}
+
+#define PORT_SEND(p, ...) do { \
+        const uint8_t _bytes[] = { __VA_ARGS__ }; \
+        port_queue((p), _bytes, sizeof(_bytes)); \
+    } while (0)
+
+// Devices drop whatever they had queued when the host sends a command
+static void port_flush(Ps2Port* p)
+{
+    p->tail = p->head;
+}
+
+static bool port_idle(Ps2Port* p)
+{
+    return p->head == p->tail && p->in_flight < 0;
+}
+
+// Start bit 0, data LSB first, odd parity, stop bit 1. The state machine
+// wants pindirs, so a 1 is a line pulled low.
+static uint32_t ps2_tx_frame(uint8_t b)
+{
+    uint32_t parity = (__builtin_popcount(b) & 1) ^ 1;
+    uint32_t bits = ((uint32_t) b << 1) | (parity << 9) | (1u << 10);
+    return 10 | ((~bits & 0x7ff) << 4);
+}
+
+static void port_kick(Ps2Port* p)
+{
+    if (!s_pio || p->frames_queued || p->head == p->tail)
+        return;
+    if (!gpio_get(p->clk_gpio) || !gpio_get(p->data_gpio))
+        return;
+
+    // the CLK interrupt may hand the state machine a receive frame
+    uint32_t irq = save_and_disable_interrupts();
+    if (!p->frames_queued && time_us_32() - p->clk_rise_us >= PS2_IDLE_US) {
+        uint8_t b = p->queue[p->tail++ & PS2_QUEUE_MASK];
+        p->in_flight = b;
+        p->frames_queued++;
+        pio_sm_put(p->pio, p->sm, ps2_tx_frame(b));
+    }
+    restore_interrupts(irq);
+}
+
+// Read back the results of finished frames
+static void port_drain(Ps2Port* p)
+{
+    while (s_pio && !pio_sm_is_rx_fifo_empty(p->pio, p->sm)) {
+        uint32_t w = pio_sm_get(p->pio, p->sm);
+
+        uint32_t irq = save_and_disable_interrupts();
+        p->frames_queued--;
+        restore_interrupts(irq);
+
+        // A send is only started with nothing else outstanding, so while one
+        // is in flight the next result is its own.
+        if (p->in_flight >= 0) {
+            uint8_t b = p->in_flight;
+            p->in_flight = -1;
+
+            if (w == PS2_FRAME_ABANDONED) {
+                p->retried++;
+                if (p->head - p->tail < PS2_QUEUE_SIZE)
+                    p->queue[--p->tail & PS2_QUEUE_MASK] = b;
+                else
+                    p->overflows++;
+            } else {
+                p->sent++;
+                p->last_sent = b;
+            }
+            continue;
+        }
+
+        // an abandoned receive: the host will send the byte again
+        if (w == PS2_FRAME_ABANDONED)
+            continue;
+
+        // samples: data in bits 21-28, parity 29, stop 30, our ACK in 31
+        uint8_t b = (w >> 21) & 0xff;
+        uint32_t parity = (w >> 29) & 1;
+        uint32_t stop = (w >> 30) & 1;
+        if (!stop || ((__builtin_popcount(b) + parity) & 1) == 0) {
+            DBG("%s: bad frame 0x%08lx\n", p->name, w);
+            p->rx_errors++;
+            port_flush(p);
+            PORT_SEND(p, 0xfe);
+            continue;
+        }
+
+        p->received++;
+        DBG_V("%s: rx %02x\n", p->name, b);
+        p->on_byte(p, b);
+    }
+}
+
+// Any rising edge on either CLK line. Most of them are our own clocks; a
+// release with DATA low while the state machine is parked on its pull is
+// the host's request to send.
+void __not_in_flash_func(ps2_clk_irq)()
+{
+    ISR_STAT_BEGIN();
+
+    for (int i = 0; i < 2; i++) {
+        Ps2Port* p = &s_ports[i];
+        uint32_t events = gpio_get_irq_event_mask(p->clk_gpio);
+        if (!events)
+            continue;
+        gpio_irq_acknowledge(p->clk_gpio, events);
+
+        p->clk_rise_us = time_us_32();
+
+        if (!gpio_get(p->data_gpio) &&
+            pio_sm_get_pc(p->pio, p->sm) == s_offset &&
+            pio_sm_is_tx_fifo_empty(p->pio, p->sm)) {
+            p->frames_queued++;
+            pio_sm_put(p->pio, p->sm, PS2_RX_FRAME);
+        }
+    }
+
+    ISR_STAT_END(IsrStatPs2Clk);
+}
+
+//
+// Keyboard
+//
+
+#define PS2_TYPEMATIC_DEFAULT 0x2b // 10.9 characters/s after 500 ms
+
+static struct {
+    bool scanning;
+    uint8_t typematic;      // 0xF3 argument: delay in bits 5-6, rate in bits 0-4
+    uint8_t leds;
+    uint8_t pending_cmd;    // command waiting for its argument, 0 if none
+    uint8_t repeat_usage;   // key being repeated, 0 if none
+    uint32_t repeat_at_us;
+} s_kbd;
+
+static uint32_t typematic_delay_us()
+{
+    return (((s_kbd.typematic >> 5) & 3) + 1) * 250000;
+}
+
+// (8 + A) * 2^B * 4.17 ms, A and B from the low five bits
+static uint32_t typematic_period_us()
+{
+    return (8 + (s_kbd.typematic & 7)) * (1u << ((s_kbd.typematic >> 3) & 3)) * 4170;
+}
+
+static void kbd_defaults()
+{
+    s_kbd.typematic = PS2_TYPEMATIC_DEFAULT;
+    s_kbd.pending_cmd = 0;
+    s_kbd.repeat_usage = 0;
+}
+
+static void kbd_send_key(uint8_t usage, bool down)
+{
+    uint16_t code = usb2ps2[usage];
+
+    if (code == PS2_SPECIAL) {
+        if (usage == HID_KEY_PRINTSCREEN) {
+            if (down)
+                PORT_SEND(KBD, 0xe0, 0x12, 0xe0, 0x7c);
+            else
+                PORT_SEND(KBD, 0xe0, 0xf0, 0x7c, 0xe0, 0xf0, 0x12);
+        } else if (down) {
+            // Pause has no break code
+            PORT_SEND(KBD, 0xe1, 0x14, 0x77, 0xe1, 0xf0, 0x14, 0xf0, 0x77);
+        }
+        return;
+    }
+
+    if (!code)
+        return;
+
+    // the Korean language keys only have make codes
+    if (!down && (code == 0xf1 || code == 0xf2))
+        return;
+
+    uint8_t seq[3];
+    uint n = 0;
+    if (code & PS2_E0)
+        seq[n++] = 0xe0;
+    if (!down)
+        seq[n++] = 0xf0;
+    seq[n++] = code & 0xff;
+    port_queue(KBD, seq, n);
+}
+
+static void kbd_on_byte(Ps2Port* p, uint8_t b)
+{
+    // the argument to an earlier command, unless the host gave up on it
+    uint8_t cmd = s_kbd.pending_cmd;
+    s_kbd.pending_cmd = 0;
+    if (cmd && b < 0xed) {
+        switch (cmd) {
+            case 0xed:
+                s_kbd.leds = b & 7;
+                DBG("leds %x\n", s_kbd.leds);
+                // PS/2 has scroll, num, caps from bit 0; HID num, caps, scroll
+                kbd_leds_set(((b & 1) ? KEYBOARD_LED_SCROLLLOCK : 0) | ((b & 2) ? KEYBOARD_LED_NUMLOCK : 0) |
+                             ((b & 4) ? KEYBOARD_LED_CAPSLOCK : 0));
+                PORT_SEND(p, 0xfa);
+                break;
+            case 0xf3:
+                s_kbd.typematic = b & 0x7f;
+                PORT_SEND(p, 0xfa);
+                break;
+            case 0xf0:
+                if (b == 0)
+                    PORT_SEND(p, 0xfa, 0x02);
+                else
+                    PORT_SEND(p, 0xfa);
+                break;
+        }
+        return;
+    }
+
+    if (b != 0xfe)
+        port_flush(p);
+
+    switch (b) {
+        case 0xff: // reset
+            kbd_defaults();
+            s_kbd.scanning = true;
+            PORT_SEND(p, 0xfa, 0xaa);
+            break;
+        case 0xfe: // resend
+            PORT_SEND(p, p->last_sent);
+            break;
+        case 0xf6: // set defaults
+            kbd_defaults();
+            PORT_SEND(p, 0xfa);
+            break;
+        case 0xf5: // disable
+            kbd_defaults();
+            s_kbd.scanning = false;
+            PORT_SEND(p, 0xfa);
+            break;
+        case 0xf4: // enable
+            s_kbd.scanning = true;
+            PORT_SEND(p, 0xfa);
+            break;
+        case 0xf3: // typematic rate/delay
+        case 0xf0: // scan code set
+        case 0xed: // LEDs
+            s_kbd.pending_cmd = b;
+            PORT_SEND(p, 0xfa);
+            break;
+        case 0xf2: // read ID
+            PORT_SEND(p, 0xfa, 0xab, 0x83);
+            break;
+        case 0xee: // echo
+            PORT_SEND(p, 0xee);
+            break;
+        case 0xf7: case 0xf8: case 0xf9: case 0xfa: case 0xfb: case 0xfc: case 0xfd:
+            // set 3 key types
+            PORT_SEND(p, 0xfa);
+            break;
+        default:
+            DBG("kbd: unknown command %02x\n", b);
+            PORT_SEND(p, 0xfe);
+            break;
+    }
+}
+
+static void kbd_task()
+{
+    if (!s_kbd.repeat_usage || (int32_t) (time_us_32() - s_kbd.repeat_at_us) < 0)
+        return;
+
+    // don't let repeats pile up behind a slow or inhibited host
+    if (port_idle(KBD))
+        kbd_send_key(s_kbd.repeat_usage, true);
+
+    s_kbd.repeat_at_us += typematic_period_us();
+    if ((int32_t) (time_us_32() - s_kbd.repeat_at_us) > 0)
+        s_kbd.repeat_at_us = time_us_32() + typematic_period_us();
+}
+
+void ps2_kbd_event(const KeyboardEvent event)
+{
+    if (event.page != 0 || !s_kbd.scanning)
+        return;
+
+    kbd_send_key(event.keycode, event.down);
+
+    if (event.down && event.keycode != HID_KEY_PAUSE) {
+        s_kbd.repeat_usage = event.keycode;
+        s_kbd.repeat_at_us = time_us_32() + typematic_delay_us();
+    } else if (!event.down && event.keycode == s_kbd.repeat_usage) {
+        s_kbd.repeat_usage = 0;
+    }
+
+    port_kick(KBD);
+}
+
+//
+// Mouse
+//
+
+// USB mice report far more counts per mm than PS/2 ones; treat USB counts as
+// the 8 counts/mm of the highest PS/2 resolution and divide down from there.
+#define PS2_MOUSE_MAX_RESOLUTION 3
+#define PS2_MOUSE_ACCUM_LIMIT 4096
+
+static struct {
+    bool reporting;
+    bool remote;
+    bool scaling_2to1;
+    uint8_t rate;           // samples per second
+    uint8_t resolution;     // 0-3: 1, 2, 4, 8 counts/mm
+    uint8_t id;             // 0 standard, 3 IntelliMouse
+    uint8_t rate_knock[3];  // the last three sample rates, oldest first
+    uint8_t pending_cmd;
+
+    // motion not reported yet, in USB counts
+    int32_t dx, dy, dz;
+    uint8_t buttons;
+    bool dirty;
+    uint32_t last_report_us;
+} s_mouse;
+
+static void mouse_defaults()
+{
+    s_mouse.reporting = false;
+    s_mouse.remote = false;
+    s_mouse.scaling_2to1 = false;
+    s_mouse.rate = 100;
+    s_mouse.resolution = 2;
+    s_mouse.pending_cmd = 0;
+    s_mouse.dx = s_mouse.dy = s_mouse.dz = 0;
+    s_mouse.dirty = false;
+}
+
+// Take up to 'limit' counts out of an accumulator at the host's resolution;
+// whatever doesn't make a whole count stays for the next packet.
+static int mouse_take(int32_t* acc, uint shift, int limit)
+{
+    int32_t v = clamp(*acc / (1 << shift), -limit, limit);
+    *acc -= v * (1 << shift);
+    return v;
+}
+
+static int mouse_scale_2to1(int v)
+{
+    static const uint8_t small[6] = { 0, 1, 1, 3, 6, 9 };
+    int a = abs(v);
+    a = a < 6 ? small[a] : 2 * a;
+    if (a > 255)
+        a = 255;
+    return v < 0 ? -a : a;
+}
+
+static void mouse_send_packet()
+{
+    uint shift = PS2_MOUSE_MAX_RESOLUTION - s_mouse.resolution;
+
+    int x = mouse_take(&s_mouse.dx, shift, 255);
+    int y = -mouse_take(&s_mouse.dy, shift, 255); // PS/2 Y is up
+    int z = -mouse_take(&s_mouse.dz, 0, 8);       // IntelliMouse Z is towards the user
+    if (z > 7)
+        z = 7;
+
+    if (s_mouse.scaling_2to1 && !s_mouse.remote) {
+        x = mouse_scale_2to1(x);
+        y = mouse_scale_2to1(y);
+    }
+
+    // USB and PS/2 agree on left, right, middle in bits 0-2
+    uint8_t b0 = 0x08 | (s_mouse.buttons & 7);
+    if (x < 0)
+        b0 |= 0x10;
+    if (y < 0)
+        b0 |= 0x20;
+
+    if (s_mouse.id == 3)
+        PORT_SEND(MOUSE, b0, x & 0xff, y & 0xff, z & 0xff);
+    else
+        PORT_SEND(MOUSE, b0, x & 0xff, y & 0xff);
+
+    if (s_mouse.id != 3)
+        s_mouse.dz = 0;
+    s_mouse.dirty = abs(s_mouse.dx) >= (1 << shift) || abs(s_mouse.dy) >= (1 << shift) || s_mouse.dz;
+    s_mouse.last_report_us = time_us_32();
+}
+
+static void mouse_on_byte(Ps2Port* p, uint8_t b)
+{
+    uint8_t cmd = s_mouse.pending_cmd;
+    s_mouse.pending_cmd = 0;
+    if (cmd && b < 0xe6) {
+        switch (cmd) {
+            case 0xf3:
+                s_mouse.rate = b < 10 ? 10 : b;
+                s_mouse.rate_knock[0] = s_mouse.rate_knock[1];
+                s_mouse.rate_knock[1] = s_mouse.rate_knock[2];
+                s_mouse.rate_knock[2] = b;
+                if (s_mouse.rate_knock[0] == 200 && s_mouse.rate_knock[1] == 100 && s_mouse.rate_knock[2] == 80) {
+                    DBG("IntelliMouse mode\n");
+                    s_mouse.id = 3;
+                }
+                break;
+            case 0xe8:
+                s_mouse.resolution = b & 3;
+                break;
+        }
+        PORT_SEND(p, 0xfa);
+        return;
+    }
+
+    if (b != 0xfe)
+        port_flush(p);
+
+    switch (b) {
+        case 0xff: // reset
+            mouse_defaults();
+            s_mouse.id = 0;
+            PORT_SEND(p, 0xfa, 0xaa, 0x00);
+            break;
+        case 0xfe: // resend
+            PORT_SEND(p, p->last_sent);
+            break;
+        case 0xf6: // set defaults
+            mouse_defaults();
+            PORT_SEND(p, 0xfa);
+            break;
+        case 0xf5: // disable data reporting
+            s_mouse.reporting = false;
+            PORT_SEND(p, 0xfa);
+            break;
+        case 0xf4: // enable data reporting
+            s_mouse.reporting = true;
+            s_mouse.dx = s_mouse.dy = s_mouse.dz = 0;
+            PORT_SEND(p, 0xfa);
+            break;
+        case 0xf3: // sample rate
+        case 0xe8: // resolution
+            s_mouse.pending_cmd = b;
+            PORT_SEND(p, 0xfa);
+            break;
+        case 0xf2: // read ID
+            PORT_SEND(p, 0xfa, s_mouse.id);
+            break;
+        case 0xf0: // remote mode
+            s_mouse.remote = true;
+            PORT_SEND(p, 0xfa);
+            break;
+        case 0xea: // stream mode
+            s_mouse.remote = false;
+            PORT_SEND(p, 0xfa);
+            break;
+        case 0xeb: // read data
+            PORT_SEND(p, 0xfa);
+            mouse_send_packet();
+            break;
+        case 0xe9: // status request
+            PORT_SEND(p, 0xfa,
+                (s_mouse.remote << 6) | (s_mouse.reporting << 5) | (s_mouse.scaling_2to1 << 4) |
+                    ((s_mouse.buttons & 1) << 2) | ((s_mouse.buttons & 4) >> 1) | ((s_mouse.buttons & 2) >> 1),
+                s_mouse.resolution, s_mouse.rate);
+            break;
+        case 0xe7: // scaling 2:1
+            s_mouse.scaling_2to1 = true;
+            PORT_SEND(p, 0xfa);
+            break;
+        case 0xe6: // scaling 1:1
+            s_mouse.scaling_2to1 = false;
+            PORT_SEND(p, 0xfa);
+            break;
+        case 0xee: // wrap mode, not emulated
+        case 0xec: // reset wrap mode
+            PORT_SEND(p, 0xfa);
+            break;
+        default:
+            DBG("mouse: unknown command %02x\n", b);
+            PORT_SEND(p, 0xfe);
+            break;
+    }
+}
+
+static void mouse_task()
+{
+    if (!s_mouse.dirty || !s_mouse.reporting || s_mouse.remote || !port_idle(MOUSE))
+        return;
+    if (time_us_32() - s_mouse.last_report_us < 1000000u / s_mouse.rate)
+        return;
+    mouse_send_packet();
+}
+
+void ps2_mouse_event(const MouseEvent event)
+{
+    if (!s_mouse.reporting && !s_mouse.remote) {
+        s_mouse.buttons = event.buttons & 7;
+        return;
+    }
+
+    s_mouse.dx = clamp(s_mouse.dx + event.dx, -PS2_MOUSE_ACCUM_LIMIT, PS2_MOUSE_ACCUM_LIMIT);
+    s_mouse.dy = clamp(s_mouse.dy + event.dy, -PS2_MOUSE_ACCUM_LIMIT, PS2_MOUSE_ACCUM_LIMIT);
+    s_mouse.dz = clamp(s_mouse.dz + event.dwheel, -PS2_MOUSE_ACCUM_LIMIT, PS2_MOUSE_ACCUM_LIMIT);
+    s_mouse.buttons = event.buttons & 7;
+    s_mouse.dirty = true;
+
+    mouse_task();
+    port_kick(MOUSE);
+}
+
+//
+// HostDevice
+//
+
+void ps2_init()
+{
+    // Both lines are open collector at 5V: plain GPIO through the shifter
+    channel_config(0, ChannelModeLevelShifter | ChannelModeGPIO | ChannelModeNoInvert);
+    channel_config(1, ChannelModeLevelShifter | ChannelModeGPIO | ChannelModeNoInvert);
+
+    uint sms[2];
+    s_pio = pio_claim_with_room(&ps2_device_program, 2, sms);
+    if (!s_pio) {
+        DBG("no PIO block with room for the PS/2 program\n");
+        return;
+    }
+
+    KBD->sm = sms[0];
+    MOUSE->sm = sms[1];
+    s_offset = pio_add_program(s_pio, &ps2_device_program);
+
+    for (int ch = 0; ch < 2; ch++) {
+        Ps2Port* p = &s_ports[ch];
+        p->pio = s_pio;
+        p->clk_gpio = channels[ch].tx_gpio;
+        p->data_gpio = channels[ch].rx_gpio;
+        p->clk_rise_us = time_us_32();
+        ps2_device_program_init(p->pio, p->sm, s_offset, p->clk_gpio, p->data_gpio);
+    }
+
+    gpio_add_raw_irq_handler_masked((1u << KBD->clk_gpio) | (1u << MOUSE->clk_gpio), ps2_clk_irq);
+    gpio_set_irq_enabled(KBD->clk_gpio, GPIO_IRQ_EDGE_RISE, true);
+    gpio_set_irq_enabled(MOUSE->clk_gpio, GPIO_IRQ_EDGE_RISE, true);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+
+    kbd_defaults();
+    s_kbd.scanning = true;
+    mouse_defaults();
+
+    // power-on self test passed (and the mouse's ID)
+    PORT_SEND(KBD, 0xaa);
+    PORT_SEND(MOUSE, 0xaa, 0x00);
+
+    DBG("pio%d sm %d/%d at offset %u\n", pio_get_index(s_pio), KBD->sm, MOUSE->sm, s_offset);
+}
+
+void ps2_update()
+{
+    port_drain(KBD);
+    port_drain(MOUSE);
+
+    kbd_task();
+    mouse_task();
+
+    port_kick(KBD);
+    port_kick(MOUSE);
+}
+
+#if DEBUG
+
+/*
+ * ps2 -- port state and counters
+ */
+void ps2_console_cmd(int argc, char** argv)
+{
+    for (int i = 0; i < 2; i++) {
+        Ps2Port* p = &s_ports[i];
+        console_printf("%-5s sent %lu received %lu retried %lu rx errors %lu overflows %lu queue max %lu\n",
+            p->name, p->sent, p->received, p->retried, p->rx_errors, p->overflows, p->max_depth);
+    }
+    console_printf("kbd   %s, typematic 0x%02x, leds %x\n",
+        s_kbd.scanning ? "scanning" : "disabled", s_kbd.typematic, s_kbd.leds);
+    console_printf("mouse %s%s, id %u, %u/s, resolution %u, scaling %s\n",
+        s_mouse.reporting ? "reporting" : "disabled", s_mouse.remote ? " (remote)" : "",
+        s_mouse.id, s_mouse.rate, s_mouse.resolution, s_mouse.scaling_2to1 ? "2:1" : "1:1");
+}
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ * Sources:
+ *
+ * Microsoft Keyboard Scan Code Specification, rev 1.3a (appendix C,
+ *  USB HID usage to scan code set 2)
+ * Adam Chapweske, "The PS/2 Keyboard Interface"
+ */
+
+#ifndef _PS2_SCANCODES_H_
+#define _PS2_SCANCODES_H_
+
+#include <stdint.h>
+#include "hid_codes.h"
+
+// Set in the table for keys whose codes are prefixed with 0xE0
+#define PS2_E0 0x100
+
+// Print Screen and Pause have multi-byte sequences of their own; see host_ps2.c
+#define PS2_SPECIAL 0x200
+
+// HID keyboard usage to scan code set 2 make code. The break code is the
+// same with 0xF0 in front of the last byte.
+//
+// At 16 kHz a scan code takes most of a millisecond to clock out, so the
+// lookup isn't worth RAM; it stays in flash.
+static const uint16_t usb2ps2[256] = {
+  [HID_KEY_A] = 0x1c,
+  [HID_KEY_B] = 0x32,
+  [HID_KEY_C] = 0x21,
+  [HID_KEY_D] = 0x23,
+  [HID_KEY_E] = 0x24,
+  [HID_KEY_F] = 0x2b,
+  [HID_KEY_G] = 0x34,
+  [HID_KEY_H] = 0x33,
+  [HID_KEY_I] = 0x43,
+  [HID_KEY_J] = 0x3b,
+  [HID_KEY_K] = 0x42,
+  [HID_KEY_L] = 0x4b,
+  [HID_KEY_M] = 0x3a,
+  [HID_KEY_N] = 0x31,
+  [HID_KEY_O] = 0x44,
+  [HID_KEY_P] = 0x4d,
+  [HID_KEY_Q] = 0x15,
+  [HID_KEY_R] = 0x2d,
+  [HID_KEY_S] = 0x1b,
+  [HID_KEY_T] = 0x2c,
+  [HID_KEY_U] = 0x3c,
+  [HID_KEY_V] = 0x2a,
+  [HID_KEY_W] = 0x1d,
+  [HID_KEY_X] = 0x22,
+  [HID_KEY_Y] = 0x35,
+  [HID_KEY_Z] = 0x1a,
+
+  [HID_KEY_1_EXCLAMATION_MARK] = 0x16,
+  [HID_KEY_2_AT] = 0x1e,
+  [HID_KEY_3_NUMBER_SIGN] = 0x26,
+  [HID_KEY_4_DOLLAR] = 0x25,
+  [HID_KEY_5_PERCENT] = 0x2e,
+  [HID_KEY_6_CARET] = 0x36,
+  [HID_KEY_7_AMPERSAND] = 0x3d,
+  [HID_KEY_8_ASTERISK] = 0x3e,
+  [HID_KEY_9_OPARENTHESIS] = 0x46,
+  [HID_KEY_0_CPARENTHESIS] = 0x45,
+
+  [HID_KEY_ENTER] = 0x5a,
+  [HID_KEY_ESCAPE] = 0x76,
+  [HID_KEY_BACKSPACE] = 0x66,
+  [HID_KEY_TAB] = 0x0d,
+  [HID_KEY_SPACEBAR] = 0x29,
+  [HID_KEY_MINUS_UNDERSCORE] = 0x4e,
+  [HID_KEY_EQUAL_PLUS] = 0x55,
+  [HID_KEY_OBRACKET_AND_OBRACE] = 0x54,
+  [HID_KEY_CBRACKET_AND_CBRACE] = 0x5b,
+  [HID_KEY_BACKSLASH_VERTICAL_BAR] = 0x5d,
+  [HID_KEY_NONUS_NUMBER_SIGN_TILDE] = 0x5d,
+  [HID_KEY_SEMICOLON_COLON] = 0x4c,
+  [HID_KEY_SINGLE_AND_DOUBLE_QUOTE] = 0x52,
+  [HID_KEY_GRAVE_ACCENT_AND_TILDE] = 0x0e,
+  [HID_KEY_COMMA_AND_LESS] = 0x41,
+  [HID_KEY_DOT_GREATER] = 0x49,
+  [HID_KEY_SLASH_QUESTION] = 0x4a,
+  [HID_KEY_CAPS_LOCK] = 0x58,
+
+  [HID_KEY_F1] = 0x05,
+  [HID_KEY_F2] = 0x06,
+  [HID_KEY_F3] = 0x04,
+  [HID_KEY_F4] = 0x0c,
+  [HID_KEY_F5] = 0x03,
+  [HID_KEY_F6] = 0x0b,
+  [HID_KEY_F7] = 0x83,
+  [HID_KEY_F8] = 0x0a,
+  [HID_KEY_F9] = 0x01,
+  [HID_KEY_F10] = 0x09,
+  [HID_KEY_F11] = 0x78,
+  [HID_KEY_F12] = 0x07,
+
+  [HID_KEY_PRINTSCREEN] = PS2_SPECIAL,
+  [HID_KEY_SCROLL_LOCK] = 0x7e,
+  [HID_KEY_PAUSE] = PS2_SPECIAL,
+  [HID_KEY_INSERT] = PS2_E0 | 0x70,
+  [HID_KEY_HOME] = PS2_E0 | 0x6c,
+  [HID_KEY_PAGEUP] = PS2_E0 | 0x7d,
+  [HID_KEY_DELETE] = PS2_E0 | 0x71,
+  [HID_KEY_END1] = PS2_E0 | 0x69,
+  [HID_KEY_PAGEDOWN] = PS2_E0 | 0x7a,
+  [HID_KEY_RIGHTARROW] = PS2_E0 | 0x74,
+  [HID_KEY_LEFTARROW] = PS2_E0 | 0x6b,
+  [HID_KEY_DOWNARROW] = PS2_E0 | 0x72,
+  [HID_KEY_UPARROW] = PS2_E0 | 0x75,
+
+  [HID_KEY_KEYPAD_NUM_LOCK_AND_CLEAR] = 0x77,
+  [HID_KEY_KEYPAD_SLASH] = PS2_E0 | 0x4a,
+  [HID_KEY_KEYPAD_ASTERISK] = 0x7c,
+  [HID_KEY_KEYPAD_MINUS] = 0x7b,
+  [HID_KEY_KEYPAD_PLUS] = 0x79,
+  [HID_KEY_KEYPAD_ENTER] = PS2_E0 | 0x5a,
+  [HID_KEY_KEYPAD_1_END] = 0x69,
+  [HID_KEY_KEYPAD_2_DOWN_ARROW] = 0x72,
+  [HID_KEY_KEYPAD_3_PAGEDN] = 0x7a,
+  [HID_KEY_KEYPAD_4_LEFT_ARROW] = 0x6b,
+  [HID_KEY_KEYPAD_5] = 0x73,
+  [HID_KEY_KEYPAD_6_RIGHT_ARROW] = 0x74,
+  [HID_KEY_KEYPAD_7_HOME] = 0x6c,
+  [HID_KEY_KEYPAD_8_UP_ARROW] = 0x75,
+  [HID_KEY_KEYPAD_9_PAGEUP] = 0x7d,
+  [HID_KEY_KEYPAD_0_INSERT] = 0x70,
+  [HID_KEY_KEYPAD_DECIMAL] = 0x71,
+  [HID_KEY_KEYPAD_EQUAL] = 0x0f,
+  [HID_KEY_KEYPAD_COMMA] = 0x6d,
+
+  [HID_KEY_NONUS_BACK_SLASH_VERTICAL_BAR] = 0x61,
+  [HID_KEY_APPLICATION] = PS2_E0 | 0x2f,
+  [HID_KEY_POWER] = PS2_E0 | 0x37,
+
+  [HID_KEY_F13] = 0x08,
+  [HID_KEY_F14] = 0x10,
+  [HID_KEY_F15] = 0x18,
+  [HID_KEY_F16] = 0x20,
+  [HID_KEY_F17] = 0x28,
+  [HID_KEY_F18] = 0x30,
+  [HID_KEY_F19] = 0x38,
+  [HID_KEY_F20] = 0x40,
+  [HID_KEY_F21] = 0x48,
+  [HID_KEY_F22] = 0x50,
+  [HID_KEY_F23] = 0x57,
+  [HID_KEY_F24] = 0x5f,
+
+  [HID_KEY_MUTE] = PS2_E0 | 0x23,
+  [HID_KEY_VOLUME_UP] = PS2_E0 | 0x32,
+  [HID_KEY_VOLUME_DOWN] = PS2_E0 | 0x21,
+
+  [HID_KEY_INTERNATIONAL1] = 0x51, // ro
+  [HID_KEY_INTERNATIONAL2] = 0x13, // katakana/hiragana
+  [HID_KEY_INTERNATIONAL3] = 0x6a, // yen
+  [HID_KEY_INTERNATIONAL4] = 0x64, // henkan
+  [HID_KEY_INTERNATIONAL5] = 0x67, // muhenkan
+  [HID_KEY_LANG1] = 0xf2,          // hangul/english
+  [HID_KEY_LANG2] = 0xf1,          // hanja
+
+  [HID_KEY_LEFT_CONTROL] = 0x14,
+  [HID_KEY_LEFT_SHIFT] = 0x12,
+  [HID_KEY_LEFT_ALT] = 0x11,
+  [HID_KEY_LEFT_GUI] = PS2_E0 | 0x1f,
+  [HID_KEY_RIGHT_CONTROL] = PS2_E0 | 0x14,
+  [HID_KEY_RIGHT_SHIFT] = 0x59,
+  [HID_KEY_RIGHT_ALT] = PS2_E0 | 0x11,
+  [HID_KEY_RIGHT_GUI] = PS2_E0 | 0x27,
+};
+
+#endif
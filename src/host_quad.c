@@ -0,0 +1,236 @@
+#include <pico/stdlib.h>
+#include <hardware/pio.h>
+#include <hardware/clocks.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tusb.h>
+
+#define DEBUG_VERBOSE 0
+#define DEBUG_TAG "quad"
+
+#include "babelfish.h"
+#include "console.h"
+#include "pio_util.h"
+
+#include "quad_out.pio.h"
+
+DBG_MODULE();
+
+/**********************
+
+Quadrature (bus) mouse, for hosts that count the edges themselves: Amiga,
+Atari ST, Sun-3 and Apollo bus mice and the like.
+
+  Ch A TX/RX   XA/XB     through the shifter, 5V
+  Ch B TX/RX   YA/YB     through the shifter, 5V
+  GPIO14/15    left/right button, pulled low while pressed, floating
+               otherwise (3.3V: don't leave a 5V pull-up on them)
+
+Each axis has a state machine running quad_out.pio at the maximum edge rate;
+it takes a word of 16 quadrature states at a time. The mainloop turns USB
+motion into edges and only ever hands over words the FIFO has room for, so
+nothing here waits on the wire.
+
+USB counts are scaled by 'counts per edge' (8.8 fixed point); the remainder
+that doesn't make a whole edge is carried to the next report, in both
+directions. When the mouse moves faster than the edge rate can follow, the
+backlog is capped at QUAD_MAX_LAG_MS worth of edges and the rest is dropped
+(and counted): the pointer falls short rather than drifting on long after
+the hand has stopped.
+
+tools/sim runs this with a model of the state machines for trying out rates
+and saturation on Linux.
+
+***********************/
+
+#define QUAD_DEFAULT_EDGE_RATE 10000
+#define QUAD_MIN_EDGE_RATE 2000     // clock divider limit at 125 MHz
+#define QUAD_MAX_EDGE_RATE 100000
+#define QUAD_DEFAULT_COUNTS_PER_EDGE (1 << 8)
+#define QUAD_MAX_LAG_MS 50
+
+#define QUAD_STATES_PER_WORD 16
+
+#define QUAD_BUTTON_LEFT_GPIO 14
+#define QUAD_BUTTON_RIGHT_GPIO 15
+
+typedef struct {
+    const char* name;
+    uint sm;
+    uint a_gpio;
+
+    int32_t pending_q8;     // motion not yet turned into edges, USB counts << 8
+    uint8_t phase;          // index into s_gray
+
+    uint32_t edges;
+    uint32_t saturated;     // edges dropped because the backlog was full
+    uint32_t words;
+} QuadAxis;
+
+// A on bit 0, B on bit 1; stepping forward through the table is +1
+static const uint8_t s_gray[4] = { 0, 1, 3, 2 };
+
+static QuadAxis s_axes[2] = {
+    { .name = "x" },
+    { .name = "y" },
+};
+
+static PIO s_pio = NULL;
+static uint32_t s_edge_rate = QUAD_DEFAULT_EDGE_RATE;
+static int32_t s_counts_per_edge_q8 = QUAD_DEFAULT_COUNTS_PER_EDGE;
+static int32_t s_max_backlog;   // edges
+static uint8_t s_buttons;
+
+static void update_backlog_limit()
+{
+    s_max_backlog = s_edge_rate * QUAD_MAX_LAG_MS / 1000;
+}
+
+static void axis_add(QuadAxis* axis, int32_t counts)
+{
+    axis->pending_q8 += counts * 256;
+
+    int32_t limit_q8 = s_max_backlog * s_counts_per_edge_q8;
+    if (axis->pending_q8 > limit_q8) {
+        axis->saturated += (axis->pending_q8 - limit_q8) / s_counts_per_edge_q8;
+        axis->pending_q8 = limit_q8;
+    } else if (axis->pending_q8 < -limit_q8) {
+        axis->saturated += (-limit_q8 - axis->pending_q8) / s_counts_per_edge_q8;
+        axis->pending_q8 = -limit_q8;
+    }
+}
+
+// Up to 16 edges' worth of states; false if there isn't a whole edge pending
+static bool axis_word(QuadAxis* axis, uint32_t* word)
+{
+    int32_t edges = axis->pending_q8 / s_counts_per_edge_q8;
+    if (edges == 0)
+        return false;
+
+    int32_t step = edges > 0 ? 1 : -1;
+    int32_t n = abs(edges) < QUAD_STATES_PER_WORD ? abs(edges) : QUAD_STATES_PER_WORD;
+    axis->pending_q8 -= step * n * s_counts_per_edge_q8;
+
+    uint32_t w = 0;
+    for (int i = 0; i < QUAD_STATES_PER_WORD; i++) {
+        if (i < n)
+            axis->phase = (axis->phase + step) & 3;
+        w |= (uint32_t) s_gray[axis->phase] << (2 * i);
+    }
+
+    axis->edges += n;
+    axis->words++;
+    *word = w;
+    return true;
+}
+
+static void axis_pump(QuadAxis* axis)
+{
+    uint32_t word;
+    while (!pio_sm_is_tx_fifo_full(s_pio, axis->sm) && axis_word(axis, &word))
+        pio_sm_put(s_pio, axis->sm, word);
+}
+
+static void button_put(uint gpio, bool pressed)
+{
+    // open drain: drive low while pressed, let go otherwise
+    gpio_set_dir(gpio, pressed ? GPIO_OUT : GPIO_IN);
+}
+
+void quad_init()
+{
+    update_backlog_limit();
+
+    // the RX side of each channel is an output here too
+    channel_config(0, ChannelModeLevelShifter | ChannelModeGPIO | ChannelModeNoInvert);
+    channel_config(1, ChannelModeLevelShifter | ChannelModeGPIO | ChannelModeNoInvert);
+
+    s_axes[0].a_gpio = channels[0].tx_gpio;
+    s_axes[1].a_gpio = channels[1].tx_gpio;
+
+    for (int i = 0; i < 2; i++) {
+        uint gpio = i == 0 ? QUAD_BUTTON_LEFT_GPIO : QUAD_BUTTON_RIGHT_GPIO;
+        gpio_init(gpio);
+        gpio_put(gpio, 0);
+        button_put(gpio, false);
+    }
+
+    uint sms[2];
+    s_pio = pio_claim_with_room(&quad_out_program, 2, sms);
+    if (!s_pio) {
+        DBG("no PIO block with room for the quadrature program\n");
+        return;
+    }
+
+    s_axes[0].sm = sms[0];
+    s_axes[1].sm = sms[1];
+    uint offset = pio_add_program(s_pio, &quad_out_program);
+    for (int i = 0; i < 2; i++)
+        quad_out_program_init(s_pio, s_axes[i].sm, offset, s_axes[i].a_gpio, s_edge_rate);
+
+    DBG("pio%d sm %d/%d, %lu edges/s\n", pio_get_index(s_pio), s_axes[0].sm, s_axes[1].sm, s_edge_rate);
+}
+
+void quad_update()
+{
+    if (!s_pio)
+        return;
+    axis_pump(&s_axes[0]);
+    axis_pump(&s_axes[1]);
+}
+
+void quad_kbd_event(const KeyboardEvent event)
+{
+}
+
+void quad_mouse_event(const MouseEvent event)
+{
+    axis_add(&s_axes[0], event.dx);
+    axis_add(&s_axes[1], event.dy);
+
+    uint8_t changed = (event.buttons ^ s_buttons) & (MOUSE_BUTTON_LEFT | MOUSE_BUTTON_RIGHT);
+    if (changed & MOUSE_BUTTON_LEFT)
+        button_put(QUAD_BUTTON_LEFT_GPIO, event.buttons & MOUSE_BUTTON_LEFT);
+    if (changed & MOUSE_BUTTON_RIGHT)
+        button_put(QUAD_BUTTON_RIGHT_GPIO, event.buttons & MOUSE_BUTTON_RIGHT);
+    s_buttons = event.buttons;
+
+    quad_update();
+}
+
+#if DEBUG
+
+/*
+ * quad [rate <edges/s>] [scale <counts per edge>] -- settings and counters
+ */
+void quad_console_cmd(int argc, char** argv)
+{
+    if (argc >= 3 && strcmp(argv[1], "rate") == 0) {
+        uint32_t rate = strtoul(argv[2], NULL, 0);
+        if (rate < QUAD_MIN_EDGE_RATE || rate > QUAD_MAX_EDGE_RATE) {
+            console_printf("rate must be %u-%u edges/s\n", QUAD_MIN_EDGE_RATE, QUAD_MAX_EDGE_RATE);
+            return;
+        }
+        s_edge_rate = rate;
+        update_backlog_limit();
+        for (int i = 0; s_pio && i < 2; i++)
+            pio_sm_set_clkdiv(s_pio, s_axes[i].sm, (float) clock_get_hz(clk_sys) / s_edge_rate);
+    } else if (argc >= 3 && strcmp(argv[1], "scale") == 0) {
+        int32_t q8 = (int32_t) (atof(argv[2]) * 256);
+        if (q8 < 16 || q8 > (64 << 8)) {
+            console_printf("scale must be 0.0625-64 counts per edge\n");
+            return;
+        }
+        s_counts_per_edge_q8 = q8;
+    }
+
+    console_printf("%lu edges/s, %ld.%02ld counts per edge, backlog max %ld edges\n",
+        s_edge_rate, s_counts_per_edge_q8 >> 8, ((s_counts_per_edge_q8 & 0xff) * 100) >> 8, s_max_backlog);
+    for (int i = 0; i < 2; i++) {
+        QuadAxis* a = &s_axes[i];
+        console_printf("%s: edges %lu words %lu saturated %lu pending %ld/256\n",
+            a->name, a->edges, a->words, a->saturated, a->pending_q8);
+    }
+}
+
+#endif
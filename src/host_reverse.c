@@ -0,0 +1,465 @@
+#include <pico/stdlib.h>
+#include <hardware/uart.h>
+#include <hardware/irq.h>
+#include <string.h>
+#include <tusb.h>
+
+#define DEBUG_VERBOSE 0
+#define DEBUG_TAG "reverse"
+
+#include "babelfish.h"
+#include "console.h"
+#include "isr_stats.h"
+#include "uart_tx.h"
+#include "usb_hid_device.h"
+
+#include "host_reverse_keycodes.h"
+
+/**********************
+
+Reverse mode: a retro keyboard on channel A and a serial mouse on channel B,
+presented to a modern computer as a USB keyboard and mouse on the native
+USB port (usb_hid_device.c). The USB host port is unused.
+
+Keyboards, channel A:
+
+  sun     Type 4/5, TTL inverted, 1200 8N1. A key sends its code when
+          pressed and code | 0x80 when released; 0x7F once the last key is
+          up. 0xFF announces a reset and is followed by the type byte, 0xFE
+          the layout byte. LEDs are set with 0x0E and a bitmap.
+
+  apollo  Apollo keyboard at 5V, 1200 8E1, put in keystate mode (0xFF 0x01)
+          where it sends down codes and down | 0x80. Its own mouse port
+          comes through as mode 2: 0xFF 0x02, a 3 byte packet, 0xFF 0x01.
+
+Mice, channel B RX:
+
+  sun           Mouse Systems at TTL level and inverted, 1200 8N1
+  mousesystems  Mouse Systems through the MAX3232, 1200 8N1
+  microsoft     Microsoft/Logitech through the MAX3232, 1200 7N1
+
+Mouse Systems packets are a sync byte with the inverted buttons and two
+delta pairs (Y up); each pair is queued as soon as it is complete. A
+Microsoft packet is three bytes, the first with bit 6 set; a Logitech mouse
+adds a 4th byte with the middle button. Those mice live off the PC's RTS
+line: channel B TX is held in break (space, the positive level) so it can
+power one wired to the mouse's RTS pin.
+
+Bytes are decoded in the RX interrupts and the events queued straight for
+the USB side; the mainloop only handles LED changes and link upkeep.
+
+***********************/
+
+#define UART_KEYBOARD uart0
+#define UART_KEYBOARD_IRQ UART0_IRQ
+#define UART_MOUSE uart1
+#define UART_MOUSE_IRQ UART1_IRQ
+
+#define REVERSE_BAUD 1200
+
+#define SUN_RESET 0x01
+#define SUN_SET_LEDS 0x0e
+#define SUN_RESET_REPLY 0xff
+#define SUN_LAYOUT_REPLY 0xfe
+#define SUN_ALL_UP 0x7f
+#define SUN_KEY_UP 0x80
+
+#define SUN_LED_NUM_LOCK 0x01
+#define SUN_LED_COMPOSE 0x02
+#define SUN_LED_SCROLL_LOCK 0x04
+#define SUN_LED_CAPS_LOCK 0x08
+
+// HID LED output report bits
+#define HID_LED_NUM_LOCK 0x01
+#define HID_LED_CAPS_LOCK 0x02
+#define HID_LED_SCROLL_LOCK 0x04
+#define HID_LED_COMPOSE 0x08
+
+#define APOLLO_CMD 0xff
+#define APOLLO_MODE_KEYSTATE 0x01
+#define APOLLO_MODE_MOUSE 0x02
+#define APOLLO_KEY_UP 0x80
+
+#define MSYS_SYNC_MASK 0xf8
+#define MSYS_SYNC 0x80
+#define MSYS_NO_LEFT 0x04
+#define MSYS_NO_MIDDLE 0x02
+#define MSYS_NO_RIGHT 0x01
+
+#define MS_SYNC 0x40
+#define MS_LEFT 0x20
+#define MS_RIGHT 0x10
+#define LOGITECH_MIDDLE 0x20
+
+typedef enum {
+    ReverseKbdNone,
+    ReverseKbdSun,
+    ReverseKbdApollo,
+    ReverseKbdCount
+} ReverseKbd;
+
+typedef enum {
+    ReverseMouseNone,
+    ReverseMouseSun,
+    ReverseMouseMouseSystems,
+    ReverseMouseMicrosoft,
+    ReverseMouseCount
+} ReverseMouse;
+
+static const char* const s_kbd_names[ReverseKbdCount] = {
+    [ReverseKbdNone] = "none",
+    [ReverseKbdSun] = "sun",
+    [ReverseKbdApollo] = "apollo",
+};
+
+static const char* const s_mouse_names[ReverseMouseCount] = {
+    [ReverseMouseNone] = "none",
+    [ReverseMouseSun] = "sun",
+    [ReverseMouseMouseSystems] = "mousesystems",
+    [ReverseMouseMicrosoft] = "microsoft",
+};
+
+static UartTx s_kbd_tx;
+
+static struct {
+    ReverseKbd type;
+    uint8_t skip;               // reply bytes still to come after 0xFF/0xFE
+    bool apollo_cmd;            // 0xFF seen, mode byte next
+    uint8_t apollo_mode;
+    uint8_t apollo_mouse[3];
+    uint8_t apollo_mouse_len;
+    volatile bool reset_seen;   // the keyboard reset; LEDs need resending
+    uint8_t leds;               // HID LED bits last sent to the keyboard
+
+    uint32_t keys;
+    uint32_t resets;
+    uint32_t unknown;
+} s_kbd;
+
+static struct {
+    ReverseMouse type;
+    uint8_t packet[5];
+    uint8_t len;
+    uint8_t buttons;            // USB order
+
+    uint32_t packets;
+    uint32_t sync_errors;
+} s_mouse;
+
+static void on_keyboard_rx();
+static void on_mouse_rx();
+
+static void kbd_init(ReverseKbd type)
+{
+    irq_set_enabled(UART_KEYBOARD_IRQ, false);
+    memset(&s_kbd, 0, sizeof(s_kbd));
+    s_kbd.type = type;
+    if (type == ReverseKbdNone)
+        return;
+
+    if (type == ReverseKbdSun)
+        channel_config(0, ChannelModeLevelShifter | ChannelModeUART | ChannelModeInvert);
+    else
+        channel_config(0, ChannelModeLevelShifter | ChannelModeUART);
+
+    uart_init(UART_KEYBOARD, REVERSE_BAUD);
+    uart_set_hw_flow(UART_KEYBOARD, false, false);
+    uart_set_format(UART_KEYBOARD, 8, 1, type == ReverseKbdApollo ? UART_PARITY_EVEN : UART_PARITY_NONE);
+    uart_tx_init(&s_kbd_tx, UART_KEYBOARD);
+    irq_set_exclusive_handler(UART_KEYBOARD_IRQ, on_keyboard_rx);
+    irq_set_enabled(UART_KEYBOARD_IRQ, true);
+    uart_set_irq_enables(UART_KEYBOARD, true, false);
+
+    if (type == ReverseKbdSun) {
+        uart_tx_putc(&s_kbd_tx, SUN_RESET);
+    } else {
+        static const uint8_t keystate[] = { APOLLO_CMD, APOLLO_MODE_KEYSTATE };
+        uart_tx_write(&s_kbd_tx, keystate, sizeof(keystate));
+    }
+}
+
+static void mouse_init(ReverseMouse type)
+{
+    irq_set_enabled(UART_MOUSE_IRQ, false);
+    memset(&s_mouse, 0, sizeof(s_mouse));
+    s_mouse.type = type;
+    if (type == ReverseMouseNone)
+        return;
+
+    if (type == ReverseMouseSun)
+        channel_config(1, ChannelModeLevelShifter | ChannelModeUART | ChannelModeInvert);
+    else
+        channel_config(1, ChannelConfigRS232);
+
+    uart_init(UART_MOUSE, REVERSE_BAUD);
+    uart_set_hw_flow(UART_MOUSE, false, false);
+    uart_set_format(UART_MOUSE, type == ReverseMouseMicrosoft ? 7 : 8, 1, UART_PARITY_NONE);
+    // RTS power for a Microsoft mouse; it comes up and sends its ident,
+    // which the decoder drops
+    uart_set_break(UART_MOUSE, type == ReverseMouseMicrosoft);
+    irq_set_exclusive_handler(UART_MOUSE_IRQ, on_mouse_rx);
+    irq_set_enabled(UART_MOUSE_IRQ, true);
+    uart_set_irq_enables(UART_MOUSE, true, false);
+}
+
+void reverse_init()
+{
+    kbd_init(ReverseKbdSun);
+    mouse_init(ReverseMouseSun);
+}
+
+static void __not_in_flash_func(kbd_key)(const uint8_t* table, uint8_t code, bool down)
+{
+    uint8_t usage = table[code & 0x7f];
+    if (!usage) {
+        s_kbd.unknown++;
+        return;
+    }
+    s_kbd.keys++;
+    usb_hid_device_key(usage, down);
+}
+
+static void __not_in_flash_func(sun_rx)(uint8_t ch)
+{
+    if (s_kbd.skip) {
+        s_kbd.skip--;
+        return;
+    }
+
+    switch (ch) {
+        case SUN_RESET_REPLY:
+            // type byte, then 0x7F
+            s_kbd.skip = 1;
+            s_kbd.resets++;
+            s_kbd.reset_seen = true;
+            usb_hid_device_keys_up();
+            break;
+        case SUN_LAYOUT_REPLY:
+            s_kbd.skip = 1;
+            break;
+        case SUN_ALL_UP:
+            usb_hid_device_keys_up();
+            break;
+        default:
+            kbd_key(sun2usb, ch, !(ch & SUN_KEY_UP));
+            break;
+    }
+}
+
+// The mouse's buttons come in the Apollo host's order, which is USB's
+static void __not_in_flash_func(apollo_mouse_rx)(uint8_t ch)
+{
+    s_kbd.apollo_mouse[s_kbd.apollo_mouse_len++] = ch;
+    if (s_kbd.apollo_mouse_len < sizeof(s_kbd.apollo_mouse))
+        return;
+
+    s_kbd.apollo_mouse_len = 0;
+    uint8_t buttons = ((s_kbd.apollo_mouse[0] ^ 0xf0) >> 4) & 0x07;
+    usb_hid_device_mouse((int8_t) s_kbd.apollo_mouse[1], -(int8_t) s_kbd.apollo_mouse[2], 0, buttons);
+}
+
+static void __not_in_flash_func(apollo_rx)(uint8_t ch)
+{
+    if (s_kbd.apollo_cmd) {
+        s_kbd.apollo_cmd = false;
+        s_kbd.apollo_mode = ch;
+        s_kbd.apollo_mouse_len = 0;
+        // back in compatibility mode (ASCII) after a keyboard reset
+        if (ch != APOLLO_MODE_KEYSTATE && ch != APOLLO_MODE_MOUSE) {
+            s_kbd.resets++;
+            s_kbd.reset_seen = true;
+            usb_hid_device_keys_up();
+        }
+        return;
+    }
+    if (ch == APOLLO_CMD) {
+        s_kbd.apollo_cmd = true;
+        return;
+    }
+
+    if (s_kbd.apollo_mode == APOLLO_MODE_MOUSE)
+        apollo_mouse_rx(ch);
+    else if (s_kbd.apollo_mode == APOLLO_MODE_KEYSTATE)
+        kbd_key(apollo2usb, ch, !(ch & APOLLO_KEY_UP));
+}
+
+// RX interrupt handlers, RAM-resident to keep XIP cache misses out of them.
+// Both run at the same priority, so with an Apollo keyboard and a serial
+// mouse the two never preempt each other on the USB mouse queue.
+void __not_in_flash_func(on_keyboard_rx)()
+{
+    ISR_STAT_BEGIN();
+    while (uart_is_readable(UART_KEYBOARD)) {
+        uint8_t ch = uart_getc(UART_KEYBOARD);
+        if (s_kbd.type == ReverseKbdSun)
+            sun_rx(ch);
+        else
+            apollo_rx(ch);
+    }
+    ISR_STAT_END(IsrStatKbdRx);
+}
+
+static void __not_in_flash_func(msys_rx)(uint8_t ch)
+{
+    if ((ch & MSYS_SYNC_MASK) == MSYS_SYNC) {
+        if (s_mouse.len != 0 && s_mouse.len != 3)
+            s_mouse.sync_errors++;
+        s_mouse.packet[0] = ch;
+        s_mouse.len = 1;
+        s_mouse.buttons = ((ch & MSYS_NO_LEFT) ? 0 : MOUSE_BUTTON_LEFT)
+            | ((ch & MSYS_NO_MIDDLE) ? 0 : MOUSE_BUTTON_MIDDLE)
+            | ((ch & MSYS_NO_RIGHT) ? 0 : MOUSE_BUTTON_RIGHT);
+        return;
+    }
+    if (s_mouse.len == 0 || s_mouse.len >= sizeof(s_mouse.packet))
+        return;
+
+    s_mouse.packet[s_mouse.len++] = ch;
+    if (s_mouse.len == 3 || s_mouse.len == 5) {
+        int8_t dx = s_mouse.packet[s_mouse.len - 2];
+        int8_t dy = s_mouse.packet[s_mouse.len - 1];
+        if (s_mouse.len == 3)
+            s_mouse.packets++;
+        usb_hid_device_mouse(dx, -dy, 0, s_mouse.buttons);
+    }
+}
+
+static void __not_in_flash_func(microsoft_rx)(uint8_t ch)
+{
+    if (ch & MS_SYNC) {
+        if (s_mouse.len != 0 && s_mouse.len < 3)
+            s_mouse.sync_errors++;
+        s_mouse.packet[0] = ch;
+        s_mouse.len = 1;
+        return;
+    }
+
+    if (s_mouse.len == 3) {
+        // Logitech: the middle button, after the packet it belongs to
+        uint8_t buttons = (s_mouse.buttons & ~MOUSE_BUTTON_MIDDLE)
+            | ((ch & LOGITECH_MIDDLE) ? MOUSE_BUTTON_MIDDLE : 0);
+        s_mouse.len = 4;
+        if (buttons != s_mouse.buttons) {
+            s_mouse.buttons = buttons;
+            usb_hid_device_mouse(0, 0, 0, buttons);
+        }
+        return;
+    }
+    if (s_mouse.len == 0 || s_mouse.len > 3)
+        return;
+
+    s_mouse.packet[s_mouse.len++] = ch;
+    if (s_mouse.len < 3)
+        return;
+
+    uint8_t b0 = s_mouse.packet[0];
+    int8_t dx = ((b0 & 0x03) << 6) | (s_mouse.packet[1] & 0x3f);
+    int8_t dy = ((b0 & 0x0c) << 4) | (s_mouse.packet[2] & 0x3f);
+    s_mouse.buttons = (s_mouse.buttons & MOUSE_BUTTON_MIDDLE)
+        | ((b0 & MS_LEFT) ? MOUSE_BUTTON_LEFT : 0)
+        | ((b0 & MS_RIGHT) ? MOUSE_BUTTON_RIGHT : 0);
+    s_mouse.packets++;
+    usb_hid_device_mouse(dx, dy, 0, s_mouse.buttons);
+}
+
+void __not_in_flash_func(on_mouse_rx)()
+{
+    ISR_STAT_BEGIN();
+    while (uart_is_readable(UART_MOUSE)) {
+        uint8_t ch = uart_getc(UART_MOUSE);
+        if (s_mouse.type == ReverseMouseMicrosoft)
+            microsoft_rx(ch);
+        else
+            msys_rx(ch);
+    }
+    ISR_STAT_END(IsrStatMouseRx);
+}
+
+static uint8_t sun_leds(uint8_t hid)
+{
+    return ((hid & HID_LED_NUM_LOCK) ? SUN_LED_NUM_LOCK : 0)
+        | ((hid & HID_LED_CAPS_LOCK) ? SUN_LED_CAPS_LOCK : 0)
+        | ((hid & HID_LED_SCROLL_LOCK) ? SUN_LED_SCROLL_LOCK : 0)
+        | ((hid & HID_LED_COMPOSE) ? SUN_LED_COMPOSE : 0);
+}
+
+static void kbd_task()
+{
+    if (s_kbd.type == ReverseKbdNone)
+        return;
+    uart_tx_task(&s_kbd_tx);
+
+    bool reset = s_kbd.reset_seen;
+    s_kbd.reset_seen = false;
+
+    if (s_kbd.type == ReverseKbdApollo) {
+        if (reset) {
+            static const uint8_t keystate[] = { APOLLO_CMD, APOLLO_MODE_KEYSTATE };
+            uart_tx_write(&s_kbd_tx, keystate, sizeof(keystate));
+        }
+        return;
+    }
+
+    uint8_t leds = usb_hid_device_leds();
+    if (leds != s_kbd.leds || reset) {
+        const uint8_t cmd[] = { SUN_SET_LEDS, sun_leds(leds) };
+        if (uart_tx_write(&s_kbd_tx, cmd, sizeof(cmd)))
+            s_kbd.leds = leds;
+    }
+}
+
+void reverse_update()
+{
+    kbd_task();
+    usb_hid_device_task();
+}
+
+// The USB host port has nothing to say in this mode
+void reverse_kbd_event(const KeyboardEvent event)
+{
+}
+
+void reverse_mouse_event(const MouseEvent event)
+{
+}
+
+#if DEBUG
+
+static int find_name(const char* const* names, int count, const char* name)
+{
+    for (int i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * reverse [kbd sun|apollo|none] [mouse sun|mousesystems|microsoft|none]
+ *   -- devices on the channels, decode and USB counters
+ */
+void reverse_console_cmd(int argc, char** argv)
+{
+    for (int i = 1; i + 1 < argc; i += 2) {
+        int type;
+        if (strcmp(argv[i], "kbd") == 0
+            && (type = find_name(s_kbd_names, ReverseKbdCount, argv[i + 1])) >= 0) {
+            kbd_init(type);
+        } else if (strcmp(argv[i], "mouse") == 0
+            && (type = find_name(s_mouse_names, ReverseMouseCount, argv[i + 1])) >= 0) {
+            mouse_init(type);
+        } else {
+            console_printf("usage: reverse [kbd sun|apollo|none] [mouse sun|mousesystems|microsoft|none]\n");
+            return;
+        }
+    }
+
+    console_printf("kbd   %s: %lu keys, %lu unknown codes, %lu resets; tx %lu bytes, %lu dropped\n",
+        s_kbd_names[s_kbd.type], s_kbd.keys, s_kbd.unknown, s_kbd.resets,
+        s_kbd_tx.bytes, s_kbd_tx.dropped);
+    console_printf("mouse %s: %lu packets, %lu sync errors\n",
+        s_mouse_names[s_mouse.type], s_mouse.packets, s_mouse.sync_errors);
+    usb_hid_device_print_stats();
+}
+
+#endif
@@ -0,0 +1,233 @@
+/*
+ * Keyboard codes back to HID usages, for the reverse hosts (host_reverse.c).
+ *
+ * sun2usb inverts usb2sun (host_sun_keycodes.h), plus the left-hand block
+ * (Stop, Again, Props, Undo, Front, Copy, Open, Paste, Find, Cut) which
+ * usb2sun doesn't send. apollo2usb inverts the Down codes of the unmodified
+ * Apollo table (host_apollo.c); the Apollo-only keys have no HID usage and
+ * are dropped.
+ */
+
+#ifndef _REVERSE_KEYCODES_H_
+#define _REVERSE_KEYCODES_H_
+
+#include <stdint.h>
+#include "hid_codes.h"
+
+// Looked up on every key event; kept in RAM with the other keymaps
+static const uint8_t __not_in_flash("keymap") sun2usb[128] = {
+    [0x01] = HID_KEY_STOP,
+    [0x02] = HID_KEY_VOLUME_DOWN,
+    [0x03] = HID_KEY_AGAIN,
+    [0x04] = HID_KEY_VOLUME_UP,
+    [0x05] = HID_KEY_F1,
+    [0x06] = HID_KEY_F2,
+    [0x07] = HID_KEY_F10,
+    [0x08] = HID_KEY_F3,
+    [0x09] = HID_KEY_F11,
+    [0x0a] = HID_KEY_F4,
+    [0x0b] = HID_KEY_F12,
+    [0x0c] = HID_KEY_F5,
+    [0x0d] = HID_KEY_RIGHT_ALT,
+    [0x0e] = HID_KEY_F6,
+    [0x0f] = HID_KEY_ESCAPE,
+    [0x10] = HID_KEY_F7,
+    [0x11] = HID_KEY_F8,
+    [0x12] = HID_KEY_F9,
+    [0x13] = HID_KEY_LEFT_ALT,
+    [0x14] = HID_KEY_ARROW_UP,
+    [0x15] = HID_KEY_PAUSE,
+    [0x16] = HID_KEY_PRINTSCREEN,
+    [0x17] = HID_KEY_SCROLL_LOCK,
+    [0x18] = HID_KEY_ARROW_LEFT,
+    [0x19] = HID_KEY_MENU,
+    [0x1a] = HID_KEY_UNDO,
+    [0x1b] = HID_KEY_ARROW_DOWN,
+    [0x1c] = HID_KEY_ARROW_RIGHT,
+    [0x1e] = HID_KEY_1_EXCLAMATION_MARK,
+    [0x1f] = HID_KEY_2_AT,
+    [0x20] = HID_KEY_3_NUMBER_SIGN,
+    [0x21] = HID_KEY_4_DOLLAR,
+    [0x22] = HID_KEY_5_PERCENT,
+    [0x23] = HID_KEY_6_CARET,
+    [0x24] = HID_KEY_7_AMPERSAND,
+    [0x25] = HID_KEY_8_ASTERISK,
+    [0x26] = HID_KEY_9_OPARENTHESIS,
+    [0x27] = HID_KEY_0_CPARENTHESIS,
+    [0x28] = HID_KEY_MINUS_UNDERSCORE,
+    [0x29] = HID_KEY_EQUAL_PLUS,
+    [0x2a] = HID_KEY_GRAVE_ACCENT_AND_TILDE,
+    [0x2b] = HID_KEY_BACKSPACE,
+    [0x2c] = HID_KEY_INSERT,
+    [0x2d] = HID_KEY_MUTE,
+    [0x2e] = HID_KEY_KEYPAD_DIVIDE,
+    [0x2f] = HID_KEY_KEYPAD_MULTIPLY,
+    [0x30] = HID_KEY_POWER,
+    [0x31] = HID_KEY_SELECT,
+    [0x32] = HID_KEY_KEYPAD_COMMA,
+    [0x33] = HID_KEY_COPY,
+    [0x34] = HID_KEY_HOME,
+    [0x35] = HID_KEY_TAB,
+    [0x36] = HID_KEY_Q,
+    [0x37] = HID_KEY_W,
+    [0x38] = HID_KEY_E,
+    [0x39] = HID_KEY_R,
+    [0x3a] = HID_KEY_T,
+    [0x3b] = HID_KEY_Y,
+    [0x3c] = HID_KEY_U,
+    [0x3d] = HID_KEY_I,
+    [0x3e] = HID_KEY_O,
+    [0x3f] = HID_KEY_P,
+    [0x40] = HID_KEY_OBRACKET_AND_OBRACE,
+    [0x41] = HID_KEY_OBRACKET_AND_OBRACE,
+    [0x42] = HID_KEY_DELETE,
+    [0x43] = HID_KEY_RIGHT_CONTROL,
+    [0x44] = HID_KEY_KEYPAD_7,
+    [0x45] = HID_KEY_KEYPAD_8,
+    [0x46] = HID_KEY_KEYPAD_9,
+    [0x47] = HID_KEY_KEYPAD_SUBTRACT,
+    [0x48] = HID_KEY_EXECUTE,
+    [0x49] = HID_KEY_PASTE,
+    [0x4a] = HID_KEY_END,
+    [0x4c] = HID_KEY_LEFT_CONTROL,
+    [0x4d] = HID_KEY_A,
+    [0x4e] = HID_KEY_S,
+    [0x4f] = HID_KEY_D,
+    [0x50] = HID_KEY_F,
+    [0x51] = HID_KEY_G,
+    [0x52] = HID_KEY_H,
+    [0x53] = HID_KEY_J,
+    [0x54] = HID_KEY_K,
+    [0x55] = HID_KEY_L,
+    [0x56] = HID_KEY_SEMICOLON_COLON,
+    [0x57] = HID_KEY_SINGLE_AND_DOUBLE_QUOTE,
+    [0x58] = HID_KEY_BACKSLASH_VERTICAL_BAR,
+    [0x59] = HID_KEY_ENTER,
+    [0x5a] = HID_KEY_KEYPAD_ENTER,
+    [0x5b] = HID_KEY_KEYPAD_4,
+    [0x5c] = HID_KEY_KEYPAD_5,
+    [0x5d] = HID_KEY_KEYPAD_6,
+    [0x5e] = HID_KEY_KEYPAD_0,
+    [0x5f] = HID_KEY_FIND,
+    [0x60] = HID_KEY_PAGE_UP,
+    [0x61] = HID_KEY_CUT,
+    [0x62] = HID_KEY_NUM_LOCK,
+    [0x63] = HID_KEY_LEFT_SHIFT,
+    [0x64] = HID_KEY_Z,
+    [0x65] = HID_KEY_X,
+    [0x66] = HID_KEY_C,
+    [0x67] = HID_KEY_V,
+    [0x68] = HID_KEY_B,
+    [0x69] = HID_KEY_N,
+    [0x6a] = HID_KEY_M,
+    [0x6b] = HID_KEY_COMMA,
+    [0x6c] = HID_KEY_PERIOD,
+    [0x6d] = HID_KEY_SLASH,
+    [0x6e] = HID_KEY_RIGHT_SHIFT,
+    [0x70] = HID_KEY_KEYPAD_1,
+    [0x71] = HID_KEY_KEYPAD_2,
+    [0x72] = HID_KEY_KEYPAD_3,
+    [0x76] = HID_KEY_HELP,
+    [0x77] = HID_KEY_CAPS_LOCK,
+    [0x78] = HID_KEY_GUI_LEFT,
+    [0x79] = HID_KEY_SPACE,
+    [0x7a] = HID_KEY_GUI_RIGHT,
+    [0x7b] = HID_KEY_PAGE_DOWN,
+    [0x7d] = HID_KEY_KEYPAD_ADD,
+};
+
+// Down codes; Up is the same with bit 7 set
+static const uint8_t __not_in_flash("keymap") apollo2usb[128] = {
+    [0x04] = HID_KEY_F10,
+    [0x05] = HID_KEY_F1,
+    [0x06] = HID_KEY_F2,
+    [0x07] = HID_KEY_F3,
+    [0x08] = HID_KEY_F4,
+    [0x09] = HID_KEY_F5,
+    [0x0a] = HID_KEY_F6,
+    [0x0b] = HID_KEY_F7,
+    [0x0c] = HID_KEY_F8,
+    [0x0d] = HID_KEY_F9,
+    [0x17] = HID_KEY_ESCAPE,
+    [0x18] = HID_KEY_1,
+    [0x19] = HID_KEY_2,
+    [0x1a] = HID_KEY_3,
+    [0x1b] = HID_KEY_4,
+    [0x1c] = HID_KEY_5,
+    [0x1d] = HID_KEY_6,
+    [0x1e] = HID_KEY_7,
+    [0x1f] = HID_KEY_8,
+    [0x20] = HID_KEY_9,
+    [0x21] = HID_KEY_0,
+    [0x22] = HID_KEY_MINUS,
+    [0x23] = HID_KEY_EQUAL,
+    [0x24] = HID_KEY_GRAVE,
+    [0x25] = HID_KEY_BACKSPACE,
+    [0x27] = HID_KEY_HOME,
+    [0x29] = HID_KEY_END,
+    [0x2c] = HID_KEY_TAB,
+    [0x2d] = HID_KEY_Q,
+    [0x2e] = HID_KEY_W,
+    [0x2f] = HID_KEY_E,
+    [0x30] = HID_KEY_R,
+    [0x31] = HID_KEY_T,
+    [0x32] = HID_KEY_Y,
+    [0x33] = HID_KEY_U,
+    [0x34] = HID_KEY_I,
+    [0x35] = HID_KEY_O,
+    [0x36] = HID_KEY_P,
+    [0x37] = HID_KEY_BRACKET_LEFT,
+    [0x38] = HID_KEY_BRACKET_RIGHT,
+    [0x3a] = HID_KEY_DELETE,
+    [0x3c] = HID_KEY_KEYPAD_7_HOME,
+    [0x3d] = HID_KEY_KEYPAD_8_UP_ARROW,
+    [0x3e] = HID_KEY_KEYPAD_9_PAGEUP,
+    [0x3f] = HID_KEY_KEYPAD_PLUS,
+    [0x41] = HID_KEY_ARROW_UP,
+    [0x43] = HID_KEY_LEFT_CONTROL,
+    [0x46] = HID_KEY_A,
+    [0x47] = HID_KEY_S,
+    [0x48] = HID_KEY_D,
+    [0x49] = HID_KEY_F,
+    [0x4a] = HID_KEY_G,
+    [0x4b] = HID_KEY_H,
+    [0x4c] = HID_KEY_J,
+    [0x4d] = HID_KEY_K,
+    [0x4e] = HID_KEY_L,
+    [0x4f] = HID_KEY_SEMICOLON,
+    [0x50] = HID_KEY_APOSTROPHE,
+    [0x52] = HID_KEY_ENTER,
+    [0x53] = HID_KEY_BACKSLASH,
+    [0x55] = HID_KEY_KEYPAD_4_LEFT_ARROW,
+    [0x56] = HID_KEY_KEYPAD_5,
+    [0x57] = HID_KEY_KEYPAD_6_RIGHT_ARROW,
+    [0x58] = HID_KEY_KEYPAD_MINUS,
+    [0x59] = HID_KEY_ARROW_LEFT,
+    [0x5b] = HID_KEY_ARROW_RIGHT,
+    [0x5e] = HID_KEY_LEFT_SHIFT,
+    [0x60] = HID_KEY_Z,
+    [0x61] = HID_KEY_X,
+    [0x62] = HID_KEY_C,
+    [0x63] = HID_KEY_V,
+    [0x64] = HID_KEY_B,
+    [0x65] = HID_KEY_N,
+    [0x66] = HID_KEY_M,
+    [0x67] = HID_KEY_COMMA,
+    [0x68] = HID_KEY_PERIOD,
+    [0x69] = HID_KEY_SLASH,
+    [0x6a] = HID_KEY_RIGHT_SHIFT,
+    [0x6e] = HID_KEY_KEYPAD_1_END,
+    [0x6f] = HID_KEY_KEYPAD_2_DOWN_ARROW,
+    [0x70] = HID_KEY_KEYPAD_3_PAGEDN,
+    [0x72] = HID_KEY_PAGE_UP,
+    [0x73] = HID_KEY_ARROW_DOWN,
+    [0x74] = HID_KEY_PAGE_DOWN,
+    [0x75] = HID_KEY_LEFT_ALT,
+    [0x76] = HID_KEY_SPACE,
+    [0x77] = HID_KEY_RIGHT_ALT,
+    [0x79] = HID_KEY_KEYPAD_0_INSERT,
+    [0x7b] = HID_KEY_KEYPAD_DECIMAL,
+    [0x7c] = HID_KEY_KEYPAD_ENTER,
+};
+
+#endif
@@ -0,0 +1,295 @@
+#include <pico/stdlib.h>
+#include <hardware/uart.h>
+#include <hardware/irq.h>
+#include <stdlib.h>
+#include <tusb.h>
+
+#define DEBUG_VERBOSE 0
+#define DEBUG_TAG "sgi"
+
+#include "babelfish.h"
+#include "console.h"
+#include "isr_stats.h"
+#include "kbd_leds.h"
+#include "uart_tx.h"
+
+#include "host_sgi_keycodes.h"
+
+DBG_MODULE();
+
+/**********************
+
+SGI IRIS keyboard and mouse: the serial ones from before the move to PS/2
+(IRIS 4D, Personal IRIS, Indigo). Both go through the MAX3232.
+
+Keyboard, channel A, 600 baud 8O1. A key sends its number when pressed and
+the number | 0x80 when released; once the last key is up the keyboard adds
+0xF0. Every host byte writes a control register: bit 0 picks register A or
+B, the rest are flags (below). Asking for the configuration gets 0x6E and
+the DIP switch byte back.
+
+Mouse, channel B TX, 4800 baud 8N1, Mouse Systems style 5 byte packets:
+0x80 | inverted buttons (left, middle, right in bits 2-0), then dx1, dy1,
+dx2, dy2 as signed bytes with Y up.
+
+A mouse packet is only built once the previous one has completely left the
+wire, from all the motion since. At 4800 baud that is 96 packets a second,
+the most the link carries, and nothing stale ever waits in a queue. The two
+delta pairs each carry half the motion, so one packet can move 254 counts.
+
+***********************/
+
+#define UART_KEYBOARD uart0
+#define UART_KEYBOARD_IRQ UART0_IRQ
+#define UART_MOUSE uart1
+
+#define SGI_KBD_BAUD 600
+#define SGI_MOUSE_BAUD 4800
+
+// control register A (bit 0 clear)
+#define SGI_CTRL_A_SHORT_BEEP 0x02
+#define SGI_CTRL_A_LONG_BEEP 0x04
+#define SGI_CTRL_A_NO_CLICK 0x08
+#define SGI_CTRL_A_CONFIG 0x10
+#define SGI_CTRL_A_NUM_LOCK 0x20
+#define SGI_CTRL_A_CAPS_LOCK 0x40
+#define SGI_CTRL_A_AUTOREPEAT 0x80
+
+// control register B (bit 0 set)
+#define SGI_CTRL_B_SCROLL_LOCK 0x04
+#define SGI_CTRL_B_USER_LEDS 0x78 // L1-L4
+
+#define SGI_KEY_UP 0x80
+#define SGI_KEY_ALL_UP 0xf0
+#define SGI_KEY_CONFIG 0x6e
+
+// US layout, no options
+#define SGI_CONFIG_SWITCHES 0x00
+
+// The keyboard's own repeat: 650 ms, then 28 per second
+#define SGI_REPEAT_DELAY_US 650000
+#define SGI_REPEAT_PERIOD_US (1000000 / 28)
+
+#define SGI_MOUSE_ACCUM_LIMIT 1024
+
+static UartTx s_kbd_tx;
+static UartTx s_mouse_tx;
+
+static struct {
+    // last values written to the control registers, updated by the RX ISR
+    volatile uint8_t ctrl_a;
+    volatile uint8_t ctrl_b;
+    volatile uint8_t beeps;      // bell requests not yet logged
+    uint8_t logged_a, logged_b;
+
+    uint8_t keys_down;
+    uint8_t repeat_code;         // key being repeated, 0xff if none
+    uint32_t repeat_at_us;
+} s_kbd = { .repeat_code = 0xff };
+
+static struct {
+    int32_t dx, dy;              // motion not sent yet, USB counts, Y down
+    uint8_t buttons;
+    bool dirty;
+    uint32_t packets;
+} s_mouse;
+
+static void on_keyboard_rx();
+
+void sgi_init()
+{
+    channel_config(0, ChannelConfigRS232);
+    channel_config(1, ChannelConfigRS232);
+
+    uart_init(UART_KEYBOARD, SGI_KBD_BAUD);
+    uart_set_hw_flow(UART_KEYBOARD, false, false);
+    uart_set_format(UART_KEYBOARD, 8, 1, UART_PARITY_ODD);
+    uart_tx_init(&s_kbd_tx, UART_KEYBOARD);
+    irq_set_exclusive_handler(UART_KEYBOARD_IRQ, on_keyboard_rx);
+    irq_set_enabled(UART_KEYBOARD_IRQ, true);
+    uart_set_irq_enables(UART_KEYBOARD, true, false);
+
+    uart_init(UART_MOUSE, SGI_MOUSE_BAUD);
+    uart_set_hw_flow(UART_MOUSE, false, false);
+    uart_set_format(UART_MOUSE, 8, 1, UART_PARITY_NONE);
+    uart_tx_init(&s_mouse_tx, UART_MOUSE);
+}
+
+// RX interrupt handler, RAM-resident to keep XIP cache misses out of it.
+// Register writes are only recorded here; the mainloop acts on them.
+void __not_in_flash_func(on_keyboard_rx)()
+{
+    ISR_STAT_BEGIN();
+    while (uart_is_readable(UART_KEYBOARD)) {
+        uint8_t ch = uart_getc(UART_KEYBOARD);
+
+        if (ch & 1) {
+            s_kbd.ctrl_b = ch;
+            continue;
+        }
+
+        s_kbd.ctrl_a = ch;
+        if (ch & (SGI_CTRL_A_SHORT_BEEP | SGI_CTRL_A_LONG_BEEP))
+            s_kbd.beeps++;
+        if (ch & SGI_CTRL_A_CONFIG) {
+            static const uint8_t config[] = { SGI_KEY_CONFIG, SGI_CONFIG_SWITCHES };
+            uart_tx_write(&s_kbd_tx, config, sizeof(config));
+        }
+    }
+    ISR_STAT_END(IsrStatKbdRx);
+}
+
+static void kbd_log_ctrl()
+{
+    if (s_kbd.beeps) {
+        s_kbd.beeps = 0;
+        DBG("bell (%s)\n", (s_kbd.ctrl_a & SGI_CTRL_A_LONG_BEEP) ? "long" : "short");
+    }
+
+    uint8_t leds_a = s_kbd.ctrl_a & (SGI_CTRL_A_NUM_LOCK | SGI_CTRL_A_CAPS_LOCK | SGI_CTRL_A_NO_CLICK | SGI_CTRL_A_AUTOREPEAT);
+    uint8_t leds_b = s_kbd.ctrl_b & (SGI_CTRL_B_SCROLL_LOCK | SGI_CTRL_B_USER_LEDS);
+    if (leds_a != s_kbd.logged_a || leds_b != s_kbd.logged_b) {
+        s_kbd.logged_a = leds_a;
+        s_kbd.logged_b = leds_b;
+        DBG("leds num %d caps %d scroll %d L1-4 %x, click %s, repeat %s\n",
+            !!(leds_a & SGI_CTRL_A_NUM_LOCK), !!(leds_a & SGI_CTRL_A_CAPS_LOCK),
+            !!(leds_b & SGI_CTRL_B_SCROLL_LOCK), (leds_b & SGI_CTRL_B_USER_LEDS) >> 3,
+            (leds_a & SGI_CTRL_A_NO_CLICK) ? "off" : "on",
+            (leds_a & SGI_CTRL_A_AUTOREPEAT) ? "on" : "off");
+    }
+}
+
+// the lock LEDs back to the USB keyboards; kbd_leds_set drops repeats
+static void kbd_leds_update()
+{
+    uint8_t a = s_kbd.ctrl_a, b = s_kbd.ctrl_b;
+    kbd_leds_set(((a & SGI_CTRL_A_NUM_LOCK) ? KEYBOARD_LED_NUMLOCK : 0) |
+                 ((a & SGI_CTRL_A_CAPS_LOCK) ? KEYBOARD_LED_CAPSLOCK : 0) |
+                 ((b & SGI_CTRL_B_SCROLL_LOCK) ? KEYBOARD_LED_SCROLLLOCK : 0));
+}
+
+static void kbd_send(uint8_t code, bool down)
+{
+    if (down) {
+        s_kbd.keys_down++;
+        uart_tx_putc(&s_kbd_tx, code);
+        s_kbd.repeat_code = code;
+        s_kbd.repeat_at_us = time_us_32() + SGI_REPEAT_DELAY_US;
+        return;
+    }
+
+    if (s_kbd.keys_down)
+        s_kbd.keys_down--;
+    if (code == s_kbd.repeat_code)
+        s_kbd.repeat_code = 0xff;
+
+    uart_tx_putc(&s_kbd_tx, code | SGI_KEY_UP);
+    if (s_kbd.keys_down == 0)
+        uart_tx_putc(&s_kbd_tx, SGI_KEY_ALL_UP);
+}
+
+static void kbd_repeat()
+{
+    if (s_kbd.repeat_code == 0xff || !(s_kbd.ctrl_a & SGI_CTRL_A_AUTOREPEAT))
+        return;
+    if ((int32_t) (time_us_32() - s_kbd.repeat_at_us) < 0)
+        return;
+
+    // at 600 baud a queue of repeats would outlive the key
+    if (uart_tx_idle(&s_kbd_tx))
+        uart_tx_putc(&s_kbd_tx, s_kbd.repeat_code);
+    s_kbd.repeat_at_us += SGI_REPEAT_PERIOD_US;
+    if ((int32_t) (time_us_32() - s_kbd.repeat_at_us) > 0)
+        s_kbd.repeat_at_us = time_us_32() + SGI_REPEAT_PERIOD_US;
+}
+
+void sgi_kbd_event(const KeyboardEvent event)
+{
+    // the host modifier reaches the keys a PC keyboard doesn't have
+    static bool gui = false;
+
+    if (event.page != 0)
+        return;
+
+    if (EVENT_IS_HOST_MOD(event)) {
+        gui = event.down;
+        return;
+    }
+
+    if (gui) {
+        switch (event.keycode) {
+            case HID_KEY_ESCAPE: kbd_send(SGI_KEY_BREAK, event.down); break;
+            case HID_KEY_F1: kbd_send(SGI_KEY_PAD_PF1, event.down); break;
+            case HID_KEY_F2: kbd_send(SGI_KEY_PAD_PF2, event.down); break;
+            case HID_KEY_F3: kbd_send(SGI_KEY_PAD_PF3, event.down); break;
+            case HID_KEY_F4: kbd_send(SGI_KEY_PAD_PF4, event.down); break;
+            case HID_KEY_F5: kbd_send(SGI_KEY_SETUP, event.down); break;
+            case HID_KEY_ENTER: kbd_send(SGI_KEY_LINEFEED, event.down); break;
+        }
+        return;
+    }
+
+    if (usb2sgi[event.keycode] != 0)
+        kbd_send(usb2sgi[event.keycode], event.down);
+}
+
+static void mouse_tx()
+{
+    if (!s_mouse.dirty || !uart_tx_idle(&s_mouse_tx))
+        return;
+
+    int32_t x = clamp(s_mouse.dx, -254, 254);
+    int32_t y = clamp(s_mouse.dy, -254, 254);
+    s_mouse.dx -= x;
+    s_mouse.dy -= y;
+
+    int8_t x1 = x / 2, x2 = x - x1;
+    int8_t y1 = -y / 2, y2 = -y - y1;
+
+    uint8_t packet[5] = {
+        0x80 | ((s_mouse.buttons & MOUSE_BUTTON_LEFT) ? 0 : 4)
+             | ((s_mouse.buttons & MOUSE_BUTTON_MIDDLE) ? 0 : 2)
+             | ((s_mouse.buttons & MOUSE_BUTTON_RIGHT) ? 0 : 1),
+        x1, y1, x2, y2
+    };
+    uart_tx_write(&s_mouse_tx, packet, sizeof(packet));
+
+    s_mouse.packets++;
+    s_mouse.dirty = s_mouse.dx || s_mouse.dy;
+}
+
+void sgi_mouse_event(const MouseEvent event)
+{
+    s_mouse.dx = clamp(s_mouse.dx + event.dx, -SGI_MOUSE_ACCUM_LIMIT, SGI_MOUSE_ACCUM_LIMIT);
+    s_mouse.dy = clamp(s_mouse.dy + event.dy, -SGI_MOUSE_ACCUM_LIMIT, SGI_MOUSE_ACCUM_LIMIT);
+    s_mouse.buttons = event.buttons;
+    s_mouse.dirty = true;
+
+    mouse_tx();
+}
+
+void sgi_update()
+{
+    uart_tx_task(&s_kbd_tx);
+    kbd_log_ctrl();
+    kbd_leds_update();
+    kbd_repeat();
+
+    uart_tx_task(&s_mouse_tx);
+    mouse_tx();
+}
+
+#if DEBUG
+
+/*
+ * sgi -- link counters and keyboard state
+ */
+void sgi_console_cmd(int argc, char** argv)
+{
+    console_printf("kbd   tx %lu bytes, %lu dropped, queue max %lu; ctrl a %02x b %02x\n",
+        s_kbd_tx.bytes, s_kbd_tx.dropped, s_kbd_tx.max_depth, s_kbd.ctrl_a, s_kbd.ctrl_b);
+    console_printf("mouse tx %lu bytes, %lu dropped, %lu packets\n",
+        s_mouse_tx.bytes, s_mouse_tx.dropped, s_mouse.packets);
+}
+
+#endif
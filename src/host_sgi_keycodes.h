@@ -0,0 +1,137 @@
+/*
+ * Sources:
+ *
+ * NetBSD sys/arch/sgimips/dev/wskbdmap_sgi.c (zskbd key numbers)
+ * IRIS GL <gl/device.h>, whose key device numbers are the key number plus one
+ */
+
+#ifndef _SGI_KEYCODES_H_
+#define _SGI_KEYCODES_H_
+
+#include <stdint.h>
+#include "hid_codes.h"
+
+#define SGI_KEY_BREAK 0x00
+#define SGI_KEY_SETUP 0x01
+#define SGI_KEY_LINEFEED 0x3b
+#define SGI_KEY_PAD_PF1 0x47
+#define SGI_KEY_PAD_PF2 0x46
+#define SGI_KEY_PAD_PF3 0x4e
+#define SGI_KEY_PAD_PF4 0x4d
+
+// 0 means no key, so the Break key (number 0) is only reachable through
+// the host modifier layer in host_sgi.c. Looked up on every key event; kept
+// in RAM with the other keymaps.
+static const uint8_t __not_in_flash("keymap") usb2sgi[256] = {
+  [HID_KEY_ESCAPE] = 0x06,
+  [HID_KEY_F1] = 0x56,
+  [HID_KEY_F2] = 0x57,
+  [HID_KEY_F3] = 0x58,
+  [HID_KEY_F4] = 0x59,
+  [HID_KEY_F5] = 0x5a,
+  [HID_KEY_F6] = 0x5b,
+  [HID_KEY_F7] = 0x5c,
+  [HID_KEY_F8] = 0x5d,
+  [HID_KEY_F9] = 0x5e,
+  [HID_KEY_F10] = 0x5f,
+  [HID_KEY_F11] = 0x60,
+  [HID_KEY_F12] = 0x61,
+  [HID_KEY_PRINTSCREEN] = 0x62,
+  [HID_KEY_SCROLL_LOCK] = 0x63,
+  [HID_KEY_PAUSE] = 0x64,
+
+  [HID_KEY_GRAVE_ACCENT_AND_TILDE] = 0x36,
+  [HID_KEY_1_EXCLAMATION_MARK] = 0x07,
+  [HID_KEY_2_AT] = 0x0d,
+  [HID_KEY_3_NUMBER_SIGN] = 0x0e,
+  [HID_KEY_4_DOLLAR] = 0x15,
+  [HID_KEY_5_PERCENT] = 0x16,
+  [HID_KEY_6_CARET] = 0x1d,
+  [HID_KEY_7_AMPERSAND] = 0x1e,
+  [HID_KEY_8_ASTERISK] = 0x25,
+  [HID_KEY_9_OPARENTHESIS] = 0x26,
+  [HID_KEY_0_CPARENTHESIS] = 0x2d,
+  [HID_KEY_MINUS_UNDERSCORE] = 0x2e,
+  [HID_KEY_EQUAL_PLUS] = 0x35,
+  [HID_KEY_BACKSPACE] = 0x3c,
+
+  [HID_KEY_TAB] = 0x08,
+  [HID_KEY_Q] = 0x09,
+  [HID_KEY_W] = 0x0f,
+  [HID_KEY_E] = 0x10,
+  [HID_KEY_R] = 0x17,
+  [HID_KEY_T] = 0x18,
+  [HID_KEY_Y] = 0x1f,
+  [HID_KEY_U] = 0x20,
+  [HID_KEY_I] = 0x27,
+  [HID_KEY_O] = 0x28,
+  [HID_KEY_P] = 0x2f,
+  [HID_KEY_OBRACKET_AND_OBRACE] = 0x30,
+  [HID_KEY_CBRACKET_AND_CBRACE] = 0x37,
+  [HID_KEY_BACKSLASH_VERTICAL_BAR] = 0x38,
+
+  [HID_KEY_CAPS_LOCK] = 0x03,
+  [HID_KEY_A] = 0x0a,
+  [HID_KEY_S] = 0x0b,
+  [HID_KEY_D] = 0x11,
+  [HID_KEY_F] = 0x12,
+  [HID_KEY_G] = 0x19,
+  [HID_KEY_H] = 0x1a,
+  [HID_KEY_J] = 0x21,
+  [HID_KEY_K] = 0x22,
+  [HID_KEY_L] = 0x29,
+  [HID_KEY_SEMICOLON_COLON] = 0x2a,
+  [HID_KEY_SINGLE_AND_DOUBLE_QUOTE] = 0x31,
+  [HID_KEY_ENTER] = 0x32,
+
+  [HID_KEY_LEFT_SHIFT] = 0x05,
+  [HID_KEY_Z] = 0x13,
+  [HID_KEY_X] = 0x14,
+  [HID_KEY_C] = 0x1b,
+  [HID_KEY_V] = 0x1c,
+  [HID_KEY_B] = 0x23,
+  [HID_KEY_N] = 0x24,
+  [HID_KEY_M] = 0x2c,
+  [HID_KEY_COMMA_AND_LESS] = 0x33,
+  [HID_KEY_DOT_GREATER] = 0x2b,
+  [HID_KEY_SLASH_QUESTION] = 0x34,
+  [HID_KEY_RIGHT_SHIFT] = 0x04,
+
+  [HID_KEY_LEFT_CONTROL] = 0x02,
+  [HID_KEY_LEFT_ALT] = 0x53,
+  [HID_KEY_SPACEBAR] = 0x52,
+  [HID_KEY_RIGHT_CONTROL] = 0x55,
+
+  [HID_KEY_INSERT] = 0x65,
+  [HID_KEY_HOME] = 0x66,
+  [HID_KEY_PAGEUP] = 0x67,
+  [HID_KEY_DELETE] = 0x3d,
+  [HID_KEY_END1] = 0x68,
+  [HID_KEY_PAGEDOWN] = 0x69,
+
+  [HID_KEY_UPARROW] = 0x50,
+  [HID_KEY_LEFTARROW] = 0x48,
+  [HID_KEY_DOWNARROW] = 0x49,
+  [HID_KEY_RIGHTARROW] = 0x4f,
+
+  [HID_KEY_KEYPAD_NUM_LOCK_AND_CLEAR] = 0x6a,
+  [HID_KEY_KEYPAD_SLASH] = 0x6b,
+  [HID_KEY_KEYPAD_ASTERISK] = 0x6c,
+  [HID_KEY_KEYPAD_MINUS] = 0x4b,
+  [HID_KEY_KEYPAD_PLUS] = 0x6d,
+  [HID_KEY_KEYPAD_ENTER] = 0x51,
+  [HID_KEY_KEYPAD_1_END] = 0x39,
+  [HID_KEY_KEYPAD_2_DOWN_ARROW] = 0x3f,
+  [HID_KEY_KEYPAD_3_PAGEDN] = 0x40,
+  [HID_KEY_KEYPAD_4_LEFT_ARROW] = 0x3e,
+  [HID_KEY_KEYPAD_5] = 0x44,
+  [HID_KEY_KEYPAD_6_RIGHT_ARROW] = 0x45,
+  [HID_KEY_KEYPAD_7_HOME] = 0x42,
+  [HID_KEY_KEYPAD_8_UP_ARROW] = 0x43,
+  [HID_KEY_KEYPAD_9_PAGEUP] = 0x4a,
+  [HID_KEY_KEYPAD_0_INSERT] = 0x3a,
+  [HID_KEY_KEYPAD_DECIMAL] = 0x41,
+  [HID_KEY_KEYPAD_COMMA] = 0x4c,
+};
+
+#endif
@@ -1,8 +1,10 @@
 extern void sun_keyboard_uart_init();
+extern void sun_keyboard_keymap_init();
 extern void sun_mouse_uart_init();
 extern void sun_mouse_tx();
 
 void sun_init() {
+    sun_keyboard_keymap_init();
     sun_keyboard_uart_init();
     sun_mouse_uart_init();
 }
@@ -6,6 +6,10 @@
 
 #define DEBUG_TAG "sun"
 #include "babelfish.h"
+#include "isr_stats.h"
+#include "kbd_leds.h"
+#include "keymap.h"
+#include "remap.h"
 
 #include "host_sun_keycodes.h"
 
@@ -27,8 +31,9 @@ void sun_keyboard_uart_init() {
   uart_set_irq_enables(UART_KEYBOARD, true, false);
 }
 
-// RX interrupt handler
-void on_keyboard_rx() {
+// RX interrupt handler, RAM-resident to keep XIP cache misses out of it
+void __not_in_flash_func(on_keyboard_rx)() {
+    ISR_STAT_BEGIN();
     while (uart_is_readable(UART_KEYBOARD)) {
         // printf("System command: ");
         uint8_t ch = uart_getc(UART_KEYBOARD);
@@ -56,6 +61,9 @@ void on_keyboard_rx() {
             // printf("Led\n");
             {
               uint8_t led = uart_getc(UART_KEYBOARD);
+              // Sun: num, compose, scroll, caps from bit 0
+              kbd_leds_set(((led & 1) ? KEYBOARD_LED_NUMLOCK : 0) | ((led & 2) ? KEYBOARD_LED_COMPOSE : 0) |
+                           ((led & 4) ? KEYBOARD_LED_SCROLLLOCK : 0) | ((led & 8) ? KEYBOARD_LED_CAPSLOCK : 0));
             }
             break;
           case 0x0f: // layout command
@@ -68,51 +76,44 @@ void on_keyboard_rx() {
             break;
         };
     }
+    ISR_STAT_END(IsrStatKbdRx);
+}
+
+// usb2sun, or a replacement uploaded over the USB link (keymap.c)
+static const void* volatile s_usb2sun = usb2sun;
+
+// one layer, one state: the Sun code, 0 for none
+static uint16_t sun_keymap_lookup(const void* table, uint8_t layer, uint16_t keycode, uint8_t state) {
+  return ((const uint8_t*) table)[keycode];
+}
+
+void sun_keyboard_keymap_init() {
+  remap_set_preset(sun_remap_preset, sun_remap_preset_count);
+  keymap_register(KeymapKindSun, usb2sun, sizeof(usb2sun), &s_usb2sun, sun_keymap_lookup, 1, 1);
 }
 
 void sun_kbd_event(const KeyboardEvent event) {
-  // if the gui/sun-extra-keys modifier is pressed
-  static bool gui = false;
   static uint32_t keys_down = 0;
 
   if (event.page != 0)
     return;
 
-  if (EVENT_IS_HOST_MOD(event)) {
-    gui = event.down;
-    return;
-  }
-
   if (event.down) {
     keys_down++;
-  } else {
+  } else if (keys_down) {
+    // a release without its press (the key was down before we started)
     keys_down--;
   }
 
 #define SEND_SUN_KEY(suncode, down) uart_putc_raw(UART_KEYBOARD, down ? (suncode) : ((suncode) | 0x80))
 
-  if (gui) {
-    switch (event.keycode) {
-      case HID_KEY_F1: SEND_SUN_KEY(SUN_KEY_STOP, event.down); break;
-      case HID_KEY_F2: SEND_SUN_KEY(SUN_KEY_AGAIN, event.down); break;
-      case HID_KEY_1: SEND_SUN_KEY(SUN_KEY_PROPS, event.down); break;
-      case HID_KEY_2: SEND_SUN_KEY(SUN_KEY_UNDO, event.down); break;
-      case HID_KEY_Q: SEND_SUN_KEY(SUN_KEY_FRONT, event.down); break;
-      case HID_KEY_W: SEND_SUN_KEY(SUN_KEY_COPY, event.down); break;
-      case HID_KEY_A: SEND_SUN_KEY(SUN_KEY_OPEN, event.down); break;
-      case HID_KEY_S: SEND_SUN_KEY(SUN_KEY_PASTE, event.down); break;
-      case HID_KEY_Z: SEND_SUN_KEY(SUN_KEY_FIND, event.down); break;
-      case HID_KEY_X: SEND_SUN_KEY(SUN_KEY_CUT, event.down); break;
-    }
-
-    return;
-  }
-
-  if (usb2sun[event.keycode] != 0) {
-    SEND_SUN_KEY(usb2sun[event.keycode], event.down);
+  // one load of the live keymap per event, it may be swapped in between
+  uint8_t code = sun_keymap_lookup(s_usb2sun, 0, event.keycode, 0);
+  if (code != 0) {
+    SEND_SUN_KEY(code, event.down);
   }
 
   if (keys_down == 0) {
     uart_putc_raw(UART_KEYBOARD, 0x7f);
   }
-}
\ No newline at end of file
+}
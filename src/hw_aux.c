@@ -7,9 +7,12 @@
 #define DEBUG_TAG "hwaux"
 
 #include "babelfish.h"
+#include "isr_stats.h"
 
 void usb_pwr_signal_irq(uint gpio, uint32_t event_mask)
 {
+    ISR_STAT_BEGIN();
+
     bool stat_ok = !gpio_get(USB_5V_STAT_GPIO);
     bool aux_ok = !gpio_get(USB_AUX_EN_GPIO);
     bool ok = stat_ok && aux_ok;
@@ -18,6 +21,8 @@ void usb_pwr_signal_irq(uint gpio, uint32_t event_mask)
 
     if (gpio != 0)
         gpio_acknowledge_irq(gpio, event_mask);
+
+    ISR_STAT_END(IsrStatUsbPwr);
 }
 
 void usb_aux_init(void)
@@ -0,0 +1,174 @@
+#include <pico/stdlib.h>
+#include <hardware/irq.h>
+#include <hardware/clocks.h>
+
+#define DEBUG_TAG "irq"
+#include "babelfish.h"
+#include "console.h"
+#include "irq_plan.h"
+#include "isr_stats.h"
+#include "usb_host_health.h"
+#include "stdio_nusb/stdio_usb.h"
+
+/**********************
+
+Interrupt priority plan.
+
+Core 0 runs the mainloop, the USB device stack and every host emulation.
+Core 1 runs nothing but tuh_task() and PIO-USB; the IRQs it takes are the
+PIO-USB frame timer, which keeps the top priority to itself, and the FIFO
+IRQ that parks it while core0 writes flash. Built with USB_HOST_REALTIME,
+every other IRQ is masked on core1, so nothing can delay a frame.
+
+  core irq                 prio      why
+  0    IO_IRQ_BANK0        critical  ADB edges, needs to be within a few us.
+                                     PS/2 CLK rising edges: the host's request
+                                     to send has to be seen before the state
+                                     machine would start a frame of its own.
+                                     USB power status edges share the bank;
+                                     they are rare and their handler is tiny.
+  0    UART0/UART1         high      host RX; the 32 byte FIFO gives slack, but
+                                     the Sun/Apollo replies should go out promptly;
+                                     in reverse mode, keyboard and mouse decode
+  0    PIO0_IRQ_0/PIO1_... high      NeXT poll; the reply word has to be in the
+                                     TX FIFO within one bit time (50 us)
+  0    USBCTRL_IRQ         normal    CDC device; the host retries
+  0    DMA_IRQ_0           normal    logic analyzer half-complete
+  0    TIMER_IRQ_3         normal    default alarm pool (sleep_ms, stdio timer)
+  0    stdio worker        low       tud_task() in the background
+  1    TIMER_IRQ_2         critical  PIO-USB SOF, 1 ms frame timer
+                                     (usb_host_health.c)
+  1    SIO_IRQ_PROC1       normal    multicore lockout, for flash writes
+
+Budgets are the most a handler may spend executing itself, and the most it
+may spend preempted by the handlers above it. Overruns are counted per ISR
+and shown by the 'stats' console command.
+
+***********************/
+
+// The PIO-USB frame timer on core1 has its own alarm pool on hardware alarm 2
+#define PIO_USB_ALARM_IRQ TIMER_IRQ_2
+
+typedef struct {
+    const char* name;
+    int irq; // -1: looked up at runtime
+    uint8_t core;
+    uint8_t priority;
+    int8_t stat; // IsrStatId, -1 if not instrumented
+    uint16_t budget_us;
+    uint16_t preempt_budget_us;
+} IrqPlanEntry;
+
+static IrqPlanEntry s_plan[] = {
+    { "gpio",         IO_IRQ_BANK0,       0, IRQ_PRIO_CRITICAL, IsrStatAdb,          20,    5 },
+    { "gpio",         IO_IRQ_BANK0,       0, IRQ_PRIO_CRITICAL, IsrStatUsbPwr,       10,   25 },
+    { "gpio",         IO_IRQ_BANK0,       0, IRQ_PRIO_CRITICAL, IsrStatPs2Clk,       10,   25 },
+    { "uart0",        UART0_IRQ,          0, IRQ_PRIO_HIGH,     IsrStatKbdRx,       100,   30 },
+    { "uart1",        UART1_IRQ,          0, IRQ_PRIO_HIGH,     IsrStatMouseRx,     100,   30 },
+    { "pio0_irq0",    PIO0_IRQ_0,         0, IRQ_PRIO_HIGH,     IsrStatNext,          5,   25 },
+    { "pio1_irq0",    PIO1_IRQ_0,         0, IRQ_PRIO_HIGH,     IsrStatNext,          5,   25 },
+    { "usbctrl",      USBCTRL_IRQ,        0, IRQ_PRIO_NORMAL,   IsrStatUsbDevice,   100,  150 },
+    { "dma0",         DMA_IRQ_0,          0, IRQ_PRIO_NORMAL,   IsrStatLaDma,         5,  150 },
+    { "alarm",        TIMER_IRQ_3,        0, IRQ_PRIO_NORMAL,   -1,                   0,    0 },
+    { "stdio_worker", -1,                 0, IRQ_PRIO_LOW,      IsrStatStdioWorker, 1000, 2000 },
+    { "pio_usb_sof",  PIO_USB_ALARM_IRQ,  1, IRQ_PRIO_CRITICAL, -1,                   0,    0 },
+    { "lockout",      SIO_IRQ_PROC1,      1, IRQ_PRIO_NORMAL,   -1,                   0,    0 },
+};
+
+#define PLAN_COUNT (sizeof(s_plan) / sizeof(s_plan[0]))
+
+// core1 IRQs masked in real time mode
+static uint s_masked;
+
+static int plan_irq(const IrqPlanEntry* e)
+{
+    if (e->irq >= 0)
+        return e->irq;
+    return stdio_nusb_worker_irq();
+}
+
+#if USB_HOST_REALTIME
+static bool planned(uint core, int irq)
+{
+    for (uint i = 0; i < PLAN_COUNT; i++) {
+        if (s_plan[i].core == core && plan_irq(&s_plan[i]) == irq)
+            return true;
+    }
+    return false;
+}
+#endif
+
+void irq_plan_apply()
+{
+    uint core = get_core_num();
+    for (uint i = 0; i < PLAN_COUNT; i++) {
+        const IrqPlanEntry* e = &s_plan[i];
+        int irq = plan_irq(e);
+        if (e->core != core || irq < 0)
+            continue;
+        irq_set_priority(irq, e->priority);
+    }
+
+#if USB_HOST_REALTIME
+    if (core == 1) {
+        for (int irq = 0; irq < NUM_IRQS; irq++) {
+            if (!planned(core, irq) && irq_is_enabled(irq)) {
+                irq_set_enabled(irq, false);
+                s_masked++;
+            }
+        }
+    }
+#endif
+}
+
+void irq_plan_init_budgets()
+{
+    uint32_t mhz = clock_get_hz(clk_sys) / 1000000;
+    for (uint i = 0; i < PLAN_COUNT; i++) {
+        const IrqPlanEntry* e = &s_plan[i];
+        if (e->stat < 0)
+            continue;
+        isr_stats[e->stat].budget_cycles = e->budget_us * mhz;
+        isr_stats[e->stat].preempt_budget_cycles = e->preempt_budget_us * mhz;
+    }
+}
+
+// TinyUSB installs the device IRQ as a shared handler; bracket it with our
+// own shared handlers at the highest and lowest order priority. These are
+// added before tud_init() so the begin marker runs ahead of the driver.
+static uint32_t s_usb_irq_start;
+static uint32_t s_usb_irq_nested;
+
+static void __not_in_flash_func(usb_device_irq_begin)()
+{
+    s_usb_irq_start = isr_cycles_now();
+    s_usb_irq_nested = isr_nested_cycles;
+}
+
+static void __not_in_flash_func(usb_device_irq_end)()
+{
+    isr_stat_record(IsrStatUsbDevice, s_usb_irq_start, s_usb_irq_nested);
+}
+
+void irq_plan_usb_device_markers_init()
+{
+    irq_add_shared_handler(USBCTRL_IRQ, usb_device_irq_begin, PICO_SHARED_IRQ_HANDLER_HIGHEST_ORDER_PRIORITY);
+    irq_add_shared_handler(USBCTRL_IRQ, usb_device_irq_end, PICO_SHARED_IRQ_HANDLER_LOWEST_ORDER_PRIORITY);
+}
+
+#if DEBUG
+
+void irq_plan_print()
+{
+    console_printf("  irq plan:\n");
+    for (uint i = 0; i < PLAN_COUNT; i++) {
+        const IrqPlanEntry* e = &s_plan[i];
+        int irq = plan_irq(e);
+        console_printf("  core%d %-12s irq %2d prio 0x%02x budget %4u us preempt %4u us\n",
+            e->core, e->name, irq, e->priority, e->budget_us, e->preempt_budget_us);
+    }
+    if (USB_HOST_REALTIME)
+        console_printf("  core1 real time, %u other irqs masked\n", s_masked);
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef IRQ_PLAN_H_
+#define IRQ_PLAN_H_
+
+#include <stdint.h>
+
+// RP2040 NVIC priorities; only the top two bits are implemented, so these
+// are the four distinct levels (lower value = more urgent).
+#define IRQ_PRIO_CRITICAL 0x00
+#define IRQ_PRIO_HIGH     0x40
+#define IRQ_PRIO_NORMAL   0x80
+#define IRQ_PRIO_LOW      0xc0
+
+// Apply the priorities for every IRQ owned by the calling core. NVIC state is
+// per core, so core0 and core1 each call this once their IRQs are set up.
+void irq_plan_apply();
+
+// Fill in the per-ISR budgets in isr_stats from the plan.
+void irq_plan_init_budgets();
+
+void irq_plan_print();
+
+// Instrumentation for the USB device IRQ, which TinyUSB owns
+void irq_plan_usb_device_markers_init();
+
+#endif
@@ -0,0 +1,127 @@
+#include <pico/stdlib.h>
+#include <hardware/structs/systick.h>
+#include <hardware/structs/xip_ctrl.h>
+#include <hardware/clocks.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEBUG_TAG "isr"
+#include "babelfish.h"
+#include "console.h"
+#include "isr_stats.h"
+
+IsrStat isr_stats[IsrStatCount] = {
+    [IsrStatAdb] = { .name = "adb_isr" },
+    [IsrStatKbdRx] = { .name = "kbd_rx" },
+    [IsrStatUsbPwr] = { .name = "usb_pwr" },
+    [IsrStatUsbDevice] = { .name = "usb_dev" },
+    [IsrStatLaDma] = { .name = "la_dma" },
+    [IsrStatStdioWorker] = { .name = "stdio_wk" },
+    [IsrStatPs2Clk] = { .name = "ps2_clk" },
+    [IsrStatNext] = { .name = "next_kms" },
+    [IsrStatMouseRx] = { .name = "mouse_rx" },
+};
+
+volatile uint32_t isr_nested_cycles = 0;
+
+void isr_stats_reset()
+{
+    uint32_t irq = save_and_disable_interrupts();
+    for (int i = 0; i < IsrStatCount; i++) {
+        IsrStat* s = &isr_stats[i];
+        s->count = 0;
+        s->min_cycles = UINT32_MAX;
+        s->max_cycles = 0;
+        s->total_cycles = 0;
+        s->max_preempt_cycles = 0;
+        s->max_latency_cycles = 0;
+        s->pending = false;
+        s->over_budget = 0;
+        s->over_preempt_budget = 0;
+    }
+    restore_interrupts(irq);
+}
+
+// SysTick is per core, so each core that wants isr_cycles_now() has to
+// start its own.
+void isr_cycles_init()
+{
+    systick_hw->rvr = 0x00ffffff;
+    systick_hw->cvr = 0;
+    // enable, processor clock, no interrupt
+    systick_hw->csr = 0x5;
+}
+
+// The instrumented ISRs all run on core0, so this must be called from core0.
+void isr_stats_init()
+{
+    isr_cycles_init();
+    isr_stats_reset();
+}
+
+#if DEBUG
+
+void isr_stats_print(const char* label)
+{
+    uint32_t mhz = clock_get_hz(clk_sys) / 1000000;
+
+    console_printf("  %-8s %-9s %8s %7s %7s %7s %7s %7s %5s %5s\n", label, "isr", "n",
+        "avg_us", "max_us", "bud_us", "pre_us", "lat_us", "over", "ovpre");
+    for (int i = 0; i < IsrStatCount; i++) {
+        IsrStat* s = &isr_stats[i];
+        if (s->count == 0) {
+            console_printf("  %-8s %-9s %8s\n", label, s->name, "-");
+            continue;
+        }
+        console_printf("  %-8s %-9s %8lu %7lu %7lu %7lu %7lu %7lu %5lu %5lu\n", label, s->name,
+            s->count,
+            (uint32_t) (s->total_cycles / s->count) / mhz,
+            s->max_cycles / mhz,
+            s->budget_cycles / mhz,
+            s->max_preempt_cycles / mhz,
+            s->max_latency_cycles / mhz,
+            s->over_budget,
+            s->over_preempt_budget);
+    }
+}
+
+/*
+ * isrbench [ms]
+ *
+ * Lets the instrumented ISRs run for a window with the XIP cache left alone,
+ * then for a second window while the mainloop hammers the XIP cache flush.
+ * If the ISRs and their tables are really RAM-resident the two windows
+ * should report the same worst case. Needs live traffic on the channel
+ * (keyboard commands from the host, ADB polling) for there to be anything
+ * to measure; the mainloop is blocked while this runs.
+ */
+void isr_bench_console_cmd(int argc, char** argv)
+{
+    uint32_t window_ms = argc >= 2 ? strtoul(argv[1], NULL, 0) : 2000;
+    IsrStat warm[IsrStatCount];
+
+    isr_stats_reset();
+    busy_wait_ms(window_ms);
+    memcpy(warm, isr_stats, sizeof(warm));
+
+    isr_stats_reset();
+    uint32_t flushes = 0;
+    absolute_time_t until = make_timeout_time_ms(window_ms);
+    while (!time_reached(until)) {
+        xip_ctrl_hw->flush = 1;
+        // reading back blocks until the flush has completed
+        (void) xip_ctrl_hw->flush;
+        flushes++;
+    }
+
+    IsrStat cold[IsrStatCount];
+    memcpy(cold, isr_stats, sizeof(cold));
+
+    console_printf("isrbench: %lu ms per window, %lu XIP flushes\n", window_ms, flushes);
+    memcpy(isr_stats, warm, sizeof(warm));
+    isr_stats_print("cached");
+    memcpy(isr_stats, cold, sizeof(cold));
+    isr_stats_print("flushed");
+}
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef ISR_STATS_H_
+#define ISR_STATS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <hardware/structs/systick.h>
+
+/*
+ * Entry-to-exit cycle counts for the core0 ISRs, taken from the core's
+ * SysTick (24 bit, counting down at the processor clock). Everything here
+ * is inline so it lands wherever the ISR itself lives (i.e. in RAM).
+ *
+ * Each record splits the elapsed time into the handler's own execution
+ * time and the time it spent preempted by higher priority handlers, and
+ * checks both against the budgets declared in irq_plan.c.
+ */
+
+typedef enum {
+    IsrStatAdb = 0,
+    IsrStatKbdRx,
+    IsrStatUsbPwr,
+    IsrStatUsbDevice,
+    IsrStatLaDma,
+    IsrStatStdioWorker,
+    IsrStatPs2Clk,
+    IsrStatNext,
+    IsrStatMouseRx,
+    IsrStatCount
+} IsrStatId;
+
+typedef struct {
+    const char* name;
+    // budgets, filled in from the IRQ plan at init
+    uint32_t budget_cycles;
+    uint32_t preempt_budget_cycles;
+
+    uint32_t count;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+    uint32_t max_preempt_cycles;
+    // pending-to-entry latency, only for handlers whose pend we can see
+    uint32_t max_latency_cycles;
+    uint32_t pending_at;
+    bool pending;
+
+    uint32_t over_budget;
+    uint32_t over_preempt_budget;
+} IsrStat;
+
+extern IsrStat isr_stats[IsrStatCount];
+
+// Cycles spent in instrumented handlers on core0, used to work out how long
+// an outer handler was preempted. See isr_stat_record.
+extern volatile uint32_t isr_nested_cycles;
+
+void isr_cycles_init();
+void isr_stats_init();
+void isr_stats_reset();
+void isr_stats_print(const char* label);
+
+static inline uint32_t isr_cycles_now()
+{
+    return systick_hw->cvr;
+}
+
+// Note that a handler has been made pending (irq_set_pending), so its
+// entry latency can be measured.
+static inline void isr_stat_mark_pending(IsrStatId id)
+{
+    IsrStat* s = &isr_stats[id];
+    if (!s->pending) {
+        s->pending_at = isr_cycles_now();
+        s->pending = true;
+    }
+}
+
+static inline void isr_stat_entered(IsrStatId id, uint32_t start)
+{
+    IsrStat* s = &isr_stats[id];
+    if (s->pending) {
+        uint32_t latency = (s->pending_at - start) & 0xffffff;
+        if (latency > s->max_latency_cycles) s->max_latency_cycles = latency;
+        s->pending = false;
+    }
+}
+
+static inline void isr_stat_record(IsrStatId id, uint32_t start, uint32_t nested_at_start)
+{
+    IsrStat* s = &isr_stats[id];
+    uint32_t elapsed = (start - isr_cycles_now()) & 0xffffff;
+    uint32_t preempted = isr_nested_cycles - nested_at_start;
+    uint32_t cycles = elapsed - preempted;
+
+    // replace whatever nested inside us with our whole elapsed time, so an
+    // outer handler sees exactly the time it lost to us
+    isr_nested_cycles = nested_at_start + elapsed;
+
+    s->count++;
+    s->total_cycles += cycles;
+    if (cycles < s->min_cycles) s->min_cycles = cycles;
+    if (cycles > s->max_cycles) s->max_cycles = cycles;
+    if (preempted > s->max_preempt_cycles) s->max_preempt_cycles = preempted;
+    if (cycles > s->budget_cycles) s->over_budget++;
+    if (preempted > s->preempt_budget_cycles) s->over_preempt_budget++;
+}
+
+#define ISR_STAT_BEGIN() \
+    uint32_t _isr_stat_start = isr_cycles_now(); \
+    uint32_t _isr_stat_nested = isr_nested_cycles
+#define ISR_STAT_BEGIN_ID(id) \
+    ISR_STAT_BEGIN(); \
+    isr_stat_entered(id, _isr_stat_start)
+#define ISR_STAT_END(id) isr_stat_record(id, _isr_stat_start, _isr_stat_nested)
+
+#endif
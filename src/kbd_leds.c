@@ -0,0 +1,151 @@
+#include <pico/stdlib.h>
+#include <tusb.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEBUG_TAG "leds"
+#include "babelfish.h"
+#include "console.h"
+#include "hid_pool.h"
+#include "kbd_leds.h"
+#include "usb_host_health.h"
+
+DBG_MODULE();
+
+KbdLedsRequest kbd_leds_request;
+
+// Everything below is core1's
+typedef struct {
+    uint8_t dev_addr; // 0: free
+    uint8_t instance;
+    uint8_t report_id;
+    uint8_t leds;     // what this keyboard was last sent
+} KbdLedsTarget;
+
+static KbdLedsTarget s_targets[HID_POOL_SLOTS];
+
+// the one SET_REPORT on the bus, if any
+static KbdLedsTarget* s_in_flight;
+static uint8_t s_report[2]; // has to outlive the transfer
+static uint32_t s_in_flight_changed_us;
+
+static struct {
+    uint32_t sent;
+    uint32_t failed;   // completed with an error, sent again on the next pass
+    uint32_t deferred; // a control transfer was pending, tried again on the next pass
+    uint32_t last_us;  // host command to SET_REPORT completing
+    uint32_t max_us;
+} s_stats;
+
+void kbd_leds_mount(uint8_t dev_addr, uint8_t instance, uint8_t report_id)
+{
+    for (uint i = 0; i < count_of(s_targets); i++) {
+        if (s_targets[i].dev_addr == 0) {
+            // keyboards come up with their LEDs off; only a lit one needs a report
+            s_targets[i] = (KbdLedsTarget) { dev_addr, instance, report_id, 0 };
+            return;
+        }
+    }
+}
+
+void kbd_leds_umount(uint8_t dev_addr, uint8_t instance)
+{
+    for (uint i = 0; i < count_of(s_targets); i++) {
+        KbdLedsTarget* t = &s_targets[i];
+        if (t->dev_addr == dev_addr && t->instance == instance) {
+            // the transfer dies with the device, its callback may never come;
+            // hid_app.c frees the control transfer gate
+            if (s_in_flight == t)
+                s_in_flight = NULL;
+            t->dev_addr = 0;
+        }
+    }
+}
+
+void kbd_leds_host_task()
+{
+    if (s_in_flight)
+        return;
+
+    uint8_t leds = kbd_leds_request.leds;
+    for (uint i = 0; i < count_of(s_targets); i++) {
+        KbdLedsTarget* t = &s_targets[i];
+        if (t->dev_addr == 0 || t->leds == leds)
+            continue;
+
+        if (!hid_app_ctrl_claim(t->dev_addr, t->instance, HidCtrlLeds)) {
+            s_stats.deferred++;
+            return;
+        }
+
+        // with report IDs in use the ID leads the data stage too
+        uint16_t len = 0;
+        if (t->report_id)
+            s_report[len++] = t->report_id;
+        s_report[len++] = leds;
+
+        s_in_flight = t;
+        s_in_flight_changed_us = kbd_leds_request.changed_us;
+        if (!tuh_hid_set_report(t->dev_addr, t->instance, t->report_id, HID_REPORT_TYPE_OUTPUT, s_report, len)) {
+            s_in_flight = NULL;
+            hid_app_ctrl_release(t->dev_addr, t->instance, HidCtrlLeds);
+            s_stats.deferred++;
+        }
+        return;
+    }
+}
+
+void tuh_hid_set_report_complete_cb(uint8_t dev_addr, uint8_t instance, uint8_t report_id, uint8_t report_type,
+    uint16_t len)
+{
+    KbdLedsTarget* t = s_in_flight;
+    if (report_type != HID_REPORT_TYPE_OUTPUT || !t || t->dev_addr != dev_addr || t->instance != instance)
+        return;
+    s_in_flight = NULL;
+    hid_app_ctrl_release(dev_addr, instance, HidCtrlLeds);
+
+    // a failed one stays different, so the next pass sends it again
+    if (len == 0) {
+        s_stats.failed++;
+        usb_host_health.ctrl_errors++;
+        DBG("set_report to %d:%d failed\n", dev_addr, instance);
+        return;
+    }
+
+    t->leds = s_report[t->report_id ? 1 : 0];
+    uint32_t us = time_us_32() - s_in_flight_changed_us;
+    s_stats.sent++;
+    s_stats.last_us = us;
+    if (us > s_stats.max_us)
+        s_stats.max_us = us;
+}
+
+void kbd_leds_stats_reset()
+{
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
+#if DEBUG
+
+void kbd_leds_stats_print()
+{
+    uint keyboards = 0;
+    for (uint i = 0; i < count_of(s_targets); i++) {
+        if (s_targets[i].dev_addr)
+            keyboards++;
+    }
+    console_printf("  leds %02x: %lu changes, %lu reports to %u keyboards, %lu failed, %lu deferred\n",
+        kbd_leds_request.leds, kbd_leds_request.changes, s_stats.sent, keyboards, s_stats.failed, s_stats.deferred);
+    console_printf("  leds latency: last %lu us max %lu us\n", s_stats.last_us, s_stats.max_us);
+}
+
+// 'leds': state and counters
+// 'leds <hex>': set them as a host would, KEYBOARD_LED_* bits
+void kbd_leds_console_cmd(int argc, char** argv)
+{
+    if (argc >= 2)
+        kbd_leds_set(strtoul(argv[1], NULL, 16));
+    kbd_leds_stats_print();
+}
+
+#endif
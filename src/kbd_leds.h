@@ -0,0 +1,47 @@
+#ifndef KBD_LEDS_H_
+#define KBD_LEDS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pico/time.h>
+
+/*
+ * Lock LEDs, from the retro host back to the USB keyboards.
+ *
+ * A host calls kbd_leds_set() when its LED command arrives, from its RX
+ * ISR or the mainloop on core0; that is a couple of stores and nothing
+ * else. Core1 picks the state up from the USB host task and sends it to
+ * each mounted keyboard as a SET_REPORT(Output), but only to the ones whose
+ * LEDs differ from it; one that fails is sent again on the next pass.
+ * Changes that land while a report is in flight coalesce into the next
+ * one. Reports share hid_app.c's control transfer gate with the mount time
+ * requests, so only one of either is on the bus.
+ */
+
+typedef struct {
+    volatile uint8_t leds;
+    volatile uint32_t changed_us; // for the latency in 'stats'
+    volatile uint32_t changes;
+} KbdLedsRequest;
+
+extern KbdLedsRequest kbd_leds_request;
+
+// core0, any context; leds in HID output report bits (KEYBOARD_LED_*)
+static inline void kbd_leds_set(uint8_t leds)
+{
+    if (leds == kbd_leds_request.leds)
+        return;
+    kbd_leds_request.changed_us = time_us_32();
+    kbd_leds_request.leds = leds;
+    kbd_leds_request.changes++;
+}
+
+// core1, from the HID mount callbacks and the host task
+void kbd_leds_mount(uint8_t dev_addr, uint8_t instance, uint8_t report_id);
+void kbd_leds_umount(uint8_t dev_addr, uint8_t instance);
+void kbd_leds_host_task();
+
+void kbd_leds_stats_reset();
+void kbd_leds_stats_print();
+
+#endif
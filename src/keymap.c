@@ -0,0 +1,381 @@
+#include <pico/stdlib.h>
+#include <pico/multicore.h>
+#include <hardware/dma.h>
+#include <hardware/flash.h>
+#include <hardware/sync.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEBUG_TAG "keymap"
+#include "babelfish.h"
+#include "console.h"
+#include "hid_rec.h"
+#include "isr_stats.h"
+#include "keymap.h"
+
+DBG_MODULE();
+
+// one slot per kind, just below the HID recorder's copy at the end of flash
+#define KEYMAP_FLASH_SLOT (2 * FLASH_SECTOR_SIZE)
+#define KEYMAP_FLASH_SIZE ((KeymapKindCount - 1) * KEYMAP_FLASH_SLOT)
+#define KEYMAP_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - HID_REC_FLASH_SIZE - KEYMAP_FLASH_SIZE)
+
+typedef struct {
+    KeymapHeader header;
+    uint8_t table[]; // the registered length
+} KeymapImage;
+
+_Static_assert(sizeof(KeymapHeader) == 16, "the header keeps the table word aligned");
+_Static_assert(sizeof(KeymapHeader) + KEYMAP_MAX_LENGTH <= KEYMAP_FLASH_SLOT, "a keymap fits its flash slot");
+
+// The live table (if it isn't the builtin one) and the spare an upload is
+// staged in. Both in RAM, so a lookup costs what it does in the builtin
+// table, which is in RAM too. They are sized for the host's table when it
+// registers, so an image whose host has none, or a small one, doesn't pay
+// for the largest.
+static KeymapImage* s_images[2];
+static uint32_t s_image_size; // of each, header and table
+static int s_live_image = -1; // -1: the builtin table
+static uint32_t s_staged;     // bytes uploaded into the spare so far, from offset 0
+
+static struct {
+    KeymapKind kind;
+    const void* builtin;
+    uint32_t length;
+    const void* volatile* live;
+    KeymapLookup lookup;
+    uint8_t layers;
+    uint8_t states;
+    KeymapHeader builtin_header;
+} s_host;
+
+static struct {
+    const char* source;
+    uint32_t load_us; // copy and check of the live table
+    uint32_t swaps;
+    uint32_t rejected;
+    KeymapStatus last_status;
+    uint32_t saves;
+} s_stats = { .source = "built in" };
+
+static uint32_t slot_offset(KeymapKind kind)
+{
+    return KEYMAP_FLASH_OFFSET + (kind - 1) * KEYMAP_FLASH_SLOT;
+}
+
+// zlib's CRC-32 of len bytes at src, copying them to dst on the way unless
+// dst is NULL. The DMA sniffer does the work at a byte per cycle, so a
+// checked load costs about what a memcpy would. Nothing else uses the
+// sniffer.
+static uint32_t dma_crc32(void* dst, const void* src, uint32_t len)
+{
+    static uint8_t sink;
+
+    uint ch = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(ch);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, dst != NULL);
+    channel_config_set_sniff_enable(&c, true);
+
+    // reflected CRC-32, seeded and finished the zlib way
+    dma_sniffer_set_data_accumulator(0xffffffff);
+    dma_sniffer_set_output_reverse_enabled(true);
+    dma_sniffer_set_output_invert_enabled(true);
+    dma_sniffer_enable(ch, DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, true);
+
+    dma_channel_configure(ch, &c, dst ? dst : &sink, src, len, true);
+    dma_channel_wait_for_finish_blocking(ch);
+    uint32_t crc = dma_sniffer_get_data_accumulator();
+
+    dma_sniffer_disable();
+    dma_channel_unclaim(ch);
+    return crc;
+}
+
+static KeymapStatus header_check(const KeymapHeader* h)
+{
+    if (h->magic != KEYMAP_MAGIC || h->version != KEYMAP_VERSION)
+        return KeymapBadHeader;
+    if (s_host.kind == KeymapKindNone || h->kind != s_host.kind)
+        return KeymapWrongKind;
+    if (h->length != s_host.length)
+        return KeymapWrongLength;
+    return KeymapOk;
+}
+
+// Readers load the pointer once per event; the table has to be complete
+// before they can see it
+static void swap_in(int image, const char* source)
+{
+    __dmb();
+    *s_host.live = image < 0 ? s_host.builtin : s_images[image]->table;
+    s_live_image = image;
+    s_stats.source = source;
+    s_stats.swaps++;
+}
+
+void keymap_register(KeymapKind kind, const void* builtin, uint32_t length, const void* volatile* live,
+    KeymapLookup lookup, uint8_t layers, uint8_t states)
+{
+    *live = builtin;
+    if (length > KEYMAP_MAX_LENGTH)
+        return;
+
+    // only at host init, with no upload or swap in progress
+    uint32_t size = sizeof(KeymapHeader) + length;
+    if (size != s_image_size) {
+        for (int i = 0; i < 2; i++) {
+            free(s_images[i]);
+            s_images[i] = malloc(size);
+        }
+        s_image_size = size;
+        if (!s_images[0] || !s_images[1]) {
+            DBG("no RAM for keymap images, keeping the built in one\n");
+            free(s_images[0]);
+            free(s_images[1]);
+            s_images[0] = s_images[1] = NULL;
+            s_image_size = 0;
+            return;
+        }
+    }
+    s_staged = 0;
+
+    s_host.kind = kind;
+    s_host.builtin = builtin;
+    s_host.length = length;
+    s_host.live = live;
+    s_host.lookup = lookup;
+    s_host.layers = layers;
+    s_host.states = states;
+    s_live_image = -1;
+
+    s_host.builtin_header = (KeymapHeader) {
+        .magic = KEYMAP_MAGIC,
+        .version = KEYMAP_VERSION,
+        .kind = kind,
+        .length = length,
+        .crc32 = dma_crc32(NULL, builtin, length),
+    };
+
+    const KeymapImage* saved = (const KeymapImage*) (XIP_BASE + slot_offset(kind));
+    if (header_check(&saved->header) != KeymapOk)
+        return;
+
+    uint32_t start = time_us_32();
+    KeymapImage* img = s_images[0];
+    img->header = saved->header;
+    uint32_t crc = dma_crc32(img->table, saved->table, length);
+    s_stats.load_us = time_us_32() - start;
+
+    if (crc != saved->header.crc32) {
+        DBG("saved keymap fails its CRC, keeping the built in one\n");
+        return;
+    }
+    swap_in(0, "flash");
+    DBG("keymap loaded from flash in %lu us\n", s_stats.load_us);
+}
+
+static int spare_image()
+{
+    return s_live_image == 0 ? 1 : 0;
+}
+
+// Chunks have to follow each other, so s_staged is what has been written
+// and an upload with a gap in it can't be applied
+KeymapStatus keymap_stage(uint32_t offset, const uint8_t* data, uint32_t len)
+{
+    if (offset == 0)
+        s_staged = 0;
+    if (offset != s_staged)
+        return KeymapOutOfOrder;
+    if (!s_image_size)
+        return KeymapWrongKind;
+    if (offset > s_image_size || len > s_image_size - offset)
+        return KeymapTooLarge;
+
+    memcpy((uint8_t*) s_images[spare_image()] + offset, data, len);
+    s_staged = offset + len;
+    return KeymapOk;
+}
+
+// Core1 is parked in RAM while the flash is busy, as for 'rec flush'
+static void flash_save(const KeymapImage* img)
+{
+    static uint8_t page[FLASH_PAGE_SIZE];
+    uint32_t offset = slot_offset(img->header.kind);
+    uint32_t size = sizeof(KeymapHeader) + img->header.length;
+
+    multicore_lockout_start_blocking();
+    uint32_t irq = save_and_disable_interrupts();
+
+    flash_range_erase(offset, KEYMAP_FLASH_SLOT);
+    for (uint32_t off = 0; off < size; off += FLASH_PAGE_SIZE) {
+        uint32_t n = size - off;
+        if (n > FLASH_PAGE_SIZE)
+            n = FLASH_PAGE_SIZE;
+        memset(page, 0xff, sizeof(page));
+        memcpy(page, (const uint8_t*) img + off, n);
+        flash_range_program(offset + off, page, FLASH_PAGE_SIZE);
+    }
+
+    restore_interrupts(irq);
+    multicore_lockout_end_blocking();
+    s_stats.saves++;
+}
+
+KeymapStatus keymap_apply(bool save)
+{
+    if (!s_image_size)
+        return KeymapWrongKind;
+    int spare = spare_image();
+    KeymapImage* img = s_images[spare];
+
+    KeymapStatus status = header_check(&img->header);
+    if (status == KeymapOk && s_staged < sizeof(KeymapHeader) + img->header.length)
+        status = KeymapWrongLength;
+
+    uint32_t start = time_us_32();
+    if (status == KeymapOk && dma_crc32(NULL, img->table, img->header.length) != img->header.crc32)
+        status = KeymapBadCrc;
+
+    s_stats.last_status = status;
+    if (status != KeymapOk) {
+        s_stats.rejected++;
+        return status;
+    }
+
+    s_stats.load_us = time_us_32() - start;
+    swap_in(spare, "upload");
+    s_staged = 0;
+    if (save)
+        flash_save(img);
+    return KeymapOk;
+}
+
+uint32_t keymap_load_us()
+{
+    return s_stats.load_us;
+}
+
+const KeymapHeader* keymap_live_header()
+{
+    return s_live_image < 0 ? &s_host.builtin_header : &s_images[s_live_image]->header;
+}
+
+const uint8_t* keymap_live_table()
+{
+    return s_live_image < 0 ? s_host.builtin : s_images[s_live_image]->table;
+}
+
+#if DEBUG
+
+static const char* const s_kind_names[KeymapKindCount] = {
+    [KeymapKindNone] = "none",
+    [KeymapKindSun] = "sun",
+    [KeymapKindApollo] = "apollo",
+};
+
+void keymap_stats_print()
+{
+    if (s_host.kind == KeymapKindNone) {
+        console_printf("  this host has no replaceable keymap\n");
+        return;
+    }
+    const KeymapHeader* h = keymap_live_header();
+    console_printf("  %s, %lu bytes, crc %08lx, %s", s_kind_names[s_host.kind], h->length, h->crc32, s_stats.source);
+    if (s_live_image >= 0)
+        console_printf(", loaded in %lu us", s_stats.load_us);
+    console_printf("\n  %lu swaps, %lu rejected (last status %d), %lu saved to flash\n", s_stats.swaps,
+        s_stats.rejected, s_stats.last_status, s_stats.saves);
+}
+
+// Every entry of a table through the host's lookup
+static uint32_t lookup_all(const void* table)
+{
+    uint32_t sum = 0;
+    for (uint layer = 0; layer < s_host.layers; layer++) {
+        for (uint k = 0; k < 256; k++) {
+            for (uint state = 0; state < s_host.states; state++)
+                sum += s_host.lookup(table, layer, k, state);
+        }
+    }
+    return sum;
+}
+
+// Load (checked DMA copy vs memcpy) and lookup (live pointer vs the
+// builtin table) costs, on the current host's table. The lookups go
+// through the host's own function, called through a pointer here where
+// its event path has it inlined, so the two columns compare with each
+// other rather than with a key event. The copies go to the spare image,
+// so an upload staged there has to start over.
+static void keymap_bench(int n)
+{
+    uint8_t* copy = s_images[spare_image()]->table;
+    s_staged = 0;
+    uint32_t len = s_host.length;
+    uint32_t lookups = s_host.layers * 256 * s_host.states;
+    uint32_t dma_max = 0, memcpy_max = 0, live_max = 0, builtin_max = 0;
+    volatile uint32_t sum = 0;
+
+    for (int i = 0; i < n; i++) {
+        uint32_t start = isr_cycles_now();
+        dma_crc32(copy, s_host.builtin, len);
+        uint32_t cycles = (start - isr_cycles_now()) & 0xffffff;
+        if (cycles > dma_max) dma_max = cycles;
+
+        start = isr_cycles_now();
+        memcpy(copy, s_host.builtin, len);
+        cycles = (start - isr_cycles_now()) & 0xffffff;
+        if (cycles > memcpy_max) memcpy_max = cycles;
+
+        // the way a host makes them: one load of the live pointer, then
+        // its lookup
+        start = isr_cycles_now();
+        sum += lookup_all(*s_host.live);
+        cycles = (start - isr_cycles_now()) & 0xffffff;
+        if (cycles > live_max) live_max = cycles;
+
+        start = isr_cycles_now();
+        sum += lookup_all(s_host.builtin);
+        cycles = (start - isr_cycles_now()) & 0xffffff;
+        if (cycles > builtin_max) builtin_max = cycles;
+    }
+
+    console_printf("keymap bench: %lu bytes, load with crc %lu cycles, memcpy %lu\n", len, dma_max, memcpy_max);
+    console_printf("  %lu lookups (%u layers x 256 x %u states): live %lu cycles, builtin %lu\n", lookups,
+        s_host.layers, s_host.states, live_max, builtin_max);
+}
+
+// 'keymap': the live keymap
+// 'keymap builtin': back to the compiled-in table (flash is left alone)
+// 'keymap erase': forget the saved one, from the next boot
+// 'keymap bench [n]'
+void keymap_console_cmd(int argc, char** argv)
+{
+    if (argc < 2) {
+        console_printf("keymap:\n");
+        keymap_stats_print();
+        return;
+    }
+
+    if (s_host.kind == KeymapKindNone) {
+        console_printf("keymap: this host has no replaceable keymap\n");
+    } else if (strcmp(argv[1], "builtin") == 0) {
+        swap_in(-1, "built in");
+    } else if (strcmp(argv[1], "erase") == 0) {
+        multicore_lockout_start_blocking();
+        uint32_t irq = save_and_disable_interrupts();
+        flash_range_erase(slot_offset(s_host.kind), KEYMAP_FLASH_SLOT);
+        restore_interrupts(irq);
+        multicore_lockout_end_blocking();
+        console_printf("keymap: saved %s keymap erased\n", s_kind_names[s_host.kind]);
+    } else if (strcmp(argv[1], "bench") == 0 && s_image_size) {
+        int n = argc >= 3 ? atoi(argv[2]) : 100;
+        keymap_bench(n > 0 ? n : 100);
+    } else {
+        console_printf("usage: keymap [builtin | erase | bench [n]]\n");
+    }
+}
+
+#endif
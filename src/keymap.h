@@ -0,0 +1,81 @@
+#ifndef KEYMAP_H_
+#define KEYMAP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Replaceable host keymaps. A host registers its compiled-in table and a
+ * pointer it reads the live table through; a keymap uploaded over the USB
+ * link (or saved to flash earlier) is validated in a RAM buffer the host
+ * isn't using, then swapped in with a single pointer store. Translation
+ * runs in the mainloop and the swap happens in usb_link_task, between
+ * events, so a lookup never sees a half-written table.
+ *
+ * The binary format is a header followed by the table exactly as the C
+ * array lays it out, little endian:
+ *
+ *   magic:u32 'BFKM'  version:u16  kind:u16  length:u32  crc32:u32
+ *   table[length]
+ *
+ * crc32 is the zlib one, over the table. tools/usb_link.py reads and
+ * writes these files.
+ */
+
+#define KEYMAP_MAGIC 0x4d4b4642 // 'BFKM'
+#define KEYMAP_VERSION 1
+
+typedef enum {
+    KeymapKindNone = 0,
+    KeymapKindSun,    // uint8_t [256]: HID usage to Sun code (usb2sun)
+    KeymapKindApollo, // uint16_t [2][256][5]: gui, HID usage, KeyState (s_code_table)
+    KeymapKindCount
+} KeymapKind;
+
+// the largest table, the Apollo one; the RAM images are sized to the
+// registered table, this bounds the flash slots
+#define KEYMAP_MAX_LENGTH (2 * 256 * 5 * 2)
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t kind;
+    uint32_t length;
+    uint32_t crc32;
+} KeymapHeader;
+
+typedef enum {
+    KeymapOk = 0,
+    KeymapBadHeader,   // magic or version
+    KeymapWrongKind,   // not the current host's table, or it has none
+    KeymapWrongLength,
+    KeymapBadCrc,
+    KeymapTooLarge,    // upload past the end of the buffer
+    KeymapOutOfOrder,  // a chunk that doesn't start where the last one ended
+} KeymapStatus;
+
+// A host's lookup, the one its event path makes: the code for keycode in
+// table, under one of the host's layers and one of its states per key
+typedef uint16_t (*KeymapLookup)(const void* table, uint8_t layer, uint16_t keycode, uint8_t state);
+
+// From a host's init: live starts out pointing at builtin, and is switched
+// to a keymap saved in flash for this kind if there is a valid one. lookup,
+// layers and states are for 'keymap bench'.
+void keymap_register(KeymapKind kind, const void* builtin, uint32_t length, const void* volatile* live,
+    KeymapLookup lookup, uint8_t layers, uint8_t states);
+
+// Upload: header and table written into the spare buffer in chunks, in
+// order from offset 0, then checked and swapped in (and saved to flash if
+// asked)
+KeymapStatus keymap_stage(uint32_t offset, const uint8_t* data, uint32_t len);
+KeymapStatus keymap_apply(bool save);
+// how long checking (and copying, from flash) the live keymap took
+uint32_t keymap_load_us();
+
+// The live table with its header, for reading it back
+const KeymapHeader* keymap_live_header();
+const uint8_t* keymap_live_table();
+
+void keymap_stats_print();
+
+#endif
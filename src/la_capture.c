@@ -0,0 +1,486 @@
+#include <pico/stdlib.h>
+#include <hardware/pio.h>
+#include <hardware/dma.h>
+#include <hardware/irq.h>
+#include <hardware/clocks.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tusb.h>
+
+#define DEBUG_TAG "la"
+#include "babelfish.h"
+#include "console.h"
+#include "la_capture.h"
+#include "isr_stats.h"
+#include "pio_util.h"
+
+#include "la_capture.pio.h"
+
+DBG_MODULE();
+
+#if DEBUG && LA_CAPTURE
+
+/**********************
+
+Logic analyzer capture mode.
+
+The la_capture PIO program samples GPIO0..15 at the configured rate and packs
+two 16-bit samples into each 32-bit word. Two DMA channels are chained in
+ping-pong fashion, each filling one half of the capture ring; the DMA IRQ
+re-arms the finished channel and marks its half ready. The mainloop (via
+debug_task) run-length encodes ready halves and streams them over the CDC.
+
+If a half completes again before the encoder released it, its previous
+contents were overwritten and the whole half is counted as dropped. Likewise
+if the host stops reading: the encoder waits at most LA_WRITE_TIMEOUT_US for
+room in the staging buffer, then drops the frame it was about to stage (for
+a data frame, the rest of the half) and counts it.
+
+The 32 KiB ring is static, so the capture mode is only built in with the
+BABELFISH_LA_CAPTURE CMake option.
+
+While capturing, the CDC carries only the binary stream below; dbg() output
+is suppressed. All multibyte values are little endian.
+
+  frame := type:u8 len:u16 payload[len]
+
+  'H' header   rate_hz:u32 pin_mask:u16 channel_count:u8 { gpio:u8 name:char[8] }*
+  'D' data     { value:u16 run:varint }*   (run is the count of samples minus 1)
+  'S' status   samples:u32 dropped:u32 bytes_out:u32 elapsed_us:u32
+  'E' end      (status payload, sent once on stop)
+
+tools/la_capture.py decodes this into a sigrok session (.sr) file.
+
+***********************/
+
+// 4096 words (8192 samples) per half
+#define LA_HALF_WORDS 4096
+#define LA_HALF_SAMPLES (LA_HALF_WORDS * 2)
+
+#define LA_MAX_RATE_HZ 24000000
+#define LA_DEFAULT_RATE_HZ 1000000
+#define LA_STATUS_INTERVAL_US 1000000
+// longest the encoder waits on the host for room in s_out
+#define LA_WRITE_TIMEOUT_US 2000
+
+// Only the channel pins take part in the run-length comparison; the mux
+// select lines and anything else in GPIO0..15 are ignored.
+#define LA_PIN_MASK ((1u << TX_A_GPIO) | (1u << RX_A_GPIO) | \
+                     (1u << TX_B_GPIO) | (1u << RX_B_GPIO) | \
+                     (1u << 14) | (1u << 15))
+
+static const struct {
+    uint8_t gpio;
+    char name[8];
+} s_la_channels[] = {
+    { TX_A_GPIO, "TX_A" },
+    { RX_A_GPIO, "RX_A" },
+    { TX_B_GPIO, "TX_B" },
+    { RX_B_GPIO, "RX_B" },
+    { 14, "GPIO14" },
+    { 15, "GPIO15" },
+};
+
+#define LA_NUM_CHANNELS (sizeof(s_la_channels) / sizeof(s_la_channels[0]))
+
+static uint32_t s_ring[2][LA_HALF_WORDS] __attribute__((aligned(4)));
+
+static struct {
+    bool active;
+    PIO pio;
+    uint sm;
+    uint offset;
+    int dma[2];
+    uint32_t rate_hz;
+
+    // halves written by DMA and not yet released by the encoder (bit per half)
+    volatile uint32_t ready;
+    volatile uint32_t dropped_samples;
+    // frames dropped because the host didn't take the staged ones, and the
+    // samples lost with them (the encoder's own, dropped_samples is the IRQ's)
+    uint32_t stalled_frames;
+    uint32_t stalled_samples;
+    // the rest of this half's data frames are being dropped
+    bool stalled;
+    // which half the encoder expects next
+    uint next_half;
+
+    uint64_t start_us;
+    uint64_t last_status_us;
+    uint32_t samples;
+    uint32_t bytes_out;
+
+    // current run
+    uint16_t run_value;
+    uint32_t run_length;
+} s_la;
+
+// staging buffer for outgoing frames
+#define LA_OUT_SIZE 512
+static uint8_t s_out[LA_OUT_SIZE];
+static uint32_t s_out_len = 0;
+
+static void la_stop();
+
+bool la_capture_active()
+{
+    return s_la.active;
+}
+
+static void __not_in_flash_func(la_dma_irq)()
+{
+    ISR_STAT_BEGIN();
+
+    for (int h = 0; h < 2; h++) {
+        int ch = s_la.dma[h];
+        if (!dma_channel_get_irq0_status(ch))
+            continue;
+
+        dma_channel_acknowledge_irq0(ch);
+
+        // the other half is already filling (chained); point this one back at its
+        // buffer so it is ready when the chain comes around again
+        dma_channel_set_write_addr(ch, s_ring[h], false);
+
+        if (s_la.ready & (1u << h)) {
+            s_la.dropped_samples += LA_HALF_SAMPLES;
+        }
+        s_la.ready |= 1u << h;
+    }
+
+    ISR_STAT_END(IsrStatLaDma);
+}
+
+// Push all staged bytes to the CDC. Returns false if the CDC couldn't take them all.
+static bool la_flush()
+{
+    uint32_t off = 0;
+    while (off < s_out_len) {
+        uint32_t avail = tud_cdc_write_available();
+        if (avail == 0) {
+            tud_task();
+            tud_cdc_write_flush();
+            if (!tud_cdc_connected() || tud_cdc_write_available() == 0)
+                break;
+            continue;
+        }
+        uint32_t n = s_out_len - off;
+        if (n > avail) n = avail;
+        off += tud_cdc_write(s_out + off, n);
+    }
+    tud_cdc_write_flush();
+
+    s_la.bytes_out += off;
+    if (off < s_out_len) {
+        memmove(s_out, s_out + off, s_out_len - off);
+    }
+    s_out_len -= off;
+    return s_out_len == 0;
+}
+
+// Make room for n more bytes. Only call this between frames. This is where
+// the encoder waits on USB; if the host doesn't make room within
+// LA_WRITE_TIMEOUT_US, returns false and the caller drops its frame.
+static bool la_reserve(uint32_t n)
+{
+    uint64_t deadline = time_us_64() + LA_WRITE_TIMEOUT_US;
+    while (s_out_len + n > LA_OUT_SIZE) {
+        if (!tud_cdc_connected()) {
+            s_out_len = 0;
+            break;
+        }
+        if (time_us_64() >= deadline) {
+            s_la.stalled_frames++;
+            return false;
+        }
+        la_flush();
+    }
+    return true;
+}
+
+static void la_frame(uint8_t type, const void* payload, uint16_t len)
+{
+    if (!la_reserve(3 + len))
+        return;
+
+    s_out[s_out_len++] = type;
+    s_out[s_out_len++] = len & 0xff;
+    s_out[s_out_len++] = len >> 8;
+    memcpy(s_out + s_out_len, payload, len);
+    s_out_len += len;
+}
+
+static void la_send_status(uint8_t type)
+{
+    uint32_t st[4] = {
+        s_la.samples,
+        s_la.dropped_samples + s_la.stalled_samples,
+        s_la.bytes_out,
+        (uint32_t) (time_us_64() - s_la.start_us),
+    };
+    la_frame(type, st, sizeof(st));
+}
+
+static void la_send_header()
+{
+    uint8_t hdr[7 + LA_NUM_CHANNELS * 9];
+    uint32_t rate = s_la.rate_hz;
+    uint16_t mask = LA_PIN_MASK;
+
+    memcpy(hdr, &rate, 4);
+    memcpy(hdr + 4, &mask, 2);
+    hdr[6] = LA_NUM_CHANNELS;
+    for (uint i = 0; i < LA_NUM_CHANNELS; i++) {
+        hdr[7 + i * 9] = s_la_channels[i].gpio;
+        memcpy(hdr + 8 + i * 9, s_la_channels[i].name, 8);
+    }
+    la_frame('H', hdr, sizeof(hdr));
+}
+
+// Data frames are built in place in s_out: 3 byte header, then tokens.
+static uint32_t s_data_hdr = 0;
+
+static void la_data_begin()
+{
+    if (!la_reserve(3 + 7)) {
+        s_la.stalled = true;
+        return;
+    }
+    s_data_hdr = s_out_len;
+    s_out[s_out_len++] = 'D';
+    s_out_len += 2;
+}
+
+static void la_data_end()
+{
+    if (s_la.stalled)
+        return;
+    uint16_t len = s_out_len - s_data_hdr - 3;
+    if (len == 0) {
+        s_out_len = s_data_hdr;
+        return;
+    }
+    s_out[s_data_hdr + 1] = len & 0xff;
+    s_out[s_data_hdr + 2] = len >> 8;
+}
+
+static void la_emit_run()
+{
+    // 2 bytes value + up to 5 bytes varint
+    if (!s_la.stalled && s_out_len + 7 > LA_OUT_SIZE) {
+        la_data_end();
+        la_data_begin();
+    }
+    if (s_la.stalled) {
+        s_la.stalled_samples += s_la.run_length;
+        return;
+    }
+
+    s_out[s_out_len++] = s_la.run_value & 0xff;
+    s_out[s_out_len++] = s_la.run_value >> 8;
+
+    uint32_t run = s_la.run_length - 1;
+    while (run >= 0x80) {
+        s_out[s_out_len++] = (run & 0x7f) | 0x80;
+        run >>= 7;
+    }
+    s_out[s_out_len++] = run;
+}
+
+static inline void la_sample(uint16_t v)
+{
+    v &= LA_PIN_MASK;
+    if (v == s_la.run_value && s_la.run_length != 0) {
+        s_la.run_length++;
+        return;
+    }
+    if (s_la.run_length)
+        la_emit_run();
+    s_la.run_value = v;
+    s_la.run_length = 1;
+}
+
+static void la_encode_half(const uint32_t* words)
+{
+    // most of the time the lines are idle; compare whole words against the
+    // current run so we only split samples when something changes
+    uint32_t masked_run = s_la.run_value | ((uint32_t) s_la.run_value << 16);
+    const uint32_t mask2 = LA_PIN_MASK | (LA_PIN_MASK << 16);
+
+    la_data_begin();
+    for (uint i = 0; i < LA_HALF_WORDS; i++) {
+        uint32_t w = words[i];
+        if ((w & mask2) == masked_run && s_la.run_length != 0) {
+            s_la.run_length += 2;
+            continue;
+        }
+        la_sample(w & 0xffff);
+        la_sample(w >> 16);
+        masked_run = s_la.run_value | ((uint32_t) s_la.run_value << 16);
+    }
+
+    // close out the run at the half boundary so the host sees a steady stream
+    if (s_la.run_length) {
+        la_emit_run();
+        s_la.run_length = 0;
+    }
+    la_data_end();
+    s_la.stalled = false;
+
+    s_la.samples += LA_HALF_SAMPLES;
+}
+
+void la_capture_task()
+{
+    if (!s_la.active)
+        return;
+
+    if (!tud_cdc_connected()) {
+        la_stop();
+        return;
+    }
+
+    uint32_t bit = 1u << s_la.next_half;
+    if (s_la.ready & bit) {
+        la_encode_half(s_ring[s_la.next_half]);
+
+        // release it; if DMA lapped us while encoding, the drop was already counted
+        uint32_t irq = save_and_disable_interrupts();
+        s_la.ready &= ~bit;
+        restore_interrupts(irq);
+
+        s_la.next_half ^= 1;
+    } else if (s_la.ready & (bit ^ 3)) {
+        // we fell behind and the other half finished first; resync to it
+        s_la.next_half ^= 1;
+    }
+
+    uint64_t now = time_us_64();
+    if (now - s_la.last_status_us >= LA_STATUS_INTERVAL_US) {
+        la_send_status('S');
+        s_la.last_status_us = now;
+    }
+
+    la_flush();
+}
+
+static bool la_start(uint32_t rate_hz)
+{
+    if (s_la.active)
+        return true;
+
+    uint32_t sys_hz = clock_get_hz(clk_sys);
+    if (rate_hz == 0 || rate_hz > LA_MAX_RATE_HZ || rate_hz > sys_hz) {
+        DBG("rate %lu out of range (max %u)\n", rate_hz, LA_MAX_RATE_HZ);
+        return false;
+    }
+
+    s_la.pio = pio_claim_with_room(&la_capture_program, 1, &s_la.sm);
+    if (!s_la.pio) {
+        DBG("no free PIO state machine\n");
+        return false;
+    }
+
+    // The divider has 8 fractional bits, so the rate we get is rarely the
+    // one asked for; the header and status report the one we got.
+    uint32_t div = ((uint64_t) sys_hz * 256 + rate_hz / 2) / rate_hz;
+    div = clamp(div, 256, 0xffffff);
+    s_la.offset = pio_add_program(s_la.pio, &la_capture_program);
+    la_capture_program_init(s_la.pio, s_la.sm, s_la.offset, 0, div >> 8, div & 0xff);
+    s_la.rate_hz = (uint32_t) (((uint64_t) sys_hz * 256 + div / 2) / div);
+
+    for (int h = 0; h < 2; h++) {
+        s_la.dma[h] = dma_claim_unused_channel(true);
+    }
+
+    for (int h = 0; h < 2; h++) {
+        dma_channel_config c = dma_channel_get_default_config(s_la.dma[h]);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+        channel_config_set_read_increment(&c, false);
+        channel_config_set_write_increment(&c, true);
+        channel_config_set_dreq(&c, pio_get_dreq(s_la.pio, s_la.sm, false));
+        channel_config_set_chain_to(&c, s_la.dma[h ^ 1]);
+        dma_channel_configure(s_la.dma[h], &c, s_ring[h], &s_la.pio->rxf[s_la.sm], LA_HALF_WORDS, false);
+        dma_channel_set_irq0_enabled(s_la.dma[h], true);
+    }
+
+    irq_add_shared_handler(DMA_IRQ_0, la_dma_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+
+    s_la.ready = 0;
+    s_la.dropped_samples = 0;
+    s_la.stalled_frames = 0;
+    s_la.stalled_samples = 0;
+    s_la.stalled = false;
+    s_la.next_half = 0;
+    s_la.samples = 0;
+    s_la.bytes_out = 0;
+    s_la.run_length = 0;
+    s_out_len = 0;
+
+    // dbg() goes quiet from here on; say so while we still can
+    DBG("capturing at %lu Hz\n", s_la.rate_hz);
+
+    s_la.active = true;
+    s_la.start_us = s_la.last_status_us = time_us_64();
+    la_send_header();
+
+    pio_sm_clear_fifos(s_la.pio, s_la.sm);
+    dma_channel_start(s_la.dma[0]);
+    pio_sm_set_enabled(s_la.pio, s_la.sm, true);
+
+    return true;
+}
+
+static void la_stop()
+{
+    if (!s_la.active)
+        return;
+
+    pio_sm_set_enabled(s_la.pio, s_la.sm, false);
+
+    for (int h = 0; h < 2; h++) {
+        dma_channel_set_irq0_enabled(s_la.dma[h], false);
+        // break the chain so the abort doesn't just restart the other half
+        dma_channel_config c = dma_get_channel_config(s_la.dma[h]);
+        channel_config_set_chain_to(&c, s_la.dma[h]);
+        dma_channel_set_config(s_la.dma[h], &c, false);
+    }
+    for (int h = 0; h < 2; h++) {
+        dma_channel_abort(s_la.dma[h]);
+        dma_channel_acknowledge_irq0(s_la.dma[h]);
+        dma_channel_unclaim(s_la.dma[h]);
+    }
+    irq_remove_handler(DMA_IRQ_0, la_dma_irq);
+
+    pio_remove_program(s_la.pio, &la_capture_program, s_la.offset);
+    pio_sm_unclaim(s_la.pio, s_la.sm);
+
+    la_send_status('E');
+    la_flush();
+
+    s_la.active = false;
+
+    uint32_t elapsed_ms = (uint32_t) ((time_us_64() - s_la.start_us) / 1000);
+    DBG("capture stopped: %lu samples, %lu dropped (%lu in %lu stalled frames), %lu bytes in %lu ms\n",
+        s_la.samples, s_la.dropped_samples + s_la.stalled_samples, s_la.stalled_samples,
+        s_la.stalled_frames, s_la.bytes_out, elapsed_ms);
+}
+
+void la_console_cmd(int argc, char** argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "start") == 0) {
+        uint32_t rate = argc >= 3 ? strtoul(argv[2], NULL, 0) : LA_DEFAULT_RATE_HZ;
+        la_start(rate);
+    } else if (argc >= 2 && strcmp(argv[1], "stop") == 0) {
+        la_stop();
+    } else if (argc >= 2 && strcmp(argv[1], "status") == 0) {
+        console_printf("la: %s, %lu Hz, %lu samples, %lu dropped, %lu stalled frames, %lu bytes\n",
+            s_la.active ? "active" : "idle", s_la.rate_hz, s_la.samples,
+            s_la.dropped_samples + s_la.stalled_samples, s_la.stalled_frames, s_la.bytes_out);
+    } else {
+        console_printf("usage: la start [rate_hz] | la stop | la status\n");
+    }
+}
+
+#endif
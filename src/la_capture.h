@@ -0,0 +1,21 @@
+#ifndef LA_CAPTURE_H_
+#define LA_CAPTURE_H_
+
+#include <stdbool.h>
+
+// Logic analyzer capture mode; see la_capture.c for the stream format. Its
+// DMA ring takes 32 KiB of RAM, so it is only built in when asked for; set
+// from CMake, BABELFISH_LA_CAPTURE.
+#ifndef LA_CAPTURE
+#define LA_CAPTURE 0
+#endif
+
+#if DEBUG && LA_CAPTURE
+bool la_capture_active();
+void la_capture_task();
+#else
+static inline bool la_capture_active() { return false; }
+static inline void la_capture_task() {}
+#endif
+
+#endif
@@ -11,6 +11,7 @@
  */
 
 #include <pico/stdlib.h>
+#include <stdlib.h>
 #include <pico/multicore.h>
 #include <tusb.h>
 #include <pio_usb.h>
@@ -20,20 +21,82 @@
 #define DEBUG_TAG "main"
 
 #include "babelfish.h"
+#include "isr_stats.h"
+#include "irq_plan.h"
+#include "console.h"
+#include "hid_ring.h"
+#include "usb_link.h"
+#include "remap.h"
+#include "usb_host_health.h"
+
+DBG_MODULE();
 
 // Whether to run USB host on core1
 #define USB_ON_CORE1 1
 
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_SUN
 HOST_PROTOTYPES(sun);
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_ADB
 HOST_PROTOTYPES(adb);
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_APOLLO
 HOST_PROTOTYPES(apollo);
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_PS2
+HOST_PROTOTYPES(ps2);
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_SGI
+HOST_PROTOTYPES(sgi);
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_NEXT
+HOST_PROTOTYPES(next);
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_QUAD
+HOST_PROTOTYPES(quad);
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_PCMOUSE
+HOST_PROTOTYPES(pcmouse);
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_REVERSE
+HOST_PROTOTYPES(reverse);
+#endif
+#if BABELFISH_HOST_ALL
 HOST_PROTOTYPES(test_3v3);
+#endif
 
 HostDevice hosts[] = {
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_SUN
   HOST_ENTRY(sun, "Sun emulation. Ch A RX/TX for keyboard, Ch B TX for mouse. Shifter setting 5V."),
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_ADB
   HOST_ENTRY(adb, "ADB emulation. Ch A RX bidirectional. Shifter setting 5V."),
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_APOLLO
   HOST_ENTRY(apollo, "Apollo emulation. Ch A RX/TX for keyboard and mouse. Shifter setting 5V."),
+#endif
+#if BABELFISH_HOST_ALL
   HOST_ENTRY(test_3v3, "3v3 TTL test. Transmits A on Ch A TX and B on Ch B TX every 0.5s, 1200 baud 8n1."),
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_PS2
+  HOST_ENTRY(ps2, "PS/2 emulation. Ch A keyboard, Ch B mouse; TX is CLK, RX is DATA, both bidirectional. Shifter setting 5V."),
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_SGI
+  HOST_ENTRY(sgi, "SGI emulation. Ch A RX/TX for keyboard, Ch B TX for mouse. RS-232."),
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_NEXT
+  HOST_ENTRY(next, "NeXT (non-ADB) emulation. Ch A RX from the monitor, TX to it; the mouse rides along. Shifter setting 5V."),
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_QUAD
+  HOST_ENTRY(quad, "Quadrature bus mouse. Ch A TX/RX XA/XB, Ch B TX/RX YA/YB, buttons on GPIO14/15. Shifter setting 5V."),
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_PCMOUSE
+  HOST_ENTRY(pcmouse, "PC serial mouse (Microsoft, Logitech, Mouse Systems). Ch B TX data, RX from RTS. RS-232."),
+#endif
+#if BABELFISH_HOST_ALL || BABELFISH_HOST_REVERSE
+  HOST_ENTRY_FLAGS(reverse, "Reverse: Sun/Apollo keyboard on Ch A, serial mouse on Ch B RX, as a USB HID keyboard and mouse.",
+    HostFlagUsbHidDevice),
+#endif
   { 0 }
 };
 
@@ -57,7 +120,11 @@ ChannelConfig channels[NUM_CHANNELS] = {
 };
 
 // TODO read from flash
+#if BABELFISH_HOST_ALL
 int g_current_host_index = 3;
+#else
+int g_current_host_index = 0;
+#endif
 
 HostDevice *host = NULL;
 KeyboardEvent kbd_event_queue[MAX_QUEUED_EVENTS];
@@ -77,6 +144,7 @@ void channel_init(void);
 void led_init(void);
 void usb_aux_init(void);
 bool cmd_process_event(KeyboardEvent ev);
+void cmd_task(void);
 
 int main(void)
 {
@@ -85,6 +153,10 @@ int main(void)
 
   led_init();
 
+  isr_stats_init();
+  irq_plan_init_budgets();
+  irq_plan_usb_device_markers_init();
+
   tud_init(0);
 
   stdio_nusb_init();
@@ -119,54 +191,105 @@ int main(void)
   DBG("%s\n", host->notes);
 
   // TODO: read hostid from storage
-  host->init();
+  HOST_INIT();
+
+  // after host init, so every IRQ the host uses is in place
+  irq_plan_apply();
 
   mainloop();
 
   return 0;
 }
 
+// Key events out of the remap stage go to the command processor, then the host
+static void dispatch_kbd(const KeyboardEvent* events, uint count)
+{
+  for (uint i = 0; i < count; i++) {
+    usb_link_trace_kbd(&events[i]);
+    // if cmd_process_event took the event
+    if (cmd_process_event(events[i]))
+      continue;
+    HOST_KBD_EVENT(events[i]);
+  }
+}
+
 _Noreturn void mainloop(void)
 {
   KeyboardEvent kbd_events[MAX_QUEUED_EVENTS];
   MouseEvent mouse_events[MAX_QUEUED_EVENTS];
+  KeyboardEvent remapped[REMAP_MAX_OUT];
   uint kbd_event_count = 0;
   uint mouse_event_count = 0;
 
   while (true) {
     DEBUG_TASK();
 
+    hid_app_task();
+
     get_queued_kbd_events(kbd_events, &kbd_event_count);
     get_queued_mouse_events(mouse_events, &mouse_event_count);
 
     for (uint i = 0; i < kbd_event_count; i++) {
       DBG_V("xmit key %s: [%d] 0x%04x\n", kbd_events[i].down ? "DOWN" : "UP", kbd_events[i].page, kbd_events[i].keycode);
-      // if cmd_process_event took the event
-      if (cmd_process_event(kbd_events[i]))
-        continue;
-      host->kbd_event(kbd_events[i]);
+      dispatch_kbd(remapped, remap_event(kbd_events[i], remapped));
     }
 
     for (uint i = 0; i < mouse_event_count; i++) {
-      host->mouse_event(mouse_events[i]);
+      usb_link_trace_mouse(&mouse_events[i]);
+      HOST_MOUSE_EVENT(mouse_events[i]);
     }
 
-    host->update();
+    // tap/hold and chord keys whose time is up
+    dispatch_kbd(remapped, remap_task(remapped));
+    cmd_task();
+
+    HOST_UPDATE();
 
     gpio_put(LED_P_OK_GPIO, !gpio_get(USB_5V_STAT_GPIO));
     //gpio_put(LED_AUX_GPIO, tud_cdc_connected());
   }
 }
 
+#if DEBUG
+// 'dispatchbench [n]': time n calls of the host update hook the same way the
+// mainloop makes them. Compare the multi-host image (indirect call through
+// HostDevice) with a single-host one (direct, possibly inlined, call).
+void dispatchbench_console_cmd(int argc, char** argv)
+{
+  int n = argc >= 2 ? atoi(argv[1]) : 1000;
+  if (n <= 0)
+    n = 1000;
+
+  uint64_t total = 0;
+  uint32_t min = UINT32_MAX, max = 0;
+  for (int i = 0; i < n; i++) {
+    uint32_t start = isr_cycles_now();
+    HOST_UPDATE();
+    // SysTick counts down
+    uint32_t cycles = (start - isr_cycles_now()) & 0xffffff;
+    total += cycles;
+    if (cycles < min) min = cycles;
+    if (cycles > max) max = cycles;
+  }
+
+  console_printf("%s dispatch (%s): %d calls, cycles min %lu avg %lu max %lu\n",
+                 host->name, BABELFISH_HOST_ALL ? "indirect" : "direct", n,
+                 min, (uint32_t)(total / n), max);
+}
+#endif
+
 void usb_host_setup()
 {
   pio_usb_configuration_t pio_cfg = PIO_USB_DEFAULT_CONFIG;
   pio_cfg.pinout = PIO_USB_PINOUT_DMDP;
   pio_cfg.pin_dp = USB_AUX_DP_GPIO;
+  // the 1 ms frame timer is ours, so it can be timed (usb_host_health.c)
+  pio_cfg.skip_alarm_pool = true;
 
   tuh_configure(1, TUH_CFGID_RPI_PIO_USB_CONFIGURATION, &pio_cfg);
 
   tuh_init(1);
+  usb_host_health_start();
 }
 
 //
@@ -176,31 +299,53 @@ void core1_main(void)
 {
   sleep_ms(10);
 
+  // lets core0 park us while it writes to flash (hid_rec.c)
+  multicore_lockout_victim_init();
+
   usb_host_setup();
 
+  // in real time mode, also masks everything core1 doesn't need
+  irq_plan_apply();
+
+  // SysTick for the rearm / tuh_task timings in hid_ring_stats
+  isr_cycles_init();
+
   while (true) {
+    uint32_t start = isr_cycles_now();
     tuh_task(); // tinyusb host task
+    uint32_t cycles = (start - isr_cycles_now()) & 0xffffff;
+    if (cycles > hid_ring_stats.core1.task_max_cycles)
+      hid_ring_stats.core1.task_max_cycles = cycles;
+    hid_ring_stats_core1_task();
+
+    hid_app_host_task();
   }
 }
 
-void enqueue_kbd_event(const KeyboardEvent* event)
+bool enqueue_kbd_event(const KeyboardEvent* event)
 {
   //DBG_VV("Enqueued key %s: [%d] 0x%04x\n", event->down ? "DOWN" : "UP", event->page, event->keycode);
+  bool queued = false;
   mutex_enter_blocking(&event_queue_mutex);
   if (kbd_event_queue_count < MAX_QUEUED_EVENTS) {
     kbd_event_queue[kbd_event_queue_count++] = *event;
+    queued = true;
   }
   mutex_exit(&event_queue_mutex);
+  return queued;
 }
 
-void enqueue_mouse_event(const MouseEvent* event)
+bool enqueue_mouse_event(const MouseEvent* event)
 {
   //DBG("Enqueued mouse\n");
+  bool queued = false;
   mutex_enter_blocking(&event_queue_mutex);
   if (mouse_event_queue_count < MAX_QUEUED_EVENTS) {
     mouse_event_queue[mouse_event_queue_count++] = *event;
+    queued = true;
   }
   mutex_exit(&event_queue_mutex);
+  return queued;
 }
 
 void get_queued_kbd_events(KeyboardEvent* events, uint* count)
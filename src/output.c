@@ -2,6 +2,8 @@
 #include "debug.h"
 #include "babelfish.h"
 
+DBG_MODULE();
+
 void channel_init() {
   for (int ch = 0; ch < NUM_CHANNELS; ++ch) {
     ChannelConfig *cfg = &channels[ch];
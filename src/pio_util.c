@@ -0,0 +1,28 @@
+#include <pico/stdlib.h>
+#include <hardware/pio.h>
+
+#include "pio_util.h"
+
+// PIO-USB takes most of both blocks' instruction memory, so the host
+// programs and the logic analyzer go wherever there is still room
+PIO pio_claim_with_room(const pio_program_t* program, uint sm_count, uint* sms)
+{
+    PIO pios[] = { pio1, pio0 };
+    for (uint i = 0; i < count_of(pios); i++) {
+        if (!pio_can_add_program(pios[i], program))
+            continue;
+
+        uint n = 0;
+        for (; n < sm_count; n++) {
+            int sm = pio_claim_unused_sm(pios[i], false);
+            if (sm < 0)
+                break;
+            sms[n] = sm;
+        }
+        if (n == sm_count)
+            return pios[i];
+        while (n--)
+            pio_sm_unclaim(pios[i], sms[n]);
+    }
+    return NULL;
+}
@@ -0,0 +1,12 @@
+#ifndef PIO_UTIL_H_
+#define PIO_UTIL_H_
+
+#include <stdint.h>
+#include <hardware/pio.h>
+
+// A PIO block with room for program and sm_count free state machines,
+// which are claimed into sms[]; NULL if neither block has both. The
+// program itself is left for the caller to add.
+PIO pio_claim_with_room(const pio_program_t* program, uint sm_count, uint* sms);
+
+#endif
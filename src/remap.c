@@ -0,0 +1,670 @@
+#include <pico/stdlib.h>
+#include <hardware/clocks.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEBUG_TAG "remap"
+#include "babelfish.h"
+#include "console.h"
+#include "hid_codes.h"
+#include "isr_stats.h"
+#include "remap.h"
+
+DBG_MODULE();
+
+/*
+ * See remap.h. The press of a key looks up the topmost active layer's
+ * action for it and remembers that action in state->down[key]; the release
+ * undoes whatever was remembered. Tap/hold and chord keys sit in the single
+ * pending slot until the next event or remap_task decides what they were.
+ */
+
+_Static_assert(REMAP_LAYERS <= 32, "layers are a bitmask");
+_Static_assert(REMAP_CHORDS <= 255 && REMAP_MACROS <= 255, "indices are uint8_t");
+
+static RemapConfig s_preset;
+static RemapConfig s_config;
+static RemapTable s_table;
+static RemapState s_state;
+
+static struct {
+    uint32_t events;
+    uint32_t out;
+    uint32_t max_out;
+    uint32_t timeouts;     // pending keys resolved by remap_task
+    uint32_t max_cycles;   // slowest remap_event
+} s_stats;
+
+//
+// Compiling
+//
+
+static bool rule_valid(const RemapRule* r, const RemapConfig* config)
+{
+    if (r->layer >= REMAP_LAYERS)
+        return false;
+    if ((r->flags & RemapFlagOtherKeys) && r->type != RemapNone)
+        return false;
+
+    switch (r->type) {
+        case RemapKey:
+        case RemapNone:
+        case RemapChord:
+            return true;
+        case RemapLayerHold:
+        case RemapLayerToggle:
+            return r->a < REMAP_LAYERS;
+        case RemapTapHold:
+            return !(r->flags & RemapFlagHoldLayer) || r->b < REMAP_LAYERS;
+        case RemapMacro:
+            return r->a < REMAP_MACROS && config->macro_len[r->a] <= REMAP_MACRO_STEPS;
+        default:
+            return false;
+    }
+}
+
+bool remap_compile(RemapTable* table, const RemapConfig* config)
+{
+    memset(table, 0, sizeof(*table));
+    if (config->rule_count > REMAP_MAX_RULES)
+        return false;
+
+    for (uint i = 0; i < config->rule_count; i++) {
+        if (!rule_valid(&config->rules[i], config))
+            return false;
+    }
+
+    uint chords = 0;
+    for (uint layer = 0; layer < REMAP_LAYERS; layer++) {
+        RemapAction* actions = table->action[layer];
+
+        // transparent keys: whatever the layer below resolved to
+        for (uint key = 0; key < REMAP_KEYS; key++) {
+            if (layer)
+                actions[key] = table->action[layer - 1][key];
+            else
+                actions[key] = (RemapAction) { .type = RemapKey, .a = key };
+        }
+
+        // a layer that swallows every key it has no rule for
+        for (uint i = 0; i < config->rule_count; i++) {
+            const RemapRule* r = &config->rules[i];
+            if (r->layer != layer || !(r->flags & RemapFlagOtherKeys))
+                continue;
+            for (uint key = 0; key < REMAP_KEYS; key++)
+                actions[key] = (RemapAction) { .type = RemapNone };
+        }
+
+        for (uint i = 0; i < config->rule_count; i++) {
+            const RemapRule* r = &config->rules[i];
+            if (r->layer != layer || r->type == RemapChord || (r->flags & RemapFlagOtherKeys))
+                continue;
+            actions[r->key] = (RemapAction) { .type = r->type, .a = r->a, .b = r->b, .flags = r->flags };
+        }
+
+        // chords last, on top of the key's own action on this layer; the
+        // first chord rule for a key places all of its partners together
+        for (uint i = 0; i < config->rule_count; i++) {
+            const RemapRule* r = &config->rules[i];
+            if (r->layer != layer || r->type != RemapChord)
+                continue;
+
+            bool placed = false;
+            for (uint j = 0; j < i && !placed; j++) {
+                const RemapRule* p = &config->rules[j];
+                placed = p->layer == layer && p->type == RemapChord && p->key == r->key;
+            }
+            if (placed)
+                continue;
+
+            // pressed alone the key does what it would have; only plain
+            // keys (or chord keys from a layer below) can be held back
+            RemapAction* action = &actions[r->key];
+            if (action->type != RemapKey && action->type != RemapChord)
+                return false;
+            action->type = RemapChord;
+            action->chord_first = chords;
+            action->chord_count = 0;
+
+            for (uint j = i; j < config->rule_count; j++) {
+                const RemapRule* p = &config->rules[j];
+                if (p->layer != layer || p->type != RemapChord || p->key != r->key)
+                    continue;
+                if (chords == REMAP_CHORDS || action->chord_count == REMAP_CHORD_PARTNERS)
+                    return false;
+                table->chords[chords++] = (RemapChordEntry) { .partner = p->b, .usage = p->a };
+                action->chord_count++;
+            }
+        }
+    }
+
+    memcpy(table->macros, config->macros, sizeof(table->macros));
+    memcpy(table->macro_len, config->macro_len, sizeof(table->macro_len));
+    table->active = config->rule_count > 0;
+    return true;
+}
+
+void remap_state_reset(RemapState* state)
+{
+    memset(state, 0, sizeof(*state));
+    state->layers = 1;
+}
+
+//
+// The engine
+//
+
+static inline uint emit(KeyboardEvent* out, uint n, uint8_t usage, bool down)
+{
+    out[n] = (KeyboardEvent) { .page = 0, .keycode = usage, .down = down };
+    return n + 1;
+}
+
+static inline uint top_layer(const RemapState* state)
+{
+    return 31 - __builtin_clz(state->layers | state->toggled);
+}
+
+// Counted, so of two keys holding the same layer the first one released
+// doesn't drop it
+static inline void layer_hold(RemapState* state, uint layer)
+{
+    state->holds[layer]++;
+    state->layers |= 1u << layer;
+}
+
+static inline void layer_release(RemapState* state, uint layer)
+{
+    if (state->holds[layer] && --state->holds[layer])
+        return;
+    state->layers &= ~(1u << layer) | 1;
+}
+
+// A held back key is decided: tap (released in time), or hold (timed out,
+// or another key came). Chord keys without their partner become plain keys.
+static uint resolve_pending(RemapState* state, bool tap, KeyboardEvent* out, uint n)
+{
+    const RemapAction* p = &state->pending_action;
+    RemapAction* down = &state->down[state->pending_key];
+    state->pending = false;
+
+    if (p->type == RemapChord) {
+        n = emit(out, n, p->a, true);
+        if (tap) {
+            n = emit(out, n, p->a, false);
+            *down = (RemapAction) { 0 };
+        } else {
+            *down = (RemapAction) { .type = RemapKey, .a = p->a };
+        }
+    } else if (tap) {
+        n = emit(out, n, p->a, true);
+        n = emit(out, n, p->a, false);
+        *down = (RemapAction) { 0 };
+    } else if (p->flags & RemapFlagHoldLayer) {
+        layer_hold(state, p->b);
+        *down = (RemapAction) { .type = RemapLayerHold, .a = p->b };
+    } else {
+        n = emit(out, n, p->b, true);
+        *down = (RemapAction) { .type = RemapKey, .a = p->b };
+    }
+    return n;
+}
+
+static uint press(RemapState* state, const RemapTable* table, uint8_t key, uint32_t now_ms,
+    KeyboardEvent* out, uint n)
+{
+    const RemapAction* action = &table->action[top_layer(state)][key];
+    RemapAction* down = &state->down[key];
+    *down = *action;
+
+    switch (action->type) {
+        case RemapKey:
+            return emit(out, n, action->a, true);
+
+        case RemapLayerHold:
+            layer_hold(state, action->a);
+            return n;
+
+        case RemapLayerToggle:
+            state->toggled ^= 1u << action->a;
+            *down = (RemapAction) { .type = RemapNone };
+            return n;
+
+        case RemapTapHold:
+        case RemapChord:
+            state->pending = true;
+            state->pending_key = key;
+            state->pending_at_ms = now_ms;
+            state->pending_action = *action;
+            *down = (RemapAction) { 0 };
+            return n;
+
+        case RemapMacro: {
+            const RemapStep* step = table->macros[action->a];
+            for (uint i = 0; i < table->macro_len[action->a]; i++, step++)
+                n = emit(out, n, step->usage, step->down);
+            *down = (RemapAction) { .type = RemapNone };
+            return n;
+        }
+
+        case RemapNone:
+        default:
+            return n;
+    }
+}
+
+static uint release(RemapState* state, uint8_t key, KeyboardEvent* out, uint n)
+{
+    RemapAction* down = &state->down[key];
+    uint8_t type = down->type;
+    uint8_t a = down->a;
+    *down = (RemapAction) { 0 };
+
+    switch (type) {
+        case RemapKey:
+            return emit(out, n, a, false);
+
+        case RemapLayerHold:
+            layer_release(state, a);
+            return n;
+
+        case RemapTransparent:
+            // pressed before these rules were loaded: let it go as it is
+            return emit(out, n, key, false);
+
+        default:
+            return n;
+    }
+}
+
+uint __no_inline_not_in_flash_func(remap_event_at)(RemapState* state, const RemapTable* table, KeyboardEvent ev,
+    uint32_t now_ms, KeyboardEvent* out)
+{
+    if (!table->active || ev.page != 0 || ev.keycode >= REMAP_KEYS) {
+        out[0] = ev;
+        return 1;
+    }
+
+    uint8_t key = ev.keycode;
+    uint n = 0;
+
+    if (state->pending) {
+        if (key == state->pending_key) {
+            // released in time, or a repeat: it was a tap
+            n = resolve_pending(state, true, out, n);
+            return ev.down ? press(state, table, key, now_ms, out, n) : n;
+        }
+
+        if (ev.down) {
+            const RemapAction* p = &state->pending_action;
+            if (p->type == RemapChord) {
+                const RemapChordEntry* c = &table->chords[p->chord_first];
+                for (uint i = 0; i < p->chord_count; i++, c++) {
+                    if (c->partner != key)
+                        continue;
+                    // the chord's output goes up with the first key,
+                    // the second key is swallowed
+                    state->pending = false;
+                    state->down[state->pending_key] = (RemapAction) { .type = RemapKey, .a = c->usage };
+                    state->down[key] = (RemapAction) { .type = RemapNone };
+                    return emit(out, n, c->usage, true);
+                }
+            }
+            // another key while a tap/hold key is down makes it a hold
+            n = resolve_pending(state, false, out, n);
+        }
+    }
+
+    return ev.down ? press(state, table, key, now_ms, out, n) : release(state, key, out, n);
+}
+
+uint __not_in_flash_func(remap_task_at)(RemapState* state, const RemapTable* table, uint32_t now_ms,
+    KeyboardEvent* out)
+{
+    if (!state->pending)
+        return 0;
+
+    uint32_t limit = state->pending_action.type == RemapChord ? REMAP_CHORD_MS : REMAP_TAP_MS;
+    if (now_ms - state->pending_at_ms < limit)
+        return 0;
+    return resolve_pending(state, false, out, 0);
+}
+
+static inline uint32_t now_ms()
+{
+    return to_ms_since_boot(get_absolute_time());
+}
+
+uint __not_in_flash_func(remap_event)(KeyboardEvent ev, KeyboardEvent* out)
+{
+    uint32_t start = isr_cycles_now();
+    uint n = remap_event_at(&s_state, &s_table, ev, now_ms(), out);
+    // SysTick counts down
+    uint32_t cycles = (start - isr_cycles_now()) & 0xffffff;
+
+    s_stats.events++;
+    s_stats.out += n;
+    if (n > s_stats.max_out)
+        s_stats.max_out = n;
+    if (cycles > s_stats.max_cycles)
+        s_stats.max_cycles = cycles;
+    return n;
+}
+
+uint remap_task(KeyboardEvent* out)
+{
+    uint n = remap_task_at(&s_state, &s_table, now_ms(), out);
+    if (n)
+        s_stats.timeouts++;
+    return n;
+}
+
+// Recompiles after a change. Held keys keep what they were pressed as, a
+// pending key what it was going to be; only a pending chord loses its
+// partners, since they index the old table.
+static bool apply_config()
+{
+    s_state.pending_action.chord_count = 0;
+    bool ok = remap_compile(&s_table, &s_config);
+    if (!ok)
+        DBG("rules rejected, passing keys through\n");
+    return ok;
+}
+
+void remap_set_preset(const RemapRule* rules, uint count)
+{
+    memset(&s_preset, 0, sizeof(s_preset));
+    if (count > REMAP_MAX_RULES)
+        count = REMAP_MAX_RULES;
+    memcpy(s_preset.rules, rules, count * sizeof(*rules));
+    s_preset.rule_count = count;
+
+    s_config = s_preset;
+    remap_state_reset(&s_state);
+    apply_config();
+}
+
+#if DEBUG
+
+static const char* const s_type_names[] = {
+    [RemapKey] = "key",
+    [RemapNone] = "none",
+    [RemapLayerHold] = "hold",
+    [RemapLayerToggle] = "toggle",
+    [RemapTapHold] = "taphold",
+    [RemapMacro] = "play",
+    [RemapChord] = "chord",
+};
+
+static void rule_print(const RemapRule* r)
+{
+    if (r->flags & RemapFlagOtherKeys) {
+        console_printf("  L%u *    %-7s\n", r->layer, s_type_names[r->type]);
+        return;
+    }
+    console_printf("  L%u 0x%02x %-7s", r->layer, r->key, s_type_names[r->type]);
+    switch (r->type) {
+        case RemapKey:
+            console_printf(" 0x%02x\n", r->a);
+            break;
+        case RemapLayerHold:
+        case RemapLayerToggle:
+        case RemapMacro:
+            console_printf(" %u\n", r->a);
+            break;
+        case RemapTapHold:
+            console_printf(" 0x%02x %s%u\n", r->a, r->flags & RemapFlagHoldLayer ? "layer " : "", r->b);
+            break;
+        case RemapChord:
+            console_printf(" +0x%02x -> 0x%02x\n", r->b, r->a);
+            break;
+        default:
+            console_printf("\n");
+            break;
+    }
+}
+
+static void status_print()
+{
+    console_printf("remap: %u rules (%u from the host), %s, layers held %lx toggled %lx\n",
+        s_config.rule_count, s_preset.rule_count, s_table.active ? "active" : "passing through",
+        s_state.layers, s_state.toggled);
+    console_printf("  %lu events in, %lu out (max %lu per event), %lu timeouts, slowest %lu cycles\n",
+        s_stats.events, s_stats.out, s_stats.max_out, s_stats.timeouts, s_stats.max_cycles);
+    for (uint i = 0; i < s_config.rule_count; i++)
+        rule_print(&s_config.rules[i]);
+    for (uint m = 0; m < REMAP_MACROS; m++) {
+        if (!s_config.macro_len[m])
+            continue;
+        console_printf("  macro %u:", m);
+        for (uint i = 0; i < s_config.macro_len[m]; i++)
+            console_printf(" %c%02x", s_config.macros[m][i].down ? '+' : '-', s_config.macros[m][i].usage);
+        console_printf("\n");
+    }
+}
+
+static bool same_slot(const RemapRule* a, const RemapRule* b)
+{
+    if (a->layer != b->layer)
+        return false;
+    if ((a->flags | b->flags) & RemapFlagOtherKeys)
+        return (a->flags & b->flags) & RemapFlagOtherKeys;
+    if (a->key != b->key)
+        return false;
+    // a key can start several chords, one per partner
+    if (a->type == RemapChord && b->type == RemapChord)
+        return a->b == b->b;
+    return a->type != RemapChord && b->type != RemapChord;
+}
+
+static void rule_add(RemapRule r)
+{
+    RemapConfig saved = s_config;
+
+    uint i;
+    for (i = 0; i < s_config.rule_count; i++) {
+        if (same_slot(&s_config.rules[i], &r))
+            break;
+    }
+    if (i == REMAP_MAX_RULES) {
+        console_printf("remap: no room for more rules\n");
+        return;
+    }
+    s_config.rules[i] = r;
+    if (i == s_config.rule_count)
+        s_config.rule_count++;
+
+    if (!apply_config()) {
+        console_printf("remap: rule rejected (layer, macro or chord limits)\n");
+        s_config = saved;
+        apply_config();
+    }
+}
+
+static void macro_cmd(int argc, char** argv)
+{
+    uint m = strtoul(argv[2], NULL, 0);
+    if (m >= REMAP_MACROS) {
+        console_printf("remap: macros 0..%d\n", REMAP_MACROS - 1);
+        return;
+    }
+    if (argc == 3)
+        s_config.macro_len[m] = 0;
+
+    for (int i = 3; i < argc; i++) {
+        char sign = argv[i][0];
+        if ((sign != '+' && sign != '-') || s_config.macro_len[m] == REMAP_MACRO_STEPS) {
+            console_printf("remap: steps are +usage (press) or -usage (release), at most %d\n",
+                REMAP_MACRO_STEPS);
+            break;
+        }
+        s_config.macros[m][s_config.macro_len[m]++] =
+            (RemapStep) { .usage = strtoul(argv[i] + 1, NULL, 0), .down = sign == '+' };
+    }
+    apply_config();
+}
+
+//
+// Benchmark: each case is run on a private state and table, timing every
+// remap_event_at call. 'worst' is the longest path there is: a chord key
+// whose partners are all scanned and miss, is resolved, and the key that
+// missed plays the longest macro.
+//
+
+enum {
+    BenchHold = HID_KEY_LEFT_GUI,
+    BenchTapHold = HID_KEY_CAPS_LOCK,
+    BenchChord = HID_KEY_J,
+    BenchMacro = HID_KEY_M,
+};
+
+#define BENCH_DOWN(usage) { .page = 0, .keycode = (usage), .down = true }
+#define BENCH_UP(usage) { .page = 0, .keycode = (usage), .down = false }
+
+typedef struct {
+    const char* name;
+    KeyboardEvent seq[4];
+} BenchCase;
+
+static const BenchCase s_bench_cases[] = {
+    { "pass", { { .page = 0x0c, .keycode = 0xe9, .down = true }, { .page = 0x0c, .keycode = 0xe9 },
+        { .page = 0x0c, .keycode = 0xea, .down = true }, { .page = 0x0c, .keycode = 0xea } } },
+    { "key", { BENCH_DOWN(HID_KEY_A), BENCH_UP(HID_KEY_A), BENCH_DOWN(HID_KEY_B), BENCH_UP(HID_KEY_B) } },
+    { "layer", { BENCH_DOWN(BenchHold), BENCH_DOWN(HID_KEY_H), BENCH_UP(HID_KEY_H), BENCH_UP(BenchHold) } },
+    { "taphold", { BENCH_DOWN(BenchTapHold), BENCH_DOWN(HID_KEY_A), BENCH_UP(HID_KEY_A), BENCH_UP(BenchTapHold) } },
+    { "chord", { BENCH_DOWN(BenchChord), BENCH_DOWN(HID_KEY_K), BENCH_UP(HID_KEY_K), BENCH_UP(BenchChord) } },
+    { "worst", { BENCH_DOWN(BenchChord), BENCH_DOWN(BenchMacro), BENCH_UP(BenchMacro), BENCH_UP(BenchChord) } },
+};
+
+#define BENCH_CASES (sizeof(s_bench_cases) / sizeof(s_bench_cases[0]))
+#define BENCH_SEQ (sizeof(s_bench_cases[0].seq) / sizeof(s_bench_cases[0].seq[0]))
+
+static RemapConfig s_bench_config;
+static RemapTable s_bench_table;
+static RemapState s_bench_state;
+
+static bool bench_setup()
+{
+    RemapConfig* c = &s_bench_config;
+    memset(c, 0, sizeof(*c));
+
+    const RemapRule rules[] = {
+        { .layer = 0, .key = BenchHold, .type = RemapLayerHold, .a = REMAP_LAYERS - 1 },
+        { .layer = REMAP_LAYERS - 1, .key = HID_KEY_H, .type = RemapKey, .a = HID_KEY_ARROW_LEFT },
+        { .layer = 0, .key = BenchTapHold, .type = RemapTapHold, .a = HID_KEY_ESCAPE, .b = HID_KEY_LEFT_CONTROL },
+        { .layer = 0, .key = BenchMacro, .type = RemapMacro, .a = 0 },
+    };
+    memcpy(c->rules, rules, sizeof(rules));
+    c->rule_count = sizeof(rules) / sizeof(rules[0]);
+
+    // K is the last partner scanned
+    const uint8_t partners[REMAP_CHORD_PARTNERS] = { HID_KEY_U, HID_KEY_I, HID_KEY_O, HID_KEY_K };
+    for (uint i = 0; i < REMAP_CHORD_PARTNERS; i++) {
+        c->rules[c->rule_count++] = (RemapRule) {
+            .layer = 0, .key = BenchChord, .type = RemapChord, .a = HID_KEY_F13 + i, .b = partners[i]
+        };
+    }
+
+    for (uint i = 0; i < REMAP_MACRO_STEPS; i++)
+        c->macros[0][i] = (RemapStep) { .usage = HID_KEY_A + i / 2, .down = !(i & 1) };
+    c->macro_len[0] = REMAP_MACRO_STEPS;
+
+    return remap_compile(&s_bench_table, c);
+}
+
+static void bench_cmd(int n)
+{
+    if (!bench_setup()) {
+        console_printf("remap bench: rules rejected\n");
+        return;
+    }
+
+    KeyboardEvent out[REMAP_MAX_OUT];
+    uint32_t mhz = clock_get_hz(clk_sys) / 1000000;
+    uint32_t worst = 0;
+    uint worst_out = 0;
+
+    for (uint c = 0; c < BENCH_CASES; c++) {
+        const BenchCase* bc = &s_bench_cases[c];
+        uint64_t total = 0;
+        uint32_t min = UINT32_MAX, max = 0;
+        uint max_out = 0;
+
+        for (int i = 0; i < n; i++) {
+            remap_state_reset(&s_bench_state);
+            for (uint e = 0; e < BENCH_SEQ; e++) {
+                // 1 ms apart, well inside the tap and chord windows
+                uint32_t start = isr_cycles_now();
+                uint got = remap_event_at(&s_bench_state, &s_bench_table, bc->seq[e], e, out);
+                uint32_t cycles = (start - isr_cycles_now()) & 0xffffff;
+                total += cycles;
+                if (cycles < min) min = cycles;
+                if (cycles > max) max = cycles;
+                if (got > max_out) max_out = got;
+            }
+        }
+
+        console_printf("  %-8s cycles min %lu avg %lu max %lu, up to %u events out\n", bc->name, min,
+            (uint32_t) (total / (n * BENCH_SEQ)), max, max_out);
+        if (max > worst) worst = max;
+        if (max_out > worst_out) worst_out = max_out;
+    }
+
+    console_printf("remap bench: worst %lu cycles (%lu us) per event, %u of at most %d events out\n", worst,
+        mhz ? worst / mhz : 0, worst_out, REMAP_MAX_OUT);
+}
+
+// 'remap': show the rules and counters
+// 'remap clear': back to the host's own rules
+// 'remap key|hold|toggle|play <layer> <key> <usage|layer|macro>', 'remap none <layer> <key|*>'
+//   ('*': every key the layer has no rule for)
+// 'remap taphold <layer> <key> <tap> <hold>', 'remap tapholdlayer <layer> <key> <tap> <layer>'
+// 'remap chord <layer> <key> <partner> <usage>'
+// 'remap macro <n> [+usage|-usage ...]': add steps, none clears it
+// 'remap bench [n]'
+void remap_console_cmd(int argc, char** argv)
+{
+    if (argc < 2) {
+        status_print();
+        return;
+    }
+
+    const char* op = argv[1];
+    uint arg[4] = { 0 };
+    for (int i = 2; i < argc && i < 6; i++)
+        arg[i - 2] = strtoul(argv[i], NULL, 0);
+    RemapRule r = { .layer = arg[0], .key = arg[1], .a = arg[2], .b = arg[3] };
+
+    if (strcmp(op, "clear") == 0) {
+        s_config = s_preset;
+        apply_config();
+    } else if (strcmp(op, "bench") == 0) {
+        bench_cmd(argc >= 3 && arg[0] > 0 ? arg[0] : 1000);
+    } else if (strcmp(op, "macro") == 0 && argc >= 3) {
+        macro_cmd(argc, argv);
+    } else if (strcmp(op, "none") == 0 && argc == 4) {
+        r.type = RemapNone;
+        if (strcmp(argv[3], "*") == 0)
+            r = (RemapRule) { .layer = arg[0], .type = RemapNone, .flags = RemapFlagOtherKeys };
+        rule_add(r);
+    } else if (argc == 5 && (strcmp(op, "key") == 0 || strcmp(op, "hold") == 0 || strcmp(op, "toggle") == 0
+                                || strcmp(op, "play") == 0)) {
+        r.type = op[0] == 'k' ? RemapKey : op[0] == 'h' ? RemapLayerHold : op[0] == 't' ? RemapLayerToggle
+                                                                                      : RemapMacro;
+        rule_add(r);
+    } else if (argc == 6 && (strcmp(op, "taphold") == 0 || strcmp(op, "tapholdlayer") == 0)) {
+        r.type = RemapTapHold;
+        r.flags = op[7] ? RemapFlagHoldLayer : 0;
+        rule_add(r);
+    } else if (argc == 6 && strcmp(op, "chord") == 0) {
+        // the partner goes in b, the output in a
+        r = (RemapRule) { .layer = arg[0], .key = arg[1], .type = RemapChord, .a = arg[3], .b = arg[2] };
+        rule_add(r);
+    } else {
+        console_printf("usage: remap [clear | bench [n] | macro <n> [+usage|-usage ...]\n");
+        console_printf("        | key|hold|toggle|play <layer> <key> <usage|layer|macro> | none <layer> <key|*>\n");
+        console_printf("        | taphold|tapholdlayer <layer> <key> <tap> <hold> | chord <layer> <key> <partner> <usage>]\n");
+    }
+}
+
+#endif
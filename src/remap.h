@@ -0,0 +1,132 @@
+#ifndef REMAP_H_
+#define REMAP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "events.h"
+
+/*
+ * Key remapping between the event queue and the host: layers, tap/hold
+ * keys, two-key chords and macros. Rules are compiled into flat per-layer
+ * tables whenever they change, so handling an event is a table lookup plus
+ * a bounded amount of work, with no allocation:
+ *
+ *   - one event produces at most REMAP_MAX_OUT events
+ *   - a chord key scans at most REMAP_CHORD_PARTNERS entries
+ *   - a tap/hold or chord key is held back at most REMAP_TAP_MS or
+ *     REMAP_CHORD_MS, after which remap_task resolves it
+ *
+ * Only usage page 0 (the keyboard page) is remapped; anything else passes
+ * through untouched. With no rules loaded every event passes through.
+ */
+
+#define REMAP_LAYERS 4
+#define REMAP_KEYS 256
+#define REMAP_MAX_RULES 64
+#define REMAP_MACROS 8
+#define REMAP_MACRO_STEPS 16
+#define REMAP_CHORDS 16
+#define REMAP_CHORD_PARTNERS 4
+
+#define REMAP_TAP_MS 200
+#define REMAP_CHORD_MS 50
+
+// a held back key resolving (2 events) followed by the longest macro
+#define REMAP_MAX_OUT (2 + REMAP_MACRO_STEPS)
+
+typedef enum {
+    RemapTransparent = 0, // whatever the layer below does
+    RemapKey,             // send usage a instead
+    RemapNone,            // swallow the key
+    RemapLayerHold,       // layer a is active while the key is held
+    RemapLayerToggle,     // each press turns layer a on or off
+    RemapTapHold,         // tap: usage a, hold: usage b (or layer b, RemapFlagHoldLayer)
+    RemapMacro,           // play macro a on press
+    RemapChord,           // with key b pressed within REMAP_CHORD_MS: usage a
+} RemapType;
+
+typedef enum {
+    RemapFlagHoldLayer = 1 << 0,
+    RemapFlagOtherKeys = 1 << 1, // RemapNone for every key without a rule on the layer; key is ignored
+} RemapFlag;
+
+typedef struct {
+    uint8_t layer;
+    uint8_t key;
+    uint8_t type;
+    uint8_t a;
+    uint8_t b;
+    uint8_t flags;
+} RemapRule;
+
+typedef struct {
+    uint8_t usage;
+    bool down;
+} RemapStep;
+
+// Compiled form of one key on one layer; transparency is already resolved
+typedef struct {
+    uint8_t type;
+    uint8_t a;
+    uint8_t b;
+    uint8_t flags;
+    uint8_t chord_first; // chords this key starts, in RemapTable.chords
+    uint8_t chord_count;
+} RemapAction;
+
+typedef struct {
+    uint8_t partner;
+    uint8_t usage;
+} RemapChordEntry;
+
+typedef struct {
+    bool active; // false: no rules, everything passes through
+    RemapAction action[REMAP_LAYERS][REMAP_KEYS];
+    RemapChordEntry chords[REMAP_CHORDS];
+    RemapStep macros[REMAP_MACROS][REMAP_MACRO_STEPS];
+    uint8_t macro_len[REMAP_MACROS];
+} RemapTable;
+
+typedef struct {
+    uint32_t layers;         // held layers, bit 0 always set
+    uint32_t toggled;        // layers turned on by RemapLayerToggle
+    uint8_t holds[REMAP_LAYERS]; // keys holding each layer, it drops with the last
+    // what each held key did when pressed, so the release matches it even
+    // if the layer changed in between
+    RemapAction down[REMAP_KEYS];
+
+    // the key held back waiting for a tap/hold or chord decision
+    bool pending;
+    uint8_t pending_key;
+    uint32_t pending_at_ms;
+    RemapAction pending_action;
+} RemapState;
+
+// The editable form: what the console changes and remap_compile reads
+typedef struct {
+    RemapRule rules[REMAP_MAX_RULES];
+    uint rule_count;
+    RemapStep macros[REMAP_MACROS][REMAP_MACRO_STEPS];
+    uint8_t macro_len[REMAP_MACROS];
+} RemapConfig;
+
+// Builds table from config; returns false (table inactive) if a rule is out
+// of range or the chord or macro limits are exceeded
+bool remap_compile(RemapTable* table, const RemapConfig* config);
+void remap_state_reset(RemapState* state);
+
+// The engine proper, on an explicit state and clock
+uint remap_event_at(RemapState* state, const RemapTable* table, KeyboardEvent ev, uint32_t now_ms,
+    KeyboardEvent* out);
+uint remap_task_at(RemapState* state, const RemapTable* table, uint32_t now_ms, KeyboardEvent* out);
+
+// The live instance used by the mainloop. Each fills out[REMAP_MAX_OUT] and
+// returns how many events to hand on.
+uint remap_event(KeyboardEvent ev, KeyboardEvent* out);
+uint remap_task(KeyboardEvent* out);
+
+// Rules a host installs at init (e.g. its extra keys); the console adds to
+// them and 'remap clear' goes back to them
+void remap_set_preset(const RemapRule* rules, uint count);
+
+#endif
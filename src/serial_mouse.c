@@ -0,0 +1,168 @@
+#include <pico/stdlib.h>
+#include <hardware/uart.h>
+#include <tusb.h>
+
+#define DEBUG_TAG "sermouse"
+#include "babelfish.h"
+#include "serial_mouse.h"
+
+DBG_MODULE();
+
+#define SERIAL_MOUSE_BAUD 1200
+#define SERIAL_MOUSE_ACCUM_LIMIT 1024
+
+// Microsoft: sync bit in the first byte, high bits of the deltas in its
+// low nibble
+#define MS_SYNC 0x40
+#define MS_LEFT 0x20
+#define MS_RIGHT 0x10
+#define LOGITECH_MIDDLE 0x20
+
+// Mouse Systems: sync pattern, buttons inverted in the low 3 bits
+#define MSYS_SYNC 0x80
+#define MSYS_NO_LEFT 0x04
+#define MSYS_NO_MIDDLE 0x02
+#define MSYS_NO_RIGHT 0x01
+
+static const char* const s_format_names[SerialMouseFormatCount] = {
+    [SerialMouseMicrosoft] = "microsoft",
+    [SerialMouseLogitech] = "logitech",
+    [SerialMouseMouseSystems] = "mousesystems",
+};
+
+const char* serial_mouse_format_name(SerialMouseFormat format)
+{
+    return format < SerialMouseFormatCount ? s_format_names[format] : "?";
+}
+
+void serial_mouse_init(SerialMouse* m, uart_inst_t* uart, SerialMouseFormat format)
+{
+    uart_init(uart, SERIAL_MOUSE_BAUD);
+    uart_set_hw_flow(uart, false, false);
+    uart_set_format(uart, format == SerialMouseMouseSystems ? 8 : 7, 1, UART_PARITY_NONE);
+    uart_tx_init(&m->tx, uart);
+
+    m->format = format;
+    m->dx = m->dy = 0;
+    m->buttons = m->sent_buttons = 0;
+    m->dirty = false;
+    m->tail_due = false;
+}
+
+// Takes up to 'limit' counts per axis off the accumulator
+static void take_motion(SerialMouse* m, int32_t limit, int32_t* x, int32_t* y)
+{
+    *x = clamp(m->dx, -limit, limit);
+    *y = clamp(m->dy, -limit, limit);
+    m->dx -= *x;
+    m->dy -= *y;
+}
+
+static uint encode_microsoft(SerialMouse* m, uint8_t* packet)
+{
+    int32_t x, y;
+    take_motion(m, 127, &x, &y);
+
+    packet[0] = MS_SYNC
+        | ((m->buttons & MOUSE_BUTTON_LEFT) ? MS_LEFT : 0)
+        | ((m->buttons & MOUSE_BUTTON_RIGHT) ? MS_RIGHT : 0)
+        | ((y >> 4) & 0x0c) | ((x >> 6) & 0x03);
+    packet[1] = x & 0x3f;
+    packet[2] = y & 0x3f;
+
+    // Logitech: the middle button rides in a 4th byte, sent while it is
+    // down and once more when it comes up
+    if (m->format == SerialMouseLogitech && ((m->buttons | m->sent_buttons) & MOUSE_BUTTON_MIDDLE)) {
+        packet[3] = (m->buttons & MOUSE_BUTTON_MIDDLE) ? LOGITECH_MIDDLE : 0;
+        return 4;
+    }
+    return 3;
+}
+
+static uint encode_msys_head(SerialMouse* m, uint8_t* packet)
+{
+    int32_t x, y;
+    take_motion(m, 127, &x, &y);
+
+    packet[0] = MSYS_SYNC
+        | ((m->buttons & MOUSE_BUTTON_LEFT) ? 0 : MSYS_NO_LEFT)
+        | ((m->buttons & MOUSE_BUTTON_MIDDLE) ? 0 : MSYS_NO_MIDDLE)
+        | ((m->buttons & MOUSE_BUTTON_RIGHT) ? 0 : MSYS_NO_RIGHT);
+    packet[1] = x;
+    packet[2] = -y;
+    return 3;
+}
+
+static uint encode_msys_tail(SerialMouse* m, uint8_t* packet)
+{
+    int32_t x, y;
+    take_motion(m, 127, &x, &y);
+
+    packet[0] = x;
+    packet[1] = -y;
+    return 2;
+}
+
+void serial_mouse_task(SerialMouse* m)
+{
+    uart_tx_task(&m->tx);
+
+    if (!(m->dirty || m->tail_due) || !uart_tx_idle(&m->tx))
+        return;
+
+    uint8_t packet[5];
+    uint len;
+    if (m->tail_due) {
+        len = encode_msys_tail(m, packet);
+        m->tail_due = false;
+    } else if (m->format == SerialMouseMouseSystems) {
+        len = encode_msys_head(m, packet);
+        m->tail_due = true;
+        m->packets++;
+    } else {
+        len = encode_microsoft(m, packet);
+        m->packets++;
+    }
+    uart_tx_write(&m->tx, packet, len);
+
+    // a Mouse Systems tail has no buttons; a change since the head waits
+    // for the next one
+    if (len != 2)
+        m->sent_buttons = m->buttons;
+    m->dirty = m->dx || m->dy || m->buttons != m->sent_buttons;
+}
+
+void serial_mouse_event(SerialMouse* m, const MouseEvent* event)
+{
+    m->dx = clamp(m->dx + event->dx, -SERIAL_MOUSE_ACCUM_LIMIT, SERIAL_MOUSE_ACCUM_LIMIT);
+    m->dy = clamp(m->dy + event->dy, -SERIAL_MOUSE_ACCUM_LIMIT, SERIAL_MOUSE_ACCUM_LIMIT);
+    m->buttons = event->buttons;
+    if (event->dx || event->dy || m->buttons != m->sent_buttons)
+        m->dirty = true;
+
+    serial_mouse_task(m);
+}
+
+void serial_mouse_ident(SerialMouse* m)
+{
+    static const uint8_t ms_ident[] = { 'M' };
+    static const uint8_t logitech_ident[] = { 'M', '3' };
+
+    // whatever was pending belongs to the session before the reset
+    m->dx = m->dy = 0;
+    m->dirty = false;
+    m->tail_due = false;
+
+    switch (m->format) {
+        case SerialMouseMicrosoft:
+            uart_tx_write(&m->tx, ms_ident, sizeof(ms_ident));
+            break;
+        case SerialMouseLogitech:
+            uart_tx_write(&m->tx, logitech_ident, sizeof(logitech_ident));
+            break;
+        default:
+            return;
+    }
+    m->idents++;
+    DBG("ident (%s)\n", serial_mouse_format_name(m->format));
+}
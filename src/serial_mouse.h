@@ -0,0 +1,60 @@
+#ifndef SERIAL_MOUSE_H_
+#define SERIAL_MOUSE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <hardware/uart.h>
+
+#include "events.h"
+#include "uart_tx.h"
+
+/*
+ * Serial mouse encoder shared by the hosts that talk to a serial mouse port
+ * at 1200 baud: Microsoft, Logitech and Mouse Systems packets from the same
+ * motion accumulator.
+ *
+ * A packet is only built once the previous one has completely left the
+ * wire, from all the motion since, so at full speed packets go out back to
+ * back and nothing stale ever queues. What the 1200 baud link carries:
+ *
+ *   Microsoft      7N1, 3 bytes               44 packets/s
+ *   Logitech       7N1, 3 bytes + middle      44/s, 33/s while middle is down
+ *   Mouse Systems  8N1, 5 bytes in two halves 24 packets/s, 48 halves/s
+ *
+ * Mouse Systems packets go out as the 3 byte head (buttons, dx1, dy1) and
+ * the 2 byte tail (dx2, dy2), each built when it is due, so the tail carries
+ * the motion that came in while the head was on the wire.
+ */
+
+typedef enum {
+    SerialMouseMicrosoft,
+    SerialMouseLogitech,
+    SerialMouseMouseSystems,
+    SerialMouseFormatCount,
+} SerialMouseFormat;
+
+typedef struct {
+    UartTx tx;
+    SerialMouseFormat format;
+
+    int32_t dx, dy;          // not sent yet, USB counts, Y down
+    uint8_t buttons;         // USB button bits
+    uint8_t sent_buttons;
+    bool dirty;
+    bool tail_due;           // Mouse Systems: head sent, tail next
+
+    uint32_t packets;
+    uint32_t idents;
+} SerialMouse;
+
+// Sets the UART up for the format (baud rate, data bits) and clears state
+void serial_mouse_init(SerialMouse* m, uart_inst_t* uart, SerialMouseFormat format);
+void serial_mouse_event(SerialMouse* m, const MouseEvent* event);
+// From the mainloop: moves queued bytes on and sends whatever is due
+void serial_mouse_task(SerialMouse* m);
+// The power-up identification ('M', 'M3'); nothing for Mouse Systems
+void serial_mouse_ident(SerialMouse* m);
+
+const char* serial_mouse_format_name(SerialMouseFormat format);
+
+#endif
@@ -0,0 +1,52 @@
+#include <pico/stdlib.h>
+#include <string.h>
+
+#define DEBUG_TAG "stats"
+#include "babelfish.h"
+#include "console.h"
+#include "irq_plan.h"
+#include "isr_stats.h"
+#include "hid_ring.h"
+#include "usb_link.h"
+#include "keymap.h"
+#include "kbd_leds.h"
+#include "usb_host_health.h"
+
+#if DEBUG
+
+/*
+ * The 'stats' console page. Each subsystem that keeps counters gets a
+ * section here.
+ */
+void stats_console_cmd(int argc, char** argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "reset") == 0) {
+        isr_stats_reset();
+        hid_ring_stats_reset();
+        hid_app_stats_reset();
+        kbd_leds_stats_reset();
+        usb_host_health_reset();
+        console_printf("stats reset\n");
+        return;
+    }
+
+    console_printf("uptime %lu ms, host '%s'\n", to_ms_since_boot(get_absolute_time()), host->name);
+
+    console_printf("interrupts:\n");
+    irq_plan_print();
+    isr_stats_print("");
+
+    console_printf("usb host:\n");
+    hid_ring_stats_print();
+    hid_app_stats_print();
+    kbd_leds_stats_print();
+    usb_host_health_print();
+
+    console_printf("usb link:\n");
+    usb_link_stats_print();
+
+    console_printf("keymap:\n");
+    keymap_stats_print();
+}
+
+#endif
@@ -14,6 +14,8 @@
 #include "hardware/irq.h"
 #include "device/usbd_pvt.h" // for usbd_defer_func
 
+#include "isr_stats.h"
+
 static mutex_t stdio_usb_mutex;
 
 #if PICO_STDIO_USB_SUPPORT_CHARS_AVAILABLE_CALLBACK
@@ -45,11 +47,13 @@ static int64_t timer_task(__unused alarm_id_t id, __unused void *user_data) {
     } else {
         repeat_time = PICO_STDIO_USB_TASK_INTERVAL_US;
     }
+    isr_stat_mark_pending(IsrStatStdioWorker);
     irq_set_pending(low_priority_irq_num);
     return repeat_time;
 }
 
 static void low_priority_worker_irq(void) {
+    ISR_STAT_BEGIN_ID(IsrStatStdioWorker);
     if (mutex_try_enter(&stdio_usb_mutex, NULL)) {
         tud_task();
         mutex_exit(&stdio_usb_mutex);
@@ -75,9 +79,11 @@ static void low_priority_worker_irq(void) {
             }
         }
     }
+    ISR_STAT_END(IsrStatStdioWorker);
 }
 
 static void usb_irq(void) {
+    isr_stat_mark_pending(IsrStatStdioWorker);
     irq_set_pending(low_priority_irq_num);
 }
 
@@ -206,6 +212,14 @@ bool stdio_nusb_init(void) {
     return rc;
 }
 
+int stdio_nusb_worker_irq(void) {
+#if !defined(SKIP_BACKGROUND_PROCESSING)
+    return low_priority_irq_num;
+#else
+    return -1;
+#endif
+}
+
 bool stdio_nusb_connected(void) {
 #if PICO_STDIO_USB_CONNECTION_WITHOUT_DTR
     return tud_ready();
@@ -135,6 +135,13 @@ bool stdio_nusb_init(void);
  *  \return true if stdio is connected over CDC
  */
 bool stdio_nusb_connected(void);
+
+/*! \brief The user IRQ claimed for background tud_task() processing
+ *  \ingroup pico_stdio_usb
+ *
+ *  \return the IRQ number, or -1 if background processing is disabled
+ */
+int stdio_nusb_worker_irq(void);
 #ifdef __cplusplus
 }
 #endif
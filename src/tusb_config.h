@@ -43,8 +43,16 @@
 
 #define CFG_TUSB_RHPORT0_MODE (OPT_MODE_DEVICE)
 //------------- CLASS -------------//
-#define CFG_TUD_VENDOR           0
+// binary telemetry and control link (usb_link.c)
+#define CFG_TUD_VENDOR           1
 #define CFG_TUD_CDC              1
+// keyboard and mouse, only in the descriptors in reverse mode (usb_hid_device.c);
+// single-host images without the reverse host leave the class out
+#if !defined(BABELFISH_SINGLE_HOST) || BABELFISH_HOST_REVERSE
+#define CFG_TUD_HID              2
+#else
+#define CFG_TUD_HID              0
+#endif
 
 // CDC FIFO size of TX and RX
 #define CFG_TUD_CDC_RX_BUFSIZE   256
@@ -53,6 +61,16 @@
 // CDC Endpoint transfer buffer size, more is faster
 #define CFG_TUD_CDC_EP_BUFSIZE   64
 
+// Link FIFOs. The endpoint transfer size is a multiple of the 64 byte
+// packet so one transfer carries several packets without going back
+// through tud_task; 'usb_link.py bench' measures the rate.
+#define CFG_TUD_VENDOR_RX_BUFSIZE 1024
+#define CFG_TUD_VENDOR_TX_BUFSIZE 4096
+#define CFG_TUD_VENDOR_EPSIZE     512
+
+// HID endpoint size; the NKRO keyboard report is 22 bytes
+#define CFG_TUD_HID_EP_BUFSIZE   32
+
 //--------------------------------------------------------------------
 // HOST CONFIGURATION
 //--------------------------------------------------------------------
@@ -61,12 +79,16 @@
 #define CFG_TUH_ENUMERATION_BUFSIZE 256
 
 #define CFG_TUH_HUB                 1
-// max device support (excluding hub device)
-#define CFG_TUH_DEVICE_MAX          (CFG_TUH_HUB ? 4 : 1) // hub typically has 4 ports
+// max device support (excluding hub device); 7 port hubs are common enough
+#define CFG_TUH_DEVICE_MAX          (CFG_TUH_HUB ? 8 : 1)
 
-#define CFG_TUH_HID                  4
+// HID interfaces across all devices. A wireless combo receiver alone has
+// two or three. hid_pool.c keeps a slot per interface to match.
+#define CFG_TUH_HID                  16
 #define CFG_TUH_HID_EPIN_BUFSIZE    64
-#define CFG_TUH_HID_EPOUT_BUFSIZE   64
+// only tuh_hid_send_report() uses the OUT buffer, and nothing calls it:
+// the LED reports go over the control pipe (kbd_leds.c)
+#define CFG_TUH_HID_EPOUT_BUFSIZE   8
 
 #ifdef __cplusplus
  }
@@ -0,0 +1,69 @@
+#include <pico/stdlib.h>
+#include <hardware/uart.h>
+#include <hardware/sync.h>
+
+#define DEBUG_TAG "uart_tx"
+#include "babelfish.h"
+#include "uart_tx.h"
+
+#define RING_MASK (UART_TX_RING_SIZE - 1)
+
+void uart_tx_init(UartTx* tx, uart_inst_t* uart)
+{
+    tx->uart = uart;
+    tx->head = tx->tail = 0;
+    tx->bytes = tx->dropped = tx->max_depth = 0;
+}
+
+// Callers hold interrupts off
+static void __not_in_flash_func(fill_fifo)(UartTx* tx)
+{
+    while (tx->tail != tx->head && uart_is_writable(tx->uart)) {
+        uart_putc_raw(tx->uart, tx->ring[tx->tail & RING_MASK]);
+        tx->tail++;
+    }
+}
+
+bool __not_in_flash_func(uart_tx_write)(UartTx* tx, const uint8_t* data, uint len)
+{
+    uint32_t irq = save_and_disable_interrupts();
+
+    uint32_t depth = tx->head - tx->tail;
+    if (UART_TX_RING_SIZE - depth < len) {
+        tx->dropped++;
+        restore_interrupts(irq);
+        return false;
+    }
+
+    for (uint i = 0; i < len; i++)
+        tx->ring[tx->head++ & RING_MASK] = data[i];
+
+    tx->bytes += len;
+    if (depth + len > tx->max_depth)
+        tx->max_depth = depth + len;
+
+    fill_fifo(tx);
+    restore_interrupts(irq);
+    return true;
+}
+
+void uart_tx_task(UartTx* tx)
+{
+    if (tx->tail == tx->head)
+        return;
+
+    uint32_t irq = save_and_disable_interrupts();
+    fill_fifo(tx);
+    restore_interrupts(irq);
+}
+
+// Nothing queued, nothing in the FIFO, and the shift register is empty
+bool uart_tx_idle(UartTx* tx)
+{
+    return tx->tail == tx->head && !(uart_get_hw(tx->uart)->fr & UART_UARTFR_BUSY_BITS);
+}
+
+uint uart_tx_pending(UartTx* tx)
+{
+    return tx->head - tx->tail;
+}
@@ -0,0 +1,45 @@
+#ifndef UART_TX_H_
+#define UART_TX_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <hardware/uart.h>
+
+/*
+ * Non-blocking UART transmit for the host emulations.
+ *
+ * Bytes are queued in a ring and moved into the 32 byte hardware FIFO as
+ * room appears, from the mainloop (uart_tx_task) and on every write, so a
+ * burst of key codes or a mouse packet never stalls the caller on a slow
+ * link. Writes are all or nothing and may come from interrupt handlers.
+ *
+ * uart_tx_idle() says when the last stop bit has left the wire, for senders
+ * that would rather build the next packet from fresh state than queue stale
+ * ones behind it.
+ */
+
+#define UART_TX_RING_SIZE 64 // power of two
+
+typedef struct {
+    uart_inst_t* uart;
+    uint8_t ring[UART_TX_RING_SIZE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+
+    uint32_t bytes;
+    uint32_t dropped; // writes refused with the ring full
+    uint32_t max_depth;
+} UartTx;
+
+void uart_tx_init(UartTx* tx, uart_inst_t* uart);
+bool uart_tx_write(UartTx* tx, const uint8_t* data, uint len);
+void uart_tx_task(UartTx* tx);
+bool uart_tx_idle(UartTx* tx);
+uint uart_tx_pending(UartTx* tx);
+
+static inline bool uart_tx_putc(UartTx* tx, uint8_t c)
+{
+    return uart_tx_write(tx, &c, 1);
+}
+
+#endif
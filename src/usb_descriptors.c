@@ -2,21 +2,34 @@
 #include "pico/usb_reset_interface.h"
 #include "pico/unique_id.h"
 
+#include "babelfish.h"
+#include "usb_hid_device.h"
+
 // Objective Development free VID/PID pair; PID = CDC
 #define USBD_VID (0x16c0)
 #define USBD_PID (0x05e1)
 #define USBD_MANUFACTURER "bitops.com"
 #define USBD_PRODUCT "Babelfish"
 
+// Reverse mode (usb_hid_device.c) adds a keyboard and a mouse; same VID,
+// the shared keyboard PID, so hosts don't reuse the CDC-only descriptors
+#define USBD_PID_HID (0x27db)
+#define USBD_PRODUCT_HID "Babelfish Reverse"
+
 #define TUD_RPI_RESET_DESC_LEN  9
-#define USBD_DESC_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_RPI_RESET_DESC_LEN)
+#define USBD_DESC_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_RPI_RESET_DESC_LEN + TUD_VENDOR_DESC_LEN)
+#define USBD_DESC_HID_LEN (USBD_DESC_LEN + 2 * TUD_HID_DESC_LEN)
 
 #define USBD_CONFIGURATION_DESCRIPTOR_ATTRIBUTE (0)
 #define USBD_MAX_POWER_MA (250)
 
 #define USBD_ITF_CDC       (0) // needs 2 interfaces
 #define USBD_ITF_RPI_RESET (2)
-#define USBD_ITF_MAX       (3)
+#define USBD_ITF_LINK      (3)
+#define USBD_ITF_MAX       (4)
+#define USBD_ITF_HID_KBD   (4)
+#define USBD_ITF_HID_MOUSE (5)
+#define USBD_ITF_HID_MAX   (6)
 
 #define USBD_CDC_EP_CMD (0x81)
 #define USBD_CDC_EP_OUT (0x02)
@@ -24,12 +37,26 @@
 #define USBD_CDC_CMD_MAX_SIZE (8)
 #define USBD_CDC_IN_OUT_MAX_SIZE (64)
 
+// usb_link.c: bulk pair, 64 byte packets (the full speed maximum)
+#define USBD_LINK_EP_OUT (0x05)
+#define USBD_LINK_EP_IN (0x85)
+#define USBD_LINK_EP_SIZE (64)
+
+#define USBD_HID_KBD_EP_IN (0x83)
+#define USBD_HID_MOUSE_EP_IN (0x84)
+#define USBD_HID_EP_SIZE CFG_TUD_HID_EP_BUFSIZE
+#define USBD_HID_POLL_MS (1)
+
 #define USBD_STR_0 (0x00)
 #define USBD_STR_MANUF (0x01)
 #define USBD_STR_PRODUCT (0x02)
 #define USBD_STR_SERIAL (0x03)
 #define USBD_STR_CDC (0x04)
 #define USBD_STR_RPI_RESET (0x05)
+#define USBD_STR_PRODUCT_HID (0x06)
+#define USBD_STR_HID_KBD (0x07)
+#define USBD_STR_HID_MOUSE (0x08)
+#define USBD_STR_LINK (0x09)
 
 // Note: descriptors returned from callbacks must exist long enough for transfer to complete
 
@@ -50,6 +77,67 @@ static const tusb_desc_device_t usbd_desc_device = {
     .bNumConfigurations = 1,
 };
 
+#if CFG_TUD_HID
+
+static const tusb_desc_device_t usbd_desc_device_hid = {
+    .bLength = sizeof(tusb_desc_device_t),
+    .bDescriptorType = TUSB_DESC_DEVICE,
+    .bcdUSB = 0x0200,
+    .bDeviceClass = TUSB_CLASS_MISC,
+    .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+    .idVendor = USBD_VID,
+    .idProduct = USBD_PID_HID,
+    .bcdDevice = 0x0100,
+    .iManufacturer = USBD_STR_MANUF,
+    .iProduct = USBD_STR_PRODUCT_HID,
+    .iSerialNumber = USBD_STR_SERIAL,
+    .bNumConfigurations = 1,
+};
+
+// NKRO: the modifier byte, then a bit for every usage up to
+// USB_HID_KBD_MAX_USAGE. Not a boot keyboard; BIOSes won't see it.
+static const uint8_t usbd_hid_report_kbd[] = {
+    HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP),
+    HID_USAGE(HID_USAGE_DESKTOP_KEYBOARD),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+        HID_USAGE_PAGE(HID_USAGE_PAGE_KEYBOARD),
+        HID_USAGE_MIN(224),
+        HID_USAGE_MAX(231),
+        HID_LOGICAL_MIN(0),
+        HID_LOGICAL_MAX(1),
+        HID_REPORT_COUNT(8),
+        HID_REPORT_SIZE(1),
+        HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+
+        HID_USAGE_PAGE(HID_USAGE_PAGE_LED),
+        HID_USAGE_MIN(1),
+        HID_USAGE_MAX(5),
+        HID_REPORT_COUNT(5),
+        HID_REPORT_SIZE(1),
+        HID_OUTPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+        HID_REPORT_COUNT(1),
+        HID_REPORT_SIZE(3),
+        HID_OUTPUT(HID_CONSTANT),
+
+        HID_USAGE_PAGE(HID_USAGE_PAGE_KEYBOARD),
+        HID_USAGE_MIN(0),
+        HID_USAGE_MAX(USB_HID_KBD_MAX_USAGE),
+        HID_LOGICAL_MIN(0),
+        HID_LOGICAL_MAX(1),
+        HID_REPORT_COUNT(USB_HID_KBD_MAX_USAGE + 1),
+        HID_REPORT_SIZE(1),
+        HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+    HID_COLLECTION_END,
+};
+
+static const uint8_t usbd_hid_report_mouse[] = {
+    TUD_HID_REPORT_DESC_MOUSE()
+};
+
+#endif
+
 #define TUD_RPI_RESET_DESCRIPTOR(_itfnum, _stridx) \
   /* Interface */\
   9, TUSB_DESC_INTERFACE, _itfnum, 0, 0, TUSB_CLASS_VENDOR_SPECIFIC, RESET_INTERFACE_SUBCLASS, RESET_INTERFACE_PROTOCOL, _stridx,
@@ -62,8 +150,30 @@ static const uint8_t usbd_desc_cfg[USBD_DESC_LEN] = {
         USBD_CDC_CMD_MAX_SIZE, USBD_CDC_EP_OUT, USBD_CDC_EP_IN, USBD_CDC_IN_OUT_MAX_SIZE),
 
     TUD_RPI_RESET_DESCRIPTOR(USBD_ITF_RPI_RESET, USBD_STR_RPI_RESET)
+
+    TUD_VENDOR_DESCRIPTOR(USBD_ITF_LINK, USBD_STR_LINK, USBD_LINK_EP_OUT, USBD_LINK_EP_IN, USBD_LINK_EP_SIZE),
 };
 
+#if CFG_TUD_HID
+static const uint8_t usbd_desc_cfg_hid[USBD_DESC_HID_LEN] = {
+    TUD_CONFIG_DESCRIPTOR(1, USBD_ITF_HID_MAX, USBD_STR_0, USBD_DESC_HID_LEN,
+        USBD_CONFIGURATION_DESCRIPTOR_ATTRIBUTE, USBD_MAX_POWER_MA),
+
+    TUD_CDC_DESCRIPTOR(USBD_ITF_CDC, USBD_STR_CDC, USBD_CDC_EP_CMD,
+        USBD_CDC_CMD_MAX_SIZE, USBD_CDC_EP_OUT, USBD_CDC_EP_IN, USBD_CDC_IN_OUT_MAX_SIZE),
+
+    TUD_RPI_RESET_DESCRIPTOR(USBD_ITF_RPI_RESET, USBD_STR_RPI_RESET)
+
+    TUD_VENDOR_DESCRIPTOR(USBD_ITF_LINK, USBD_STR_LINK, USBD_LINK_EP_OUT, USBD_LINK_EP_IN, USBD_LINK_EP_SIZE),
+
+    TUD_HID_DESCRIPTOR(USBD_ITF_HID_KBD, USBD_STR_HID_KBD, HID_ITF_PROTOCOL_NONE,
+        sizeof(usbd_hid_report_kbd), USBD_HID_KBD_EP_IN, USBD_HID_EP_SIZE, USBD_HID_POLL_MS),
+
+    TUD_HID_DESCRIPTOR(USBD_ITF_HID_MOUSE, USBD_STR_HID_MOUSE, HID_ITF_PROTOCOL_MOUSE,
+        sizeof(usbd_hid_report_mouse), USBD_HID_MOUSE_EP_IN, USBD_HID_EP_SIZE, USBD_HID_POLL_MS),
+};
+#endif
+
 static char usbd_serial_str[PICO_UNIQUE_BOARD_ID_SIZE_BYTES * 2 + 1];
 
 static const char *const usbd_desc_str[] = {
@@ -72,16 +182,34 @@ static const char *const usbd_desc_str[] = {
     [USBD_STR_SERIAL] = usbd_serial_str,
     [USBD_STR_CDC] = "Board CDC",
     [USBD_STR_RPI_RESET] = "Reset",
+    [USBD_STR_PRODUCT_HID] = USBD_PRODUCT_HID,
+    [USBD_STR_HID_KBD] = "Keyboard",
+    [USBD_STR_HID_MOUSE] = "Mouse",
+    [USBD_STR_LINK] = "Babelfish Link",
 };
 
 const uint8_t *tud_descriptor_device_cb(void) {
+#if CFG_TUD_HID
+    if (usb_hid_device_enabled())
+        return (const uint8_t *)&usbd_desc_device_hid;
+#endif
     return (const uint8_t *)&usbd_desc_device;
 }
 
 const uint8_t *tud_descriptor_configuration_cb(__unused uint8_t index) {
+#if CFG_TUD_HID
+    if (usb_hid_device_enabled())
+        return usbd_desc_cfg_hid;
+#endif
     return usbd_desc_cfg;
 }
 
+#if CFG_TUD_HID
+const uint8_t *tud_hid_descriptor_report_cb(uint8_t instance) {
+    return instance == USB_HID_INST_KBD ? usbd_hid_report_kbd : usbd_hid_report_mouse;
+}
+#endif
+
 const uint16_t *tud_descriptor_string_cb(uint8_t index, __unused uint16_t langid) {
 #ifndef USBD_DESC_STR_MAX
 #define USBD_DESC_STR_MAX (20)
@@ -0,0 +1,311 @@
+#include <pico/stdlib.h>
+#include <hardware/sync.h>
+#include <string.h>
+#include <tusb.h>
+
+#define DEBUG_TAG "hiddev"
+#include "babelfish.h"
+#include "console.h"
+#include "usb_hid_device.h"
+
+// only built into images with the reverse host (tusb_config.h)
+#if CFG_TUD_HID
+
+#define KBD_BITMAP_BYTES ((USB_HID_KBD_MAX_USAGE + 8) / 8)
+#define KBD_REPORT_LEN (1 + KBD_BITMAP_BYTES)
+
+#define MOUSE_ACCUM_LIMIT 2048
+
+#define QUEUE_SIZE 32 // power of two
+#define QUEUE_MASK (QUEUE_SIZE - 1)
+
+typedef enum {
+    KeyOpUp,
+    KeyOpDown,
+    KeyOpAllUp,
+} KeyOp;
+
+typedef struct {
+    uint8_t usage;
+    uint8_t op;
+    uint32_t at_us;
+} KeyEntry;
+
+typedef struct {
+    int16_t dx, dy;
+    int8_t wheel;
+    uint8_t buttons;
+    uint32_t at_us;
+} MouseEntry;
+
+// head written by the producer, tail by usb_hid_device_task and the
+// report-complete callback (both on core0, serialised with interrupts off)
+static KeyEntry s_key_queue[QUEUE_SIZE];
+static volatile uint32_t s_key_head, s_key_tail;
+static MouseEntry s_mouse_queue[QUEUE_SIZE];
+static volatile uint32_t s_mouse_head, s_mouse_tail;
+
+static struct {
+    // modifiers, then one bit per usage from 0
+    uint8_t report[KBD_REPORT_LEN];
+    uint8_t sent[KBD_REPORT_LEN];
+    uint32_t changed_at_us; // oldest change not sent yet
+    volatile uint8_t leds;
+} s_kbd;
+
+static struct {
+    int32_t dx, dy, wheel;
+    uint8_t buttons;
+    uint8_t sent_buttons;
+    bool pending;
+    uint32_t changed_at_us;
+} s_mouse;
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+} Latency;
+
+static struct {
+    uint32_t kbd_reports;
+    uint32_t mouse_reports;
+    uint32_t key_overflows;
+    uint32_t mouse_overflows;
+    uint32_t unmapped;
+    uint32_t held; // events kept for the next report so a change isn't lost
+    Latency kbd_latency;
+    Latency mouse_latency;
+} s_stats;
+
+bool usb_hid_device_enabled()
+{
+    return (hosts[g_current_host_index].flags & HostFlagUsbHidDevice) != 0;
+}
+
+static bool __not_in_flash_func(key_push)(uint8_t usage, KeyOp op)
+{
+    if (s_key_head - s_key_tail == QUEUE_SIZE) {
+        s_stats.key_overflows++;
+        return false;
+    }
+    KeyEntry* e = &s_key_queue[s_key_head & QUEUE_MASK];
+    e->usage = usage;
+    e->op = op;
+    e->at_us = time_us_32();
+    // the entry must be in place before the consumer can see the new head
+    __dmb();
+    s_key_head = s_key_head + 1;
+    return true;
+}
+
+bool __not_in_flash_func(usb_hid_device_key)(uint8_t usage, bool down)
+{
+    return key_push(usage, down ? KeyOpDown : KeyOpUp);
+}
+
+bool __not_in_flash_func(usb_hid_device_keys_up)()
+{
+    return key_push(0, KeyOpAllUp);
+}
+
+bool __not_in_flash_func(usb_hid_device_mouse)(int16_t dx, int16_t dy, int8_t wheel, uint8_t buttons)
+{
+    if (s_mouse_head - s_mouse_tail == QUEUE_SIZE) {
+        s_stats.mouse_overflows++;
+        return false;
+    }
+    MouseEntry* e = &s_mouse_queue[s_mouse_head & QUEUE_MASK];
+    e->dx = dx;
+    e->dy = dy;
+    e->wheel = wheel;
+    e->buttons = buttons;
+    e->at_us = time_us_32();
+    __dmb();
+    s_mouse_head = s_mouse_head + 1;
+    return true;
+}
+
+static bool key_bit(uint8_t usage, uint* index, uint8_t* mask)
+{
+    if (usage >= HID_KEY_LEFT_CONTROL && usage <= HID_KEY_RIGHT_GUI) {
+        *index = 0;
+        *mask = 1 << (usage - HID_KEY_LEFT_CONTROL);
+        return true;
+    }
+    if (usage <= USB_HID_KBD_MAX_USAGE) {
+        *index = 1 + usage / 8;
+        *mask = 1 << (usage % 8);
+        return true;
+    }
+    return false;
+}
+
+static bool kbd_unsent()
+{
+    return memcmp(s_kbd.report, s_kbd.sent, KBD_REPORT_LEN) != 0;
+}
+
+static void latency_record(Latency* l, uint32_t since_us)
+{
+    uint32_t us = time_us_32() - since_us;
+    l->count++;
+    l->total_us += us;
+    if (us > l->max_us)
+        l->max_us = us;
+}
+
+// Moves queued key events into the report, up to the first one that would
+// undo a change that hasn't been sent yet
+static void kbd_apply()
+{
+    while (s_key_tail != s_key_head) {
+        const KeyEntry* e = &s_key_queue[s_key_tail & QUEUE_MASK];
+        bool unsent = kbd_unsent();
+
+        if (e->op == KeyOpAllUp) {
+            if (unsent) {
+                s_stats.held++;
+                return;
+            }
+            memset(s_kbd.report, 0, KBD_REPORT_LEN);
+        } else {
+            uint index;
+            uint8_t mask;
+            if (!key_bit(e->usage, &index, &mask)) {
+                s_stats.unmapped++;
+            } else if ((s_kbd.report[index] ^ s_kbd.sent[index]) & mask) {
+                s_stats.held++;
+                return;
+            } else if (e->op == KeyOpDown) {
+                s_kbd.report[index] |= mask;
+            } else {
+                s_kbd.report[index] &= ~mask;
+            }
+        }
+
+        if (!unsent && kbd_unsent())
+            s_kbd.changed_at_us = e->at_us;
+        s_key_tail = s_key_tail + 1;
+    }
+}
+
+static void kbd_send()
+{
+    if (!kbd_unsent() || !tud_hid_n_ready(USB_HID_INST_KBD))
+        return;
+    if (!tud_hid_n_report(USB_HID_INST_KBD, 0, s_kbd.report, KBD_REPORT_LEN))
+        return;
+    memcpy(s_kbd.sent, s_kbd.report, KBD_REPORT_LEN);
+    s_stats.kbd_reports++;
+    latency_record(&s_stats.kbd_latency, s_kbd.changed_at_us);
+}
+
+static void mouse_apply()
+{
+    while (s_mouse_tail != s_mouse_head) {
+        const MouseEntry* e = &s_mouse_queue[s_mouse_tail & QUEUE_MASK];
+        if (e->buttons != s_mouse.buttons && s_mouse.buttons != s_mouse.sent_buttons) {
+            s_stats.held++;
+            return;
+        }
+
+        s_mouse.dx = clamp(s_mouse.dx + e->dx, -MOUSE_ACCUM_LIMIT, MOUSE_ACCUM_LIMIT);
+        s_mouse.dy = clamp(s_mouse.dy + e->dy, -MOUSE_ACCUM_LIMIT, MOUSE_ACCUM_LIMIT);
+        s_mouse.wheel = clamp(s_mouse.wheel + e->wheel, -MOUSE_ACCUM_LIMIT, MOUSE_ACCUM_LIMIT);
+        s_mouse.buttons = e->buttons;
+        if (!s_mouse.pending) {
+            s_mouse.pending = true;
+            s_mouse.changed_at_us = e->at_us;
+        }
+        s_mouse_tail = s_mouse_tail + 1;
+    }
+}
+
+static void mouse_send()
+{
+    if (!s_mouse.pending || !tud_hid_n_ready(USB_HID_INST_MOUSE))
+        return;
+
+    int8_t x = clamp(s_mouse.dx, -127, 127);
+    int8_t y = clamp(s_mouse.dy, -127, 127);
+    int8_t wheel = clamp(s_mouse.wheel, -127, 127);
+    if (!tud_hid_n_mouse_report(USB_HID_INST_MOUSE, 0, s_mouse.buttons, x, y, wheel, 0))
+        return;
+
+    s_mouse.dx -= x;
+    s_mouse.dy -= y;
+    s_mouse.wheel -= wheel;
+    s_mouse.sent_buttons = s_mouse.buttons;
+    s_stats.mouse_reports++;
+    latency_record(&s_stats.mouse_latency, s_mouse.changed_at_us);
+
+    // what didn't fit goes in the next frame
+    s_mouse.pending = s_mouse.dx || s_mouse.dy || s_mouse.wheel;
+    s_mouse.changed_at_us = time_us_32();
+}
+
+// Called from the mainloop and from inside tud_task, which may be the
+// stdio worker interrupt preempting the mainloop
+static void flush()
+{
+    uint32_t irq = save_and_disable_interrupts();
+    kbd_apply();
+    kbd_send();
+    kbd_apply();
+    mouse_apply();
+    mouse_send();
+    mouse_apply();
+    restore_interrupts(irq);
+}
+
+void usb_hid_device_task()
+{
+    if (tud_mounted())
+        flush();
+}
+
+uint8_t usb_hid_device_leds()
+{
+    return s_kbd.leds;
+}
+
+// The previous report has gone out: the endpoint is free for the next one
+// right now, not at the next mainloop pass
+void tud_hid_report_complete_cb(uint8_t instance, uint8_t const* report, uint16_t len)
+{
+    flush();
+}
+
+uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type,
+    uint8_t* buffer, uint16_t reqlen)
+{
+    if (instance != USB_HID_INST_KBD || report_type != HID_REPORT_TYPE_INPUT || reqlen < KBD_REPORT_LEN)
+        return 0;
+    memcpy(buffer, s_kbd.sent, KBD_REPORT_LEN);
+    return KBD_REPORT_LEN;
+}
+
+void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type,
+    uint8_t const* buffer, uint16_t bufsize)
+{
+    if (instance == USB_HID_INST_KBD && report_type == HID_REPORT_TYPE_OUTPUT && bufsize >= 1)
+        s_kbd.leds = buffer[0];
+}
+
+static void latency_print(const char* name, const Latency* l)
+{
+    console_printf("  %-5s %lu reports, event to report avg %lu us max %lu us\n", name, l->count,
+        l->count ? (uint32_t) (l->total_us / l->count) : 0, l->max_us);
+}
+
+void usb_hid_device_print_stats()
+{
+    console_printf("usb hid: %s, leds %02x\n", tud_mounted() ? "mounted" : "not mounted", s_kbd.leds);
+    latency_print("kbd", &s_stats.kbd_latency);
+    latency_print("mouse", &s_stats.mouse_latency);
+    console_printf("  queue overflows kbd %lu mouse %lu, held %lu, unmapped %lu\n",
+        s_stats.key_overflows, s_stats.mouse_overflows, s_stats.held, s_stats.unmapped);
+}
+
+#endif
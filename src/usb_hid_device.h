@@ -0,0 +1,47 @@
+#ifndef USB_HID_DEVICE_H_
+#define USB_HID_DEVICE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * The native USB port as a HID keyboard and mouse, for the reverse hosts
+ * (HostFlagUsbHidDevice): they decode a retro keyboard/mouse on the
+ * channels and hand the events over here.
+ *
+ * The keyboard is NKRO, a bitmap of every usage up to
+ * USB_HID_KBD_MAX_USAGE plus the modifier byte; both interfaces are polled
+ * every 1 ms. Events may be queued from interrupt handlers (one producer
+ * per queue); usb_hid_device_task() turns them into reports as soon as the
+ * endpoint is free, and the report-complete callback sends the next one
+ * straight away, so an event goes out in the first frame after it arrives.
+ * A press and release that land in the same frame still make two reports.
+ */
+
+#define USB_HID_KBD_MAX_USAGE 0xa7
+
+// TinyUSB HID instances, in interface order (usb_descriptors.c)
+#define USB_HID_INST_KBD 0
+#define USB_HID_INST_MOUSE 1
+
+// From the owning interrupt handler (or the mainloop); false if the queue
+// is full
+bool usb_hid_device_key(uint8_t usage, bool down);
+bool usb_hid_device_mouse(int16_t dx, int16_t dy, int8_t wheel, uint8_t buttons);
+
+// Mainloop: sends whatever is pending
+void usb_hid_device_task(void);
+
+// Queues a release of every key, e.g. when the keyboard says all keys are
+// up or resets; from the keyboard queue's producer
+bool usb_hid_device_keys_up(void);
+
+// Keyboard LEDs as last set by the computer (HID LED usage bits)
+uint8_t usb_hid_device_leds(void);
+
+// Whether the selected host wants the HID interfaces in the descriptors
+bool usb_hid_device_enabled(void);
+
+void usb_hid_device_print_stats(void);
+
+#endif
@@ -0,0 +1,96 @@
+#include <pico/stdlib.h>
+#include <pio_usb.h>
+#include <string.h>
+
+#define DEBUG_TAG "usbh"
+#include "babelfish.h"
+#include "console.h"
+#include "usb_host_health.h"
+
+UsbHostHealth usb_host_health;
+
+// the same hardware alarm PIO-USB's own pool would take (irq_plan.c)
+#define FRAME_ALARM_NUM 2
+
+static alarm_pool_t* s_pool;
+static repeating_timer_t s_timer;
+static uint32_t s_due_us;
+static bool s_started;
+
+// The alarm pool reschedules a negative delay from the previous target, so
+// frames are due every 1 ms from the first; a late one is followed by the
+// next one straight away until the schedule has caught up.
+static bool __not_in_flash_func(usb_host_frame)(repeating_timer_t* rt)
+{
+    UsbHostHealth* h = &usb_host_health;
+    uint32_t start = time_us_32();
+    if (!s_started) {
+        s_due_us = start;
+        s_started = true;
+    }
+
+    pio_usb_host_frame();
+
+    uint32_t us = time_us_32() - start;
+    int32_t late = (int32_t) (start - s_due_us);
+    s_due_us += USB_HOST_FRAME_US;
+
+    h->frames++;
+    if (late >= USB_HOST_FRAME_LATE_US) {
+        h->late++;
+        if (late >= USB_HOST_FRAME_US)
+            h->missed++;
+        if ((uint32_t) late > h->max_late_us)
+            h->max_late_us = late;
+    }
+    if (us > h->max_frame_us)
+        h->max_frame_us = us;
+    uint bucket = us >> USB_HOST_HIST_SHIFT;
+    h->hist[bucket < USB_HOST_HIST_BUCKETS ? bucket : USB_HOST_HIST_BUCKETS - 1]++;
+    return true;
+}
+
+void usb_host_health_start()
+{
+    // the pool's IRQ goes to the calling core, which has to be core1
+    s_pool = alarm_pool_create(FRAME_ALARM_NUM, 1);
+    alarm_pool_add_repeating_timer_us(s_pool, -USB_HOST_FRAME_US, usb_host_frame, NULL, &s_timer);
+}
+
+void usb_host_health_reset()
+{
+    memset(&usb_host_health, 0, sizeof(usb_host_health));
+}
+
+#if DEBUG
+
+void usb_host_health_print()
+{
+    UsbHostHealth* h = &usb_host_health;
+    console_printf("  frames %lu late %lu missed %lu, max late %lu us, max frame %lu us%s\n",
+        h->frames, h->late, h->missed, h->max_late_us, h->max_frame_us,
+        USB_HOST_REALTIME ? ", core1 real time" : "");
+    console_printf("  in errors %lu re-armed after %lu, control errors %lu\n",
+        h->in_errors, h->in_rearms, h->ctrl_errors);
+
+    console_printf("  frame us:");
+    for (uint i = 0; i < USB_HOST_HIST_BUCKETS; i++) {
+        if (h->hist[i])
+            console_printf(" %s%u:%lu", i == USB_HOST_HIST_BUCKETS - 1 ? ">=" : "<",
+                (i + (i < USB_HOST_HIST_BUCKETS - 1)) << USB_HOST_HIST_SHIFT, h->hist[i]);
+    }
+    console_printf("\n");
+}
+
+// 'usbh': PIO-USB frame timing and transfer errors
+// 'usbh reset': clear them, e.g. before a mouse traffic run
+void usb_host_console_cmd(int argc, char** argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "reset") == 0) {
+        usb_host_health_reset();
+        return;
+    }
+    usb_host_health_print();
+}
+
+#endif
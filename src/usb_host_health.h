@@ -0,0 +1,59 @@
+#ifndef USB_HOST_HEALTH_H_
+#define USB_HOST_HEALTH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * PIO-USB health, on core1.
+ *
+ * PIO-USB sends each 1 ms frame (SOF, then every pending transaction) from
+ * a timer IRQ. We run that timer ourselves rather than PIO-USB's own alarm
+ * pool, so every frame can be timed: how late it started against the 1 ms
+ * it was due, and how long the transactions in it took. Anything that
+ * keeps core1 from taking the timer on time shows up here first.
+ *
+ * TinyUSB completes a failed interrupt IN (a timeout or bad CRC after
+ * PIO-USB's retries) with no data; the report callback counts those, and
+ * how many of them it managed to re-arm the endpoint after.
+ */
+
+// Real time core1: every IRQ on core1 but the frame timer and the flash
+// write lockout is masked (irq_plan.c), and nothing but the USB host runs
+// there. Set from CMake, BABELFISH_USB_HOST_REALTIME.
+#ifndef USB_HOST_REALTIME
+#define USB_HOST_REALTIME 0
+#endif
+
+#define USB_HOST_FRAME_US 1000
+// a frame starting this much after it was due counts as late
+#define USB_HOST_FRAME_LATE_US 20
+// frame handler time, 32 us buckets; the last one takes everything longer
+#define USB_HOST_HIST_SHIFT 5
+#define USB_HOST_HIST_BUCKETS 16
+
+typedef struct {
+    // frame timer IRQ
+    uint32_t frames;
+    uint32_t late;
+    uint32_t missed; // whole frames skipped, no SOF sent
+    uint32_t max_late_us;
+    uint32_t max_frame_us;
+    uint32_t hist[USB_HOST_HIST_BUCKETS];
+
+    // tuh_task
+    uint32_t in_errors;   // interrupt IN completed without data
+    uint32_t in_rearms;   // of those, the endpoint re-armed after
+    uint32_t ctrl_errors; // our control transfers (SET_IDLE, SET_PROTOCOL, LED SET_REPORTs) failed
+} UsbHostHealth;
+
+extern UsbHostHealth usb_host_health;
+
+// core1, after tuh_init with PIO-USB's skip_alarm_pool set: start the
+// frame timer
+void usb_host_health_start();
+
+void usb_host_health_reset();
+void usb_host_health_print();
+
+#endif
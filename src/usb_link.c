@@ -0,0 +1,549 @@
+#include <pico/stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <tusb.h>
+
+#define DEBUG_TAG "link"
+#include "babelfish.h"
+#include "console.h"
+#include "hid_ring.h"
+#include "isr_stats.h"
+#include "keymap.h"
+#include "usb_host_health.h"
+#include "usb_link.h"
+
+DBG_MODULE();
+
+#if DEBUG
+
+/**********************
+
+Binary link over the vendor bulk interface (usb_descriptors.c), for tools
+that want more than the console: counters, trace streams, settings and
+event injection. It has its own endpoints and FIFOs, so a busy link never
+holds up console output, and the console never stalls the link.
+
+Everything is framed like the logic analyzer stream; multibyte values are
+little endian and names are NUL padded.
+
+  frame := type:u8 len:u16 payload[len]       (len <= LINK_MAX_PAYLOAD)
+
+Computer to Babelfish:
+
+  'P' ping      anything; echoed back as 'p'
+  'C' counters  -> 'c' { name:char[16] value:u32 }*
+  'G' get       name -> 'g' status:u8 value:i32 name
+  'S' set       value:i32 name -> 'g', with the value now in effect
+  'K' key       page:u16 keycode:u16 down:u8, queued as if from USB
+  'M' mouse     dx:i8 dy:i8 wheel:i8 buttons:u8, queued as if from USB
+  'B' bench     bytes:u32 -> that many bytes of 'b' frames (seq:u32 filler),
+                then 'e' bytes:u32 elapsed_us:u32
+  'D' discard   anything; counted, for the OUT half of the bench
+  'W' keymap    offset:u32 data[] into the upload buffer (keymap.h format),
+                in order from offset 0 -> 'w' status:u8
+  'A' apply     save:u8 -> 'a' status:u8 load_us:u32; checks the upload and
+                swaps it in, and writes it to flash if save is set
+  'R' read      offset:u32 len:u16 -> 'r' offset:u32 data[], from the live
+                keymap with its header
+
+Babelfish to computer, unprompted:
+
+  't' trace     dropped:u32 { kind:u8 len:u8 stamp_us:u32 data[len] }*
+
+Trace records ('trace' setting, UsbLinkTrace bits):
+
+  'k' page:u16 keycode:u16 down:u8             keyboard event to the host
+  'm' dx:i8 dy:i8 wheel:i8 buttons:u8          mouse event to the host
+  'r' dev_addr:u8 instance:u8 report[]         HID report off the ring
+
+Settings: host (read only), trace, tulog, and log.<tag> for the per-file
+log levels. 'g' status is 0 on success, 1 for an unknown name, 2 for a read
+only one.
+
+Replies go out in request order. The OUT transfer is 512 bytes, so the
+FIFO is refilled once per 8 packets rather than once per packet; the IN
+side works the same way, and trace and bench frames are only built when
+the whole frame fits in the TX FIFO.
+
+***********************/
+
+#define LINK_MAX_PAYLOAD 1024
+#define LINK_HEADER_LEN 3
+#define LINK_NAME_LEN 16
+
+#define LINK_BENCH_PAYLOAD (LINK_MAX_PAYLOAD - LINK_HEADER_LEN)
+
+#define TRACE_RING_SIZE 4096 // power of two
+#define TRACE_RECORD_HEADER 6
+
+enum {
+    ConfigOk = 0,
+    ConfigUnknown = 1,
+    ConfigReadOnly = 2,
+};
+
+volatile uint32_t usb_link_trace_mask;
+
+static uint8_t s_rx[LINK_HEADER_LEN + LINK_MAX_PAYLOAD];
+static uint s_rx_len;
+static uint8_t s_tx[LINK_HEADER_LEN + LINK_MAX_PAYLOAD];
+
+// Written and drained from the mainloop only
+static struct {
+    uint8_t buf[TRACE_RING_SIZE];
+    uint32_t head;
+    uint32_t tail;
+    uint32_t dropped;
+} s_trace;
+
+static struct {
+    uint8_t frame[LINK_HEADER_LEN + LINK_BENCH_PAYLOAD]; // filler set up once
+    uint32_t remaining;
+    bool end_due;
+    uint32_t seq;
+    uint32_t bytes;
+    uint32_t start_us;
+} s_bench;
+
+static struct {
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+    uint32_t frames;
+    uint32_t bad_frames;
+    uint32_t discarded;
+    uint32_t injected;
+    uint32_t trace_frames;
+    bool mounted;
+} s_stats;
+
+static void put_u16(uint8_t* p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put_u32(uint8_t* p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint16_t get_u16(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static bool tx_room(uint len)
+{
+    return tud_vendor_write_available() >= LINK_HEADER_LEN + len;
+}
+
+// The payload is already in the buffer after the header; all or nothing
+static bool send_frame(uint8_t* frame, uint8_t type, uint len)
+{
+    if (!tx_room(len))
+        return false;
+    frame[0] = type;
+    put_u16(&frame[1], len);
+    tud_vendor_write(frame, LINK_HEADER_LEN + len);
+    s_stats.tx_bytes += LINK_HEADER_LEN + len;
+    return true;
+}
+
+static bool send_tx(uint8_t type, uint len)
+{
+    return send_frame(s_tx, type, len);
+}
+
+void usb_link_trace_record(uint8_t kind, uint32_t stamp_us, const void* data, uint len)
+{
+    uint size = TRACE_RECORD_HEADER + len;
+    if (TRACE_RING_SIZE - (s_trace.head - s_trace.tail) < size) {
+        s_trace.dropped++;
+        return;
+    }
+
+    uint8_t hdr[TRACE_RECORD_HEADER] = { kind, len };
+    put_u32(&hdr[2], stamp_us);
+    for (uint i = 0; i < TRACE_RECORD_HEADER; i++)
+        s_trace.buf[(s_trace.head + i) & (TRACE_RING_SIZE - 1)] = hdr[i];
+    for (uint i = 0; i < len; i++)
+        s_trace.buf[(s_trace.head + TRACE_RECORD_HEADER + i) & (TRACE_RING_SIZE - 1)] = ((const uint8_t*) data)[i];
+    s_trace.head += size;
+}
+
+void usb_link_trace_hid_report(uint32_t stamp_us, uint8_t dev_addr, uint8_t instance, const uint8_t* report, uint len)
+{
+    uint8_t data[2 + CFG_TUH_HID_EPIN_BUFSIZE];
+    if (len > CFG_TUH_HID_EPIN_BUFSIZE)
+        len = CFG_TUH_HID_EPIN_BUFSIZE;
+    data[0] = dev_addr;
+    data[1] = instance;
+    memcpy(&data[2], report, len);
+    usb_link_trace_record('r', stamp_us, data, 2 + len);
+}
+
+// As many whole records as fit in one frame
+static void trace_flush()
+{
+    while (s_trace.tail != s_trace.head) {
+        uint len = 4;
+        uint32_t at = s_trace.tail;
+        while (at != s_trace.head) {
+            uint size = TRACE_RECORD_HEADER + s_trace.buf[(at + 1) & (TRACE_RING_SIZE - 1)];
+            if (len + size > LINK_MAX_PAYLOAD)
+                break;
+            len += size;
+            at += size;
+        }
+        if (!tx_room(len))
+            return;
+
+        uint8_t* p = &s_tx[LINK_HEADER_LEN];
+        put_u32(p, s_trace.dropped);
+        for (uint i = 4; i < len; i++)
+            p[i] = s_trace.buf[(s_trace.tail + i - 4) & (TRACE_RING_SIZE - 1)];
+        send_tx('t', len);
+        s_trace.tail = at;
+        s_stats.trace_frames++;
+    }
+}
+
+static uint counter(uint8_t* p, uint len, const char* name, uint32_t value)
+{
+    if (len + LINK_NAME_LEN + 4 > LINK_MAX_PAYLOAD)
+        return len;
+    memset(&p[len], 0, LINK_NAME_LEN);
+    strncpy((char*) &p[len], name, LINK_NAME_LEN - 1);
+    put_u32(&p[len + LINK_NAME_LEN], value);
+    return len + LINK_NAME_LEN + 4;
+}
+
+static uint counters(uint8_t* p)
+{
+    char name[LINK_NAME_LEN];
+    uint len = 0;
+
+    len = counter(p, len, "uptime_ms", to_ms_since_boot(get_absolute_time()));
+
+    for (int i = 0; i < IsrStatCount; i++) {
+        const IsrStat* s = &isr_stats[i];
+        snprintf(name, sizeof(name), "%s.count", s->name);
+        len = counter(p, len, name, s->count);
+        snprintf(name, sizeof(name), "%s.max", s->name);
+        len = counter(p, len, name, s->count ? s->max_cycles : 0);
+        snprintf(name, sizeof(name), "%s.over", s->name);
+        len = counter(p, len, name, s->over_budget + s->over_preempt_budget);
+    }
+
+    len = counter(p, len, "ring.reports", hid_ring_stats.core1.reports);
+    len = counter(p, len, "ring.dropped", hid_ring_stats.core1.dropped);
+    len = counter(p, len, "ring.max_depth", hid_ring_stats.core1.max_depth);
+    len = counter(p, len, "core1.task_max", hid_ring_stats.core1.task_max_cycles);
+    len = counter(p, len, "usbh.frames", usb_host_health.frames);
+    len = counter(p, len, "usbh.late", usb_host_health.late);
+    len = counter(p, len, "usbh.missed", usb_host_health.missed);
+    len = counter(p, len, "usbh.max_frame_us", usb_host_health.max_frame_us);
+    len = counter(p, len, "usbh.in_errors", usb_host_health.in_errors);
+    len = counter(p, len, "usbh.ctrl_errors", usb_host_health.ctrl_errors);
+
+    len = counter(p, len, "link.rx_bytes", s_stats.rx_bytes);
+    len = counter(p, len, "link.tx_bytes", s_stats.tx_bytes);
+    len = counter(p, len, "link.frames", s_stats.frames);
+    len = counter(p, len, "link.bad_frames", s_stats.bad_frames);
+    len = counter(p, len, "link.discarded", s_stats.discarded);
+    len = counter(p, len, "link.injected", s_stats.injected);
+    len = counter(p, len, "trace.dropped", s_trace.dropped);
+    return len;
+}
+
+static int config_get(const char* name, int32_t* value)
+{
+    if (strcmp(name, "host") == 0) {
+        *value = g_current_host_index;
+    } else if (strcmp(name, "trace") == 0) {
+        *value = usb_link_trace_mask;
+    } else if (strcmp(name, "tulog") == 0) {
+        *value = debug_tu_log_enabled();
+    } else if (strncmp(name, "log.", 4) == 0) {
+        int level;
+        if (!dbg_tag_get_level(name + 4, &level))
+            return ConfigUnknown;
+        *value = level;
+    } else {
+        return ConfigUnknown;
+    }
+    return ConfigOk;
+}
+
+static int config_set(const char* name, int32_t value)
+{
+    if (strcmp(name, "host") == 0) {
+        return ConfigReadOnly;
+    } else if (strcmp(name, "trace") == 0) {
+        usb_link_trace_mask = value;
+    } else if (strcmp(name, "tulog") == 0) {
+        debug_tu_log_set_enabled(value != 0);
+    } else if (strncmp(name, "log.", 4) == 0) {
+        if (!dbg_tag_set_level(name + 4, value))
+            return ConfigUnknown;
+    } else {
+        return ConfigUnknown;
+    }
+    return ConfigOk;
+}
+
+// name is the rest of the payload, not necessarily terminated
+static bool config_reply(const uint8_t* name, uint name_len, bool set, int32_t value)
+{
+    char key[LINK_NAME_LEN * 2];
+    if (name_len >= sizeof(key))
+        name_len = sizeof(key) - 1;
+    memcpy(key, name, name_len);
+    key[name_len] = 0;
+
+    uint8_t* p = &s_tx[LINK_HEADER_LEN];
+    if (!tx_room(5 + name_len))
+        return false;
+
+    int status = set ? config_set(key, value) : ConfigOk;
+    if (status == ConfigOk || status == ConfigReadOnly) {
+        int s = config_get(key, &value);
+        if (status == ConfigOk)
+            status = s;
+    }
+    if (status == ConfigUnknown)
+        value = 0;
+
+    p[0] = status;
+    put_u32(&p[1], value);
+    memcpy(&p[5], key, name_len);
+    return send_tx('g', 5 + name_len);
+}
+
+// Header and table are read as one image, the way they were uploaded
+static bool keymap_read(uint32_t offset, uint len)
+{
+    const KeymapHeader* h = keymap_live_header();
+    uint32_t size = sizeof(*h) + h->length;
+    if (offset > size)
+        offset = size;
+    if (len > size - offset)
+        len = size - offset;
+    if (len > LINK_MAX_PAYLOAD - 4)
+        len = LINK_MAX_PAYLOAD - 4;
+    if (!tx_room(4 + len))
+        return false;
+
+    uint8_t* p = &s_tx[LINK_HEADER_LEN];
+    put_u32(p, offset);
+    for (uint i = 0; i < len; i++) {
+        uint32_t at = offset + i;
+        p[4 + i] = at < sizeof(*h) ? ((const uint8_t*) h)[at] : keymap_live_table()[at - sizeof(*h)];
+    }
+    return send_tx('r', 4 + len);
+}
+
+static void inject_mouse(const uint8_t* p)
+{
+    static uint8_t buttons;
+
+    MouseEvent ev = {
+        .dx = p[0],
+        .dy = p[1],
+        .dwheel = p[2],
+        .buttons = p[3],
+        .buttons_down = p[3] & ~buttons,
+        .buttons_up = buttons & ~p[3],
+    };
+    buttons = p[3];
+    enqueue_mouse_event(&ev);
+}
+
+// False if the reply doesn't fit yet; the frame is kept and tried again
+static bool handle_frame(uint8_t type, const uint8_t* p, uint len)
+{
+    switch (type) {
+        case 'P':
+            if (!tx_room(len))
+                return false;
+            memcpy(&s_tx[LINK_HEADER_LEN], p, len);
+            return send_tx('p', len);
+
+        case 'C':
+            if (!tx_room(LINK_MAX_PAYLOAD))
+                return false;
+            return send_tx('c', counters(&s_tx[LINK_HEADER_LEN]));
+
+        case 'G':
+            return config_reply(p, len, false, 0);
+
+        case 'S':
+            if (len < 4)
+                break;
+            return config_reply(p + 4, len - 4, true, get_u32(p));
+
+        case 'K':
+            if (len < 5)
+                break;
+            {
+                KeyboardEvent ev = { .page = get_u16(p), .keycode = get_u16(p + 2), .down = p[4] != 0 };
+                enqueue_kbd_event(&ev);
+            }
+            s_stats.injected++;
+            return true;
+
+        case 'M':
+            if (len < 4)
+                break;
+            inject_mouse(p);
+            s_stats.injected++;
+            return true;
+
+        case 'B':
+            if (len < 4)
+                break;
+            if (!s_bench.frame[LINK_HEADER_LEN + 4]) {
+                for (uint i = 4; i < LINK_BENCH_PAYLOAD; i++)
+                    s_bench.frame[LINK_HEADER_LEN + i] = i | 1;
+            }
+            s_bench.remaining = get_u32(p);
+            s_bench.end_due = false;
+            s_bench.seq = 0;
+            s_bench.bytes = 0;
+            s_bench.start_us = time_us_32();
+            return true;
+
+        case 'D':
+            s_stats.discarded += len;
+            return true;
+
+        case 'W':
+            if (len < 4)
+                break;
+            if (!tx_room(1))
+                return false;
+            s_tx[LINK_HEADER_LEN] = keymap_stage(get_u32(p), p + 4, len - 4);
+            return send_tx('w', 1);
+
+        case 'A':
+            if (len < 1)
+                break;
+            if (!tx_room(5))
+                return false;
+            s_tx[LINK_HEADER_LEN] = keymap_apply(p[0] != 0);
+            put_u32(&s_tx[LINK_HEADER_LEN + 1], keymap_load_us());
+            return send_tx('a', 5);
+
+        case 'R':
+            if (len < 6)
+                break;
+            return keymap_read(get_u32(p), get_u16(p + 4));
+    }
+
+    s_stats.bad_frames++;
+    return true;
+}
+
+static void rx_task()
+{
+    uint room = sizeof(s_rx) - s_rx_len;
+    if (room && tud_vendor_available()) {
+        uint n = tud_vendor_read(&s_rx[s_rx_len], room);
+        s_rx_len += n;
+        s_stats.rx_bytes += n;
+    }
+
+    uint at = 0;
+    while (s_rx_len - at >= LINK_HEADER_LEN) {
+        uint len = get_u16(&s_rx[at + 1]);
+        if (len > LINK_MAX_PAYLOAD) {
+            // no way to find the next frame; the client resyncs with a ping
+            s_stats.bad_frames++;
+            at = s_rx_len;
+            break;
+        }
+        if (s_rx_len - at < LINK_HEADER_LEN + len)
+            break;
+        if (!handle_frame(s_rx[at], &s_rx[at + LINK_HEADER_LEN], len))
+            break;
+        s_stats.frames++;
+        at += LINK_HEADER_LEN + len;
+    }
+
+    if (at) {
+        memmove(s_rx, &s_rx[at], s_rx_len - at);
+        s_rx_len -= at;
+    }
+}
+
+static void bench_task()
+{
+    while (s_bench.remaining) {
+        // the last frame may be short, but always has its sequence number
+        uint len = LINK_BENCH_PAYLOAD;
+        if (s_bench.remaining < LINK_HEADER_LEN + len)
+            len = s_bench.remaining > LINK_HEADER_LEN + 4 ? s_bench.remaining - LINK_HEADER_LEN : 4;
+
+        put_u32(&s_bench.frame[LINK_HEADER_LEN], s_bench.seq);
+        if (!send_frame(s_bench.frame, 'b', len))
+            return;
+        s_bench.seq++;
+        s_bench.bytes += LINK_HEADER_LEN + len;
+        if (s_bench.remaining > LINK_HEADER_LEN + len) {
+            s_bench.remaining -= LINK_HEADER_LEN + len;
+        } else {
+            s_bench.remaining = 0;
+            s_bench.end_due = true;
+        }
+    }
+
+    if (s_bench.end_due) {
+        uint8_t* p = &s_tx[LINK_HEADER_LEN];
+        put_u32(p, s_bench.bytes);
+        put_u32(p + 4, time_us_32() - s_bench.start_us);
+        if (send_tx('e', 8))
+            s_bench.end_due = false;
+    }
+}
+
+// Mainloop, from debug_task()
+void usb_link_task()
+{
+    bool mounted = tud_vendor_mounted();
+    if (mounted != s_stats.mounted) {
+        s_stats.mounted = mounted;
+        s_rx_len = 0;
+        s_bench.remaining = 0;
+        s_bench.end_due = false;
+        DBG("link %s\n", mounted ? "open" : "closed");
+    }
+    if (!mounted) {
+        // nobody reading; don't let stale records pile up
+        s_trace.tail = s_trace.head;
+        return;
+    }
+
+    rx_task();
+    trace_flush();
+    bench_task();
+    tud_vendor_write_flush();
+}
+
+void usb_link_stats_print()
+{
+    console_printf("  %s, rx %lu bytes %lu frames (%lu bad), tx %lu bytes, %lu trace frames\n",
+        s_stats.mounted ? "open" : "closed", s_stats.rx_bytes, s_stats.frames, s_stats.bad_frames,
+        s_stats.tx_bytes, s_stats.trace_frames);
+    console_printf("  trace mask %lx, %lu records dropped; %lu events injected\n",
+        usb_link_trace_mask, s_trace.dropped, s_stats.injected);
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef USB_LINK_H_
+#define USB_LINK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pico/time.h>
+#include "events.h"
+
+/*
+ * Binary telemetry and control over the vendor bulk interface, next to the
+ * CDC console; see usb_link.c for the frame format and tools/usb_link.py
+ * for the client.
+ *
+ * The trace hooks sit in the mainloop's event path. With their channel off
+ * (the default) each one is a load and a branch.
+ */
+
+typedef enum {
+    UsbLinkTraceKbd = 1 << 0,    // keyboard events, as handed to the host
+    UsbLinkTraceMouse = 1 << 1,  // mouse events, as handed to the host
+    UsbLinkTraceReport = 1 << 2, // raw HID reports, with core1's arrival time
+} UsbLinkTrace;
+
+#if DEBUG
+
+extern volatile uint32_t usb_link_trace_mask;
+
+void usb_link_task();
+void usb_link_stats_print();
+
+void usb_link_trace_record(uint8_t kind, uint32_t stamp_us, const void* data, uint len);
+
+static inline void usb_link_trace_kbd(const KeyboardEvent* ev)
+{
+    if (usb_link_trace_mask & UsbLinkTraceKbd) {
+        const uint8_t data[] = { ev->page, ev->page >> 8, ev->keycode, ev->keycode >> 8, ev->down };
+        usb_link_trace_record('k', time_us_32(), data, sizeof(data));
+    }
+}
+
+static inline void usb_link_trace_mouse(const MouseEvent* ev)
+{
+    if (usb_link_trace_mask & UsbLinkTraceMouse) {
+        const uint8_t data[] = { ev->dx, ev->dy, ev->dwheel, ev->buttons };
+        usb_link_trace_record('m', time_us_32(), data, sizeof(data));
+    }
+}
+
+void usb_link_trace_hid_report(uint32_t stamp_us, uint8_t dev_addr, uint8_t instance, const uint8_t* report, uint len);
+
+static inline void usb_link_trace_report(uint32_t stamp_us, uint8_t dev_addr, uint8_t instance,
+    const uint8_t* report, uint len)
+{
+    if (usb_link_trace_mask & UsbLinkTraceReport)
+        usb_link_trace_hid_report(stamp_us, dev_addr, instance, report, len);
+}
+
+#else
+
+#define usb_link_trace_kbd(ev) do { } while (0)
+#define usb_link_trace_mouse(ev) do { } while (0)
+#define usb_link_trace_report(stamp_us, dev_addr, instance, report, len) do { } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+#
+# Babelfish HID trace download.
+#
+# Asks the recorder (src/hid_rec.c) for its contents over the debug CDC and
+# saves them as a trace file, in the format described in src/hid_rec.h.
+#
+#   hid_trace.py /dev/ttyACM0 -o keyboard.trace
+#   hid_trace.py /dev/ttyACM0 --load -o keyboard.trace   # what was flushed to flash
+#
+
+import argparse
+import sys
+
+import serial
+
+CONSOLE_CMD = b"\x1c"
+TRACE_HEADER = "# babelfish hid trace v1"
+
+
+def command(port, line):
+    port.write(CONSOLE_CMD + line.encode() + b"\r")
+    port.flush()
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Download the Babelfish HID report recorder")
+    ap.add_argument("port", help="debug CDC serial port, e.g. /dev/ttyACM0")
+    ap.add_argument("-o", "--output", default="-", help="trace file to write (default stdout)")
+    ap.add_argument("--load", action="store_true", help="dump the copy saved in flash instead of the live ring")
+    ap.add_argument("--timeout", type=float, default=5.0, help="seconds to wait for output")
+    args = ap.parse_args()
+
+    port = serial.Serial(args.port, 115200, timeout=args.timeout)
+    port.reset_input_buffer()
+
+    if args.load:
+        command(port, "rec load")
+    command(port, "rec dump")
+
+    lines = []
+    started = False
+    while True:
+        raw = port.readline()
+        if not raw:
+            sys.exit("timed out waiting for the trace")
+        line = raw.decode(errors="replace").rstrip("\r\n")
+        if not started:
+            # skip any log output that was already queued
+            started = line == TRACE_HEADER
+        if started:
+            lines.append(line)
+            if line == "# end":
+                break
+
+    out = sys.stdout if args.output == "-" else open(args.output, "w")
+    out.write("\n".join(lines) + "\n")
+    if out is not sys.stdout:
+        out.close()
+        records = sum(1 for l in lines if l and not l.startswith("#"))
+        print(f"{records} reports written to {args.output}", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
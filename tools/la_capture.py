@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+#
+# Babelfish logic analyzer capture client.
+#
+# Starts a capture over the debug CDC, decodes the run-length stream described
+# in src/la_capture.c and writes a sigrok session file that PulseView and
+# sigrok-cli can open directly (sigrok-cli -i capture.sr -P uart:rx=RX_A ...).
+#
+#   la_capture.py /dev/ttyACM0 --rate 4000000 --seconds 5 -o capture.sr
+#
+# The firmware has to be built with -DBABELFISH_LA_CAPTURE=ON.
+#
+
+import argparse
+import struct
+import sys
+import time
+import zipfile
+
+import serial
+
+CONSOLE_CMD = b"\x1c"
+
+
+def read_exact(port, n):
+    buf = b""
+    while len(buf) < n:
+        chunk = port.read(n - len(buf))
+        if not chunk:
+            raise TimeoutError("timed out waiting for capture data")
+        buf += chunk
+    return buf
+
+
+def read_frame(port):
+    hdr = read_exact(port, 3)
+    ftype = chr(hdr[0])
+    (length,) = struct.unpack("<H", hdr[1:3])
+    return ftype, read_exact(port, length)
+
+
+def parse_header(payload):
+    rate, pin_mask, count = struct.unpack_from("<IHB", payload, 0)
+    channels = []
+    for i in range(count):
+        gpio = payload[7 + i * 9]
+        name = payload[8 + i * 9 : 17 + i * 9].split(b"\0")[0].decode()
+        channels.append((gpio, name))
+    return rate, pin_mask, channels
+
+
+def decode_data(payload, channels, out):
+    # each token is a 16-bit GPIO snapshot plus a varint (run - 1); repack the
+    # channel bits into one byte per sample for sigrok
+    lut = {}
+    i = 0
+    n = len(payload)
+    while i < n:
+        (value,) = struct.unpack_from("<H", payload, i)
+        i += 2
+        run = 0
+        shift = 0
+        while True:
+            b = payload[i]
+            i += 1
+            run |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                break
+        packed = lut.get(value)
+        if packed is None:
+            packed = 0
+            for bit, (gpio, _) in enumerate(channels):
+                if value & (1 << gpio):
+                    packed |= 1 << bit
+            lut[value] = packed
+        out.extend(bytes((packed,)) * (run + 1))
+
+
+def report(tag, payload):
+    samples, dropped, bytes_out, elapsed_us = struct.unpack("<IIII", payload)
+    secs = max(elapsed_us / 1e6, 1e-6)
+    print(
+        "%s: %d samples (%.2f Msps), %d dropped, %d bytes (%.1f KB/s, %.1fx compression)"
+        % (
+            tag,
+            samples,
+            samples / secs / 1e6,
+            dropped,
+            bytes_out,
+            bytes_out / secs / 1024,
+            (samples * 2) / max(bytes_out, 1),
+        ),
+        file=sys.stderr,
+    )
+    return dropped
+
+
+def write_sr(path, rate, channels, samples):
+    meta = [
+        "[global]",
+        "sigrok version=0.5.2",
+        "",
+        "[device 1]",
+        "capturefile=logic-1",
+        "total probes=%d" % len(channels),
+        "samplerate=%d Hz" % rate,
+        "total analog=0",
+        "unitsize=1",
+    ]
+    for i, (_, name) in enumerate(channels):
+        meta.append("probe%d=%s" % (i + 1, name))
+    with zipfile.ZipFile(path, "w", zipfile.ZIP_DEFLATED) as z:
+        z.writestr("version", "2")
+        z.writestr("metadata", "\n".join(meta) + "\n")
+        z.writestr("logic-1-1", bytes(samples))
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Babelfish logic analyzer capture")
+    ap.add_argument("port")
+    ap.add_argument("--rate", type=int, default=1000000, help="sample rate in Hz")
+    ap.add_argument("--seconds", type=float, default=2.0, help="capture length")
+    ap.add_argument("-o", "--output", default="capture.sr")
+    args = ap.parse_args()
+
+    port = serial.Serial(args.port, timeout=2)
+    port.reset_input_buffer()
+
+    # the firmware prints one last line before the stream starts; skip to the header
+    port.write(CONSOLE_CMD + b"la start %d\r" % args.rate)
+    line = b""
+    while not line.endswith(b"Hz\r\n"):
+        line += read_exact(port, 1)
+    ftype, payload = read_frame(port)
+    if ftype != "H":
+        sys.exit("unexpected frame %r, expected capture header" % ftype)
+    rate, _, channels = parse_header(payload)
+    print("capturing %d channels at %d Hz" % (len(channels), rate), file=sys.stderr)
+
+    samples = bytearray()
+    stop_at = time.monotonic() + args.seconds
+    stopping = False
+    dropped = 0
+    try:
+        while True:
+            if not stopping and time.monotonic() >= stop_at:
+                port.write(CONSOLE_CMD + b"la stop\r")
+                stopping = True
+            ftype, payload = read_frame(port)
+            if ftype == "D":
+                decode_data(payload, channels, samples)
+            elif ftype == "S":
+                report("status", payload)
+            elif ftype == "E":
+                dropped = report("done", payload)
+                break
+    except KeyboardInterrupt:
+        port.write(CONSOLE_CMD + b"la stop\r")
+
+    write_sr(args.output, rate, channels, samples)
+    print("wrote %s (%d samples)" % (args.output, len(samples)), file=sys.stderr)
+    if dropped:
+        print("warning: %d samples were dropped; the capture has gaps" % dropped, file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
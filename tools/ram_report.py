@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+#
+# Build-time report of what lives in RP2040 SRAM.
+#
+# Lists every function that was placed in RAM (__not_in_flash_func and
+# friends) and the largest RAM data symbols, and checks that a set of
+# required symbols are RAM-resident. A required symbol that is in flash is
+# an error, and so is one that is missing: the list is per image, so a
+# function that was inlined away can't be checked and must be marked
+# __no_inline_not_in_flash_func instead.
+#
+
+import argparse
+import subprocess
+import sys
+
+RAM_START = 0x20000000
+RAM_END = 0x20042000
+
+
+def read_symbols(nm, elf):
+    out = subprocess.run(
+        [nm, "-S", "--defined-only", elf], check=True, capture_output=True, text=True
+    ).stdout
+    syms = []
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) != 4:
+            continue
+        addr, size, kind, name = parts
+        syms.append((int(addr, 16), int(size, 16), kind, name))
+    return syms
+
+
+def main():
+    ap = argparse.ArgumentParser(description="RP2040 RAM placement report")
+    ap.add_argument("elf")
+    ap.add_argument("--nm", default="arm-none-eabi-nm")
+    ap.add_argument("--require", default="", help="comma separated symbols that must be in RAM")
+    ap.add_argument("--top", type=int, default=20, help="how many data symbols to list")
+    ap.add_argument("-o", "--output")
+    args = ap.parse_args()
+
+    syms = read_symbols(args.nm, args.elf)
+    in_ram = lambda addr: RAM_START <= addr < RAM_END
+
+    code = sorted((s for s in syms if in_ram(s[0]) and s[2] in "tT"), key=lambda s: -s[1])
+    data = sorted((s for s in syms if in_ram(s[0]) and s[2] not in "tT"), key=lambda s: -s[1])
+
+    lines = []
+    lines.append("RAM code: %d functions, %d bytes" % (len(code), sum(s[1] for s in code)))
+    for addr, size, _, name in code:
+        lines.append("  %08x %6d  %s" % (addr, size, name))
+    lines.append("RAM data: %d symbols, %d bytes (top %d)" % (len(data), sum(s[1] for s in data), args.top))
+    for addr, size, _, name in data[: args.top]:
+        lines.append("  %08x %6d  %s" % (addr, size, name))
+
+    errors = 0
+    for req in filter(None, args.require.split(",")):
+        matches = [s for s in syms if s[3] == req]
+        if not matches:
+            lines.append("error: %s not found (inlined, or not in this image?)" % req)
+            errors += 1
+            continue
+        for addr, _, _, name in matches:
+            if not in_ram(addr):
+                lines.append("error: %s is at %08x, not in RAM" % (name, addr))
+                errors += 1
+
+    report = "\n".join(lines) + "\n"
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(report)
+    sys.stdout.write(report)
+    sys.exit(1 if errors else 0)
+
+
+if __name__ == "__main__":
+    main()
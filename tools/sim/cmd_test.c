@@ -0,0 +1,165 @@
+/*
+ * Command key tests: src/cmd.c's hold detection on a virtual clock.
+ *
+ *   make -C tools/sim test
+ *
+ * Drives cmd_process_event_at/cmd_task_at with explicit times the way the
+ * mainloop does (an event the command processor doesn't take goes on to
+ * the host) and checks what reached the host.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "babelfish.h"
+#include "hid_codes.h"
+
+bool cmd_process_event_at(KeyboardEvent ev, uint32_t now_ms);
+void cmd_task_at(uint32_t now_ms);
+
+#define CMD_KEY HID_KEY_EQUAL
+#define HOLD_MS 500
+
+//
+// A host that records what it gets
+//
+
+static KeyboardEvent s_sent[16];
+static int s_sent_count;
+
+static void test_init(void) {}
+static void test_update(void) {}
+static void test_mouse_event(const MouseEvent ev) {}
+
+static void test_kbd_event(const KeyboardEvent ev)
+{
+  if (s_sent_count < (int) (sizeof(s_sent) / sizeof(s_sent[0])))
+    s_sent[s_sent_count] = ev;
+  s_sent_count++;
+}
+
+HostDevice hosts[] = {
+  { .name = "test", .init = test_init, .update = test_update, .kbd_event = test_kbd_event,
+    .mouse_event = test_mouse_event },
+  { .name = "" },
+};
+
+HostDevice *host = &hosts[0];
+int g_current_host_index = 0;
+
+// cmd.c's command processor; none of the keys used below runs a command
+void channel_config(int ch, ChannelMode mode) {}
+void gpio_put(uint gpio, bool value) {}
+void sleep_ms(uint32_t ms) {}
+
+// only cmd_process_event/cmd_task read it, not used here
+absolute_time_t get_absolute_time(void) { return 0; }
+
+//
+// Steps
+//
+
+static int s_failures;
+
+// An event at now_ms, dispatched like main.c does
+static void key(uint16_t keycode, bool down, uint32_t now_ms)
+{
+  KeyboardEvent ev = { .page = 0, .keycode = keycode, .down = down };
+  if (!cmd_process_event_at(ev, now_ms))
+    test_kbd_event(ev);
+}
+
+// What the host got since the last check: keycode, down, keycode, down...
+static void expect(const char* name, const uint16_t* pairs, int n)
+{
+  bool ok = s_sent_count == n / 2;
+  for (int i = 0; ok && i < n / 2; i++)
+    ok = s_sent[i].keycode == pairs[2 * i] && s_sent[i].down == pairs[2 * i + 1];
+
+  printf("%s %s\n", ok ? "ok  " : "FAIL", name);
+  if (!ok) {
+    s_failures++;
+    printf("  host got %d events:", s_sent_count);
+    for (int i = 0; i < s_sent_count && i < (int) (sizeof(s_sent) / sizeof(s_sent[0])); i++)
+      printf(" %02x%s", s_sent[i].keycode, s_sent[i].down ? "v" : "^");
+    printf("\n");
+  }
+  s_sent_count = 0;
+}
+
+#define EXPECT(name, ...) do { \
+    const uint16_t pairs[] = { 0, ##__VA_ARGS__ }; \
+    expect(name, pairs + 1, sizeof(pairs) / sizeof(pairs[0]) - 1); \
+  } while (0)
+
+int main(void)
+{
+  uint32_t t = 1000;
+
+  // released before the deadline: a tap, forwarded at the release
+  key(CMD_KEY, true, t);
+  cmd_task_at(t + HOLD_MS - 1);
+  EXPECT("tap: nothing before the release");
+  key(CMD_KEY, false, t + 100);
+  EXPECT("tap: down and up at the release", CMD_KEY, 1, CMD_KEY, 0);
+  cmd_task_at(t + HOLD_MS + 100);
+  key(HID_KEY_A, true, t + HOLD_MS + 100);
+  EXPECT("tap: no command mode after the old deadline", HID_KEY_A, 1);
+  key(HID_KEY_A, false, t + HOLD_MS + 110);
+  EXPECT("tap: other keys pass", HID_KEY_A, 0);
+
+  // another key before the deadline: a chord, the held back down goes first
+  t = 5000;
+  key(CMD_KEY, true, t);
+  key(HID_KEY_LEFT_SHIFT, true, t + 50);
+  EXPECT("chord: held back down, then the other key", CMD_KEY, 1, HID_KEY_LEFT_SHIFT, 1);
+  key(CMD_KEY, false, t + 80);
+  key(HID_KEY_LEFT_SHIFT, false, t + 90);
+  EXPECT("chord: releases pass", CMD_KEY, 0, HID_KEY_LEFT_SHIFT, 0);
+
+  // held to the deadline: command mode, found by cmd_task with no event
+  t = 9000;
+  key(CMD_KEY, true, t);
+  cmd_task_at(t + HOLD_MS - 1);
+  key(HID_KEY_1, true, t + HOLD_MS - 1);
+  EXPECT("hold: a key just before the deadline is a chord", CMD_KEY, 1, HID_KEY_1, 1);
+  key(HID_KEY_1, false, t + HOLD_MS);
+  key(CMD_KEY, false, t + HOLD_MS);
+  EXPECT("hold: its releases pass", HID_KEY_1, 0, CMD_KEY, 0);
+
+  t = 13000;
+  key(CMD_KEY, true, t);
+  cmd_task_at(t + HOLD_MS);
+  key(HID_KEY_1, true, t + HOLD_MS + 10);
+  key(HID_KEY_1, false, t + HOLD_MS + 20);
+  EXPECT("hold: command mode at the deadline takes keys");
+  key(CMD_KEY, false, t + HOLD_MS + 30);
+  EXPECT("hold: releasing the command key leaves it, nothing sent");
+  key(HID_KEY_A, true, t + HOLD_MS + 40);
+  EXPECT("hold: keys pass again", HID_KEY_A, 1);
+  key(HID_KEY_A, false, t + HOLD_MS + 50);
+  s_sent_count = 0;
+
+  // past the deadline with no cmd_task in between: the next event sees it
+  t = 17000;
+  key(CMD_KEY, true, t);
+  key(HID_KEY_1, true, t + HOLD_MS + 200);
+  EXPECT("late: the deadline is checked at the next event");
+  key(HID_KEY_1, false, t + HOLD_MS + 210);
+  key(CMD_KEY, false, t + HOLD_MS + 220);
+  EXPECT("late: left on release");
+
+  // the clock wrapping between the down and the deadline
+  t = UINT32_MAX - 100;
+  key(CMD_KEY, true, t);
+  cmd_task_at(t + 50);
+  key(CMD_KEY, false, t + 150);
+  EXPECT("wrap: a tap across the wrap", CMD_KEY, 1, CMD_KEY, 0);
+  key(CMD_KEY, true, t);
+  cmd_task_at(t + HOLD_MS);
+  key(CMD_KEY, false, t + HOLD_MS + 10);
+  EXPECT("wrap: a hold across the wrap");
+
+  printf("%s\n", s_failures ? "FAILED" : "all passed");
+  return s_failures ? 1 : 0;
+}
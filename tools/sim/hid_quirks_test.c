@@ -0,0 +1,48 @@
+/*
+ * Quirks table tests: src/hid_quirks.c's lookup by VID/PID, then by
+ * interface protocol.
+ *
+ *   make -C tools/sim test
+ *
+ * Checks the flags each lookup lands on against the table as shipped, so
+ * an entry added above a default, or a default moved, shows up here.
+ */
+
+#include <stdio.h>
+
+#include "hid_quirks.h"
+#include "tusb.h"
+
+static int s_failures;
+
+static void expect(const char* name, uint16_t vid, uint16_t pid, uint8_t itf_protocol, uint8_t flags, uint8_t idle)
+{
+  const HidQuirk* q = hid_quirks_find(vid, pid, itf_protocol);
+  bool ok = q && q->flags == flags && q->idle == idle;
+
+  printf("%s %s\n", ok ? "ok  " : "FAIL", name);
+  if (!ok) {
+    s_failures++;
+    if (q)
+      printf("  got %04x:%04x protocol %u flags %x idle %u\n", q->vid, q->pid, q->itf_protocol, q->flags, q->idle);
+  }
+}
+
+int main(void)
+{
+  // Logitech M105
+  expect("listed device, listed interface", 0x046d, 0xc077, HID_ITF_PROTOCOL_MOUSE, HidQuirkReportProtocol, 0);
+  expect("listed device, other interface: the default for it", 0x046d, 0xc077, HID_ITF_PROTOCOL_KEYBOARD,
+      HidQuirkRepeatFilter, 0);
+  expect("same vendor, other product: the default", 0x046d, 0xc078, HID_ITF_PROTOCOL_MOUSE, 0, 0);
+  expect("same product id, other vendor: the default", 0x046e, 0xc077, HID_ITF_PROTOCOL_MOUSE, 0, 0);
+
+  expect("unlisted keyboard: repeat filter", 0x1234, 0x5678, HID_ITF_PROTOCOL_KEYBOARD, HidQuirkRepeatFilter, 0);
+  expect("unlisted mouse: nothing, mice are never filtered", 0x1234, 0x5678, HID_ITF_PROTOCOL_MOUSE, 0, 0);
+  expect("report protocol interface: nothing", 0x1234, 0x5678, HID_ITF_PROTOCOL_NONE, 0, 0);
+  // a device that reports 0000:0000 must not match the ANY entries as a device
+  expect("vid/pid 0: the defaults", 0, 0, HID_ITF_PROTOCOL_KEYBOARD, HidQuirkRepeatFilter, 0);
+
+  printf("%s\n", s_failures ? "FAILED" : "all passed");
+  return s_failures ? 1 : 0;
+}
@@ -0,0 +1,387 @@
+/*
+ * NeXT bus state machine tests: src/next_kms.pio run on a cycle model of a
+ * PIO state machine against a host that sends command frames.
+ *
+ *   make -C tools/sim test
+ *
+ * The program waits for the host's line to go high after the last command
+ * bit before it turns around, so the turnaround could depend on the value
+ * of that bit. This checks, for every command byte, a host clock up to 3%
+ * off and the start edge anywhere within a state machine cycle, that
+ *   - the byte lands in the RX FIFO as sent,
+ *   - the reply starts at the same time whatever the command's bits were,
+ *     after the host's stop bit and within two bit times of it,
+ *   - the reply comes out bit for bit,
+ *   - and the state machine is back in time for a frame sent right after.
+ *
+ * The model reads the program from the .pio source; it knows the
+ * instructions next_kms uses and the shift setup next_kms_program_init
+ * gives it, nothing more.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CLOCKS_PER_BIT 8
+#define HOST_FRAME_BITS 10 // start, 8 data, stop
+#define REPLY_BITS 22
+
+enum Op {
+  OpWait,
+  OpSetX,
+  OpIn,
+  OpJmp,
+  OpJmpXDec,
+  OpPull,
+  OpOut,
+};
+
+typedef struct {
+  enum Op op;
+  int arg;    // wait polarity, set value, bit count, jump target
+  int delay;
+} Instr;
+
+static Instr s_prog[32];
+static int s_prog_len;
+static int s_wrap_target, s_wrap;
+
+static int s_failures;
+
+static char* trim(char* s)
+{
+  while (*s == ' ' || *s == '\t')
+    s++;
+  char* end = s + strlen(s);
+  while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r'))
+    *--end = 0;
+  return s;
+}
+
+static bool load_program(const char* path)
+{
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+
+  char labels[8][32];
+  int label_pc[8];
+  int nlabels = 0;
+  char targets[32][32];
+  char line[256];
+
+  s_wrap = -1;
+  while (fgets(line, sizeof line, f)) {
+    char* semi = strchr(line, ';');
+    if (semi)
+      *semi = 0;
+    char* s = trim(line);
+    if (!*s || !strncmp(s, ".program", 8))
+      continue;
+    if (*s == '%')
+      break; // the c-sdk block
+    if (!strcmp(s, ".wrap_target")) {
+      s_wrap_target = s_prog_len;
+      continue;
+    }
+    if (!strcmp(s, ".wrap")) {
+      s_wrap = s_prog_len - 1;
+      continue;
+    }
+    size_t len = strlen(s);
+    if (s[len - 1] == ':') {
+      s[len - 1] = 0;
+      snprintf(labels[nlabels], sizeof labels[0], "%s", s);
+      label_pc[nlabels++] = s_prog_len;
+      continue;
+    }
+
+    Instr* in = &s_prog[s_prog_len];
+    char* bracket = strchr(s, '[');
+    in->delay = bracket ? atoi(bracket + 1) : 0;
+    if (bracket)
+      *bracket = 0;
+    s = trim(s);
+
+    int a;
+    char target[32];
+    if (sscanf(s, "wait %d pin 0", &a) == 1) {
+      in->op = OpWait;
+      in->arg = a;
+    } else if (sscanf(s, "set x, %d", &a) == 1) {
+      in->op = OpSetX;
+      in->arg = a;
+    } else if (sscanf(s, "in pins, %d", &a) == 1) {
+      in->op = OpIn;
+      in->arg = a;
+    } else if (sscanf(s, "out pins, %d", &a) == 1) {
+      in->op = OpOut;
+      in->arg = a;
+    } else if (sscanf(s, "jmp x-- %31s", target) == 1) {
+      in->op = OpJmpXDec;
+      snprintf(targets[s_prog_len], sizeof targets[0], "%s", target);
+    } else if (sscanf(s, "jmp %31s", target) == 1) {
+      in->op = OpJmp;
+      snprintf(targets[s_prog_len], sizeof targets[0], "%s", target);
+    } else if (!strcmp(s, "pull block")) {
+      in->op = OpPull;
+    } else {
+      fprintf(stderr, "%s: the model does not know '%s'\n", path, s);
+      fclose(f);
+      return false;
+    }
+    s_prog_len++;
+  }
+  fclose(f);
+
+  for (int pc = 0; pc < s_prog_len; pc++) {
+    if (s_prog[pc].op != OpJmp && s_prog[pc].op != OpJmpXDec)
+      continue;
+    int i;
+    for (i = 0; i < nlabels && strcmp(labels[i], targets[pc]); i++)
+      ;
+    if (i == nlabels) {
+      fprintf(stderr, "%s: no label '%s'\n", path, targets[pc]);
+      return false;
+    }
+    s_prog[pc].arg = label_pc[i];
+  }
+  if (s_wrap < 0)
+    s_wrap = s_prog_len - 1;
+  return s_prog_len > 0;
+}
+
+/*
+ * One state machine: in_shift right with autopush at 8, out_shift right
+ * without autopull, one in pin and one out pin.
+ */
+typedef struct {
+  int pc;
+  uint32_t x;
+  uint32_t isr, osr;
+  int isr_count;
+  int delay;
+  uint32_t rx[4];
+  int rx_count;
+  uint32_t tx[4];
+  int tx_count;
+  int out_pin;
+} Sm;
+
+static void sm_reset(Sm* sm)
+{
+  memset(sm, 0, sizeof *sm);
+  sm->pc = s_wrap_target;
+  sm->out_pin = 1;
+}
+
+static void sm_advance(Sm* sm, int next)
+{
+  sm->pc = sm->pc == s_wrap && next == sm->pc + 1 ? s_wrap_target : next;
+}
+
+static void sm_step(Sm* sm, int in_pin)
+{
+  if (sm->delay) {
+    sm->delay--;
+    return;
+  }
+
+  const Instr* in = &s_prog[sm->pc];
+  int next = sm->pc + 1;
+  switch (in->op) {
+    case OpWait:
+      if (in_pin != in->arg)
+        return; // stalled, the delay only starts once it passes
+      break;
+    case OpSetX:
+      sm->x = in->arg;
+      break;
+    case OpIn:
+      sm->isr = (sm->isr >> in->arg) | ((uint32_t) in_pin << (32 - in->arg));
+      sm->isr_count += in->arg;
+      if (sm->isr_count >= 8) {
+        if (sm->rx_count < 4)
+          sm->rx[sm->rx_count++] = sm->isr;
+        sm->isr = 0;
+        sm->isr_count = 0;
+      }
+      break;
+    case OpJmp:
+      next = in->arg;
+      break;
+    case OpJmpXDec:
+      if (sm->x--)
+        next = in->arg;
+      break;
+    case OpPull:
+      if (!sm->tx_count)
+        return;
+      sm->osr = sm->tx[0];
+      memmove(sm->tx, sm->tx + 1, --sm->tx_count * sizeof sm->tx[0]);
+      break;
+    case OpOut:
+      sm->out_pin = sm->osr & 1;
+      sm->osr >>= in->arg;
+      break;
+  }
+  sm->delay = in->delay;
+  sm_advance(sm, next);
+}
+
+/*
+ * The host: frames of a start bit, 8 data bits LSB first and a stop bit,
+ * `bit` state machine cycles each, the first starting at `start`.
+ */
+typedef struct {
+  double start;
+  uint8_t byte;
+} Frame;
+
+static int host_line(const Frame* frames, int count, double bit, double t)
+{
+  for (int i = 0; i < count; i++) {
+    double pos = (t - frames[i].start) / bit;
+    if (pos < 0 || pos >= HOST_FRAME_BITS - 1)
+      continue;
+    int n = (int) pos;
+    return n == 0 ? 0 : (frames[i].byte >> (n - 1)) & 1;
+  }
+  return 1;
+}
+
+// What the firmware would answer: a framed word that carries the command
+static uint32_t reply_for(uint8_t cmd)
+{
+  if (cmd == 0xef)
+    return 0xffffffffu;
+  return (1u << 9) | (1u << 21) | ((uint32_t) cmd << 1) | ((uint32_t) (cmd ^ 0x5a) << 11);
+}
+
+typedef struct {
+  bool ok;
+  double reply_start;   // state machine cycles after the host's stop bit ended
+} Result;
+
+static Result run(uint8_t cmd, double rate, double phase)
+{
+  Result r = { false, 0 };
+  double bit = CLOCKS_PER_BIT * rate;
+  Frame frames[2] = {
+    { 3 + phase, cmd },
+    // right after the longest reply could end
+    { 3 + phase + (HOST_FRAME_BITS + 2 + REPLY_BITS + 1) * bit, 0x10 },
+  };
+  double stop_end = frames[0].start + HOST_FRAME_BITS * bit;
+  uint32_t want = reply_for(cmd);
+
+  Sm sm;
+  sm_reset(&sm);
+
+  int replies = 0;
+  long fell = -1;
+  int prev_out = 1;
+  uint32_t got_reply = 0;
+  int got_bits = 0;
+  uint8_t got_cmd[2] = { 0, 0 };
+  int got_cmds = 0;
+
+  long end = (long) (frames[1].start + (HOST_FRAME_BITS + 4) * bit);
+  for (long t = 0; t < end; t++) {
+    sm_step(&sm, host_line(frames, 2, bit, t));
+
+    // the IRQ handler answers within the cycle it sees the byte in
+    while (sm.rx_count) {
+      got_cmd[got_cmds < 2 ? got_cmds : 1] = sm.rx[0] >> 24;
+      got_cmds++;
+      memmove(sm.rx, sm.rx + 1, --sm.rx_count * sizeof sm.rx[0]);
+      sm.tx[sm.tx_count++] = replies++ ? 0xffffffffu : want;
+    }
+
+    if (fell < 0 && prev_out && !sm.out_pin)
+      fell = t;
+    // sample the reply in the middle of each of its bits
+    if (fell >= 0 && got_bits < REPLY_BITS && t == fell + CLOCKS_PER_BIT / 2 + got_bits * CLOCKS_PER_BIT)
+      got_reply |= (uint32_t) sm.out_pin << got_bits++;
+    prev_out = sm.out_pin;
+  }
+
+  if (got_cmds != 2 || got_cmd[0] != cmd || got_cmd[1] != 0x10) {
+    printf("  command %02x: received %d bytes (%02x %02x)\n", cmd, got_cmds, got_cmd[0], got_cmd[1]);
+    return r;
+  }
+  if (want == 0xffffffffu) {
+    if (fell >= 0) {
+      printf("  command %02x: the line went low with nothing to send\n", cmd);
+      return r;
+    }
+    r.ok = true;
+    return r;
+  }
+  if (fell < 0 || got_reply != (want & ((1u << REPLY_BITS) - 1))) {
+    printf("  command %02x: reply %06x, wanted %06x\n", cmd, got_reply, want & ((1u << REPLY_BITS) - 1));
+    return r;
+  }
+  r.ok = true;
+  r.reply_start = fell - stop_end;
+  return r;
+}
+
+static void check_turnaround(double rate, double phase)
+{
+  bool ok = true;
+  double first = 0, lo = 1e9, hi = -1e9;
+  int first_cmd = -1;
+
+  for (int cmd = 0; cmd < 256; cmd++) {
+    Result r = run(cmd, rate, phase);
+    if (!r.ok) {
+      ok = false;
+      continue;
+    }
+    if (cmd == 0xef)
+      continue;
+    if (first_cmd < 0) {
+      first = r.reply_start;
+      first_cmd = cmd;
+    }
+    if (r.reply_start != first) {
+      printf("  command %02x: reply %.2f cycles after the stop bit, command %02x %.2f\n", cmd, r.reply_start,
+          first_cmd, first);
+      ok = false;
+    }
+    if (r.reply_start < lo)
+      lo = r.reply_start;
+    if (r.reply_start > hi)
+      hi = r.reply_start;
+  }
+  if (ok && (lo <= 0 || hi > 2 * CLOCKS_PER_BIT * rate)) {
+    printf("  reply %.2f to %.2f cycles after the stop bit\n", lo, hi);
+    ok = false;
+  }
+
+  printf("%s host clock %+.0f%%, start edge %.2f cycles in\n", ok ? "ok  " : "FAIL", (rate - 1) * 100, phase);
+  if (!ok)
+    s_failures++;
+}
+
+int main(int argc, char** argv)
+{
+  const char* path = argc > 1 ? argv[1] : "../../src/next_kms.pio";
+  if (!load_program(path))
+    return 1;
+
+  static const double rates[] = { 0.97, 1.0, 1.03 };
+  static const double phases[] = { 0, 0.25, 0.5, 0.75 };
+  for (size_t i = 0; i < sizeof rates / sizeof rates[0]; i++)
+    for (size_t j = 0; j < sizeof phases / sizeof phases[0]; j++)
+      check_turnaround(rates[i], phases[j]);
+
+  printf("%s\n", s_failures ? "FAILED" : "all passed");
+  return s_failures ? 1 : 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * Remap tests: src/remap.c's engine on an explicit state and clock.
+ *
+ *   make -C tools/sim test
+ *
+ * Compiles a rule set the way the console does (remap_compile), feeds key
+ * events through remap_event_at/remap_task_at and checks what would reach
+ * the host. The Sun preset is the one host_sun_keycodes.c installs.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "remap.h"
+#include "hid_codes.h"
+#include "host_sun_keycodes.h"
+
+// remap_event's own clock and cycle count, not used here
+systick_hw_t sim_systick;
+absolute_time_t get_absolute_time(void) { return 0; }
+
+static RemapConfig s_config;
+static RemapTable s_table;
+static RemapState s_state;
+
+static KeyboardEvent s_sent[32];
+static int s_sent_count;
+
+static int s_failures;
+
+static void load(const RemapRule* rules, uint count)
+{
+  memset(&s_config, 0, sizeof(s_config));
+  memcpy(s_config.rules, rules, count * sizeof(*rules));
+  s_config.rule_count = count;
+  if (!remap_compile(&s_table, &s_config)) {
+    printf("FAIL rules rejected\n");
+    s_failures++;
+  }
+  remap_state_reset(&s_state);
+  s_sent_count = 0;
+}
+
+static void record(const KeyboardEvent* out, uint n)
+{
+  for (uint i = 0; i < n; i++) {
+    if (s_sent_count < (int) (sizeof(s_sent) / sizeof(s_sent[0])))
+      s_sent[s_sent_count] = out[i];
+    s_sent_count++;
+  }
+}
+
+static void key(uint16_t keycode, bool down, uint32_t now_ms)
+{
+  KeyboardEvent out[REMAP_MAX_OUT];
+  KeyboardEvent ev = { .page = 0, .keycode = keycode, .down = down };
+  record(out, remap_event_at(&s_state, &s_table, ev, now_ms, out));
+}
+
+static void task(uint32_t now_ms)
+{
+  KeyboardEvent out[REMAP_MAX_OUT];
+  record(out, remap_task_at(&s_state, &s_table, now_ms, out));
+}
+
+// What the host got since the last check: keycode, down, keycode, down...
+static void expect(const char* name, const uint16_t* pairs, int n)
+{
+  bool ok = s_sent_count == n / 2;
+  for (int i = 0; ok && i < n / 2; i++)
+    ok = s_sent[i].keycode == pairs[2 * i] && s_sent[i].down == pairs[2 * i + 1];
+
+  printf("%s %s\n", ok ? "ok  " : "FAIL", name);
+  if (!ok) {
+    s_failures++;
+    printf("  host got %d events:", s_sent_count);
+    for (int i = 0; i < s_sent_count && i < (int) (sizeof(s_sent) / sizeof(s_sent[0])); i++)
+      printf(" %02x%s", s_sent[i].keycode, s_sent[i].down ? "v" : "^");
+    printf("\n");
+  }
+  s_sent_count = 0;
+}
+
+#define EXPECT(name, ...) do { \
+    const uint16_t pairs[] = { 0, ##__VA_ARGS__ }; \
+    expect(name, pairs + 1, sizeof(pairs) / sizeof(pairs[0]) - 1); \
+  } while (0)
+
+static void test_layer_holds(void)
+{
+  static const RemapRule rules[] = {
+    { .layer = 0, .key = HID_KEY_CAPS_LOCK, .type = RemapLayerHold, .a = 1 },
+    { .layer = 0, .key = HID_KEY_TAB, .type = RemapLayerHold, .a = 1 },
+    { .layer = 0, .key = HID_KEY_SPACE, .type = RemapTapHold, .a = HID_KEY_SPACE, .b = 1,
+      .flags = RemapFlagHoldLayer },
+    { .layer = 1, .key = HID_KEY_H, .type = RemapKey, .a = HID_KEY_ARROW_LEFT },
+  };
+  load(rules, sizeof(rules) / sizeof(rules[0]));
+
+  key(HID_KEY_CAPS_LOCK, true, 0);
+  key(HID_KEY_TAB, true, 10);
+  key(HID_KEY_CAPS_LOCK, false, 20);
+  key(HID_KEY_H, true, 30);
+  key(HID_KEY_H, false, 40);
+  EXPECT("two holds: the layer stays up while one is held", HID_KEY_ARROW_LEFT, 1, HID_KEY_ARROW_LEFT, 0);
+  key(HID_KEY_TAB, false, 50);
+  key(HID_KEY_H, true, 60);
+  key(HID_KEY_H, false, 70);
+  EXPECT("two holds: and drops with the last", HID_KEY_H, 1, HID_KEY_H, 0);
+
+  // a tap/hold key that resolved to the layer counts as one more hold
+  key(HID_KEY_SPACE, true, 100);
+  task(100 + REMAP_TAP_MS);
+  key(HID_KEY_CAPS_LOCK, true, 400);
+  key(HID_KEY_SPACE, false, 410);
+  key(HID_KEY_H, true, 420);
+  key(HID_KEY_H, false, 430);
+  EXPECT("tap/hold and hold: the layer outlives the tap/hold key", HID_KEY_ARROW_LEFT, 1, HID_KEY_ARROW_LEFT, 0);
+  key(HID_KEY_CAPS_LOCK, false, 440);
+  key(HID_KEY_H, true, 450);
+  key(HID_KEY_H, false, 460);
+  EXPECT("tap/hold and hold: gone after both", HID_KEY_H, 1, HID_KEY_H, 0);
+
+  // a key held across the layer change releases as what it was pressed as
+  key(HID_KEY_CAPS_LOCK, true, 500);
+  key(HID_KEY_H, true, 510);
+  key(HID_KEY_CAPS_LOCK, false, 520);
+  key(HID_KEY_H, false, 530);
+  EXPECT("held across the change: released as pressed", HID_KEY_ARROW_LEFT, 1, HID_KEY_ARROW_LEFT, 0);
+}
+
+static void test_other_keys(void)
+{
+  static const RemapRule rules[] = {
+    { .layer = 0, .key = HID_KEY_CAPS_LOCK, .type = RemapLayerHold, .a = 1 },
+    { .layer = 1, .key = HID_KEY_H, .type = RemapKey, .a = HID_KEY_ARROW_LEFT },
+    { .layer = 1, .type = RemapNone, .flags = RemapFlagOtherKeys },
+  };
+  load(rules, sizeof(rules) / sizeof(rules[0]));
+
+  key(HID_KEY_CAPS_LOCK, true, 0);
+  key(HID_KEY_J, true, 10);
+  key(HID_KEY_J, false, 20);
+  key(HID_KEY_H, true, 30);
+  key(HID_KEY_H, false, 40);
+  key(HID_KEY_CAPS_LOCK, false, 50);
+  EXPECT("other keys: swallowed, the key with a rule still mapped", HID_KEY_ARROW_LEFT, 1, HID_KEY_ARROW_LEFT, 0);
+  key(HID_KEY_J, true, 60);
+  key(HID_KEY_J, false, 70);
+  EXPECT("other keys: pass with the layer down", HID_KEY_J, 1, HID_KEY_J, 0);
+}
+
+static void test_sun_preset(void)
+{
+  load(sun_remap_preset, sun_remap_preset_count);
+
+  key(HID_KEY_LEFT_GUI, true, 0);
+  key(HID_KEY_F1, true, 10);
+  key(HID_KEY_F1, false, 20);
+  EXPECT("sun: GUI+F1 is Stop", HID_KEY_STOP, 1, HID_KEY_STOP, 0);
+  key(HID_KEY_K, true, 30);
+  key(HID_KEY_K, false, 40);
+  key(HID_KEY_ENTER, true, 50);
+  key(HID_KEY_ENTER, false, 60);
+  EXPECT("sun: GUI and a key the block doesn't have sends nothing");
+
+  key(HID_KEY_RIGHT_ALT, true, 70);
+  key(HID_KEY_LEFT_GUI, false, 80);
+  key(HID_KEY_X, true, 90);
+  key(HID_KEY_X, false, 100);
+  EXPECT("sun: right alt keeps the block after GUI is let go", HID_KEY_CUT, 1, HID_KEY_CUT, 0);
+  key(HID_KEY_RIGHT_ALT, false, 110);
+  EXPECT("sun: the hold keys themselves send nothing");
+
+  key(HID_KEY_K, true, 120);
+  key(HID_KEY_K, false, 130);
+  key(HID_KEY_F1, true, 140);
+  key(HID_KEY_F1, false, 150);
+  EXPECT("sun: keys pass once both are released", HID_KEY_K, 1, HID_KEY_K, 0, HID_KEY_F1, 1, HID_KEY_F1, 0);
+}
+
+int main(void)
+{
+  test_layer_holds();
+  test_other_keys();
+  test_sun_preset();
+
+  printf("%s\n", s_failures ? "FAILED" : "all passed");
+  return s_failures ? 1 : 0;
+}
@@ -0,0 +1,2 @@
+// Simulator stand-in for the pico-sdk/TinyUSB header of the same name
+#include "sim_shim.h"
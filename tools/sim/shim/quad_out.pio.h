@@ -0,0 +1,16 @@
+// Simulator stand-in for the header pioasm generates from src/quad_out.pio
+#include "sim_shim.h"
+
+static const uint16_t quad_out_program_instructions[] = { 0x6002 }; // out pins, 2
+
+static const pio_program_t quad_out_program = {
+    .instructions = quad_out_program_instructions,
+    .length = 1,
+    .origin = -1,
+};
+
+// One 2 bit state per clock, so 16 clocks per FIFO word
+static inline void quad_out_program_init(PIO pio, uint sm, uint offset, uint a_pin, uint32_t edge_rate_hz)
+{
+    sim_pio_sm_start(pio, sm, a_pin, (float) edge_rate_hz, 16);
+}
@@ -0,0 +1,254 @@
+#ifndef SIM_SHIM_H_
+#define SIM_SHIM_H_
+
+/*
+ * Just enough of the pico-sdk and TinyUSB for the host emulation modules
+ * (host_*.c, bootmode.c) to build and run on Linux. UARTs are backed by
+ * pseudo-terminals and "IRQs" are called from the simulator's poll loop;
+ * see sim.c.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef unsigned int uint;
+
+// pico/platform.h
+#define __not_in_flash(group)
+#define __not_in_flash_func(f) f
+#define __no_inline_not_in_flash_func(f) f
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+
+// pico/time.h
+typedef uint64_t absolute_time_t;
+
+absolute_time_t get_absolute_time(void);
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+void sleep_ms(uint32_t ms);
+void busy_wait_ms(uint32_t ms);
+static inline void tight_loop_contents(void) {}
+void busy_wait_us(uint64_t us);
+
+static inline uint32_t to_ms_since_boot(absolute_time_t t)
+{
+    return (uint32_t) (t / 1000);
+}
+
+// hardware/uart.h
+typedef struct uart_inst uart_inst_t;
+
+extern uart_inst_t* const sim_uart0;
+extern uart_inst_t* const sim_uart1;
+#define uart0 sim_uart0
+#define uart1 sim_uart1
+
+typedef enum {
+    UART_PARITY_NONE,
+    UART_PARITY_EVEN,
+    UART_PARITY_ODD
+} uart_parity_t;
+
+uint uart_init(uart_inst_t* uart, uint baudrate);
+void uart_set_hw_flow(uart_inst_t* uart, bool cts, bool rts);
+void uart_set_format(uart_inst_t* uart, uint data_bits, uint stop_bits, uart_parity_t parity);
+void uart_set_irq_enables(uart_inst_t* uart, bool rx_has_data, bool tx_needs_data);
+void uart_putc_raw(uart_inst_t* uart, char c);
+bool uart_is_readable(uart_inst_t* uart);
+char uart_getc(uart_inst_t* uart);
+
+// TX takes wire time at the baud rate and format set: the 32 byte FIFO
+// fills up and BUSY stays set until the last stop bit is out
+typedef struct {
+    volatile uint32_t fr;
+} uart_hw_t;
+
+#define UART_UARTFR_BUSY_BITS 0x00000008
+
+bool uart_is_writable(uart_inst_t* uart);
+uart_hw_t* uart_get_hw(uart_inst_t* uart);
+
+// hardware/irq.h
+#define UART0_IRQ 20
+#define UART1_IRQ 21
+
+typedef void (*irq_handler_t)(void);
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool enabled);
+
+// hardware/sync.h, there is only the one thread
+static inline uint32_t save_and_disable_interrupts(void)
+{
+    return 0;
+}
+
+static inline void restore_interrupts(uint32_t status)
+{
+}
+
+static inline void __dmb(void)
+{
+}
+
+// hardware/gpio.h
+#define GPIO_IN false
+#define GPIO_OUT true
+
+void gpio_init(uint gpio);
+void gpio_put(uint gpio, bool value);
+void gpio_set_dir(uint gpio, bool out);
+// Inputs read high (an idle UART line) unless sim.c says otherwise
+bool gpio_get(uint gpio);
+
+// hardware/clocks.h, the default system clock
+enum clock_index { clk_sys };
+
+static inline uint32_t clock_get_hz(enum clock_index clk)
+{
+    return 125000000;
+}
+
+// hardware/pio.h, the TX FIFO side of a state machine only (sim_pio.c)
+typedef struct pio_inst* PIO;
+
+extern struct pio_inst* const sim_pio0;
+extern struct pio_inst* const sim_pio1;
+#define pio0 sim_pio0
+#define pio1 sim_pio1
+
+typedef struct {
+    const uint16_t* instructions;
+    uint8_t length;
+    int8_t origin;
+} pio_program_t;
+
+bool pio_can_add_program(PIO pio, const pio_program_t* program);
+uint pio_add_program(PIO pio, const pio_program_t* program);
+int pio_claim_unused_sm(PIO pio, bool required);
+void pio_sm_unclaim(PIO pio, uint sm);
+uint pio_get_index(PIO pio);
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm);
+void pio_sm_put(PIO pio, uint sm, uint32_t data);
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div);
+
+// Stands in for a program's c-sdk init: the state machine starts taking one
+// FIFO word per 'clocks_per_word' clocks at 'clk_hz', and each word is
+// decoded as 16 quadrature states for the edge counts
+void sim_pio_sm_start(PIO pio, uint sm, uint pin, float clk_hz, uint clocks_per_word);
+void sim_pio_print_stats(void);
+
+// hardware/structs/systick.h, isr_stats.h reads the current value
+typedef struct {
+    volatile uint32_t csr;
+    volatile uint32_t rvr;
+    volatile uint32_t cvr;
+    volatile uint32_t calib;
+} systick_hw_t;
+
+extern systick_hw_t sim_systick;
+#define systick_hw (&sim_systick)
+
+// class/hid/hid.h, interface protocols (hid_quirks.c)
+enum {
+    HID_ITF_PROTOCOL_NONE = 0,
+    HID_ITF_PROTOCOL_KEYBOARD = 1,
+    HID_ITF_PROTOCOL_MOUSE = 2,
+};
+
+// class/hid/hid.h, the boot protocol reports and their bits
+typedef struct __attribute__((packed)) {
+    uint8_t modifier;
+    uint8_t reserved;
+    uint8_t keycode[6];
+} hid_keyboard_report_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t buttons;
+    int8_t x;
+    int8_t y;
+    int8_t wheel;
+    int8_t pan;
+} hid_mouse_report_t;
+
+typedef enum {
+    KEYBOARD_MODIFIER_LEFTCTRL   = 1 << 0,
+    KEYBOARD_MODIFIER_LEFTSHIFT  = 1 << 1,
+    KEYBOARD_MODIFIER_LEFTALT    = 1 << 2,
+    KEYBOARD_MODIFIER_LEFTGUI    = 1 << 3,
+    KEYBOARD_MODIFIER_RIGHTCTRL  = 1 << 4,
+    KEYBOARD_MODIFIER_RIGHTSHIFT = 1 << 5,
+    KEYBOARD_MODIFIER_RIGHTALT   = 1 << 6,
+    KEYBOARD_MODIFIER_RIGHTGUI   = 1 << 7
+} hid_keyboard_modifier_bm_t;
+
+typedef enum {
+    KEYBOARD_LED_NUMLOCK    = 1 << 0,
+    KEYBOARD_LED_CAPSLOCK   = 1 << 1,
+    KEYBOARD_LED_SCROLLLOCK = 1 << 2,
+    KEYBOARD_LED_COMPOSE    = 1 << 3,
+    KEYBOARD_LED_KANA       = 1 << 4
+} hid_keyboard_led_bm_t;
+
+typedef enum {
+    MOUSE_BUTTON_LEFT     = 1 << 0,
+    MOUSE_BUTTON_RIGHT    = 1 << 1,
+    MOUSE_BUTTON_MIDDLE   = 1 << 2,
+    MOUSE_BUTTON_BACKWARD = 1 << 3,
+    MOUSE_BUTTON_FORWARD  = 1 << 4,
+} hid_mouse_button_bm_t;
+
+// class/hid/hid.h keycodes under the TinyUSB names the hosts use; the rest
+// of the usages come from the repo's own hid_codes.h
+#define HID_KEY_1                       0x1E
+#define HID_KEY_2                       0x1F
+#define HID_KEY_3                       0x20
+#define HID_KEY_4                       0x21
+#define HID_KEY_5                       0x22
+#define HID_KEY_6                       0x23
+#define HID_KEY_7                       0x24
+#define HID_KEY_8                       0x25
+#define HID_KEY_9                       0x26
+#define HID_KEY_0                       0x27
+#define HID_KEY_SPACE                   0x2C
+#define HID_KEY_MINUS                   0x2D
+#define HID_KEY_EQUAL                   0x2E
+#define HID_KEY_BRACKET_LEFT            0x2F
+#define HID_KEY_BRACKET_RIGHT           0x30
+#define HID_KEY_BACKSLASH               0x31
+#define HID_KEY_SEMICOLON               0x33
+#define HID_KEY_APOSTROPHE              0x34
+#define HID_KEY_GRAVE                   0x35
+#define HID_KEY_COMMA                   0x36
+#define HID_KEY_PERIOD                  0x37
+#define HID_KEY_SLASH                   0x38
+#define HID_KEY_PRINT_SCREEN            0x46
+#define HID_KEY_PAGE_UP                 0x4B
+#define HID_KEY_END                     0x4D
+#define HID_KEY_PAGE_DOWN               0x4E
+#define HID_KEY_ARROW_RIGHT             0x4F
+#define HID_KEY_ARROW_LEFT              0x50
+#define HID_KEY_ARROW_DOWN              0x51
+#define HID_KEY_ARROW_UP                0x52
+#define HID_KEY_NUM_LOCK                0x53
+#define HID_KEY_KEYPAD_DIVIDE           0x54
+#define HID_KEY_KEYPAD_MULTIPLY         0x55
+#define HID_KEY_KEYPAD_SUBTRACT         0x56
+#define HID_KEY_KEYPAD_ADD              0x57
+#define HID_KEY_KEYPAD_1                0x59
+#define HID_KEY_KEYPAD_2                0x5A
+#define HID_KEY_KEYPAD_3                0x5B
+#define HID_KEY_KEYPAD_4                0x5C
+#define HID_KEY_KEYPAD_6                0x5E
+#define HID_KEY_KEYPAD_7                0x5F
+#define HID_KEY_KEYPAD_8                0x60
+#define HID_KEY_KEYPAD_9                0x61
+#define HID_KEY_KEYPAD_0                0x62
+#define HID_KEY_EUROPE_2                0x64
+#define HID_KEY_GUI_LEFT                0xE3
+#define HID_KEY_GUI_RIGHT               0xE7
+
+#endif
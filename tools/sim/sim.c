@@ -0,0 +1,737 @@
+/*
+ * Babelfish host simulator.
+ *
+ * Runs the real host emulation modules (host_apollo.c, host_sun*.c,
+ * host_quad.c, host_pcmouse.c) and the boot report translation (bootmode.c)
+ * on Linux. Every UART a host opens
+ * becomes a pseudo-terminal that an emulator's serial keyboard/mouse port
+ * (MAME's, say) can be attached to. Input comes from local evdev devices or
+ * from a HID trace recorded on the device ('rec dump', tools/hid_trace.py).
+ *
+ *   make -C tools/sim
+ *   tools/sim/babelfish_sim -H apollo -a /tmp/apollo-kbd -e /dev/input/event3
+ *   tools/sim/babelfish_sim -H sun -a /tmp/sun-kbd -b /tmp/sun-mouse -t kbd.trace -q
+ *   tools/sim/babelfish_sim -H quad -c "quad rate 4000" -M 127:0:200 -q
+ *   tools/sim/babelfish_sim -H pcmouse -c "pcmouse logitech" -R 200 -M 50:20:1000 -q
+ *
+ * Host RX is delivered by calling the handler the host registered for the
+ * UART IRQ from the poll loop; the mainloop part (event dispatch and
+ * host->update) runs about once a millisecond, like on the device.
+ *
+ * On exit (ctrl-C, or the end of the trace with -q) it prints how long
+ * inputs took to turn into the first byte handed to the UART, and the byte
+ * counts per channel. The UARTs take wire time at their baud rate and
+ * format, so hosts that wait for the line to go idle pace themselves as on
+ * the device; the latency numbers stop at the UART and don't include it.
+ *
+ * Hosts that drive PIO state machines run against the FIFO model in
+ * sim_pio.c instead; -M moves the mouse at a steady rate for a while, to see
+ * how far behind the wire falls (its stats are printed on exit too).
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEBUG_TAG "sim"
+#include "babelfish.h"
+#include "console.h"
+#include "isr_stats.h"
+#include "kbd_leds.h"
+#include "keymap.h"
+#include "remap.h"
+#include "sim.h"
+
+DBG_MODULE();
+
+HOST_PROTOTYPES(sun);
+HOST_PROTOTYPES(apollo);
+HOST_PROTOTYPES(quad);
+HOST_PROTOTYPES(pcmouse);
+
+extern void quad_console_cmd(int argc, char** argv);
+extern void pcmouse_console_cmd(int argc, char** argv);
+extern void remap_console_cmd(int argc, char** argv);
+
+HostDevice hosts[] = {
+  HOST_ENTRY(sun, "Sun emulation. Ch A keyboard, Ch B mouse."),
+  HOST_ENTRY(apollo, "Apollo emulation. Ch A keyboard and mouse."),
+  HOST_ENTRY(quad, "Quadrature mouse. Ch A X, Ch B Y, buttons on GPIO14/15."),
+  HOST_ENTRY(pcmouse, "PC serial mouse. Ch B TX data, RX from RTS."),
+  { .name = "" }
+};
+
+HostDevice *host = NULL;
+int g_current_host_index = 0;
+
+ChannelConfig channels[NUM_CHANNELS] = {
+  { .channel_num = 0, .uart_num = 0, .tx_gpio = TX_A_GPIO, .rx_gpio = RX_A_GPIO },
+  { .channel_num = 1, .uart_num = 1, .tx_gpio = TX_B_GPIO, .rx_gpio = RX_B_GPIO },
+};
+
+// isr_stats.h instrumentation in the host RX handlers
+IsrStat isr_stats[IsrStatCount];
+volatile uint32_t isr_nested_cycles = 0;
+systick_hw_t sim_systick;
+
+//
+// Time
+//
+
+static uint64_t s_start_us;
+static bool s_hexdump = false;
+
+static uint64_t mono_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t time_us_64(void) { return mono_us() - s_start_us; }
+uint32_t time_us_32(void) { return (uint32_t) time_us_64(); }
+absolute_time_t get_absolute_time(void) { return time_us_64(); }
+
+void busy_wait_us(uint64_t us)
+{
+  struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000 };
+  while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+    ;
+}
+
+void busy_wait_ms(uint32_t ms) { busy_wait_us((uint64_t) ms * 1000); }
+void sleep_ms(uint32_t ms) { busy_wait_us((uint64_t) ms * 1000); }
+
+//
+// Latency
+//
+// Keyboard events are timed from arrival to the first byte the host sends
+// while handling them; mouse events from the first unsent one to the next
+// byte sent while handling mouse events or in host->update (the hosts batch
+// mouse motion).
+//
+
+typedef struct {
+  uint32_t count;
+  uint32_t silent; // handled without sending anything
+  uint64_t total_us;
+  uint64_t max_us;
+} LatencyStat;
+
+typedef enum {
+  DispatchNone,
+  DispatchKbd,
+  DispatchMouse,
+  DispatchUpdate,
+} DispatchKind;
+
+static uint64_t s_input_at = 0;
+static DispatchKind s_dispatch = DispatchNone;
+static uint64_t s_kbd_at = 0;     // arrival of the keyboard event being dispatched
+static uint64_t s_mouse_at = 0;   // arrival of the oldest unsent mouse event, 0 if none
+static LatencyStat s_kbd_latency, s_mouse_latency;
+
+void sim_input_arrived(void)
+{
+  s_input_at = mono_us();
+}
+
+static void latency_record(LatencyStat* s, uint64_t since)
+{
+  uint64_t us = mono_us() - since;
+  s->count++;
+  s->total_us += us;
+  if (us > s->max_us)
+    s->max_us = us;
+}
+
+static void latency_on_tx(void)
+{
+  if (s_dispatch == DispatchKbd && s_kbd_at) {
+    latency_record(&s_kbd_latency, s_kbd_at);
+    s_kbd_at = 0;
+  } else if ((s_dispatch == DispatchMouse || s_dispatch == DispatchUpdate) && s_mouse_at) {
+    latency_record(&s_mouse_latency, s_mouse_at);
+    s_mouse_at = 0;
+  }
+}
+
+static void latency_print(const char* name, const LatencyStat* s)
+{
+  fprintf(stderr, "  %-6s %6u events, first byte avg %6.2f ms max %6.2f ms, %u sent nothing\n", name,
+      s->count, s->count ? s->total_us / 1000.0 / s->count : 0.0, s->max_us / 1000.0, s->silent);
+}
+
+//
+// Event queues, as in main.c but single threaded
+//
+
+static KeyboardEvent s_kbd_queue[MAX_QUEUED_EVENTS];
+static uint64_t s_kbd_queue_at[MAX_QUEUED_EVENTS];
+static uint s_kbd_queue_count = 0;
+static MouseEvent s_mouse_queue[MAX_QUEUED_EVENTS];
+static uint64_t s_mouse_queue_at[MAX_QUEUED_EVENTS];
+static uint s_mouse_queue_count = 0;
+
+bool enqueue_kbd_event(const KeyboardEvent* event)
+{
+  if (s_kbd_queue_count >= MAX_QUEUED_EVENTS)
+    return false;
+  s_kbd_queue_at[s_kbd_queue_count] = s_input_at;
+  s_kbd_queue[s_kbd_queue_count++] = *event;
+  return true;
+}
+
+bool enqueue_mouse_event(const MouseEvent* event)
+{
+  if (s_mouse_queue_count >= MAX_QUEUED_EVENTS)
+    return false;
+  s_mouse_queue_at[s_mouse_queue_count] = s_input_at;
+  s_mouse_queue[s_mouse_queue_count++] = *event;
+  return true;
+}
+
+static void dispatch_events(void)
+{
+  for (uint i = 0; i < s_kbd_queue_count; i++) {
+    s_dispatch = DispatchKbd;
+    s_kbd_at = s_kbd_queue_at[i];
+    // through the remap stage, as in main.c
+    KeyboardEvent out[REMAP_MAX_OUT];
+    uint n = remap_event(s_kbd_queue[i], out);
+    for (uint j = 0; j < n; j++)
+      HOST_KBD_EVENT(out[j]);
+    if (s_kbd_at) {
+      s_kbd_latency.silent++;
+      s_kbd_at = 0;
+    }
+  }
+  s_kbd_queue_count = 0;
+
+  KeyboardEvent out[REMAP_MAX_OUT];
+  uint n = remap_task(out);
+  for (uint j = 0; j < n; j++)
+    HOST_KBD_EVENT(out[j]);
+
+  for (uint i = 0; i < s_mouse_queue_count; i++) {
+    s_dispatch = DispatchMouse;
+    if (!s_mouse_at)
+      s_mouse_at = s_mouse_queue_at[i];
+    HOST_MOUSE_EVENT(s_mouse_queue[i]);
+  }
+  s_mouse_queue_count = 0;
+
+  s_dispatch = DispatchUpdate;
+  HOST_UPDATE();
+  s_dispatch = DispatchNone;
+}
+
+// Hosts always run on their compiled-in keymaps here
+void keymap_register(KeymapKind kind, const void* builtin, uint32_t length, const void* volatile* live,
+    KeymapLookup lookup, uint8_t layers, uint8_t states)
+{
+  *live = builtin;
+}
+
+// LED commands from the host land here; there is no USB keyboard to send them to
+KbdLedsRequest kbd_leds_request;
+
+//
+// Channels, GPIO and UARTs
+//
+
+void channel_config(int ch, ChannelMode mode)
+{
+  DBG("Channel %c set config: 0x%08x\n", 'A' + ch, mode);
+  channels[ch].mode = mode;
+}
+
+static uint32_t s_gpio_out;
+static uint32_t s_gpio_dir;
+
+void gpio_init(uint gpio)
+{
+  s_gpio_out &= ~(1u << gpio);
+  s_gpio_dir &= ~(1u << gpio);
+}
+
+void gpio_put(uint gpio, bool value)
+{
+  s_gpio_out = (s_gpio_out & ~(1u << gpio)) | ((uint32_t) value << gpio);
+}
+
+// -R: the PC drops RTS (channel B RX) for a while to reset the mouse
+static uint32_t s_rts_off_ms = 0;
+#define SIM_RTS_OFF_AT_MS 50
+
+bool gpio_get(uint gpio)
+{
+  if (s_rts_off_ms && gpio == channels[1].rx_gpio) {
+    uint64_t ms = time_us_64() / 1000;
+    return ms >= SIM_RTS_OFF_AT_MS && ms < SIM_RTS_OFF_AT_MS + s_rts_off_ms;
+  }
+  return true;
+}
+
+void gpio_set_dir(uint gpio, bool out)
+{
+  uint32_t old = s_gpio_dir;
+  s_gpio_dir = (s_gpio_dir & ~(1u << gpio)) | ((uint32_t) out << gpio);
+  if (s_hexdump && old != s_gpio_dir)
+    fprintf(stderr, "[%10.3f] gpio%u %s\n", time_us_64() / 1000.0, gpio,
+        out ? ((s_gpio_out >> gpio) & 1 ? "high" : "low") : "released");
+}
+
+struct uart_inst {
+  int num;
+  int master;
+  int slave;
+  const char* link;
+  uint baudrate;
+  uint frame_bits;
+  uint64_t wire_until_us; // when the last byte handed over has been sent
+  uart_hw_t hw;
+  bool rx_irq;
+  uint64_t tx_bytes;
+  uint64_t tx_dropped;
+  uint64_t rx_bytes;
+};
+
+static struct uart_inst s_uarts[2] = {
+  { .num = 0, .master = -1, .slave = -1 },
+  { .num = 1, .master = -1, .slave = -1 },
+};
+
+uart_inst_t* const sim_uart0 = &s_uarts[0];
+uart_inst_t* const sim_uart1 = &s_uarts[1];
+
+static irq_handler_t s_irq_handlers[32];
+static bool s_irq_enabled[32];
+
+static void uart_open_pty(struct uart_inst* u)
+{
+  if (u->master >= 0)
+    return;
+
+  u->master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (u->master < 0 || grantpt(u->master) < 0 || unlockpt(u->master) < 0) {
+    perror("posix_openpt");
+    exit(1);
+  }
+
+  const char* name = ptsname(u->master);
+
+  // Hold the slave open so writes don't fail before the emulator attaches,
+  // and make it raw so the line discipline leaves the bytes alone.
+  u->slave = open(name, O_RDWR | O_NOCTTY);
+  struct termios t;
+  tcgetattr(u->slave, &t);
+  cfmakeraw(&t);
+  tcsetattr(u->slave, TCSANOW, &t);
+
+  if (u->link) {
+    unlink(u->link);
+    if (symlink(name, u->link) < 0)
+      perror(u->link);
+  }
+
+  fprintf(stderr, "channel %c (uart%d): %s%s%s\n", 'A' + u->num, u->num, name,
+      u->link ? " -> " : "", u->link ? u->link : "");
+}
+
+uint uart_init(uart_inst_t* uart, uint baudrate)
+{
+  uart_open_pty(uart);
+  uart->baudrate = baudrate;
+  uart->frame_bits = 10;
+  return baudrate;
+}
+
+void uart_set_hw_flow(uart_inst_t* uart, bool cts, bool rts) { }
+
+void uart_set_format(uart_inst_t* uart, uint data_bits, uint stop_bits, uart_parity_t parity)
+{
+  uart->frame_bits = 1 + data_bits + (parity != UART_PARITY_NONE) + stop_bits;
+}
+
+static uint64_t uart_char_us(const struct uart_inst* uart)
+{
+  return uart->baudrate ? (uint64_t) uart->frame_bits * 1000000 / uart->baudrate : 0;
+}
+
+bool uart_is_writable(uart_inst_t* uart)
+{
+  return uart->wire_until_us < time_us_64() + 32 * uart_char_us(uart);
+}
+
+uart_hw_t* uart_get_hw(uart_inst_t* uart)
+{
+  uart->hw.fr = uart->wire_until_us > time_us_64() ? UART_UARTFR_BUSY_BITS : 0;
+  return &uart->hw;
+}
+
+void uart_set_irq_enables(uart_inst_t* uart, bool rx_has_data, bool tx_needs_data)
+{
+  uart->rx_irq = rx_has_data;
+}
+
+void uart_putc_raw(uart_inst_t* uart, char c)
+{
+  uart_open_pty(uart);
+
+  latency_on_tx();
+
+  if (s_hexdump)
+    fprintf(stderr, "[%10.3f] %c tx %02x\n", time_us_64() / 1000.0, 'A' + uart->num, (uint8_t) c);
+
+  uint64_t now = time_us_64();
+  uart->wire_until_us = (uart->wire_until_us > now ? uart->wire_until_us : now) + uart_char_us(uart);
+
+  if (write(uart->master, &c, 1) == 1)
+    uart->tx_bytes++;
+  else
+    uart->tx_dropped++; // nobody reading and the pty buffer is full
+}
+
+bool uart_is_readable(uart_inst_t* uart)
+{
+  struct pollfd pfd = { .fd = uart->master, .events = POLLIN };
+  return uart->master >= 0 && poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+}
+
+char uart_getc(uart_inst_t* uart)
+{
+  uint8_t c;
+  for (;;) {
+    ssize_t n = read(uart->master, &c, 1);
+    if (n == 1)
+      break;
+    struct pollfd pfd = { .fd = uart->master, .events = POLLIN };
+    poll(&pfd, 1, -1);
+  }
+
+  uart->rx_bytes++;
+  if (s_hexdump)
+    fprintf(stderr, "[%10.3f] %c rx %02x\n", time_us_64() / 1000.0, 'A' + uart->num, c);
+  return (char) c;
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) { s_irq_handlers[num] = handler; }
+void irq_set_enabled(uint num, bool enabled) { s_irq_enabled[num] = enabled; }
+
+static irq_handler_t uart_rx_handler(const struct uart_inst* u)
+{
+  uint irq = u->num == 0 ? UART0_IRQ : UART1_IRQ;
+  if (u->master < 0 || !u->rx_irq || !s_irq_enabled[irq])
+    return NULL;
+  return s_irq_handlers[irq];
+}
+
+//
+// Logging
+//
+
+static DbgTag* s_dbg_tags = NULL;
+
+void dbg_tag_register(DbgTag* tag)
+{
+  tag->next = s_dbg_tags;
+  s_dbg_tags = tag;
+}
+
+bool debug_tu_log_enabled() { return false; }
+
+void dbg(const char* tag, const char* fmt, ...)
+{
+  if (tag)
+    fprintf(stderr, "[%10.3f] (%s) ", time_us_64() / 1000.0, tag);
+
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+}
+
+// No ring here: the sim's "ISRs" run on the one thread, so just format it
+void dbg_isr(const char* tag, const char* fmt, const uintptr_t args[4])
+{
+  dbg(tag, fmt, args[0], args[1], args[2], args[3]);
+}
+
+void console_printf(const char* fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+}
+
+static void set_log_level(const char* arg)
+{
+  const char* eq = strchr(arg, '=');
+  if (!eq) {
+    fprintf(stderr, "-l wants tag=level\n");
+    exit(1);
+  }
+
+  size_t len = eq - arg;
+  bool all = len == 3 && strncmp(arg, "all", 3) == 0;
+  for (DbgTag* t = s_dbg_tags; t; t = t->next) {
+    if (all || (strlen(t->name) == len && strncmp(t->name, arg, len) == 0))
+      t->level = atoi(eq + 1);
+  }
+}
+
+//
+// Console commands of the hosts built in, run with -c
+//
+
+static const ConsoleCommand s_commands[] = {
+  { "quad", quad_console_cmd, NULL },
+  { "pcmouse", pcmouse_console_cmd, NULL },
+  { "remap", remap_console_cmd, NULL },
+  { 0 }
+};
+
+static void run_command(const char* line)
+{
+  char buf[CONSOLE_MAX_LINE + 1];
+  char* argv[CONSOLE_MAX_ARGS];
+  int argc = 0;
+
+  snprintf(buf, sizeof(buf), "%s", line);
+  for (char* tok = strtok(buf, " "); tok && argc < CONSOLE_MAX_ARGS; tok = strtok(NULL, " "))
+    argv[argc++] = tok;
+  if (argc == 0)
+    return;
+
+  for (const ConsoleCommand* c = s_commands; c->name; c++) {
+    if (strcmp(c->name, argv[0]) == 0) {
+      c->fn(argc, argv);
+      return;
+    }
+  }
+  fprintf(stderr, "no command '%s'\n", argv[0]);
+}
+
+//
+// Synthetic mouse motion, -M dx:dy:ms
+//
+
+static struct {
+  int dx, dy;
+  uint64_t until_us;
+  bool running;
+} s_motion;
+
+// One report per millisecond while it runs; false once it has ended
+static bool motion_poll(void)
+{
+  if (!s_motion.running)
+    return false;
+  if (time_us_64() >= s_motion.until_us) {
+    s_motion.running = false;
+    fprintf(stderr, "motion done at %.3f ms\n", time_us_64() / 1000.0);
+    return false;
+  }
+
+  MouseEvent event = { .dx = s_motion.dx, .dy = s_motion.dy };
+  sim_input_arrived();
+  enqueue_mouse_event(&event);
+  return true;
+}
+
+//
+// main
+//
+
+static volatile sig_atomic_t s_quit = 0;
+
+static void on_signal(int sig)
+{
+  s_quit = 1;
+}
+
+static void usage(void)
+{
+  fprintf(stderr,
+      "usage: babelfish_sim [-H host] [-a link] [-b link] [-e evdev [-g]] [-t trace [-s speed] [-q]]\n"
+      "                     [-M dx:dy:ms [-q]] [-R ms] [-c cmd] [-x] [-l tag=level]\n"
+      "  -H host    host to emulate: sun, apollo, quad, pcmouse (default apollo)\n"
+      "  -a/-b link symlink to create for the channel A/B pseudo-terminal\n"
+      "  -e evdev   read keys/mouse from /dev/input/eventN (may be repeated)\n"
+      "  -g         grab the evdev devices so they don't also reach the desktop\n"
+      "  -t trace   replay a HID trace from 'rec dump' / tools/hid_trace.py\n"
+      "  -s speed   trace playback speed, 0 for as fast as possible (default 1)\n"
+      "  -k d:i     treat trace reports from dev d, instance i as keyboard reports\n"
+      "  -m d:i     treat trace reports from dev d, instance i as mouse reports\n"
+      "  -M d:d:ms  move the mouse by dx,dy every millisecond for ms milliseconds\n"
+      "  -q         quit once the trace or the motion has been played\n"
+      "  -R ms      drop RTS (channel B RX) for ms milliseconds, 50 ms in\n"
+      "  -c cmd     run a host console command after init, e.g. \"quad rate 4000\"\n"
+      "  -x         log every byte sent and received\n"
+      "  -l t=n     log level n for tag t ('all' for every tag)\n");
+  exit(1);
+}
+
+int main(int argc, char** argv)
+{
+  const char* host_name = "apollo";
+  const char* evdev_paths[4];
+  int evdev_count = 0;
+  bool grab = false;
+  const char* trace_path = NULL;
+  double speed = 1.0;
+  bool quit_at_end = false;
+  const char* commands[8];
+  int command_count = 0;
+  int motion_ms = 0;
+
+  s_start_us = mono_us();
+
+  int opt;
+  while ((opt = getopt(argc, argv, "H:a:b:e:gt:s:k:m:M:R:c:qxl:h")) != -1) {
+    int dev, inst;
+    switch (opt) {
+      case 'H': host_name = optarg; break;
+      case 'a': s_uarts[0].link = optarg; break;
+      case 'b': s_uarts[1].link = optarg; break;
+      case 'e':
+        if (evdev_count < 4)
+          evdev_paths[evdev_count++] = optarg;
+        break;
+      case 'g': grab = true; break;
+      case 't': trace_path = optarg; break;
+      case 's': speed = atof(optarg); break;
+      case 'k':
+      case 'm':
+        if (sscanf(optarg, "%d:%d", &dev, &inst) != 2)
+          usage();
+        sim_trace_force(dev, inst, opt == 'k');
+        break;
+      case 'M':
+        if (sscanf(optarg, "%d:%d:%d", &s_motion.dx, &s_motion.dy, &motion_ms) != 3)
+          usage();
+        break;
+      case 'R': s_rts_off_ms = atoi(optarg); break;
+      case 'c':
+        if (command_count < 8)
+          commands[command_count++] = optarg;
+        break;
+      case 'q': quit_at_end = true; break;
+      case 'x': s_hexdump = true; break;
+      case 'l': set_log_level(optarg); break;
+      default: usage();
+    }
+  }
+
+  for (int i = 0; hosts[i].name[0]; i++) {
+    if (strcmp(hosts[i].name, host_name) == 0) {
+      g_current_host_index = i;
+      host = &hosts[i];
+    }
+  }
+  if (!host) {
+    fprintf(stderr, "unknown host '%s'\n", host_name);
+    usage();
+  }
+
+  int evdev_fds[4];
+  for (int i = 0; i < evdev_count; i++) {
+    evdev_fds[i] = sim_evdev_open(evdev_paths[i], grab);
+    if (evdev_fds[i] < 0)
+      return 1;
+  }
+
+  if (trace_path && !sim_trace_open(trace_path, speed))
+    return 1;
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  fprintf(stderr, "host '%s': %s\n", host->name, host->notes);
+  HOST_INIT();
+
+  for (int i = 0; i < command_count; i++)
+    run_command(commands[i]);
+
+  if (motion_ms > 0) {
+    s_motion.running = true;
+    s_motion.until_us = time_us_64() + (uint64_t) motion_ms * 1000;
+  }
+
+  bool trace_running = trace_path != NULL;
+  uint64_t quit_at = 0;
+
+  while (!s_quit) {
+    struct pollfd pfd[2 + 4];
+    irq_handler_t rx_handlers[2];
+    int n = 0;
+
+    for (int u = 0; u < 2; u++) {
+      rx_handlers[u] = uart_rx_handler(&s_uarts[u]);
+      pfd[n++] = (struct pollfd) { .fd = rx_handlers[u] ? s_uarts[u].master : -1, .events = POLLIN };
+    }
+    for (int i = 0; i < evdev_count; i++)
+      pfd[n++] = (struct pollfd) { .fd = evdev_fds[i], .events = POLLIN };
+
+    poll(pfd, n, 1);
+
+    // host RX "interrupts"
+    for (int u = 0; u < 2; u++) {
+      if (rx_handlers[u] && (pfd[u].revents & POLLIN))
+        rx_handlers[u]();
+    }
+
+    for (int i = 0; i < evdev_count; i++) {
+      if ((pfd[2 + i].revents & (POLLIN | POLLERR | POLLHUP)) && !sim_evdev_read(evdev_fds[i])) {
+        fprintf(stderr, "%s went away\n", evdev_paths[i]);
+        s_quit = 1;
+      }
+    }
+
+    if (trace_running && !sim_trace_poll()) {
+      trace_running = false;
+      fprintf(stderr, "trace done\n");
+      // give batched mouse motion a chance to go out
+      if (quit_at_end)
+        quit_at = mono_us() + 500 * 1000;
+    }
+
+    if (s_motion.running && !motion_poll() && quit_at_end && !trace_running)
+      quit_at = mono_us() + 500 * 1000;
+
+    dispatch_events();
+
+    if (quit_at && mono_us() >= quit_at)
+      break;
+  }
+
+  fprintf(stderr, "\nlatency, input to first byte handed to the UART:\n");
+  latency_print("kbd", &s_kbd_latency);
+  latency_print("mouse", &s_mouse_latency);
+  for (int u = 0; u < 2; u++) {
+    struct uart_inst* ui = &s_uarts[u];
+    if (ui->master < 0)
+      continue;
+    fprintf(stderr, "channel %c: %u baud, tx %llu bytes (%llu dropped), rx %llu bytes\n", 'A' + u, ui->baudrate,
+        (unsigned long long) ui->tx_bytes, (unsigned long long) ui->tx_dropped, (unsigned long long) ui->rx_bytes);
+    if (ui->link)
+      unlink(ui->link);
+  }
+  sim_pio_print_stats();
+  for (const ConsoleCommand* c = s_commands; c->name; c++) {
+    if (strcmp(host->name, c->name) == 0)
+      run_command(c->name);
+  }
+
+  return 0;
+}
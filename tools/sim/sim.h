@@ -0,0 +1,23 @@
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Note that an input event is about to be queued, so the next byte a host
+// sends can be matched to it for the latency numbers
+void sim_input_arrived(void);
+
+// evdev keyboard/mouse (sim_input.c)
+int sim_evdev_open(const char* path, bool grab);
+// Reads whatever is pending on fd; false on EOF/error
+bool sim_evdev_read(int fd);
+
+// HID trace files as written by 'rec dump' / tools/hid_trace.py (sim_input.c)
+bool sim_trace_open(const char* path, double speed);
+// Feeds every report that is due; false once the trace is done
+bool sim_trace_poll(void);
+// Forces a report kind for dev:inst instead of guessing from the length
+void sim_trace_force(int dev_addr, int instance, bool keyboard);
+
+#endif
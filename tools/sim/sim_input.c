@@ -0,0 +1,392 @@
+/*
+ * Simulator input: Linux evdev devices and recorded HID traces, both turned
+ * into the same boot reports/events the firmware produces.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+#define DEBUG_TAG "input"
+#include "babelfish.h"
+#include "hid_codes.h"
+#include "sim.h"
+
+DBG_MODULE();
+
+//
+// evdev
+//
+
+// Linux KEY_* -> HID usage (keyboard page)
+static const uint8_t s_linux_to_hid[KEY_CNT > 256 ? 256 : KEY_CNT] = {
+  [KEY_A] = HID_KEY_A, [KEY_B] = HID_KEY_B, [KEY_C] = HID_KEY_C, [KEY_D] = HID_KEY_D,
+  [KEY_E] = HID_KEY_E, [KEY_F] = HID_KEY_F, [KEY_G] = HID_KEY_G, [KEY_H] = HID_KEY_H,
+  [KEY_I] = HID_KEY_I, [KEY_J] = HID_KEY_J, [KEY_K] = HID_KEY_K, [KEY_L] = HID_KEY_L,
+  [KEY_M] = HID_KEY_M, [KEY_N] = HID_KEY_N, [KEY_O] = HID_KEY_O, [KEY_P] = HID_KEY_P,
+  [KEY_Q] = HID_KEY_Q, [KEY_R] = HID_KEY_R, [KEY_S] = HID_KEY_S, [KEY_T] = HID_KEY_T,
+  [KEY_U] = HID_KEY_U, [KEY_V] = HID_KEY_V, [KEY_W] = HID_KEY_W, [KEY_X] = HID_KEY_X,
+  [KEY_Y] = HID_KEY_Y, [KEY_Z] = HID_KEY_Z,
+
+  [KEY_1] = HID_KEY_1, [KEY_2] = HID_KEY_2, [KEY_3] = HID_KEY_3, [KEY_4] = HID_KEY_4,
+  [KEY_5] = HID_KEY_5, [KEY_6] = HID_KEY_6, [KEY_7] = HID_KEY_7, [KEY_8] = HID_KEY_8,
+  [KEY_9] = HID_KEY_9, [KEY_0] = HID_KEY_0,
+
+  [KEY_ENTER] = HID_KEY_ENTER, [KEY_ESC] = HID_KEY_ESCAPE, [KEY_BACKSPACE] = HID_KEY_BACKSPACE,
+  [KEY_TAB] = HID_KEY_TAB, [KEY_SPACE] = HID_KEY_SPACE, [KEY_MINUS] = HID_KEY_MINUS,
+  [KEY_EQUAL] = HID_KEY_EQUAL, [KEY_LEFTBRACE] = HID_KEY_BRACKET_LEFT,
+  [KEY_RIGHTBRACE] = HID_KEY_BRACKET_RIGHT, [KEY_BACKSLASH] = HID_KEY_BACKSLASH,
+  [KEY_SEMICOLON] = HID_KEY_SEMICOLON, [KEY_APOSTROPHE] = HID_KEY_APOSTROPHE,
+  [KEY_GRAVE] = HID_KEY_GRAVE, [KEY_COMMA] = HID_KEY_COMMA, [KEY_DOT] = HID_KEY_PERIOD,
+  [KEY_SLASH] = HID_KEY_SLASH, [KEY_CAPSLOCK] = HID_KEY_CAPS_LOCK, [KEY_102ND] = HID_KEY_EUROPE_2,
+
+  [KEY_F1] = HID_KEY_F1, [KEY_F2] = HID_KEY_F2, [KEY_F3] = HID_KEY_F3, [KEY_F4] = HID_KEY_F4,
+  [KEY_F5] = HID_KEY_F5, [KEY_F6] = HID_KEY_F6, [KEY_F7] = HID_KEY_F7, [KEY_F8] = HID_KEY_F8,
+  [KEY_F9] = HID_KEY_F9, [KEY_F10] = HID_KEY_F10, [KEY_F11] = HID_KEY_F11, [KEY_F12] = HID_KEY_F12,
+
+  [KEY_SYSRQ] = HID_KEY_PRINT_SCREEN, [KEY_SCROLLLOCK] = HID_KEY_SCROLL_LOCK, [KEY_PAUSE] = HID_KEY_PAUSE,
+  [KEY_INSERT] = HID_KEY_INSERT, [KEY_HOME] = HID_KEY_HOME, [KEY_PAGEUP] = HID_KEY_PAGE_UP,
+  [KEY_DELETE] = HID_KEY_DELETE, [KEY_END] = HID_KEY_END, [KEY_PAGEDOWN] = HID_KEY_PAGE_DOWN,
+  [KEY_RIGHT] = HID_KEY_ARROW_RIGHT, [KEY_LEFT] = HID_KEY_ARROW_LEFT,
+  [KEY_DOWN] = HID_KEY_ARROW_DOWN, [KEY_UP] = HID_KEY_ARROW_UP,
+
+  [KEY_NUMLOCK] = HID_KEY_NUM_LOCK, [KEY_KPSLASH] = HID_KEY_KEYPAD_DIVIDE,
+  [KEY_KPASTERISK] = HID_KEY_KEYPAD_MULTIPLY, [KEY_KPMINUS] = HID_KEY_KEYPAD_SUBTRACT,
+  [KEY_KPPLUS] = HID_KEY_KEYPAD_ADD, [KEY_KPENTER] = HID_KEY_KEYPAD_ENTER,
+  [KEY_KP1] = HID_KEY_KEYPAD_1, [KEY_KP2] = HID_KEY_KEYPAD_2, [KEY_KP3] = HID_KEY_KEYPAD_3,
+  [KEY_KP4] = HID_KEY_KEYPAD_4, [KEY_KP5] = HID_KEY_KEYPAD_5, [KEY_KP6] = HID_KEY_KEYPAD_6,
+  [KEY_KP7] = HID_KEY_KEYPAD_7, [KEY_KP8] = HID_KEY_KEYPAD_8, [KEY_KP9] = HID_KEY_KEYPAD_9,
+  [KEY_KP0] = HID_KEY_KEYPAD_0, [KEY_KPDOT] = HID_KEY_KEYPAD_DECIMAL,
+  [KEY_COMPOSE] = HID_KEY_APPLICATION,
+};
+
+// modifiers go in the report's modifier byte rather than the key array
+static uint8_t linux_modifier_bit(int code)
+{
+  switch (code) {
+    case KEY_LEFTCTRL: return KEYBOARD_MODIFIER_LEFTCTRL;
+    case KEY_LEFTSHIFT: return KEYBOARD_MODIFIER_LEFTSHIFT;
+    case KEY_LEFTALT: return KEYBOARD_MODIFIER_LEFTALT;
+    case KEY_LEFTMETA: return KEYBOARD_MODIFIER_LEFTGUI;
+    case KEY_RIGHTCTRL: return KEYBOARD_MODIFIER_RIGHTCTRL;
+    case KEY_RIGHTSHIFT: return KEYBOARD_MODIFIER_RIGHTSHIFT;
+    case KEY_RIGHTALT: return KEYBOARD_MODIFIER_RIGHTALT;
+    case KEY_RIGHTMETA: return KEYBOARD_MODIFIER_RIGHTGUI;
+  }
+  return 0;
+}
+
+// Built up from EV_KEY/EV_REL and sent on SYN_REPORT, so every evdev frame
+// goes through the same boot report translation as a USB report would.
+static hid_keyboard_report_t s_kbd_report;
+static bool s_kbd_dirty = false;
+static hid_mouse_report_t s_mouse_report;
+static int s_mouse_dx, s_mouse_dy, s_mouse_wheel;
+static bool s_mouse_dirty = false;
+// what the host has been told is held; live input and traces share it, as
+// they would a single keyboard and mouse
+static HidBootState s_boot;
+
+static void kbd_key(int code, bool down)
+{
+  uint8_t mod = linux_modifier_bit(code);
+  if (mod) {
+    s_kbd_report.modifier = down ? (s_kbd_report.modifier | mod) : (s_kbd_report.modifier & ~mod);
+    s_kbd_dirty = true;
+    return;
+  }
+
+  if (code >= (int) sizeof(s_linux_to_hid) || !s_linux_to_hid[code]) {
+    DBG_V("no HID usage for evdev key %d\n", code);
+    return;
+  }
+
+  uint8_t usage = s_linux_to_hid[code];
+  int slot = -1;
+  for (int i = 0; i < 6; i++) {
+    if (s_kbd_report.keycode[i] == usage)
+      slot = i;
+  }
+
+  if (down && slot < 0) {
+    for (int i = 0; i < 6; i++) {
+      if (!s_kbd_report.keycode[i]) {
+        s_kbd_report.keycode[i] = usage;
+        break;
+      }
+    }
+  } else if (!down && slot >= 0) {
+    s_kbd_report.keycode[slot] = 0;
+  }
+  s_kbd_dirty = true;
+}
+
+static void mouse_button(int code, bool down)
+{
+  uint8_t bit = code == BTN_LEFT ? MOUSE_BUTTON_LEFT
+              : code == BTN_RIGHT ? MOUSE_BUTTON_RIGHT
+              : code == BTN_MIDDLE ? MOUSE_BUTTON_MIDDLE
+              : code == BTN_SIDE ? MOUSE_BUTTON_BACKWARD
+              : code == BTN_EXTRA ? MOUSE_BUTTON_FORWARD : 0;
+  if (!bit)
+    return;
+  s_mouse_report.buttons = down ? (s_mouse_report.buttons | bit) : (s_mouse_report.buttons & ~bit);
+  s_mouse_dirty = true;
+}
+
+static int8_t clamp8(int v)
+{
+  return v > 127 ? 127 : v < -127 ? -127 : v;
+}
+
+static void evdev_sync(void)
+{
+  if (s_kbd_dirty) {
+    sim_input_arrived();
+    translate_boot_kbd_report(&s_boot, &s_kbd_report);
+    s_kbd_dirty = false;
+  }
+
+  // large moves are split into several reports, as a real mouse would
+  while (s_mouse_dirty) {
+    s_mouse_report.x = clamp8(s_mouse_dx);
+    s_mouse_report.y = clamp8(s_mouse_dy);
+    s_mouse_report.wheel = clamp8(s_mouse_wheel);
+    s_mouse_dx -= s_mouse_report.x;
+    s_mouse_dy -= s_mouse_report.y;
+    s_mouse_wheel -= s_mouse_report.wheel;
+
+    sim_input_arrived();
+    translate_boot_mouse_report(&s_boot, &s_mouse_report);
+    s_mouse_dirty = s_mouse_dx || s_mouse_dy || s_mouse_wheel;
+  }
+}
+
+int sim_evdev_open(const char* path, bool grab)
+{
+  int fd = open(path, O_RDONLY | O_NONBLOCK);
+  if (fd < 0) {
+    perror(path);
+    return -1;
+  }
+
+  if (grab && ioctl(fd, EVIOCGRAB, 1) < 0)
+    perror("EVIOCGRAB");
+
+  char name[64] = "";
+  ioctl(fd, EVIOCGNAME(sizeof(name)), name);
+  fprintf(stderr, "input: %s (%s)%s\n", path, name, grab ? ", grabbed" : "");
+  return fd;
+}
+
+bool sim_evdev_read(int fd)
+{
+  struct input_event ev[64];
+
+  for (;;) {
+    ssize_t n = read(fd, ev, sizeof(ev));
+    if (n < 0)
+      return errno == EAGAIN || errno == EINTR;
+    if (n == 0)
+      return false;
+
+    for (size_t i = 0; i < n / sizeof(ev[0]); i++) {
+      switch (ev[i].type) {
+        case EV_KEY:
+          // value 2 is autorepeat, the hosts do their own (or none)
+          if (ev[i].value == 2)
+            break;
+          if (ev[i].code >= BTN_MOUSE && ev[i].code < BTN_JOYSTICK)
+            mouse_button(ev[i].code, ev[i].value);
+          else
+            kbd_key(ev[i].code, ev[i].value);
+          break;
+
+        case EV_REL:
+          if (ev[i].code == REL_X)
+            s_mouse_dx += ev[i].value;
+          else if (ev[i].code == REL_Y)
+            s_mouse_dy += ev[i].value;
+          else if (ev[i].code == REL_WHEEL)
+            s_mouse_wheel += ev[i].value;
+          else
+            break;
+          s_mouse_dirty = true;
+          break;
+
+        case EV_SYN:
+          if (ev[i].code == SYN_REPORT)
+            evdev_sync();
+          break;
+      }
+    }
+  }
+}
+
+//
+// HID traces
+//
+// Format from src/hid_rec.h: '#' comment lines, then one report per line,
+//   t_us dev_addr instance len data...
+// Reports are replayed at their recorded spacing divided by the speed.
+// Without a report descriptor the kind is guessed from the length (8 bytes
+// is a boot keyboard, 3-5 a boot mouse); -k/-m override that per interface.
+//
+
+#define TRACE_MAX_FORCED 8
+
+typedef struct {
+  uint8_t dev_addr;
+  uint8_t instance;
+  bool keyboard;
+} TraceForce;
+
+static FILE* s_trace = NULL;
+static double s_trace_speed = 1.0;
+static TraceForce s_forced[TRACE_MAX_FORCED];
+static int s_forced_count = 0;
+
+// next report, read ahead so it can wait for its time
+static struct {
+  bool valid;
+  uint32_t stamp_us;
+  uint8_t dev_addr;
+  uint8_t instance;
+  uint8_t len;
+  uint8_t data[64];
+} s_next;
+
+static bool s_trace_started = false;
+static uint32_t s_trace_prev_stamp;
+static uint64_t s_trace_due_us; // simulator time the next report is due
+static uint32_t s_trace_skipped = 0;
+
+void sim_trace_force(int dev_addr, int instance, bool keyboard)
+{
+  if (s_forced_count < TRACE_MAX_FORCED)
+    s_forced[s_forced_count++] = (TraceForce) { dev_addr, instance, keyboard };
+}
+
+static bool trace_read_next(void)
+{
+  char line[512];
+
+  s_next.valid = false;
+  while (fgets(line, sizeof(line), s_trace)) {
+    if (line[0] == '#' || line[0] == '\n' || line[0] == '\r')
+      continue;
+
+    char* p = line;
+    char* end;
+    unsigned long v[4];
+    int i;
+    for (i = 0; i < 4; i++) {
+      v[i] = strtoul(p, &end, 0);
+      if (end == p)
+        break;
+      p = end;
+    }
+    if (i < 4 || v[3] > sizeof(s_next.data)) {
+      DBG("bad trace line: %s", line);
+      continue;
+    }
+
+    s_next.stamp_us = v[0];
+    s_next.dev_addr = v[1];
+    s_next.instance = v[2];
+    s_next.len = v[3];
+    for (i = 0; i < s_next.len; i++) {
+      s_next.data[i] = strtoul(p, &end, 16);
+      if (end == p)
+        break;
+      p = end;
+    }
+    if (i < s_next.len) {
+      DBG("short trace line: %s", line);
+      continue;
+    }
+
+    s_next.valid = true;
+    return true;
+  }
+  return false;
+}
+
+bool sim_trace_open(const char* path, double speed)
+{
+  s_trace = fopen(path, "r");
+  if (!s_trace) {
+    perror(path);
+    return false;
+  }
+  s_trace_speed = speed;
+  fprintf(stderr, "input: trace %s at %gx\n", path, speed);
+  return true;
+}
+
+static void trace_feed(void)
+{
+  bool keyboard = s_next.len == 8;
+  bool mouse = s_next.len >= 3 && s_next.len <= 5;
+  for (int i = 0; i < s_forced_count; i++) {
+    if (s_forced[i].dev_addr == s_next.dev_addr && s_forced[i].instance == s_next.instance) {
+      keyboard = s_forced[i].keyboard;
+      mouse = !keyboard;
+    }
+  }
+
+  sim_input_arrived();
+
+  if (keyboard && s_next.len >= sizeof(hid_keyboard_report_t)) {
+    hid_keyboard_report_t report;
+    memcpy(&report, s_next.data, sizeof(report));
+    translate_boot_kbd_report(&s_boot, &report);
+  } else if (mouse && s_next.len >= 3) {
+    hid_mouse_report_t report = { 0 };
+    memcpy(&report, s_next.data, s_next.len < sizeof(report) ? s_next.len : sizeof(report));
+    translate_boot_mouse_report(&s_boot, &report);
+  } else {
+    s_trace_skipped++;
+  }
+}
+
+// Feeds at most a few reports per call so the simulator's event queues,
+// drained once per loop like the mainloop's, don't overflow.
+#define TRACE_REPORTS_PER_POLL 4
+
+bool sim_trace_poll(void)
+{
+  if (!s_trace)
+    return false;
+
+  for (int fed = 0; fed < TRACE_REPORTS_PER_POLL; fed++) {
+    if (!s_next.valid) {
+      if (!trace_read_next()) {
+        if (s_trace_skipped)
+          fprintf(stderr, "input: %u trace reports skipped, not a boot keyboard/mouse\n", s_trace_skipped);
+        fclose(s_trace);
+        s_trace = NULL;
+        return false;
+      }
+
+      if (!s_trace_started) {
+        s_trace_started = true;
+        s_trace_due_us = time_us_64();
+      } else if (s_trace_speed > 0) {
+        // stamps are 32 bit microseconds and wrap after ~71 minutes
+        s_trace_due_us += (uint64_t) ((uint32_t) (s_next.stamp_us - s_trace_prev_stamp) / s_trace_speed);
+      }
+      s_trace_prev_stamp = s_next.stamp_us;
+    }
+
+    if (s_trace_speed > 0 && time_us_64() < s_trace_due_us)
+      break;
+
+    trace_feed();
+    s_next.valid = false;
+  }
+  return true;
+}
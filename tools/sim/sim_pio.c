@@ -0,0 +1,172 @@
+/*
+ * PIO model for the simulator: the TX FIFO side of output-only state
+ * machines, in simulated time.
+ *
+ * A started state machine takes one FIFO word per 'clocks_per_word' clocks.
+ * The FIFO is four words deep plus the one being shifted out, so a put is
+ * refused (pio_sm_is_tx_fifo_full) while five words are still ahead of the
+ * clock. Words are decoded as 16 two bit quadrature states (A in bit 0) when
+ * they are put, timestamped with when each state would reach the pins; that
+ * gives the edge counts, the net position, and when the last edge actually
+ * went out, which is what saturation looks like from the host's side.
+ */
+
+#include <stdlib.h>
+
+#include "sim_shim.h"
+
+#define SIM_PIO_FIFO_DEPTH 4
+#define SIM_PIO_NUM_SM 4
+#define SIM_PIO_INSTR_MEM 32
+
+typedef struct {
+  bool claimed;
+  bool running;
+  uint pin;
+  double clk_hz;
+  uint clocks_per_word;
+
+  double busy_until_us; // when the last word put has been shifted out
+  uint8_t state;
+
+  uint64_t words;
+  uint64_t refused;     // puts made while the FIFO was full
+  uint64_t edges;
+  uint64_t glitches;    // both lines changed at once
+  int64_t position;
+  double last_edge_us;
+} SimSm;
+
+struct pio_inst {
+  uint num;
+  uint used;            // instruction memory
+  SimSm sm[SIM_PIO_NUM_SM];
+};
+
+static struct pio_inst s_pios[2] = { { .num = 0 }, { .num = 1 } };
+
+struct pio_inst* const sim_pio0 = &s_pios[0];
+struct pio_inst* const sim_pio1 = &s_pios[1];
+
+// Forward steps through the gray sequence 0, 1, 3, 2
+static const int8_t s_next[4] = { 1, 3, 0, 2 };
+
+static double word_us(const SimSm* sm)
+{
+  return sm->clocks_per_word * 1e6 / sm->clk_hz;
+}
+
+static double now_us(void)
+{
+  return (double) time_us_64();
+}
+
+bool pio_can_add_program(PIO pio, const pio_program_t* program)
+{
+  return pio->used + program->length <= SIM_PIO_INSTR_MEM;
+}
+
+uint pio_add_program(PIO pio, const pio_program_t* program)
+{
+  uint offset = pio->used;
+  pio->used += program->length;
+  return offset;
+}
+
+int pio_claim_unused_sm(PIO pio, bool required)
+{
+  for (int i = 0; i < SIM_PIO_NUM_SM; i++) {
+    if (!pio->sm[i].claimed) {
+      pio->sm[i].claimed = true;
+      return i;
+    }
+  }
+  if (required) {
+    fprintf(stderr, "pio%u: no free state machine\n", pio->num);
+    exit(1);
+  }
+  return -1;
+}
+
+void pio_sm_unclaim(PIO pio, uint sm)
+{
+  pio->sm[sm].claimed = false;
+}
+
+uint pio_get_index(PIO pio)
+{
+  return pio->num;
+}
+
+void sim_pio_sm_start(PIO pio, uint sm, uint pin, float clk_hz, uint clocks_per_word)
+{
+  SimSm* s = &pio->sm[sm];
+  s->running = true;
+  s->pin = pin;
+  s->clk_hz = clk_hz;
+  s->clocks_per_word = clocks_per_word;
+  s->busy_until_us = now_us();
+}
+
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div)
+{
+  pio->sm[sm].clk_hz = clock_get_hz(clk_sys) / div;
+}
+
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm)
+{
+  SimSm* s = &pio->sm[sm];
+  if (!s->running)
+    return false;
+  double ahead_us = s->busy_until_us - now_us();
+  return ahead_us > SIM_PIO_FIFO_DEPTH * word_us(s);
+}
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data)
+{
+  SimSm* s = &pio->sm[sm];
+  if (!s->running)
+    return;
+  if (pio_sm_is_tx_fifo_full(pio, sm)) {
+    // the real FIFO drops it on the floor
+    s->refused++;
+    return;
+  }
+
+  double start_us = s->busy_until_us > now_us() ? s->busy_until_us : now_us();
+  double state_us = word_us(s) / 16;
+
+  for (int i = 0; i < 16; i++) {
+    uint8_t next = (data >> (2 * i)) & 3;
+    if (next == s->state)
+      continue;
+    if (next == s_next[s->state])
+      s->position++;
+    else if (s->state == s_next[next])
+      s->position--;
+    else
+      s->glitches++;
+    s->edges++;
+    s->state = next;
+    s->last_edge_us = start_us + (i + 1) * state_us;
+  }
+
+  s->words++;
+  s->busy_until_us = start_us + word_us(s);
+}
+
+void sim_pio_print_stats(void)
+{
+  for (int p = 0; p < 2; p++) {
+    for (int i = 0; i < SIM_PIO_NUM_SM; i++) {
+      SimSm* s = &s_pios[p].sm[i];
+      if (!s->running)
+        continue;
+      fprintf(stderr, "pio%d sm%d (gpio %u): %.0f edges/s, %llu words (%llu refused), %llu edges, "
+          "position %lld, %llu glitches, last edge at %.3f ms\n",
+          p, i, s->pin, s->clk_hz, (unsigned long long) s->words, (unsigned long long) s->refused,
+          (unsigned long long) s->edges, (long long) s->position, (unsigned long long) s->glitches,
+          s->last_edge_us / 1000.0);
+    }
+  }
+}
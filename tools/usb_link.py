@@ -0,0 +1,351 @@
+#!/usr/bin/env python3
+#
+# Babelfish USB link client.
+#
+# Talks the framed binary protocol described in src/usb_link.c over the
+# vendor bulk interface, so it works alongside a terminal on the debug CDC.
+# Needs pyusb, and on Linux read/write access to the device, e.g. a udev rule:
+#
+#   SUBSYSTEM=="usb", ATTR{idVendor}=="16c0", MODE="0666"
+#
+#   usb_link.py counters
+#   usb_link.py get log.sun
+#   usb_link.py set log.sun 2
+#   usb_link.py trace kbd,mouse,report        # until ctrl-C
+#   usb_link.py key 0x04                      # HID usage, press and release
+#   usb_link.py mouse 10 -5 [buttons]
+#   usb_link.py bench --bytes 4000000
+#   usb_link.py keymap get sun.bin            # the live keymap, see src/keymap.h
+#   usb_link.py keymap put sun.bin --set 0x39=0x77 --save
+#   usb_link.py keymap put apollo.bin --set 0,0x04,2=0x61  # gui, usage, state
+#
+
+import argparse
+import struct
+import zlib
+import sys
+import time
+
+import usb.core
+import usb.util
+
+VID = 0x16C0
+PIDS = (0x05E1, 0x27DB)  # normal and reverse mode descriptors
+
+MAX_PAYLOAD = 1024
+NAME_LEN = 16
+
+TRACE_BITS = {"kbd": 1, "mouse": 2, "report": 4}
+CONFIG_STATUS = {0: "ok", 1: "unknown setting", 2: "read only"}
+
+KEYMAP_MAGIC = 0x4D4B4642
+KEYMAP_VERSION = 1
+KEYMAP_HEADER = struct.Struct("<IHHII")
+# per kind: name, element format, dimensions (src/keymap.h)
+KEYMAP_KINDS = {1: ("sun", "B", (256,)), 2: ("apollo", "H", (2, 256, 5))}
+KEYMAP_STATUS = {1: "bad header", 2: "not this host's keymap", 3: "wrong length", 4: "CRC mismatch", 5: "too large", 6: "chunk out of order"}
+
+
+class Link:
+    def __init__(self):
+        dev = None
+        for pid in PIDS:
+            dev = usb.core.find(idVendor=VID, idProduct=pid)
+            if dev is not None:
+                break
+        if dev is None:
+            sys.exit("no Babelfish found")
+
+        cfg = dev.get_active_configuration()
+        itf = None
+        for i in cfg:
+            if i.bInterfaceClass == 0xFF and i.bNumEndpoints == 2:
+                itf = i
+                break
+        if itf is None:
+            sys.exit("no link interface; firmware too old?")
+
+        if dev.is_kernel_driver_active(itf.bInterfaceNumber):
+            dev.detach_kernel_driver(itf.bInterfaceNumber)
+        usb.util.claim_interface(dev, itf.bInterfaceNumber)
+
+        def ep(direction):
+            return usb.util.find_descriptor(
+                itf, custom_match=lambda e: usb.util.endpoint_direction(e.bEndpointAddress) == direction
+            )
+
+        self.dev = dev
+        self.ep_out = ep(usb.util.ENDPOINT_OUT)
+        self.ep_in = ep(usb.util.ENDPOINT_IN)
+        self.buf = bytearray()
+
+    def send(self, ftype, payload=b""):
+        self.ep_out.write(struct.pack("<cH", ftype, len(payload)) + payload)
+
+    def read_frame(self, timeout_ms=2000):
+        while True:
+            if len(self.buf) >= 3:
+                (length,) = struct.unpack_from("<H", self.buf, 1)
+                if len(self.buf) >= 3 + length:
+                    ftype = chr(self.buf[0])
+                    payload = bytes(self.buf[3 : 3 + length])
+                    del self.buf[: 3 + length]
+                    return ftype, payload
+            # large reads keep several packets per USB transfer
+            self.buf += self.ep_in.read(16384, timeout_ms)
+
+    def expect(self, want):
+        while True:
+            ftype, payload = self.read_frame()
+            if ftype == want:
+                return payload
+            if ftype != "t":
+                print("ignoring unexpected %r frame" % ftype, file=sys.stderr)
+
+    def sync(self):
+        # anything left over from an earlier session is skipped
+        token = struct.pack("<d", time.time())
+        self.send(b"P", token)
+        while True:
+            ftype, payload = self.read_frame()
+            if ftype == "p" and payload == token:
+                return
+
+
+def cmd_counters(link, args):
+    link.send(b"C")
+    payload = link.expect("c")
+    for off in range(0, len(payload), NAME_LEN + 4):
+        name = payload[off : off + NAME_LEN].split(b"\0")[0].decode()
+        (value,) = struct.unpack_from("<I", payload, off + NAME_LEN)
+        print("%-16s %10d" % (name, value))
+
+
+def print_config(payload):
+    status, value = struct.unpack_from("<Bi", payload)
+    name = payload[5:].decode()
+    if status:
+        sys.exit("%s: %s" % (name, CONFIG_STATUS.get(status, status)))
+    print("%s = %d" % (name, value))
+
+
+def cmd_get(link, args):
+    link.send(b"G", args.name.encode())
+    print_config(link.expect("g"))
+
+
+def cmd_set(link, args):
+    link.send(b"S", struct.pack("<i", int(args.value, 0)) + args.name.encode())
+    print_config(link.expect("g"))
+
+
+def cmd_trace(link, args):
+    mask = 0
+    for channel in args.channels.split(","):
+        if channel not in TRACE_BITS:
+            sys.exit("trace channels: %s" % ", ".join(TRACE_BITS))
+        mask |= TRACE_BITS[channel]
+    link.send(b"S", struct.pack("<i", mask) + b"trace")
+    link.expect("g")
+
+    dropped_seen = 0
+    try:
+        while True:
+            try:
+                ftype, payload = link.read_frame(timeout_ms=500)
+            except usb.core.USBTimeoutError:
+                continue
+            if ftype != "t":
+                continue
+            (dropped,) = struct.unpack_from("<I", payload)
+            if dropped != dropped_seen:
+                print("# %d records dropped" % (dropped - dropped_seen))
+                dropped_seen = dropped
+            off = 4
+            while off < len(payload):
+                kind, length, stamp = struct.unpack_from("<BBI", payload, off)
+                data = payload[off + 6 : off + 6 + length]
+                off += 6 + length
+                if kind == ord("k"):
+                    page, keycode, down = struct.unpack("<HHB", data)
+                    print("%10d key   page %d 0x%02x %s" % (stamp, page, keycode, "down" if down else "up"))
+                elif kind == ord("m"):
+                    dx, dy, wheel, buttons = struct.unpack("<bbbB", data)
+                    print("%10d mouse %4d %4d wheel %d buttons %02x" % (stamp, dx, dy, wheel, buttons))
+                elif kind == ord("r"):
+                    print("%10d hid   %d:%d %s" % (stamp, data[0], data[1], data[2:].hex(" ")))
+                else:
+                    print("%10d ?%c    %s" % (stamp, kind, data.hex(" ")))
+            sys.stdout.flush()
+    except KeyboardInterrupt:
+        link.send(b"S", struct.pack("<i", 0) + b"trace")
+
+
+def cmd_key(link, args):
+    usage = int(args.usage, 0)
+    link.send(b"K", struct.pack("<HHB", 0, usage, 1))
+    link.send(b"K", struct.pack("<HHB", 0, usage, 0))
+
+
+def cmd_mouse(link, args):
+    link.send(b"M", struct.pack("<bbbB", args.dx, args.dy, 0, args.buttons))
+
+
+def cmd_bench(link, args):
+    # IN: the device streams, we count
+    start = time.monotonic()
+    link.send(b"B", struct.pack("<I", args.bytes))
+    received = 0
+    seq = 0
+    while True:
+        ftype, payload = link.read_frame()
+        if ftype == "b":
+            (got,) = struct.unpack_from("<I", payload)
+            if got != seq:
+                sys.exit("bench frame %d missing" % seq)
+            seq += 1
+            received += 3 + len(payload)
+        elif ftype == "e":
+            sent, elapsed_us = struct.unpack("<II", payload)
+            break
+    secs = time.monotonic() - start
+    print("in:  %d bytes in %.2f s, %.1f KB/s (device side %.1f KB/s)"
+          % (received, secs, received / secs / 1024, sent / max(elapsed_us, 1) * 1e6 / 1024))
+
+    # OUT: we stream discard frames, then read the device's count back
+    link.send(b"C")
+    before = counter_value(link.expect("c"), "link.discarded")
+    chunk = struct.pack("<cH", b"D", MAX_PAYLOAD) + bytes(MAX_PAYLOAD)
+    frames = max(args.bytes // len(chunk), 1)
+    start = time.monotonic()
+    for _ in range(frames // 16):
+        link.ep_out.write(chunk * 16)
+    for _ in range(frames % 16):
+        link.ep_out.write(chunk)
+    link.sync()
+    secs = time.monotonic() - start
+    link.send(b"C")
+    discarded = counter_value(link.expect("c"), "link.discarded") - before
+    print("out: %d bytes in %.2f s, %.1f KB/s" % (frames * len(chunk), secs, frames * len(chunk) / secs / 1024))
+    if discarded != frames * MAX_PAYLOAD:
+        print("warning: device counted %d payload bytes, expected %d" % (discarded, frames * MAX_PAYLOAD))
+
+
+def keymap_read(link):
+    data = bytearray()
+    size = KEYMAP_HEADER.size
+    while len(data) < size:
+        link.send(b"R", struct.pack("<IH", len(data), MAX_PAYLOAD - 4))
+        payload = link.expect("r")
+        if len(payload) == 4:
+            break
+        data += payload[4:]
+        if len(data) >= KEYMAP_HEADER.size:
+            size = KEYMAP_HEADER.size + KEYMAP_HEADER.unpack_from(data)[3]
+    return bytes(data)
+
+
+def keymap_patch(image, settings):
+    magic, version, kind, length, crc = KEYMAP_HEADER.unpack_from(image)
+    if kind not in KEYMAP_KINDS:
+        sys.exit("unknown keymap kind %d" % kind)
+    name, fmt, dims = KEYMAP_KINDS[kind]
+    table = bytearray(image[KEYMAP_HEADER.size :])
+    for setting in settings:
+        where, value = setting.split("=")
+        index = [int(x, 0) for x in where.split(",")]
+        if len(index) != len(dims) or any(i >= d for i, d in zip(index, dims)):
+            sys.exit("%s keymap entries are indexed %s" % (name, ",".join(str(d) for d in dims)))
+        flat = 0
+        for i, d in zip(index, dims):
+            flat = flat * d + i
+        struct.pack_into("<" + fmt, table, flat * struct.calcsize(fmt), int(value, 0))
+    header = KEYMAP_HEADER.pack(KEYMAP_MAGIC, KEYMAP_VERSION, kind, len(table), zlib.crc32(table))
+    return header + bytes(table)
+
+
+def cmd_keymap(link, args):
+    if args.op == "get":
+        image = keymap_read(link)
+        with open(args.file, "wb") as f:
+            f.write(image)
+        kind = KEYMAP_HEADER.unpack_from(image)[2]
+        print("%s keymap, %d bytes" % (KEYMAP_KINDS.get(kind, ("?",))[0], len(image) - KEYMAP_HEADER.size))
+        return
+
+    with open(args.file, "rb") as f:
+        image = keymap_patch(f.read(), args.set)
+    if args.set:
+        with open(args.file, "wb") as f:
+            f.write(image)
+
+    chunk = MAX_PAYLOAD - 4
+    for off in range(0, len(image), chunk):
+        link.send(b"W", struct.pack("<I", off) + image[off : off + chunk])
+        status = link.expect("w")[0]
+        if status:
+            sys.exit("upload: %s" % KEYMAP_STATUS.get(status, status))
+    link.send(b"A", bytes([1 if args.save else 0]))
+    status, load_us = struct.unpack("<BI", link.expect("a"))
+    if status:
+        sys.exit("keymap rejected: %s" % KEYMAP_STATUS.get(status, status))
+    print("keymap live, checked in %d us%s" % (load_us, ", saved to flash" if args.save else ""))
+
+
+def counter_value(payload, want):
+    for off in range(0, len(payload), NAME_LEN + 4):
+        name = payload[off : off + NAME_LEN].split(b"\0")[0].decode()
+        if name == want:
+            return struct.unpack_from("<I", payload, off + NAME_LEN)[0]
+    return 0
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Babelfish USB link client")
+    sub = ap.add_subparsers(dest="cmd", required=True)
+
+    sub.add_parser("counters", help="ISR, HID ring and link counters").set_defaults(fn=cmd_counters)
+
+    p = sub.add_parser("get", help="read a setting (host, trace, tulog, log.<tag>)")
+    p.add_argument("name")
+    p.set_defaults(fn=cmd_get)
+
+    p = sub.add_parser("set", help="write a setting")
+    p.add_argument("name")
+    p.add_argument("value")
+    p.set_defaults(fn=cmd_set)
+
+    p = sub.add_parser("trace", help="stream events until ctrl-C")
+    p.add_argument("channels", nargs="?", default="kbd,mouse", help="comma separated: kbd, mouse, report")
+    p.set_defaults(fn=cmd_trace)
+
+    p = sub.add_parser("key", help="press and release a key (HID usage)")
+    p.add_argument("usage")
+    p.set_defaults(fn=cmd_key)
+
+    p = sub.add_parser("mouse", help="move the mouse")
+    p.add_argument("dx", type=int)
+    p.add_argument("dy", type=int)
+    p.add_argument("buttons", type=int, nargs="?", default=0)
+    p.set_defaults(fn=cmd_mouse)
+
+    p = sub.add_parser("bench", help="link throughput, both directions")
+    p.add_argument("--bytes", type=int, default=2000000)
+    p.set_defaults(fn=cmd_bench)
+
+    p = sub.add_parser("keymap", help="read or replace the host keymap")
+    p.add_argument("op", choices=("get", "put"))
+    p.add_argument("file")
+    p.add_argument("--set", action="append", default=[], metavar="INDEX=VALUE",
+                   help="patch an entry before uploading, e.g. 0x39=0x77 (sun) or 0,0x04,2=0x61 (apollo)")
+    p.add_argument("--save", action="store_true", help="also write it to flash")
+    p.set_defaults(fn=cmd_keymap)
+
+    args = ap.parse_args()
+    link = Link()
+    link.sync()
+    args.fn(link, args)
+
+
+if __name__ == "__main__":
+    main()